@@ -0,0 +1,130 @@
+//=============================================================================
+//	This file is part of MCSB, the Multi-Client Shared Buffer
+//	Copyright (C) 2014  Gregory E. Allen and
+//		Applied Research Laboratories: The University of Texas at Austin
+//
+//	MCSB is free software: you can redistribute it and/or modify it
+//	under the terms of the GNU Lesser General Public License as published
+//	by the Free Software Foundation, either version 2.1 of the License, or
+//	(at your option) any later version.
+//
+//	MCSB is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+//	Lesser General Public License <http://www.gnu.org/licenses/lgpl.html>
+//	for more details.
+//=============================================================================
+
+#include "MCSB/BufferGrower.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace MCSB {
+
+//-----------------------------------------------------------------------------
+Manager::BufferGrower::BufferGrower(Manager* manager_, ev::loop_ref loop)
+//-----------------------------------------------------------------------------
+:	manager(manager_), done(loop), addr(0), len(0), started(0), finished(0),
+	stopping(0), lockErrors(0), busy(0)
+{
+	pthread_mutex_init(&mutex,0);
+	pthread_cond_init(&cond,0);
+	done.set<Manager::BufferGrower, &Manager::BufferGrower::HandleDone>(this);
+	done.start();
+	int err = pthread_create(&thread, 0, &ThreadMain, this);
+	if (err) {
+		std::string str = "Manager::BufferGrower pthread_create error: ";
+		str += strerror(err);
+		throw std::runtime_error(str);
+	}
+}
+
+//-----------------------------------------------------------------------------
+Manager::BufferGrower::~BufferGrower(void)
+//-----------------------------------------------------------------------------
+{
+	pthread_mutex_lock(&mutex);
+	stopping = 1;
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&mutex);
+	pthread_join(thread, 0);
+	done.stop();
+	pthread_cond_destroy(&cond);
+	pthread_mutex_destroy(&mutex);
+}
+
+//-----------------------------------------------------------------------------
+void* Manager::BufferGrower::ThreadMain(void* arg)
+//-----------------------------------------------------------------------------
+{
+	BufferGrower* This = (BufferGrower*)arg;
+	This->Run();
+	return (void*)0;
+}
+
+//-----------------------------------------------------------------------------
+void Manager::BufferGrower::Run(void)
+// on the grower's thread, prefault until stopping (finishing one started)
+//-----------------------------------------------------------------------------
+{
+	pthread_mutex_lock(&mutex);
+	while (1) {
+		if (started && !finished) {
+			void* a = addr;
+			size_t l = len;
+			pthread_mutex_unlock(&mutex);
+			int errs = manager->shmMapper.LockOrTouch(a,l);
+			pthread_mutex_lock(&mutex);
+			lockErrors = errs;
+			finished = 1;
+			pthread_cond_broadcast(&cond);
+			done.send();
+			continue;
+		}
+		if (stopping) break;
+		pthread_cond_wait(&cond,&mutex);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+//-----------------------------------------------------------------------------
+void Manager::BufferGrower::Prefault(void* addr_, size_t len_)
+//-----------------------------------------------------------------------------
+{
+	if (busy) return;
+	pthread_mutex_lock(&mutex);
+	addr = addr_;
+	len = len_;
+	started = 1;
+	finished = 0;
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&mutex);
+	busy = 1;
+}
+
+//-----------------------------------------------------------------------------
+int Manager::BufferGrower::Wait(void)
+//-----------------------------------------------------------------------------
+{
+	if (!busy) return 0;
+	pthread_mutex_lock(&mutex);
+	while (!finished)
+		pthread_cond_wait(&cond,&mutex);
+	int errs = lockErrors;
+	started = 0;
+	pthread_mutex_unlock(&mutex);
+	busy = 0;
+	return errs;
+}
+
+//-----------------------------------------------------------------------------
+void Manager::BufferGrower::HandleDone(void)
+// on the manager's loop, after a prefault finished
+//-----------------------------------------------------------------------------
+{
+	manager->BufferGrown();
+}
+
+} // namespace MCSB
@@ -18,6 +18,7 @@
 #include "MCSB/ClientProxy.h"
 #include "MCSB/ProxySlabTracker.h"
 #include "MCSB/CCIHeader.h"
+#include "MCSB/uptimer.h"
 
 #include <stdexcept>
 #include <sys/socket.h>
@@ -30,11 +31,18 @@ Manager::ClientProxy::ClientProxy(ev::loop_ref loop, int fd,
 //-----------------------------------------------------------------------------
 :	SocketDaemon::ClientProxy(loop,fd,clientID,daemon), SocketEndpoint(fd),
 	manager(0), clientPID(-1), wantRegistrations(0), blocksPerSlab(0),
-	prodNiceLevel(0), pendingFreeSlabRqsts(0), maxWantedQueueSize(1024)
+	buffersPassed(0), prodNiceLevel(0), numaNode(-1), pendingFreeSlabRqsts(0), ringActive(0),
+	clientRingActive(0), deliverViaSocket(0), retirePaused(0),
+	writer(loop), sendSockBufSize(0), wantedQueueBytes(0)
 {
 	dbprintf(kDebug,"%s\n",__PRETTY_FUNCTION__);
 	throwOnPeerDisconnect = 0;
 	stats.clientID = clientID;
+	stats.wantedSegsLimit = wantedBound.MaxSegs();
+	writer.set<Manager::ClientProxy, &Manager::ClientProxy::Writable>(this);
+	writer.set(fd, ev::WRITE);
+	sendSockBufSize = GetSendSockBufSize();
+	LimitSendQueue(kMaxSendQueueBytes);
 	
 	manager = dynamic_cast<Manager*>(daemon);
 	if (!manager) {
@@ -42,6 +50,9 @@ Manager::ClientProxy::ClientProxy(ev::loop_ref loop, int fd,
 	}
 	slabs = new SlabTracker();
 
+	// flushed once per loop iteration, from the first send on
+	// (CreateNewClientProxy queues the flush, once we have a slot)
+	DeferSends();
 	SendClientID(clientID);
 	CheckBufferParams(); // tells client how to map the shared memory
 	FillProducerSlabs();
@@ -53,6 +64,7 @@ Manager::ClientProxy::~ClientProxy(void)
 //-----------------------------------------------------------------------------
 {
 	dbprintf(kDebug,"%s\n",__PRETTY_FUNCTION__);
+	writer.stop();
 
 	while (wantedQueue.size()) { // empty out wantedQueue
 		WantedSegment& seg = wantedQueue.front();
@@ -104,25 +116,99 @@ Manager::ClientProxy::~ClientProxy(void)
 	delete slabs;
 }
 
+//-----------------------------------------------------------------------------
+int Manager::ClientProxy::Read(void)
+//-----------------------------------------------------------------------------
+{
+	int result = SocketEndpoint::Recv();
+	// what the client put in the rings before sending this goes first
+	DrainRings();
+	if (result>0)
+		ParseRecvBuf();
+	return result;
+}
+
 //-----------------------------------------------------------------------------
 void Manager::ClientProxy::DeregisterAllMsgIDs(void)
 //-----------------------------------------------------------------------------
 {
 	dbprintf(kDebug,"%s\n",__PRETTY_FUNCTION__);
-	unsigned maxCount = (CtrlMsgHdr::kMaxPayloadSize-sizeof(RegistrationMsgHdr))
-		/sizeof(uint32_t);
-	uint32_t erasedMsgIDs[maxCount];
-
-	while (registeredMsgIDs.size()) {
-		unsigned erasedNum = 0;
-		std::set<uint32_t>::iterator it = registeredMsgIDs.begin();
-		while (it!=registeredMsgIDs.end() && erasedNum<maxCount) {
-			erasedMsgIDs[erasedNum++] = *it;
-			std::set<uint32_t>::iterator rmit = it++;
-			registeredMsgIDs.erase(rmit);
-		}
+	// each proxy's SendRegistration splits them to fit its peer
+	std::vector<uint32_t> erasedMsgIDs(registeredMsgIDs.begin(),registeredMsgIDs.end());
+	for (unsigned i=0; i<erasedMsgIDs.size(); i++)
+		manager->Unsubscribe(erasedMsgIDs[i],this);
+	registeredMsgIDs.clear();
+	if (erasedMsgIDs.size()) {
 		manager->SendRegistration(kRegType_DeregisterList,clientID,groupID,
-			erasedMsgIDs,erasedNum);
+			&erasedMsgIDs[0],erasedMsgIDs.size());
+	}
+
+	std::vector<uint32_t> firstLast;
+	std::map<uint32_t,uint32_t>::iterator it = registeredRanges.begin();
+	for (; it!=registeredRanges.end(); ++it) {
+		manager->UnsubscribeRange(it->first,it->second,this);
+		firstLast.push_back(it->first);
+		firstLast.push_back(it->second);
+	}
+	registeredRanges.clear();
+	if (firstLast.size()) {
+		manager->SendRangeRegistration(false,clientID,groupID,
+			&firstLast[0],firstLast.size()/2);
+	}
+}
+
+//-----------------------------------------------------------------------------
+bool Manager::ClientProxy::IsRegistered(uint32_t msgID) const
+//-----------------------------------------------------------------------------
+{
+	if (registeredMsgIDs.count(msgID))
+		return true;
+	std::map<uint32_t,uint32_t>::const_iterator it = registeredRanges.upper_bound(msgID);
+	if (it==registeredRanges.begin())
+		return false;
+	--it;
+	return msgID<=it->second;
+}
+
+//-----------------------------------------------------------------------------
+void Manager::ClientProxy::AddRegisteredRange(uint32_t first, uint32_t last)
+//	merge [first,last] into registeredRanges, which stay disjoint
+//-----------------------------------------------------------------------------
+{
+	std::map<uint32_t,uint32_t>::iterator it = registeredRanges.upper_bound(first);
+	if (it!=registeredRanges.begin()) {
+		std::map<uint32_t,uint32_t>::iterator prev = it;
+		--prev;
+		if (uint64_t(prev->second)+1>=first) {
+			first = prev->first;
+			it = prev;
+		}
+	}
+	while (it!=registeredRanges.end() && it->first<=uint64_t(last)+1) {
+		if (it->second>last) last = it->second;
+		registeredRanges.erase(it++);
+	}
+	registeredRanges[first] = last;
+}
+
+//-----------------------------------------------------------------------------
+void Manager::ClientProxy::RemoveRegisteredRange(uint32_t first, uint32_t last)
+//-----------------------------------------------------------------------------
+{
+	std::map<uint32_t,uint32_t>::iterator it = registeredRanges.upper_bound(first);
+	if (it!=registeredRanges.begin()) --it;
+	while (it!=registeredRanges.end() && it->first<=last) {
+		uint32_t f = it->first, l = it->second;
+		if (l<first) {
+			++it;
+			continue;
+		}
+		registeredRanges.erase(it++);
+		if (f<first) registeredRanges[f] = first-1;
+		if (l>last) {
+			registeredRanges[last+1] = l;
+			break;
+		}
 	}
 }
 
@@ -135,7 +221,18 @@ void Manager::ClientProxy::CheckBufferParams(void)
 	blocksPerSlab = manager->BlocksPerSlab();
 	try {
 		// tell the client to check the number of buffers
-		SendCtrlString(kCtrlString_ShmName,manager->ShmNameFormat());
+		if (!manager->ShmAnonymous()) {
+			SendCtrlString(kCtrlString_ShmName,manager->ShmNameFormat());
+		} else {
+			// or pass it the new ones, which it can't open by name
+			unsigned numBuffers = manager->NumBuffers();
+			int fds[numBuffers];
+			for (unsigned i=buffersPassed; i<numBuffers; i++)
+				fds[i] = manager->ShmBufferFD(i);
+			if (buffersPassed<numBuffers)
+				SendShmFDs(buffersPassed,fds+buffersPassed,numBuffers-buffersPassed);
+			buffersPassed = numBuffers;
+		}
 	} catch(std::runtime_error ex) {
 		dbprintf(kNotice, "# while sending to client[%d]: %s\n", clientID, ex.what());
 	}
@@ -192,8 +289,10 @@ void Manager::ClientProxy::HandleNumSlabs(uint32_t prodSlbs, uint32_t consSlbs)
 		throw std::runtime_error(str);
 	}
 
-	// FIXME: set socket buffer sizes?
-	SetSendSockBufSize(1024*1024);
+	// room for the blockIDs of all its consumer slabs, and more if it
+	// falls behind (see FlushSends)
+	GrowSendSockBuf(numConsSlabs*blocksPerSlab*sizeof(uint32_t));
+	GrowRing();
 	SetRecvSockBufSize(1024*1024);
 	dbprintf(kInfo,"- client[%d]: sendBuf %u, recvBuf %u\n",
 		clientID, GetSendSockBufSize(), GetRecvSockBufSize());
@@ -249,7 +348,20 @@ int Manager::ClientProxy::SendBlockIDs(const uint32_t blockIDs[],
 	try {
 		// this is ultimately called by a sending client;
 		// he shouldn't get disconnect because I am backed up
-		result = SocketEndpoint::SendBlockIDs(blockIDs,count);
+		if (ringActive && !deliverViaSocket) {
+			if (ring.Push(ShmRing::kDelivery,blockIDs,count)) {
+				result = count*sizeof(uint32_t);
+				if (ring.TakeDoorbell(ShmRing::kDelivery))
+					SocketEndpoint::SendRingDoorbell();
+			} else {
+				// deliveries must stay in order, so the client drains first
+				dbprintf(kInfo,"- client[%d] delivery ring full, using the socket\n", clientID);
+				deliverViaSocket = 1;
+				SendShmRing(kShmRing_Paused);
+			}
+		}
+		if (result<0)
+			result = SocketEndpoint::SendBlockIDs(blockIDs,count);
 		uint64_t sentBytes = 0;
 		for (unsigned i=0; i<count; i++) {
 			sentBytes += sizes[i];
@@ -263,6 +375,54 @@ int Manager::ClientProxy::SendBlockIDs(const uint32_t blockIDs[],
 	return result;
 }
 
+//-----------------------------------------------------------------------------
+int Manager::ClientProxy::FlushSends(void)
+//-----------------------------------------------------------------------------
+{
+	int result = -1;
+	try {
+		// a client that is behind must not block us, or be disconnected
+		result = FlushSomeSends();
+		unsigned pending = PendingSendBytes();
+		if (pending>stats.sendQueuePeak)
+			stats.sendQueuePeak = pending;
+		if (pending && !writer.is_active()) {
+			GrowSendSockBuf(2*sendSockBufSize);
+			writer.start();
+		} else if (!pending && writer.is_active()) {
+			writer.stop();
+			PopWantedQueue(); // what waited while the queue was full
+		}
+	} catch(std::runtime_error ex) {
+		writer.stop();
+		dbprintf(kNotice, "# while sending to client[%d]: %s\n", clientID, ex.what());
+	}
+	return result;
+}
+
+//-----------------------------------------------------------------------------
+void Manager::ClientProxy::Writable(ev::io &watcher, int revents)
+// once the client's socket has room again
+//-----------------------------------------------------------------------------
+{
+	FlushSends();
+}
+
+//-----------------------------------------------------------------------------
+void Manager::ClientProxy::GrowSendSockBuf(unsigned size)
+//-----------------------------------------------------------------------------
+{
+	if (size>kMaxSendSockBufSize)
+		size = kMaxSendSockBufSize;
+	if (size<=sendSockBufSize) return;
+	try {
+		SetSendSockBufSize(size);
+		sendSockBufSize = size;
+	} catch(std::runtime_error ex) {
+		dbprintf(kNotice, "# client[%d] SetSendSockBufSize(%u): %s\n", clientID, size, ex.what());
+	}
+}
+
 //-----------------------------------------------------------------------------
 int Manager::ClientProxy::SendSlabIDs(const uint32_t slabIDs[], unsigned count)
 //-----------------------------------------------------------------------------
@@ -332,6 +492,154 @@ void Manager::ClientProxy::HandleBlockIDs(const uint32_t blockIDs[], unsigned co
 	PopWantedQueue();
 }
 
+//-----------------------------------------------------------------------------
+void Manager::ClientProxy::HandleShmRing(uint32_t state)
+//-----------------------------------------------------------------------------
+{
+	dbprintf(kDebug,"%s\n",__PRETTY_FUNCTION__);
+	switch (state) {
+		case kShmRing_Request:
+			if (ring.Mapped() || !CreateRing(ring)) break;
+			SendCtrlString(kCtrlString_ShmRingName,ring.Name().c_str());
+			break;
+		case kShmRing_Attached:
+			if (nextRing.Mapped()) {
+				// the client has moved to it, after what it put in this one
+				DrainRings();
+				ring.Swap(nextRing);
+				nextRing.Close();
+				ring.Unlink();
+				deliverViaSocket = 0;
+				SendShmRing(kShmRing_Active);
+				dbprintf(kInfo,"- client[%d] using ShmRing, capacity %u\n",
+					clientID, ring.Capacity());
+				break;
+			}
+			if (!ring.Mapped() || ringActive) break;
+			ring.Unlink();
+			ringActive = 1;
+			SendShmRing(kShmRing_Active);
+			dbprintf(kInfo,"- client[%d] using ShmRing, capacity %u\n",
+				clientID, ring.Capacity());
+			break;
+		case kShmRing_Active:
+			// everything the client sent on the socket before this is handled
+			if (!ringActive) break;
+			clientRingActive = 1;
+			retirePaused = 0;
+			DrainRings();
+			GrowRing(); // if its slabs grew while it was set up
+			break;
+		case kShmRing_Paused:
+			// the client retires on the socket, after what's in the ring
+			if (!clientRingActive) break;
+			DrainRings();
+			retirePaused = 1;
+			SendShmRing(kShmRing_PauseAck);
+			break;
+		case kShmRing_PauseAck:
+			// the client drained the delivery ring, and what follows this
+			// on the socket, it handles before draining it again
+			if (!deliverViaSocket || nextRing.Mapped()) break;
+			deliverViaSocket = 0;
+			SendShmRing(kShmRing_Active);
+			break;
+		case kShmRing_Failed:
+			if (nextRing.Mapped()) {
+				// keep the one we have, and go back to it
+				nextRing.Close();
+				deliverViaSocket = 0;
+				SendShmRing(kShmRing_Active);
+				break;
+			}
+			ring.Unlink();
+			break;
+		default:
+			dbprintf(kNotice,"# unknown ShmRing state %u in %s\n", state, __PRETTY_FUNCTION__);
+	}
+}
+
+//-----------------------------------------------------------------------------
+uint32_t Manager::ClientProxy::RingEntriesNeeded(void) const
+// at most this many segments are outstanding, so the rings won't fill
+//-----------------------------------------------------------------------------
+{
+	uint32_t slabCount = slabs->NumConsSlabs();
+	if (slabCount<slabs->NumProdSlabs())
+		slabCount = slabs->NumProdSlabs();
+	return slabCount*blocksPerSlab;
+}
+
+//-----------------------------------------------------------------------------
+bool Manager::ClientProxy::CreateRing(ShmRing& r)
+//-----------------------------------------------------------------------------
+{
+	char base[100], name[120];
+	snprintf(base,sizeof(base),manager->ShmNameFormat(),0);
+	snprintf(name,sizeof(name),"%s.ring%d",base,clientID);
+	try {
+		r.Create(name,RingEntriesNeeded());
+	} catch (std::runtime_error err) {
+		dbprintf(kNotice,"# client[%d] no ShmRing: %s\n", clientID, err.what());
+		return false;
+	}
+	r.ArmDoorbell(ShmRing::kRetirement); // we start out idle
+	r.ArmDoorbell(ShmRing::kSubmission);
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+void Manager::ClientProxy::GrowRing(void)
+// replace the ring with a larger one, once its slabs have outgrown it
+//-----------------------------------------------------------------------------
+{
+	if (!clientRingActive || nextRing.Mapped()) return;
+	if (RingEntriesNeeded()<=ring.Capacity() || ring.Capacity()>=ShmRing::kMaxCapacity)
+		return;
+	if (!CreateRing(nextRing)) return;
+	// we deliver on the socket, until the client has moved (or failed to)
+	deliverViaSocket = 1;
+	SendCtrlString(kCtrlString_ShmRingName,nextRing.Name().c_str());
+	dbprintf(kInfo,"- client[%d] ShmRing capacity %u, offering %u\n",
+		clientID, ring.Capacity(), nextRing.Capacity());
+}
+
+//-----------------------------------------------------------------------------
+void Manager::ClientProxy::HandleRingDoorbell(void)
+// the client has retired or sent segments into the rings
+//-----------------------------------------------------------------------------
+{
+	dbprintf(kDebug,"%s\n",__PRETTY_FUNCTION__);
+	DrainRings();
+}
+
+//-----------------------------------------------------------------------------
+void Manager::ClientProxy::DrainRings(void)
+//-----------------------------------------------------------------------------
+{
+	if (!clientRingActive) return;
+
+	enum { kMaxPop = 256 };
+	uint32_t blockIDs[kMaxPop];
+	BlockInfo info[kMaxPop];
+	while (true) {
+		unsigned retired = retirePaused ? 0 :
+			ring.Pop(ShmRing::kRetirement,blockIDs,kMaxPop);
+		if (retired)
+			HandleBlockIDs(blockIDs,retired);
+		unsigned submitted = ring.TakeSubmissions(blockIDs,info,kMaxPop);
+		if (submitted)
+			HandleBlocksAndInfo(blockIDs,info,submitted);
+		if (retired || submitted) continue;
+		// going idle, ask for doorbells, then make sure we didn't miss one
+		ring.ArmDoorbell(ShmRing::kRetirement);
+		ring.ArmDoorbell(ShmRing::kSubmission);
+		if ((retirePaused || ring.Empty(ShmRing::kRetirement))
+				&& ring.Empty(ShmRing::kSubmission))
+			break;
+	}
+}
+
 //-----------------------------------------------------------------------------
 // when blockID gets taken by consSlabs
 //    manager->IncrementHeldRefcnt(slabID)
@@ -342,9 +650,14 @@ void Manager::ClientProxy::HandleBlockIDs(const uint32_t blockIDs[], unsigned co
 //-----------------------------------------------------------------------------
 void Manager::ClientProxy::PopWantedQueue(void)
 // send segments/messages from the wantedQueue as we are able
-// also enforce maxWantedQueueSize
+// also enforce the wantedBound
 //-----------------------------------------------------------------------------
 {
+	if (wantedQueue.size()) {
+		wantedBound.Update(stats.sentSegs,true,uptimer::CurrentTime());
+		stats.wantedSegsLimit = wantedBound.MaxSegs();
+		stats.drainRate = wantedBound.DrainRate();
+	}
 	while (wantedQueue.size()) {
 		WantedSegment& seg = wantedQueue.front();
 		uint32_t blockID = seg.BlockID();
@@ -352,14 +665,14 @@ void Manager::ClientProxy::PopWantedQueue(void)
 		const BlockInfo* info = manager->GetBlockInfo(blockID);
 		uint32_t messageID = info->messageID;
 		uint32_t segSize = info->size;
-		if (registeredMsgIDs.count(messageID)) {
-			// try to take the slab
-			bool taken = slabs->TakeConsSlab(slabID);
+		if (IsRegistered(messageID)) {
+			// try to take the slab, unless the client is behind on its socket
+			bool taken = !SendQueueFull() && slabs->TakeConsSlab(slabID);
 			if (taken) {
 				manager->IncrementHeldRefcnt(&slabID,1);
 				SendBlockIDs(&blockID,&segSize,1);
 			} else {
-				if (wantedQueue.size()<=maxWantedQueueSize ||
+				if (!wantedBound.Exceeded(wantedQueue.size(),wantedQueueBytes) ||
 					manager->PlaybackMode()) break;
 				// queue size overage, dropping
 				stats.wantedSegsOverage++;
@@ -369,6 +682,7 @@ void Manager::ClientProxy::PopWantedQueue(void)
 		}
 		stats.wantedSegsOut++;
 		stats.wantedBytesOut += segSize;
+		wantedQueueBytes -= segSize;
 		wantedQueue.pop_front();
 		manager->ReleaseWantedSegment(seg);
 	}
@@ -397,6 +711,7 @@ void Manager::ClientProxy::EraseWantedSegment(WantedSegment& seg)
 #endif
 	stats.wantedSegsDropped++;
 	stats.wantedBytesDropped += segSize;
+	wantedQueueBytes -= segSize;
 	wantedQueue.erase(seg);
 	manager->ReleaseWantedSegment(seg);
 	SendDropReport(1,segSize);
@@ -446,6 +761,7 @@ void Manager::ClientProxy::HandleRegistration(uint32_t type, int16_t cid, int16_
 					throw std::runtime_error("Cannot register for reserved msgID (kCCIMessageID)");
 				}
 				if (registeredMsgIDs.insert(msgIDs[i]).second) {
+					manager->Subscribe(msgIDs[i],this);
 					messageIDs[num++] = msgIDs[i];
 				} else {
 					dbprintf(kWarning,"# warning: client[%d] attempted to re-register msgID %u\n",clientID,msgIDs[i]);
@@ -458,6 +774,7 @@ void Manager::ClientProxy::HandleRegistration(uint32_t type, int16_t cid, int16_
 		case kRegType_DeregisterList: {
 			for (unsigned i=0; i<count; i++) {
 				if (registeredMsgIDs.erase(msgIDs[i])) {
+					manager->Unsubscribe(msgIDs[i],this);
 					messageIDs[num++] = msgIDs[i];
 				} else {
 					dbprintf(kWarning,"# warning: client[%d] attempted to deregister unregistered msgID %u\n",clientID,msgIDs[i]);
@@ -468,12 +785,64 @@ void Manager::ClientProxy::HandleRegistration(uint32_t type, int16_t cid, int16_
 			}
 		} break;
 
+		case kRegType_RegisterAllMsgs: {
+			if (count!=1) {
+				throw std::runtime_error("error: invalid RegisterAllMsgs message");
+			}
+			uint32_t all[2] = { 0, kMaxRegMsgID };
+			HandleRangeRegistration(msgIDs[0],all,1);
+		} break;
+
+		case kRegType_RangeList: {
+			if (!(count&1)) {
+				throw std::runtime_error("error: invalid range registration message");
+			}
+			HandleRangeRegistration(msgIDs[0],msgIDs+1,count/2);
+		} break;
+
 		default:
 			dbprintf(kWarning,"# client[%d]: unknown HandleRegistration(type=%u)\n",clientID, type);
 			break;
 	}
 }
 
+//-----------------------------------------------------------------------------
+void Manager::ClientProxy::HandleRangeRegistration(bool reg,
+	const uint32_t firstLast[], unsigned numRanges)
+//	ranges are subscribed as intervals, never expanded into msgIDs
+//-----------------------------------------------------------------------------
+{
+	uint32_t changed[2*numRanges];
+	unsigned num = 0;
+
+	for (unsigned i=0; i<numRanges; i++) {
+		uint32_t first = firstLast[2*i], last = firstLast[2*i+1];
+		if (first>last) {
+			throw std::runtime_error("error: invalid msgID range in registration message");
+		}
+		if (last>kMaxRegMsgID) {
+			throw std::runtime_error("Cannot register for reserved msgID (kCCIMessageID)");
+		}
+		bool result;
+		if (reg) {
+			result = manager->SubscribeRange(first,last,this);
+			AddRegisteredRange(first,last);
+		} else {
+			result = manager->UnsubscribeRange(first,last,this);
+			RemoveRegisteredRange(first,last);
+		}
+		if (result) {
+			changed[num++] = first;
+			changed[num++] = last;
+		} else {
+			dbprintf(kWarning,"# warning: client[%d] attempted to %sregister msgIDs %u-%u again\n",
+				clientID,reg?"":"de",first,last);
+		}
+	}
+	if (num)
+		manager->SendRangeRegistration(reg,clientID,groupID,changed,num/2);
+}
+
 //-----------------------------------------------------------------------------
 void Manager::ClientProxy::HandleGroupIDStr(const char* groupStr)
 //-----------------------------------------------------------------------------
@@ -483,7 +852,7 @@ void Manager::ClientProxy::HandleGroupIDStr(const char* groupStr)
 	
 	// a client must not change its groupID while it has registrations, because
 	// previously sent registration messages would now be incorrect
-	if (registeredMsgIDs.size()) {
+	if (registeredMsgIDs.size() || registeredRanges.size()) {
 		sprintf(str,"error: client[%d] changing groupID while registered for messages",clientID);
 		throw std::runtime_error(str);
 	}
@@ -507,7 +876,7 @@ void Manager::ClientProxy::HandleRegistrationsWanted(bool wantNew, bool wantCurr
 
 	wantRegistrations = wantNew;
 	if (wantCurrent) {
-		manager->SendRegistrationsToFD(sockFD);
+		manager->SendRegistrationsTo(this);
 	}
 }
 
@@ -527,44 +896,46 @@ int Manager::ClientProxy::SendRegistration(uint32_t type, int16_t cltID,
 }
 
 //-----------------------------------------------------------------------------
-void Manager::ClientProxy::SendRegistrationsToFD(int fd)
-//	send our current registration state to the requesting filedes
+int Manager::ClientProxy::SendRangeRegistration(bool reg, int16_t cltID,
+	int16_t grpID, const uint32_t firstLast[], unsigned numRanges)
 //-----------------------------------------------------------------------------
 {
 	dbprintf(kDebug,"%s\n",__PRETTY_FUNCTION__);
 
-	// send every registeredMsgIDs to the fd using SocketEndpoint
+	try {
+		return SocketEndpoint::SendRangeRegistration(reg,cltID,grpID,firstLast,numRanges);
+	} catch(std::runtime_error ex) {
+		dbprintf(kNotice, "# while sending to client[%d]: %s\n", this->clientID, ex.what());
+	}
+	return 0;
+}
 
-	unsigned midsToSend = registeredMsgIDs.size();
-	std::set<uint32_t>::iterator it = registeredMsgIDs.begin();
-	unsigned maxMsgIDsPerLoop = (CtrlMsgHdr::kMaxPayloadSize-sizeof(RegistrationMsgHdr))/sizeof(uint32_t);
-	uint32_t msgIDs[maxMsgIDsPerLoop];
+//-----------------------------------------------------------------------------
+void Manager::ClientProxy::SendRegistrationsTo(ClientProxy* requester)
+//	send our current registration state to the requesting proxy
+//-----------------------------------------------------------------------------
+{
+	dbprintf(kDebug,"%s\n",__PRETTY_FUNCTION__);
 
-	while (midsToSend) {
-		// determine number of msgIDs to send
-		unsigned count = midsToSend;
-		if (count>maxMsgIDsPerLoop)
-			count = maxMsgIDsPerLoop;
-		
-		// copy msgIDs from the set
-		for (unsigned i=0; i<count; i++) {
-			msgIDs[i] = *it;
-			++it;
-		}
-		
-		// call send, faking out the SocketEndpoint with the passed sockFD
-		int mySockFD = sockFD;
-		sockFD = fd;
-		try {
-			SocketEndpoint::SendRegistration(kRegType_RegisterList,clientID,
-				groupID,msgIDs,count);
-		} catch(std::runtime_error ex) {
-			dbprintf(kNotice, "# while sending to FD %d error: %s\n", fd, ex.what());
-		}
-		// restore our own sockFD
-		sockFD = mySockFD;
-		midsToSend -= count;
+	// send every registeredMsgIDs through the requester's SocketEndpoint,
+	// with our clientID and groupID (in as few messages as its peer takes)
+	if (registeredMsgIDs.size()) {
+		std::vector<uint32_t> msgIDs(registeredMsgIDs.begin(),registeredMsgIDs.end());
+		requester->SendRegistration(kRegType_RegisterList,clientID,
+			groupID,&msgIDs[0],msgIDs.size());
+	}
+
+	// and every range, which SendRangeRegistration chunks itself
+	if (registeredRanges.empty())
+		return;
+	std::vector<uint32_t> firstLast;
+	std::map<uint32_t,uint32_t>::iterator rit = registeredRanges.begin();
+	for (; rit!=registeredRanges.end(); ++rit) {
+		firstLast.push_back(rit->first);
+		firstLast.push_back(rit->second);
 	}
+	requester->SendRangeRegistration(true,clientID,groupID,
+		&firstLast[0],firstLast.size()/2);
 }
 
 //-----------------------------------------------------------------------------
@@ -591,20 +962,60 @@ void Manager::ClientProxy::HandleBlocksAndInfo(const uint32_t blocks[],
 			throw std::runtime_error(str);
 		}
 	}
-	manager->TakeBlocksAndInfo(blocks,info,count,groupID);
+	manager->TakeBlocksAndInfo(blocks,info,count,clientID,groupID);
 	stats.rcvdSegs += count;
 	stats.rcvdBytes += rcvdBytes;
 }
 
+//-----------------------------------------------------------------------------
+void Manager::ClientProxy::SendRoutedSegments(const uint32_t blockIDs[],
+	const uint32_t slabIDs[], const BlockInfo info[], int16_t srcClientID)
+// the segments/messages the manager routed to us with RouteSegment
+//-----------------------------------------------------------------------------
+{
+	unsigned numRouted = routedSegs.size();
+	uint32_t rtBlockIDs[numRouted];
+	uint32_t rtSlabIDs[numRouted];
+	uint32_t rtSegSizes[numRouted];
+	bool sampling = !sampler.Empty();
+	double now = sampling ? uptimer::CurrentTime() : 0;
+	unsigned count = 0;
+	for (unsigned i=0; i<numRouted; i++) {
+		unsigned idx = routedSegs[i];
+		// skip unsampled segments before SendSegments can take their slabs
+		if (sampling && info[idx].messageID!=kCCIMessageID &&
+			!sampler.Keep(srcClientID,info[idx],now)) {
+			stats.sampledSegsSkipped++;
+			stats.sampledBytesSkipped += info[idx].size;
+			continue;
+		}
+		rtBlockIDs[count] = blockIDs[idx];
+		rtSlabIDs[count] = slabIDs[idx];
+		rtSegSizes[count] = info[idx].size;
+		count++;
+	}
+	routedSegs.clear();
+	if (count)
+		SendSegments(rtBlockIDs,rtSlabIDs,rtSegSizes,count);
+}
+
 //-----------------------------------------------------------------------------
 void Manager::ClientProxy::SendSegments(const uint32_t blockIDs[],
-	const uint32_t slabIDs[], const BlockInfo info[], unsigned count)
+	const uint32_t slabIDs[], const uint32_t sizes[], unsigned count)
 // segments/messages to send to the client (or put in the wanted queue)
+// the manager has already determined that this client wants them
 //-----------------------------------------------------------------------------
 {
 	dbprintf(kDebug,"%s\n",__PRETTY_FUNCTION__);
 
 	bool wantedSegsPending = wantedQueue.size();
+	// while the client is behind on its socket, they wait in the wantedQueue
+	// (or the wantedBound drops them), as in PopWantedQueue
+	bool sendQueueFull = SendQueueFull();
+	if (!wantedSegsPending && !sendQueueFull) {
+		// the client keeps up, but let it show how fast it can go
+		wantedBound.Update(stats.sentSegs,false,uptimer::CurrentTime());
+	}
 
 	unsigned sendCount = 0;
 	uint32_t sendBlockIDs[count]; // messages we will send
@@ -612,30 +1023,20 @@ void Manager::ClientProxy::SendSegments(const uint32_t blockIDs[],
 	uint32_t sendSegSizes[count];
 	unsigned wantCount = 0;
 	uint32_t wantBlockIDs[count]; // messages we want but can't take
-	//uint32_t wantSlabIDs[count];
 	uint32_t wantSegSizes[count];
 
-	// sort the segments into send vs wanted (vs unwanted)
+	// sort the segments into send vs wanted
 	for (unsigned i=0; i<count; i++) {
-		uint32_t msgID = info[i].messageID;
-		bool wantMsg = registeredMsgIDs.count(msgID); // registered
-		if (msgID==kCCIMessageID) {
-			const char* blockPtr = manager->GetBlockPtr(blockIDs[i]);
-			uint32_t dstClientID = ((const CCIHeader*)blockPtr)->dstClientID;
-			wantMsg = (dstClientID==clientID) || (dstClientID==kCCIBcastID);
-		}
-		if (!wantMsg) continue;
-		bool tookSlab = !wantCount && !wantedSegsPending &&
+		bool tookSlab = !wantCount && !wantedSegsPending && !sendQueueFull &&
 			slabs->TakeConsSlab(slabIDs[i]);
 		if (tookSlab) {
 			sendBlockIDs[sendCount] = blockIDs[i];
 			sendSlabIDs[sendCount] = slabIDs[i];
-			sendSegSizes[sendCount] = info[i].size;
+			sendSegSizes[sendCount] = sizes[i];
 			sendCount++;
 		} else {
 			wantBlockIDs[wantCount] = blockIDs[i];
-			//wantSlabIDs[wantCount] = slabIDs[i];
-			wantSegSizes[wantCount] = info[i].size;
+			wantSegSizes[wantCount] = sizes[i];
 			wantCount++;
 		}
 	}
@@ -649,16 +1050,83 @@ void Manager::ClientProxy::SendSegments(const uint32_t blockIDs[],
 	for (unsigned i=0; i<wantCount; i++) {
 		// put wantBlockIDs into the wantedQueue
 		uint32_t blockID = wantBlockIDs[i];
-		WantedSegment& seg = manager->GetWantedSegment(clientID,blockID);
+		uint32_t messageID = manager->GetBlockInfo(blockID)->messageID;
+		WantedSegment& seg = manager->GetWantedSegment(clientID,blockID,
+			DropPriority(messageID));
 		wantedQueue.push_back(seg);
+		wantedQueueBytes += wantSegSizes[i];
 		stats.wantedBytesIn += wantSegSizes[i];
 	}
 	stats.wantedSegsIn += wantCount;
+	if (wantedQueue.size()>stats.wantedSegsPeak)
+		stats.wantedSegsPeak = wantedQueue.size();
+	if (wantedQueueBytes>stats.wantedBytesPeak)
+		stats.wantedBytesPeak = wantedQueueBytes;
 
-	// enforce maxWantedQueueSize
+	// enforce the wantedBound
 	PopWantedQueue();
 }
 
+//-----------------------------------------------------------------------------
+void Manager::ClientProxy::HandleSampling(uint32_t first, uint32_t last,
+	uint32_t everyNth, float maxRate)
+//-----------------------------------------------------------------------------
+{
+	dbprintf(kDebug,"%s\n",__PRETTY_FUNCTION__);
+	if (first>last) {
+		throw std::runtime_error("error: invalid msgID range in sampling message");
+	}
+	dbprintf(kInfo,"- client[%d] sampling msgIDs %u-%u: every %u, max rate %g\n",
+		clientID, first, last, everyNth, maxRate);
+	sampler.SetPolicy(first,last,everyNth,maxRate);
+}
+
+//-----------------------------------------------------------------------------
+void Manager::ClientProxy::HandleWantedQueueBudget(float latency, uint64_t maxBytes)
+//-----------------------------------------------------------------------------
+{
+	dbprintf(kDebug,"%s\n",__PRETTY_FUNCTION__);
+	if (!(latency>=0)) { // also NaN
+		throw std::runtime_error("error: invalid latency in wanted queue budget message");
+	}
+	dbprintf(kInfo,"- client[%d] wanted queue budget: latency %g, bytes %llu\n",
+		clientID, latency, (unsigned long long)maxBytes);
+	wantedBound.SetBudget(latency,maxBytes);
+	stats.wantedSegsLimit = wantedBound.MaxSegs();
+	stats.drainRate = wantedBound.DrainRate();
+}
+
+//-----------------------------------------------------------------------------
+void Manager::ClientProxy::HandleDropPriority(uint32_t first, uint32_t last,
+	int32_t priority)
+//-----------------------------------------------------------------------------
+{
+	dbprintf(kDebug,"%s\n",__PRETTY_FUNCTION__);
+	if (first>last) {
+		throw std::runtime_error("error: invalid msgID range in drop priority message");
+	}
+	if (priority>=kNumDropPriorities) {
+		dbprintf(kWarning,"# client[%d] drop priority %d reduced to %d\n",
+			clientID, priority, kNumDropPriorities-1);
+		priority = kNumDropPriorities-1;
+	}
+	if (priority<0)
+		priority = DropPriorityMap::kUnset;
+	dropPriorities.Set(first,last,priority);
+}
+
+//-----------------------------------------------------------------------------
+unsigned Manager::ClientProxy::DropPriority(uint32_t msgID) const
+//-----------------------------------------------------------------------------
+{
+	if (!dropPriorities.Empty()) {
+		int priority = dropPriorities.Get(msgID);
+		if (priority!=DropPriorityMap::kUnset)
+			return priority;
+	}
+	return manager->DropPriority(msgID);
+}
+
 //-----------------------------------------------------------------------------
 void Manager::ClientProxy::HandleProdNiceLevel(int32_t level)
 //-----------------------------------------------------------------------------
@@ -667,9 +1135,19 @@ void Manager::ClientProxy::HandleProdNiceLevel(int32_t level)
 	prodNiceLevel = level;
 }
 
+//-----------------------------------------------------------------------------
+void Manager::ClientProxy::HandleNumaNode(int32_t node)
+//-----------------------------------------------------------------------------
+{
+	dbprintf(kDebug,"%s\n", __PRETTY_FUNCTION__);
+	numaNode = node;
+}
+
 //-----------------------------------------------------------------------------
 int Manager::ClientProxy::HandleSendWouldBlock(void)
 //	return true to try again, or false to fail
+//	only a blocking send gets here, the handshake in the SocketEndpoint ctor;
+//	everything after it is deferred, and waits for writer instead
 //-----------------------------------------------------------------------------
 {
 	dbprintf(kDebug,"%s\n", __PRETTY_FUNCTION__);
@@ -677,6 +1155,17 @@ int Manager::ClientProxy::HandleSendWouldBlock(void)
 	return 0; // send will fail
 }
 
+//-----------------------------------------------------------------------------
+void Manager::ClientProxy::HandleSendQueueOverflow(void)
+//	kMaxSendQueueBytes are waiting for the client
+//-----------------------------------------------------------------------------
+{
+	dbprintf(kNotice,"- client[%d] is %u bytes behind, disconnecting\n",
+		clientID, PendingSendBytes());
+	writer.stop();
+	shutdown(sockFD,SHUT_RD);
+}
+
 //-----------------------------------------------------------------------------
 void ProxyStats::Print(FILE* file, const char* clientName) const
 //-----------------------------------------------------------------------------
@@ -698,6 +1187,13 @@ void ProxyStats::Print(FILE* file, const char* clientName) const
 	fprintf(file,"  wantedBytesDropped: %llu\n", (unsigned long long)wantedBytesDropped);
 	fprintf(file,"  wantedSegsOverage: %llu\n", (unsigned long long)wantedSegsOverage);
 	fprintf(file,"  wantedBytesOverage: %llu\n", (unsigned long long)wantedBytesOverage);
+	fprintf(file,"  sampledSegsSkipped: %llu\n", (unsigned long long)sampledSegsSkipped);
+	fprintf(file,"  sampledBytesSkipped: %llu\n", (unsigned long long)sampledBytesSkipped);
+	fprintf(file,"  wantedSegsPeak: %llu\n", (unsigned long long)wantedSegsPeak);
+	fprintf(file,"  wantedBytesPeak: %llu\n", (unsigned long long)wantedBytesPeak);
+	fprintf(file,"  sendQueuePeak: %llu\n", (unsigned long long)sendQueuePeak);
+	fprintf(file,"  wantedSegsLimit: %u\n", wantedSegsLimit);
+	fprintf(file,"  drainRate: %g\n", drainRate);
 	fprintf(file,"...\n");
 }
 
@@ -0,0 +1,86 @@
+//=============================================================================
+//	This file is part of MCSB, the Multi-Client Shared Buffer
+//	Copyright (C) 2014  Gregory E. Allen and
+//		Applied Research Laboratories: The University of Texas at Austin
+//
+//	MCSB is free software: you can redistribute it and/or modify it
+//	under the terms of the GNU Lesser General Public License as published
+//	by the Free Software Foundation, either version 2.1 of the License, or
+//	(at your option) any later version.
+//
+//	MCSB is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+//	Lesser General Public License <http://www.gnu.org/licenses/lgpl.html>
+//	for more details.
+//=============================================================================
+#include "MCSB/DropPriorityMap.h"
+
+namespace MCSB {
+
+//-----------------------------------------------------------------------------
+DropPriorityMap::IntervalMap::iterator DropPriorityMap::SplitAt(uint64_t msgID)
+//	make msgID the start of an interval, returns end() past the last msgID
+//-----------------------------------------------------------------------------
+{
+	if (msgID>0xFFFFFFFFull)
+		return intervals.end();
+	IntervalMap::iterator it = intervals.lower_bound(msgID);
+	if (it!=intervals.end() && it->first==msgID)
+		return it;
+	int priority = kUnset;
+	if (it!=intervals.begin()) {
+		IntervalMap::iterator prev = it;
+		--prev;
+		priority = prev->second;
+	}
+	return intervals.insert(it,std::make_pair(uint32_t(msgID),priority));
+}
+
+//-----------------------------------------------------------------------------
+void DropPriorityMap::Set(uint32_t first, uint32_t last, int priority)
+//-----------------------------------------------------------------------------
+{
+	if (first>last)
+		return;
+	IntervalMap::iterator it = SplitAt(first);
+	IntervalMap::iterator end = SplitAt(uint64_t(last)+1);
+	it->second = priority;
+	++it;
+	intervals.erase(it,end);
+
+	// merge equal neighbors around the new interval
+	it = intervals.lower_bound(first);
+	if (it!=intervals.begin()) --it;
+	while (it!=intervals.end()) {
+		IntervalMap::iterator next = it;
+		++next;
+		if (it==intervals.begin() && it->second==kUnset) {
+			intervals.erase(it);
+			it = next;
+			continue;
+		}
+		if (next==intervals.end())
+			break;
+		if (next->second==it->second) {
+			intervals.erase(next);
+			continue;
+		}
+		if (next->first>uint64_t(last)+1)
+			break;
+		it = next;
+	}
+}
+
+//-----------------------------------------------------------------------------
+int DropPriorityMap::Get(uint32_t msgID) const
+//-----------------------------------------------------------------------------
+{
+	IntervalMap::const_iterator it = intervals.upper_bound(msgID);
+	if (it==intervals.begin())
+		return kUnset;
+	--it;
+	return it->second;
+}
+
+} // namespace MCSB
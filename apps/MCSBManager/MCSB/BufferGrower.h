@@ -0,0 +1,66 @@
+//=============================================================================
+//	This file is part of MCSB, the Multi-Client Shared Buffer
+//	Copyright (C) 2014  Gregory E. Allen and
+//		Applied Research Laboratories: The University of Texas at Austin
+//
+//	MCSB is free software: you can redistribute it and/or modify it
+//	under the terms of the GNU Lesser General Public License as published
+//	by the Free Software Foundation, either version 2.1 of the License, or
+//	(at your option) any later version.
+//
+//	MCSB is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+//	Lesser General Public License <http://www.gnu.org/licenses/lgpl.html>
+//	for more details.
+//=============================================================================
+
+#ifndef MCSB_BufferGrower_h
+#define MCSB_BufferGrower_h
+#pragma once
+
+#include "MCSB/Manager.h"
+#include <pthread.h>
+#include <ev++.h>
+
+namespace MCSB {
+
+//-----------------------------------------------------------------------------
+// A BufferGrower is a worker thread that locks or prefaults a prepared (not
+// yet committed) buffer, so that the manager's event loop doesn't stall on
+// it. When done, it wakes the manager's loop, which commits the buffer.
+//-----------------------------------------------------------------------------
+
+class Manager::BufferGrower {
+  public:
+	BufferGrower(Manager* manager, ev::loop_ref loop);
+   ~BufferGrower(void); // waits for any prefault, and joins the thread
+
+	bool Busy(void) const { return busy; } // started, and not yet collected
+	void Prefault(void* addr, size_t len); // starts one, unless Busy
+	int Wait(void); // until done, then collects its lock errors (0 if idle)
+
+  protected:
+	Manager* manager;
+	ev::async done;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	// guarded by the mutex
+	void* addr;
+	size_t len;
+	bool started;
+	bool finished;
+	bool stopping;
+	int lockErrors;
+	// only on the manager's loop
+	bool busy;
+
+	static void* ThreadMain(void* arg);
+	void Run(void);
+	void HandleDone(void);
+};
+
+} // namespace MCSB
+
+#endif
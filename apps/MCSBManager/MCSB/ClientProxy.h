@@ -21,12 +21,18 @@
 
 #include "MCSB/Manager.h"
 #include "MCSB/SocketEndpoint.h"
+#include "MCSB/ShmRing.h"
 #include "MCSB/WantedSegment.h"
 #include "MCSB/ProxyStats.h"
 #include "MCSB/DropReporter.h"
+#include "MCSB/MsgSampler.h"
+#include "MCSB/DropPriorityMap.h"
+#include "MCSB/WantedQueueBound.h"
 #include <unistd.h>
 #include <string>
 #include <set>
+#include <map>
+#include <vector>
 
 namespace MCSB {
 
@@ -34,14 +40,24 @@ class Manager::ClientProxy : public SocketDaemon::ClientProxy, public SocketEndp
   public:
 	ClientProxy(ev::loop_ref loop, int fd, SocketDaemon::ClientID clientID, SocketDaemon* d);
 	~ClientProxy(void);
-	int Read(void) { return SocketEndpoint::Poll(0); }
+	int Read(void);
 
 	void CheckBufferParams(void);
 
+	// segments routed by Manager::TakeBlocksAndInfo, by index into its arrays
+	// RouteSegment returns true for the first segment routed in a batch
+	// (a segment can match both a msgID and a range, route it only once)
+	bool RouteSegment(unsigned idx) {
+		if (routedSegs.size() && routedSegs.back()==idx) return false;
+		routedSegs.push_back(idx); return routedSegs.size()==1;
+	}
+	void SendRoutedSegments(const uint32_t blockIDs[], const uint32_t slabIDs[],
+		const BlockInfo info[], int16_t srcClientID);
 	void SendSegments(const uint32_t blockIDs[], const uint32_t slabIDs[],
-		const BlockInfo info[], unsigned count);
+		const uint32_t sizes[], unsigned count);
 	int SendRegistration(uint32_t type, int16_t cltID, int16_t grpID, const uint32_t msgIDs[], unsigned count);
-	void SendRegistrationsToFD(int fd);
+	int SendRangeRegistration(bool reg, int16_t cltID, int16_t grpID, const uint32_t firstLast[], unsigned numRanges);
+	void SendRegistrationsTo(ClientProxy* requester);
 	bool WantRegistrations(void) const { return wantRegistrations; }
 
 	void EraseWantedSegment(WantedSegment& seg); // when the manager seizes wantedSlabs
@@ -50,6 +66,8 @@ class Manager::ClientProxy : public SocketDaemon::ClientProxy, public SocketEndp
 	const ProxyStats& GetProxyStats(void) const { return stats; }
 
 	void TakeFreeSlabs(const uint32_t slabIDs[], unsigned count);
+	int FlushSends(void);
+	int NumaNode(void) const { return numaNode; } // of the client, -1 if unknown
 
   protected:
 	Manager* manager;
@@ -58,15 +76,50 @@ class Manager::ClientProxy : public SocketDaemon::ClientProxy, public SocketEndp
 	class SlabTracker;
 	SlabTracker* slabs;
 	std::set<uint32_t> registeredMsgIDs;
+	std::map<uint32_t,uint32_t> registeredRanges; // disjoint, first -> last
+	std::vector<unsigned> routedSegs;
+	MsgSampler sampler;
+	DropPriorityMap dropPriorities; // the client's, else the manager's
 	bool wantRegistrations;
 	unsigned blocksPerSlab;
+	unsigned buffersPassed; // to the client as fds, if the buffers are anonymous
 	char prodNiceLevel;
+	int numaNode;
 	unsigned pendingFreeSlabRqsts;
 	ProxyStats stats;
 	DropReporter dropReporter;
 
+	// delivery and retirement through shared memory, if the client asked
+	ShmRing ring;
+	ShmRing nextRing;      // a larger one, until the client attaches it
+	bool ringActive;       // we deliver through it
+	bool clientRingActive; // the client retires and submits through it
+	bool deliverViaSocket; // the delivery ring filled up, until kShmRing_PauseAck
+	bool retirePaused;     // the client's retirement ring, until kShmRing_Active
+	void DrainRings(void);
+	uint32_t RingEntriesNeeded(void) const;
+	bool CreateRing(ShmRing& r);
+	void GrowRing(void); // if the slabs outgrew it
+
+
+	// deferred sends that the client's socket has not yet taken wait in
+	// the SocketEndpoint's sendBuf, drained by writer; while they exceed
+	// kSendQueueBytes, deliveries wait in the wantedQueue (or are dropped)
+	enum { kSendQueueBytes = 4*1024*1024 };
+	// control traffic (registrations, slabIDs, drop reports) still queues
+	// past kSendQueueBytes, but a client that lets it reach
+	// kMaxSendQueueBytes has stopped reading, and is disconnected
+	enum { kMaxSendQueueBytes = 64*1024*1024 };
+	enum { kMaxSendSockBufSize = 4*1024*1024 };
+	ev::io writer;
+	unsigned sendSockBufSize;
+	bool SendQueueFull(void) const { return PendingSendBytes()>kSendQueueBytes; }
+	void Writable(ev::io &watcher, int revents);
+	void GrowSendSockBuf(unsigned size);
+
 	WantedSegmentCProxyList wantedQueue;
-	unsigned maxWantedQueueSize;
+	uint64_t wantedQueueBytes;
+	WantedQueueBound wantedBound;
 	void PopWantedQueue(void);
 
 	int SendBlockIDs(const uint32_t blockIDs[], const uint32_t sizes[], unsigned count);
@@ -85,12 +138,25 @@ class Manager::ClientProxy : public SocketDaemon::ClientProxy, public SocketEndp
 	void HandleManagerEcho(const void* ptr, uint16_t len);
 	void HandleDropReportAck(void);
 	void HandleProdNiceLevel(int32_t lvl);
+	void HandleNumaNode(int32_t node);
+	void HandleShmRing(uint32_t state);
+	void HandleRingDoorbell(void);
+	void HandleSampling(uint32_t first, uint32_t last, uint32_t everyNth, float maxRate);
+	void HandleDropPriority(uint32_t first, uint32_t last, int32_t priority);
+	void HandleWantedQueueBudget(float latency, uint64_t maxBytes);
+	unsigned DropPriority(uint32_t msgID) const;
 	int HandleSendWouldBlock(void);
+	void HandleSendsDeferred(void) { manager->QueueFlush(this); }
+	void HandleSendQueueOverflow(void);
 
 	void HandleSequenceToken(uint32_t token)
 		{ SendSequenceToken(token); }
 
 	void DeregisterAllMsgIDs(void);
+	bool IsRegistered(uint32_t msgID) const;
+	void HandleRangeRegistration(bool reg, const uint32_t firstLast[], unsigned numRanges);
+	void AddRegisteredRange(uint32_t first, uint32_t last);
+	void RemoveRegisteredRange(uint32_t first, uint32_t last);
 };
 
 } // namespace MCSB
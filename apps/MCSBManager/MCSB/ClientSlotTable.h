@@ -0,0 +1,132 @@
+//=============================================================================
+//	This file is part of MCSB, the Multi-Client Shared Buffer
+//	Copyright (C) 2014  Gregory E. Allen and
+//		Applied Research Laboratories: The University of Texas at Austin
+//
+//	MCSB is free software: you can redistribute it and/or modify it
+//	under the terms of the GNU Lesser General Public License as published
+//	by the Free Software Foundation, either version 2.1 of the License, or
+//	(at your option) any later version.
+//
+//	MCSB is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+//	Lesser General Public License <http://www.gnu.org/licenses/lgpl.html>
+//	for more details.
+//=============================================================================
+
+#ifndef MCSB_ClientSlotTable_h
+#define MCSB_ClientSlotTable_h
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+namespace MCSB {
+
+//-----------------------------------------------------------------------------
+// ClientSlotTable is a dense table of typed client pointers, indexed by
+// clientID, with a list of the occupied slots for iteration.
+// Each slot has a generation that is incremented when it is reused, so a
+// Handle (generation and clientID) saved for later can be checked for
+// staleness with a single index.
+//-----------------------------------------------------------------------------
+
+template <typename T>
+class ClientSlotTable {
+  public:
+	typedef uint32_t Handle; // generation<<16 | clientID
+	enum { kInvalidHandle = 0xFFFFFFFF };
+
+	ClientSlotTable(unsigned maxClientID): slots(maxClientID+1) {}
+
+	Handle Insert(uint16_t clientID, T* t);
+	void Erase(uint16_t clientID);
+
+	T* Find(uint16_t clientID) const
+		{ return clientID<slots.size() ? slots[clientID].t : 0; }
+	T* FindHandle(Handle h) const;
+	Handle GetHandle(uint16_t clientID) const;
+
+	// for iterating over the occupied slots
+	// the order changes when a client is erased
+	size_t size(void) const { return occupied.size(); }
+	T* operator[](unsigned i) const { return occupied[i]; }
+
+  protected:
+	struct Slot {
+		T* t;
+		uint16_t generation;
+		unsigned occupiedIdx; // in occupied
+		Slot(void): t(0), generation(0), occupiedIdx(0) {}
+	};
+	std::vector<Slot> slots;
+	std::vector<T*> occupied;
+	std::vector<uint16_t> occupiedIDs; // parallel to occupied
+};
+
+//-----------------------------------------------------------------------------
+template <typename T>
+typename ClientSlotTable<T>::Handle
+	ClientSlotTable<T>::Insert(uint16_t clientID, T* t)
+//-----------------------------------------------------------------------------
+{
+	if (clientID>=slots.size())
+		slots.resize(clientID+1);
+	Slot& slot = slots[clientID];
+	if (slot.t)
+		Erase(clientID);
+	slot.t = t;
+	slot.generation++;
+	slot.occupiedIdx = occupied.size();
+	occupied.push_back(t);
+	occupiedIDs.push_back(clientID);
+	return GetHandle(clientID);
+}
+
+//-----------------------------------------------------------------------------
+template <typename T>
+void ClientSlotTable<T>::Erase(uint16_t clientID)
+//-----------------------------------------------------------------------------
+{
+	if (clientID>=slots.size() || !slots[clientID].t)
+		return;
+	Slot& slot = slots[clientID];
+	// move the last occupied into the erased position
+	unsigned idx = slot.occupiedIdx;
+	uint16_t lastID = occupiedIDs.back();
+	occupied[idx] = occupied.back();
+	occupiedIDs[idx] = lastID;
+	slots[lastID].occupiedIdx = idx;
+	occupied.pop_back();
+	occupiedIDs.pop_back();
+	slot.t = 0;
+}
+
+//-----------------------------------------------------------------------------
+template <typename T>
+T* ClientSlotTable<T>::FindHandle(Handle h) const
+//-----------------------------------------------------------------------------
+{
+	uint16_t clientID = h & 0xFFFF;
+	if (clientID>=slots.size()) return 0;
+	const Slot& slot = slots[clientID];
+	if (slot.generation != (h>>16)) return 0;
+	return slot.t;
+}
+
+//-----------------------------------------------------------------------------
+template <typename T>
+typename ClientSlotTable<T>::Handle
+	ClientSlotTable<T>::GetHandle(uint16_t clientID) const
+//-----------------------------------------------------------------------------
+{
+	if (clientID>=slots.size() || !slots[clientID].t)
+		return kInvalidHandle;
+	return (Handle(slots[clientID].generation)<<16) | clientID;
+}
+
+} // namespace MCSB
+
+#endif
@@ -0,0 +1,49 @@
+//=============================================================================
+//	This file is part of MCSB, the Multi-Client Shared Buffer
+//	Copyright (C) 2014  Gregory E. Allen and
+//		Applied Research Laboratories: The University of Texas at Austin
+//
+//	MCSB is free software: you can redistribute it and/or modify it
+//	under the terms of the GNU Lesser General Public License as published
+//	by the Free Software Foundation, either version 2.1 of the License, or
+//	(at your option) any later version.
+//
+//	MCSB is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+//	Lesser General Public License <http://www.gnu.org/licenses/lgpl.html>
+//	for more details.
+//=============================================================================
+#ifndef MCSB_DropPriorityMap_h
+#define MCSB_DropPriorityMap_h
+#pragma once
+
+#include <stdint.h>
+#include <map>
+
+namespace MCSB {
+
+//-----------------------------------------------------------------------------
+// DropPriorityMap assigns drop priorities to msgID ranges. Like the range
+// subscriptions in SubscriptionIndex, it is a map of elementary intervals,
+// keyed by the first msgID of each, so a lookup is one upper_bound.
+//-----------------------------------------------------------------------------
+
+class DropPriorityMap {
+  public:
+	enum { kUnset = -1 };
+	// priority kUnset clears [first,last]
+	void Set(uint32_t first, uint32_t last, int priority);
+	// returns kUnset if msgID has no priority
+	int Get(uint32_t msgID) const;
+	bool Empty(void) const { return intervals.empty(); }
+
+  protected:
+	typedef std::map<uint32_t,int> IntervalMap;
+	IntervalMap intervals;
+	IntervalMap::iterator SplitAt(uint64_t msgID);
+};
+
+} // namespace MCSB
+
+#endif
@@ -26,6 +26,9 @@
 #include "MCSB/GroupManager.h"
 #include "MCSB/SlabRequestManager.h"
 #include "MCSB/ManagerStats.h"
+#include "MCSB/SubscriptionIndex.h"
+#include "MCSB/DropPriorityMap.h"
+#include "MCSB/ClientSlotTable.h"
 #include "MCSB/uptimer.h"
 
 #include <ev++.h>
@@ -39,8 +42,13 @@ class Manager : public SocketDaemon, public uptimer {
 	
 	using SocketDaemon::AddConnectedClient;
 	class ClientProxy;
+	class SendFlusher;
+	class BufferGrower;
 
 	const char* ShmNameFormat(void) const { return shmMapper.ShmNameFormat(); }
+	bool ShmAnonymous(void) const { return shmMapper.Anonymous(); }
+	unsigned NumBuffers(void) const { return shmMapper.NumBuffers(); }
+	int ShmBufferFD(unsigned bufNum) const { return shmMapper.BufferFD(bufNum); }
 	int GetSlabReservation(unsigned numSlabs);
 	int ReleaseSlabReservation(unsigned numSlabs)
 		{ return slabManager.ReleaseSlabReservation(numSlabs); }
@@ -52,9 +60,15 @@ class Manager : public SocketDaemon, public uptimer {
 	void DecrementHeldRefcnt(const uint32_t slabIDs[], unsigned count,
 		const unsigned amounts[] = 0)
 		{ return slabManager.DecrementHeldRefcnt(slabIDs,count,amounts); }
-	WantedSegment& GetWantedSegment(uint16_t clientID, uint32_t blockID)
+	WantedSegment& GetWantedSegment(uint16_t clientID, uint32_t blockID,
+		unsigned dropPriority=kDefaultDropPriority)
 		{ return slabManager.GetWantedSegment(clientID,blockID,
-			blockID/blocksPerSlab); }
+			blockID/blocksPerSlab,dropPriority); }
+	// the configured drop priority, unless a client sets its own
+	unsigned DropPriority(uint32_t msgID) const {
+		int priority = dropPriorities.Get(msgID);
+		return priority==DropPriorityMap::kUnset ? kDefaultDropPriority : priority;
+	}
 	void ReleaseWantedSegment(WantedSegment& seg)
 		{ slabManager.ReleaseWantedSegment(seg,seg.BlockID()/blocksPerSlab); }
 
@@ -63,10 +77,23 @@ class Manager : public SocketDaemon, public uptimer {
 
 	int SendRegistration(uint32_t type, int16_t clientID, int16_t groupID,
 		const uint32_t msgIDs[], unsigned count);
-	void SendRegistrationsToFD(int fd);
+	int SendRangeRegistration(bool reg, int16_t clientID, int16_t groupID,
+		const uint32_t firstLast[], unsigned numRanges);
+	void SendRegistrationsTo(ClientProxy* requester);
+
+	bool Subscribe(uint32_t msgID, ClientProxy* proxy)
+		{ return subscriptions.Subscribe(msgID,proxy); }
+	bool Unsubscribe(uint32_t msgID, ClientProxy* proxy)
+		{ return subscriptions.Unsubscribe(msgID,proxy); }
+	bool SubscribeRange(uint32_t first, uint32_t last, ClientProxy* proxy)
+		{ return subscriptions.SubscribeRange(first,last,proxy); }
+	bool UnsubscribeRange(uint32_t first, uint32_t last, ClientProxy* proxy)
+		{ return subscriptions.UnsubscribeRange(first,last,proxy); }
+
+	void QueueFlush(ClientProxy* proxy); // flush its deferred sends
 
 	void TakeBlocksAndInfo(const uint32_t blocks[], const BlockInfo info[],
-		unsigned count, int16_t srcGroupID);
+		unsigned count, int16_t srcClientID, int16_t srcGroupID);
 
 	uint32_t TotalNumSlabs(void) const { return shmMapper.TotalNumSlabs(); }
 	unsigned BlocksPerSlab(void) const { return blocksPerSlab; }
@@ -91,8 +118,16 @@ class Manager : public SocketDaemon, public uptimer {
 	GroupManager groupManager;
 	ManagerStats stats;
 	SlabRequestManager slabRqstManager;
+	SubscriptionIndex<ClientProxy> subscriptions;
+	DropPriorityMap dropPriorities;
+	ClientSlotTable<ClientProxy> proxySlots; // typed, parallel to clients
+	std::vector<ClientProxy*> routedProxies; // scratch for TakeBlocksAndInfo
 	bool allowUnlockedMemory;
 	bool playbackMode;
+	SendFlusher* sendFlusher;
+	BufferGrower* bufferGrower; // prefaults the next buffer, if growing ahead
+	uint32_t growAheadSlabs; // unreserved, below which the next buffer is grown
+	uint32_t reclaimIdleSecs; // free slabs idle this long go cold
 	SocketDaemon::ClientProxy* CreateNewClientProxy(ev::loop_ref loop,
 		int fd, ClientID clientID, SocketDaemon* daemon);
 	void HandleSigInt(ev::sig &signal, int revents);
@@ -110,11 +145,16 @@ class Manager : public SocketDaemon, public uptimer {
 	client_citer statsIter;
 
 	int IncreaseNumBuffers(unsigned newNumBuffers=0);
+	void GrowBuffersAhead(void);
+	void BufferGrown(void);
+	void ReclaimIdleSlabs(void);
+	void WarmSlabs(const uint32_t slabIDs[], unsigned count);
 	void ErasingClientHook(ClientID clientID,
 		const SocketDaemon::ClientProxy* proxy);
 	unsigned HarvestWantedSlabs(unsigned count);
 	void ServiceSlabRequests(void);
 	void HandleSlabStateChange(int which, const SlabManager::SlabInfo& slab);
+	void RouteSegment(ClientProxy* proxy, unsigned idx, int16_t srcGroupID);
 };
 
 } // namespace MCSB
@@ -22,6 +22,7 @@
 #include "MCSB/dbprinter.h"
 
 #include <string>
+#include <vector>
 #include <stdint.h>
 
 namespace MCSB {
@@ -50,23 +51,42 @@ class ManagerParams {
 	// parameters about the memory buffer
 	std::string shmNameFmt; // the shared memory name format
 	uint32_t blockSize;     // in bytes
+	uint32_t smallBlockSize; // a class for smaller messages, 0 for off
 	uint32_t slabSize;      // in bytes
 	uint64_t bufferSize;    // in bytes
 	uint32_t numBlocks;     // per buffer
 	uint32_t numBuffers;    // initially allocated
 	uint32_t maxNumBuffers; // that can ever be allocated
 	float    nonrsrvblePct; // percent memory non-reservable by clients
+	float    growAheadPct;  // grow a buffer in the background when unreserved
+	                        // slabs fall below this percent of one, 0 for off
+	uint32_t reclaimIdleSecs; // return memory of slabs free this long, 0 for off
+	uint32_t hugePageSize;  // backing the buffers, 0 for normal pages
+	uint32_t numaNodes;     // buffers bound round robin to, 0 for first touch
+	bool     memfdBuffers;  // anonymous, passed to clients as fds over the socket
 	uint32_t SlabsPerBuffer(void) const { return bufferSize/slabSize; }
+	uint32_t IDBlockSize(void) const // what a blockID counts
+		{ return smallBlockSize ? smallBlockSize : blockSize; }
+
+	// drop priorities of msgID ranges, from -P first[-last]:priority
+	struct DropPriority {
+		uint32_t first, last;
+		unsigned priority;
+	};
+	std::vector<DropPriority> dropPriorities;
+	static bool ParseDropPriority(const char* str, DropPriority& dp);
 
 	const std::string& ShmNameFmt(const char* fmt); // sub %U for username
 
 	enum { kDefaultVerbosity = kNotice };
 	enum { kDefaultBlockSize = 8*1024 };
+	enum { kMinSmallBlockSize = 64 };
 	enum { kDefaultSlabSize = kDefaultBlockSize*1024 };
 	enum { kDefaultBufferSize = kDefaultSlabSize*32 };
 	enum { kDefaultNumBuffers = 1 };
 	enum { kDefaultMaxNumBuffers = 8 };
 	enum { kDefaultNonrsrvblePct = 2 };
+	enum { kDefaultGrowAheadPct = 25 };
 };
 
 } // namespace MCSB
@@ -40,6 +40,7 @@ struct ManagerStats {
 	uint32_t numFreeSlabs;
 	uint32_t numHeldSlabs;
 	uint32_t numWantedSlabs;
+	uint32_t numColdSlabs; // free, with their memory returned to the OS
 
 	uint64_t rcvdSegs; // from any Client
 	uint64_t rcvdBytes;
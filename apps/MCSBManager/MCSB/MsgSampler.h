@@ -0,0 +1,67 @@
+//=============================================================================
+//	This file is part of MCSB, the Multi-Client Shared Buffer
+//	Copyright (C) 2014  Gregory E. Allen and
+//		Applied Research Laboratories: The University of Texas at Austin
+//
+//	MCSB is free software: you can redistribute it and/or modify it
+//	under the terms of the GNU Lesser General Public License as published
+//	by the Free Software Foundation, either version 2.1 of the License, or
+//	(at your option) any later version.
+//
+//	MCSB is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+//	Lesser General Public License <http://www.gnu.org/licenses/lgpl.html>
+//	for more details.
+//=============================================================================
+#ifndef MCSB_MsgSampler_h
+#define MCSB_MsgSampler_h
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <map>
+
+namespace MCSB {
+
+class BlockInfo;
+
+//-----------------------------------------------------------------------------
+// MsgSampler decides which messages a sampling client gets, so the rest
+// are never held or queued for it. A policy covers a msgID range and keeps
+// every Nth message and/or at most maxRate messages per second, per msgID.
+// Whole messages are kept or skipped: the decision is made on segment 0
+// (and a packed batch of small messages is kept or skipped as a whole).
+// Producers can interleave segments of the same msgID, so the decision
+// for the rest of a message is kept per producer.
+//-----------------------------------------------------------------------------
+
+class MsgSampler {
+  public:
+	// everyNth<=1 and maxRate<=0 clears the policy for [first,last]
+	void SetPolicy(uint32_t first, uint32_t last, uint32_t everyNth, float maxRate);
+	bool Empty(void) const { return policies.empty(); }
+	// srcClientID is the producer of the segment
+	bool Keep(int16_t srcClientID, const BlockInfo& info, double now);
+
+  protected:
+	struct Policy {
+		uint32_t first, last;
+		uint32_t everyNth;
+		float maxRate;
+	};
+	struct State {
+		const Policy* policy;
+		uint32_t count;
+		double lastKept;
+	};
+	typedef std::pair<int16_t,uint32_t> MessageKey; // producer and msgID
+	std::vector<Policy> policies; // few, the most recent first
+	std::map<uint32_t,State> states; // only for sampled msgIDs
+	// for the remaining segments of a multi-segment message
+	std::map<MessageKey,bool> partials;
+};
+
+} // namespace MCSB
+
+#endif
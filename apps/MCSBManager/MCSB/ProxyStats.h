@@ -44,6 +44,13 @@ struct ProxyStats {
 	uint64_t wantedBytesDropped;
 	uint64_t wantedSegsOverage; // wantedQueue size overage, dropped
 	uint64_t wantedBytesOverage;
+	uint64_t sampledSegsSkipped; // skipped by a sampling policy
+	uint64_t sampledBytesSkipped;
+	uint64_t wantedSegsPeak; // the most waiting at once
+	uint64_t wantedBytesPeak;
+	uint64_t sendQueuePeak; // the most bytes waiting for the client's socket
+	uint32_t wantedSegsLimit; // the current WantedQueueBound
+	float drainRate; // measured segs/sec, if the client gave a latency budget
 };
 
 } // namespace MCSB
@@ -0,0 +1,50 @@
+//=============================================================================
+//	This file is part of MCSB, the Multi-Client Shared Buffer
+//	Copyright (C) 2014  Gregory E. Allen and
+//		Applied Research Laboratories: The University of Texas at Austin
+//
+//	MCSB is free software: you can redistribute it and/or modify it
+//	under the terms of the GNU Lesser General Public License as published
+//	by the Free Software Foundation, either version 2.1 of the License, or
+//	(at your option) any later version.
+//
+//	MCSB is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+//	Lesser General Public License <http://www.gnu.org/licenses/lgpl.html>
+//	for more details.
+//=============================================================================
+
+#ifndef MCSB_SendFlusher_h
+#define MCSB_SendFlusher_h
+#pragma once
+
+#include "MCSB/Manager.h"
+#include <vector>
+#include <ev++.h>
+
+namespace MCSB {
+
+//-----------------------------------------------------------------------------
+// SendFlusher flushes the deferred sends of client proxies once per
+// iteration of an event loop, from a lowest priority check watcher that
+// runs after the other callbacks, so that everything sent to a client
+// during the iteration goes out in a single send.
+//-----------------------------------------------------------------------------
+
+class Manager::SendFlusher {
+  public:
+	SendFlusher(Manager* manager, ev::loop_ref loop);
+	void Queue(ClientSlotTable<ClientProxy>::Handle handle)
+		{ pending.push_back(handle); }
+
+  protected:
+	Manager* manager;
+	ev::check check;
+	std::vector<ClientSlotTable<ClientProxy>::Handle> pending;
+	void HandleCheck(void);
+};
+
+} // namespace MCSB
+
+#endif
@@ -32,47 +32,90 @@ class ShmMapper { // allocates and maps for the manager
 	// nameFmt must contain %u for bufferNumber to be used with sprintf
 	// force will remove and reallocate the shared memory if it already exists
 	// the remaining parameters describe the shared memory to map
+	// pgSz is the (huge) page size backing nameFmt, 0 for the system's
+	// numaNds>1 binds the buffers' memory round robin to that many nodes
+	// memfd creates anonymous buffers (named by nameFmt only for debugging),
+	// to be mapped by clients through BufferFD instead of by name
 	ShmMapper(const char* nameFmt, bool force, uint32_t blkSz, uint32_t slbSz,
-		uint32_t numBlks, uint32_t mxNumBufs);
+		uint32_t numBlks, uint32_t mxNumBufs, uint32_t pgSz=0, unsigned numaNds=0,
+		bool memfd=false, uint32_t largeBlkSz=0);
    ~ShmMapper(void);
 
 	unsigned NumBuffers(unsigned n); // increase the number of buffers allocated and mapped
-	unsigned NumBuffers(void) const { return headerVec.size(); }
+	unsigned NumBuffers(void) const { return numBuffers; }
+
+	// or grow by one in steps, so that the slow lock or prefault can be done
+	// elsewhere: PrepareBuffer creates and maps the next buffer (not yet seen
+	// by clients), LockOrTouch(BufferBase(),BufferSize()) is then safe from
+	// any thread, and its result passed to Prefaulted. NumBuffers(n) commits.
+	unsigned PrepareBuffer(void); // returns its bufNum
+	bool Pending(void) const { return headerVec.size()>numBuffers; }
+	void Prefaulted(int lockErrs) { pendingLockErrs = lockErrs; }
+	void* BufferBase(unsigned bufNum) const { return headerVec[bufNum]; }
+	size_t BufferSize(void) const { return bufSize; }
+	int LockOrTouch(const void* addr, size_t len) const;
+
+	// return an idle slab's memory to the OS (for every mapping), or get it
+	// back (locked if possible) before it is used, both return 0 on success
+	int ReclaimSlab(uint32_t slabID);
+	int WarmSlab(uint32_t slabID);
 
 	ShmHeader* GetShmHeader(unsigned bufNum) const { return headerVec[bufNum]; }
 	BlockInfo* GetBlockInfo(unsigned blockID) const {
 		ldiv_t result = ldiv(blockID,numBlocks);
-		return infoVec[result.quot] + result.rem;
+		return (BlockInfo*)(infoVec[result.quot] + result.rem*infoStride);
 	}
 	char* GetBlockPtr(unsigned blockID) const;
 
 	const char* ShmNameFormat(void) const { return nameFormat.c_str(); }
 
 	uint32_t TotalNumBlocks(void) const
-		{ return headerVec.size()*numBlocks; }
+		{ return numBuffers*numBlocks; }
 	uint32_t TotalNumSlabs(void) const
 		{ return TotalNumBlocks()/BlocksPerSlab(); }
 	uint32_t BlocksPerSlab(void) const
 		{ return slabSize/blockSize; }
 	unsigned LockErrors(void) const
 		{ return lockErrors; }
+	uint32_t MaxNumBuffers(void) const
+		{ return maxNumBuffers; }
+	uint32_t PageSize(void) const
+		{ return pageSize; }
+	int BufferNode(unsigned bufNum) const // -1 if not bound
+		{ return bufferNodes[bufNum]; }
+	bool Anonymous(void) const
+		{ return anonymous; }
+	int BufferFD(unsigned bufNum) const // only if Anonymous()
+		{ return bufferFDs[bufNum]; }
 
   protected:
 	std::string nameFormat;
 	bool force;
 	uint32_t blockSize;
+	uint32_t largeBlockSize; // page-aligned class, when blockSize is smaller
 	uint32_t slabSize;
 	uint32_t numBlocks; // in a single buffer
 	size_t bufSize;     // of a single buffer
 	uint32_t maxNumBuffers;
+	uint32_t pageSize;
+	uint32_t infoStride;
+	unsigned numaNodes;
+	std::vector<int> bufferNodes;
+	bool anonymous;
+	std::vector<int> bufferFDs; // kept open to pass to clients
 	std::vector<ShmHeader*> headerVec; // of length numBuffers
-	std::vector<BlockInfo*> infoVec;
+	std::vector<char*> infoVec;
 	std::vector<char*> blockVec;
+	unsigned numBuffers; // committed, of the headerVec.size() mapped
+	int pendingLockErrs; // <0 until the pending buffer is prefaulted
 	unsigned lockErrors;
 	
 	int OpenShm(unsigned bufNum, std::string& shmName) const;
+	int CreateMemfd(unsigned bufNum, std::string& shmName) const;
 	void CreateAndMap(unsigned bufNum);
-	int LockOrTouch(const void* addr, size_t len) const;
+	void Commit(void);
+	bool SlabPages(uint32_t slabID, char*& addr, size_t& len) const;
+	int BindToNode(void* addr, size_t len, unsigned node) const;
 };
 
 } // namespace MCSB
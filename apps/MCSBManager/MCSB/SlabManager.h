@@ -34,6 +34,11 @@ class SlabManager { // keeps track of slabs and slab states for the manager
 	unsigned NumBuffers(void) const { return infoVec.size(); }
 	unsigned NumSlabs(void) const { return slabsPerBuf*NumBuffers(); }
 
+	enum { kMaxNumaNodes = 8 };
+	// the NUMA node a buffer's memory is on, so its free slabs can go
+	// to producers on that node (node<0 or out of range is node 0)
+	void SetBufferNode(unsigned bufNum, int node);
+
 	int GetSlabReservation(unsigned numSlabs);
 	int ReleaseSlabReservation(unsigned numSlabs);
 	uint32_t NumSlabsReserved(void) const { return numSlabsReserved; }
@@ -42,20 +47,34 @@ class SlabManager { // keeps track of slabs and slab states for the manager
 	class SlabInfo;
 	SlabInfo& GetSlabInfo(unsigned slabID) const;
 
+	// slabs on the producer's NUMA node are preferred, if it is known
 	unsigned GetFreeSlabs(uint32_t slabIDs[], unsigned mxcount,
-		int prodClientID=-1, void* prodArg=0);
+		int prodClientID=-1, void* prodArg=0, int prodNode=-1);
 	void IncrementHeldRefcnt(const uint32_t slabIDs[], unsigned count);
 	void DecrementHeldRefcnt(const uint32_t slabIDs[], unsigned count,
 		const unsigned amounts[] = 0); // if null, decrement by 1
 	WantedSegment& GetWantedSegment(uint16_t clientID, uint32_t blockID,
-		uint32_t slabID);
+		uint32_t slabID, unsigned dropPriority=kDefaultDropPriority);
 	void ReleaseWantedSegment(WantedSegment& seg, uint32_t slabID);
 
 	WantedSegment& FrontWantedSegment(void); // to free wanted slabs, see impl
 
-	size_t NumFreeSlabs(void) const { return freeSlabs.size(); }
+	// free slabs are given out most recently freed first, so the rest go
+	// idle: Tick advances the clock, GetIdleSlabs marks up to mxcount that
+	// have been free for idleTicks cold (their memory can be returned to the
+	// OS), and Warm is true (once) for a cold slab after it is given out
+	void Tick(void) { ticks++; }
+	unsigned GetIdleSlabs(uint32_t slabIDs[], unsigned mxcount, uint32_t idleTicks);
+	bool Warm(uint32_t slabID);
+	size_t NumColdSlabs(void) const { return numColdSlabs; }
+
+	size_t NumFreeSlabs(void) const { return numFreeSlabs; }
+	size_t NumFreeSlabs(unsigned node) const
+		{ return freeSlabs[node].size(); }
 	size_t NumHeldSlabs(void) const { return heldSlabs.size(); }
-	size_t NumWantedSlabs(void) const { return wantedSlabs.size(); }
+	size_t NumWantedSlabs(void) const { return numWantedSlabs; }
+	size_t NumWantedSlabs(unsigned dropPriority) const
+		{ return wantedSlabs[dropPriority].size(); }
 
 	enum { kFreeToHeld=1, /*kFreeToWanted=2,*/ kHeldToFree=4,
 		kHeldToWanted=8, kWantedToFree=16, kWantedToHeld=32 };
@@ -79,11 +98,21 @@ class SlabManager { // keeps track of slabs and slab states for the manager
 	std::vector<SlabInfo*> infoVec; // of length numBuffers
 
 	typedef IntrusiveList<SlabInfo> SlabList;
-	SlabList freeSlabs;
+	SlabList freeSlabs[kMaxNumaNodes]; // by the node of their buffer
+	size_t numFreeSlabs;
+	size_t numColdSlabs;
+	uint32_t ticks;
 	SlabList heldSlabs;
-	SlabList wantedSlabs;
+	// a wanted slab is listed by the highest drop priority it holds
+	SlabList wantedSlabs[kNumDropPriorities];
+	size_t numWantedSlabs;
 	WantedSegmentMgrList freeWantedSegs;
 
+	void PushFreeSlab(SlabInfo& slab, bool atFront=false);
+	void PushWantedSlab(SlabInfo& slab, bool atFront=false);
+	void EraseWantedSlab(SlabInfo& slab);
+	void UpdateWantedSlab(SlabInfo& slab); // its drop priority may have changed
+
 	std::pair<SlabStateChangeHandler,void*> slabStateChangeHandler;
 	int whichStateChange;
 	template <class T, void (T::*SlabStateChangeHandlerMethod)(int, const SlabInfo&)>
@@ -106,18 +135,33 @@ class SlabManager::SlabInfo : public IntrusiveList<SlabInfo>::Hook {
 	int prodClientID;    // assigned when slab is given to a producer
 	void* prodArg;
 	WantedSegmentMgrList wantedSegs;
+	uint32_t wantedByPriority[kNumDropPriorities];
+	unsigned wantedList; // index into SlabManager::wantedSlabs
+	unsigned node; // index into SlabManager::freeSlabs
+	uint32_t freedAt; // SlabManager::ticks
+	bool cold;
+	friend class SlabManager;
   public:
 	SlabInfo(unsigned id):
-		slabID(id), heldRefcnt(0) { SetProducerParams(); }
+		slabID(id), heldRefcnt(0), wantedList(0), node(0), freedAt(0), cold(0) {
+		SetProducerParams();
+		for (unsigned i=0; i<kNumDropPriorities; i++) wantedByPriority[i] = 0;
+	}
 	unsigned SlabID(void) const { return slabID; }
+	unsigned Node(void) const { return node; }
+	bool Cold(void) const { return cold; }
 	void GetFreeSlab(void);
 	uint32_t Held(void) const { return heldRefcnt; }
 	uint32_t IncrementHeld(void) { return heldRefcnt++; }
 	uint32_t DecrementHeld(unsigned amount=1);
 	uint32_t Wanted(void) const { return wantedSegs.size(); }
 	void Erase(WantedSegment& seg);
-	void Push(WantedSegment& seg) { wantedSegs.push_back(seg); };
+	void Push(WantedSegment& seg) {
+		wantedSegs.push_back(seg);
+		wantedByPriority[seg.DropPriority()]++;
+	}
 	WantedSegment& FrontWantedSegment(void) { return wantedSegs.front(); }
+	unsigned WantedDropPriority(void) const; // the highest it holds
 	void SetProducerParams(int clientID=-1, void* arg=0);
 };
 
@@ -0,0 +1,228 @@
+//=============================================================================
+//	This file is part of MCSB, the Multi-Client Shared Buffer
+//	Copyright (C) 2014  Gregory E. Allen and
+//		Applied Research Laboratories: The University of Texas at Austin
+//
+//	MCSB is free software: you can redistribute it and/or modify it
+//	under the terms of the GNU Lesser General Public License as published
+//	by the Free Software Foundation, either version 2.1 of the License, or
+//	(at your option) any later version.
+//
+//	MCSB is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+//	Lesser General Public License <http://www.gnu.org/licenses/lgpl.html>
+//	for more details.
+//=============================================================================
+
+#ifndef MCSB_SubscriptionIndex_h
+#define MCSB_SubscriptionIndex_h
+#pragma once
+
+#include <stdint.h>
+#include <map>
+#include <vector>
+#include <algorithm>
+
+namespace MCSB {
+
+//-----------------------------------------------------------------------------
+// SubscriptionIndex maps a msgID to the subscribers registered for it, so
+// the manager can route a segment to only those clients that want it
+//
+// Range subscriptions are kept separately as elementary intervals: the map
+// is keyed by the first msgID of each interval, and every msgID up to the
+// next key has the same (sorted) subscriber list. A lookup is one
+// upper_bound, regardless of how wide the ranges are.
+//-----------------------------------------------------------------------------
+
+template <typename T>
+class SubscriptionIndex {
+  public:
+	typedef std::vector<T*> SubscriberList;
+
+	// returns true if sub was not already subscribed to msgID
+	bool Subscribe(uint32_t msgID, T* sub);
+	// returns true if sub was subscribed to msgID
+	bool Unsubscribe(uint32_t msgID, T* sub);
+	// returns null if there are no subscribers
+	const SubscriberList* Subscribers(uint32_t msgID) const;
+
+	// returns true if sub was not already subscribed to all of [first,last]
+	bool SubscribeRange(uint32_t first, uint32_t last, T* sub);
+	// returns true if sub was subscribed to any of [first,last]
+	bool UnsubscribeRange(uint32_t first, uint32_t last, T* sub);
+	// returns null if there are no range subscribers
+	const SubscriberList* RangeSubscribers(uint32_t msgID) const;
+
+	size_t NumMsgIDs(void) const { return subscribers.size(); }
+	size_t NumRangeIntervals(void) const { return ranges.size(); }
+	size_t NumSubscribers(uint32_t msgID) const {
+		const SubscriberList* subs = Subscribers(msgID);
+		return subs ? subs->size() : 0;
+	}
+
+  protected:
+	typedef std::map<uint32_t,SubscriberList> SubscriberMap;
+	SubscriberMap subscribers;
+	SubscriberMap ranges;
+
+	typename SubscriberMap::iterator SplitRangeAt(uint64_t msgID);
+	void CoalesceRanges(uint32_t first, uint64_t end);
+};
+
+//-----------------------------------------------------------------------------
+template <typename T>
+bool SubscriptionIndex<T>::Subscribe(uint32_t msgID, T* sub)
+//-----------------------------------------------------------------------------
+{
+	SubscriberList& subs = subscribers[msgID];
+	if (std::find(subs.begin(),subs.end(),sub)!=subs.end())
+		return false;
+	subs.push_back(sub);
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+template <typename T>
+bool SubscriptionIndex<T>::Unsubscribe(uint32_t msgID, T* sub)
+//-----------------------------------------------------------------------------
+{
+	typename SubscriberMap::iterator it = subscribers.find(msgID);
+	if (it==subscribers.end())
+		return false;
+	SubscriberList& subs = it->second;
+	typename SubscriberList::iterator sit = std::find(subs.begin(),subs.end(),sub);
+	if (sit==subs.end())
+		return false;
+	// order among subscribers is not significant, swap with the back
+	*sit = subs.back();
+	subs.pop_back();
+	if (subs.empty())
+		subscribers.erase(it);
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+template <typename T>
+const typename SubscriptionIndex<T>::SubscriberList*
+	SubscriptionIndex<T>::Subscribers(uint32_t msgID) const
+//-----------------------------------------------------------------------------
+{
+	typename SubscriberMap::const_iterator it = subscribers.find(msgID);
+	if (it==subscribers.end())
+		return 0;
+	return &it->second;
+}
+
+//-----------------------------------------------------------------------------
+template <typename T>
+typename SubscriptionIndex<T>::SubscriberMap::iterator
+	SubscriptionIndex<T>::SplitRangeAt(uint64_t msgID)
+//-----------------------------------------------------------------------------
+{
+	// make msgID the start of an interval, returns end() past the last msgID
+	if (msgID>0xFFFFFFFFull)
+		return ranges.end();
+	typename SubscriberMap::iterator it = ranges.lower_bound(msgID);
+	if (it!=ranges.end() && it->first==msgID)
+		return it;
+	if (it==ranges.begin())
+		return ranges.insert(it,std::make_pair(uint32_t(msgID),SubscriberList()));
+	typename SubscriberMap::iterator prev = it;
+	--prev;
+	return ranges.insert(it,std::make_pair(uint32_t(msgID),prev->second));
+}
+
+//-----------------------------------------------------------------------------
+template <typename T>
+void SubscriptionIndex<T>::CoalesceRanges(uint32_t first, uint64_t end)
+//-----------------------------------------------------------------------------
+{
+	// merge equal neighbors from the interval before first to the one at end
+	typename SubscriberMap::iterator it = ranges.lower_bound(first);
+	if (it!=ranges.begin()) --it;
+	while (it!=ranges.end()) {
+		typename SubscriberMap::iterator next = it;
+		++next;
+		if (it==ranges.begin() && it->second.empty()) {
+			ranges.erase(it);
+			it = next;
+			continue;
+		}
+		if (next==ranges.end())
+			break;
+		if (next->second==it->second) {
+			ranges.erase(next);
+			continue;
+		}
+		if (next->first>end)
+			break;
+		it = next;
+	}
+}
+
+//-----------------------------------------------------------------------------
+template <typename T>
+bool SubscriptionIndex<T>::SubscribeRange(uint32_t first, uint32_t last, T* sub)
+//-----------------------------------------------------------------------------
+{
+	if (first>last)
+		return false;
+	typename SubscriberMap::iterator it = SplitRangeAt(first);
+	typename SubscriberMap::iterator end = SplitRangeAt(uint64_t(last)+1);
+	bool added = false;
+	for (; it!=end; ++it) {
+		SubscriberList& subs = it->second;
+		typename SubscriberList::iterator sit =
+			std::lower_bound(subs.begin(),subs.end(),sub);
+		if (sit!=subs.end() && *sit==sub)
+			continue;
+		subs.insert(sit,sub);
+		added = true;
+	}
+	CoalesceRanges(first,uint64_t(last)+1);
+	return added;
+}
+
+//-----------------------------------------------------------------------------
+template <typename T>
+bool SubscriptionIndex<T>::UnsubscribeRange(uint32_t first, uint32_t last, T* sub)
+//-----------------------------------------------------------------------------
+{
+	if (first>last || ranges.empty())
+		return false;
+	typename SubscriberMap::iterator it = SplitRangeAt(first);
+	typename SubscriberMap::iterator end = SplitRangeAt(uint64_t(last)+1);
+	bool removed = false;
+	for (; it!=end; ++it) {
+		SubscriberList& subs = it->second;
+		typename SubscriberList::iterator sit =
+			std::lower_bound(subs.begin(),subs.end(),sub);
+		if (sit==subs.end() || *sit!=sub)
+			continue;
+		subs.erase(sit);
+		removed = true;
+	}
+	CoalesceRanges(first,uint64_t(last)+1);
+	return removed;
+}
+
+//-----------------------------------------------------------------------------
+template <typename T>
+const typename SubscriptionIndex<T>::SubscriberList*
+	SubscriptionIndex<T>::RangeSubscribers(uint32_t msgID) const
+//-----------------------------------------------------------------------------
+{
+	typename SubscriberMap::const_iterator it = ranges.upper_bound(msgID);
+	if (it==ranges.begin())
+		return 0;
+	--it;
+	if (it->second.empty())
+		return 0;
+	return &it->second;
+}
+
+} // namespace MCSB
+
+#endif
@@ -0,0 +1,63 @@
+//=============================================================================
+//	This file is part of MCSB, the Multi-Client Shared Buffer
+//	Copyright (C) 2014  Gregory E. Allen and
+//		Applied Research Laboratories: The University of Texas at Austin
+//
+//	MCSB is free software: you can redistribute it and/or modify it
+//	under the terms of the GNU Lesser General Public License as published
+//	by the Free Software Foundation, either version 2.1 of the License, or
+//	(at your option) any later version.
+//
+//	MCSB is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+//	Lesser General Public License <http://www.gnu.org/licenses/lgpl.html>
+//	for more details.
+//=============================================================================
+
+#ifndef MCSB_WantedQueueBound_h
+#define MCSB_WantedQueueBound_h
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+
+namespace MCSB {
+
+//-----------------------------------------------------------------------------
+// WantedQueueBound limits how many segments may wait for a client before
+// the Manager starts dropping them. With a latency budget, the limit is the
+// number of segments the client is measured to drain in that many seconds,
+// so fast consumers can absorb bursts and slow ones shed early. Without
+// one, the limit is a fixed kDefaultSegs. A byte budget applies either way.
+//-----------------------------------------------------------------------------
+
+class WantedQueueBound {
+  public:
+	enum { kDefaultSegs = 1024, kMinSegs = 16, kMaxSegs = 1<<20 };
+	WantedQueueBound(void);
+
+	// latency<=0 is a fixed kDefaultSegs, maxBytes==0 is no byte budget
+	void SetBudget(float latency, uint64_t maxBytes);
+	// sentSegs is the total delivered to the client so far, and
+	// backlogged whether segments were waiting for it meanwhile
+	void Update(uint64_t sentSegs, bool backlogged, double now);
+	bool Exceeded(size_t segs, uint64_t bytes) const
+		{ return segs>maxSegs || (maxBytes && bytes>maxBytes); }
+
+	unsigned MaxSegs(void) const { return maxSegs; }
+	uint64_t MaxBytes(void) const { return maxBytes; }
+	double DrainRate(void) const { return drainRate; } // segs/sec
+
+  protected:
+	float latency;
+	uint64_t maxBytes;
+	unsigned maxSegs;
+	double drainRate;
+	double sampleTime;
+	uint64_t sampleSegs;
+};
+
+} // namespace MCSB
+
+#endif
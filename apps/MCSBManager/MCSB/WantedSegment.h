@@ -24,18 +24,23 @@
 
 namespace MCSB {
 
+// harvesting drops wanted segments of lower drop priority first
+enum { kNumDropPriorities = 4, kDefaultDropPriority = 1 };
+
 class WantedSegment :
 	public IntrusiveList<WantedSegment>::Hook,
 	public IntrusiveList<WantedSegment,int>::Hook
 {
   public:
-	WantedSegment(void): clientID(-1), blockID(-1) {}
+	WantedSegment(void): clientID(-1), dropPriority(0), blockID(-1) {}
 
 	uint16_t ClientID(void) const { return clientID; }
 	uint32_t BlockID(void) const { return blockID; }
+	unsigned DropPriority(void) const { return dropPriority; }
 
   protected:
 	uint16_t clientID; // of the client wanting this segment
+	uint8_t dropPriority;
 	uint32_t blockID;  // of the segment
 	friend class SlabManager;
 };
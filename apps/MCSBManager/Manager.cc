@@ -17,11 +17,15 @@
 
 #include "MCSB/Manager.h"
 #include "MCSB/ClientProxy.h"
+#include "MCSB/BufferGrower.h"
+#include "MCSB/SendFlusher.h"
+#include "MCSB/CCIHeader.h"
 
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <stdexcept>
+#include <errno.h>
 
 
 namespace MCSB {
@@ -32,15 +36,23 @@ Manager* Manager::theManager=0;
 Manager::Manager(const ManagerParams& p, ev::loop_ref loop_)
 //-----------------------------------------------------------------------------
 :	SocketDaemon(loop_, p.ctrlSockName.c_str(),p.verbosity,p.force,p.maxNumClients,p.backlog),
-	shmMapper(p.shmNameFmt.c_str(),p.force,p.blockSize,p.slabSize,p.numBlocks,p.maxNumBuffers),
+	shmMapper(p.shmNameFmt.c_str(),p.force,p.IDBlockSize(),p.slabSize,p.numBlocks,p.maxNumBuffers,
+		p.hugePageSize,p.numaNodes,p.memfdBuffers,p.blockSize),
 	slabManager(p.SlabsPerBuffer(),p.numBuffers,p.nonrsrvblePct),
+	proxySlots(kMaxClientID),
 	allowUnlockedMemory(p.allowUnlockedMemory), playbackMode(p.playbackMode),
-	sigintCount(0), loop(loop_), sigintWatcher(loop), sigtermWatcher(loop),
+	sendFlusher(0), bufferGrower(0), growAheadSlabs(0),
+	reclaimIdleSecs(p.reclaimIdleSecs), sigintCount(0), loop(loop_),
+	sigintWatcher(loop), sigtermWatcher(loop),
 	timerWatcher(loop), idleWatcher(loop)
 {
 	theManager = this;
 	statsIter = clients.end();
 	blocksPerSlab = shmMapper.BlocksPerSlab();
+	for (unsigned i=0; i<p.dropPriorities.size(); i++) {
+		const ManagerParams::DropPriority& dp = p.dropPriorities[i];
+		dropPriorities.Set(dp.first,dp.last,dp.priority);
+	}
 	int which = SlabManager::kHeldToFree | SlabManager::kWantedToFree;
 	slabManager.SetSlabStateChangeHandler<Manager,
 		&Manager::HandleSlabStateChange>(this,which);
@@ -55,12 +67,19 @@ Manager::Manager(const ManagerParams& p, ev::loop_ref loop_)
 	signal(SIGSEGV,HandleFatalSignal);
 	signal(SIGBUS,HandleFatalSignal);
 	IncreaseNumBuffers(p.numBuffers);
+	growAheadSlabs = uint32_t(p.SlabsPerBuffer()*p.growAheadPct/100 + .5);
+	if (growAheadSlabs && p.maxNumBuffers>p.numBuffers)
+		bufferGrower = new BufferGrower(this,loop);
+
+	sendFlusher = new SendFlusher(this,loop);
 }
 
 //-----------------------------------------------------------------------------
 Manager::~Manager(void)
 //-----------------------------------------------------------------------------
 {
+	delete bufferGrower;
+	delete sendFlusher;
 }
 
 //-----------------------------------------------------------------------------
@@ -77,6 +96,8 @@ int Manager::GetSlabReservation(unsigned numSlabs)
 		dbprintf(kNotice,"# Manager::GetSlabReservation is denying a request for %d slabs\n", numSlabs);
 		break;
 	}
+	if (!failed)
+		GrowBuffersAhead();
 	return failed;
 }
 
@@ -87,7 +108,9 @@ void Manager::RequestFreeSlabs(unsigned numSlabs, ClientProxy* proxy, int niceLe
 	niceLevel += playbackMode;
 	if (niceLevel) {
 		// all nice free slabs go through the slabRqstManager
-		slabRqstManager.AddRequest(niceLevel,numSlabs,proxy->ClientID(),proxy);
+		ClientSlotTable<ClientProxy>::Handle handle =
+			proxySlots.GetHandle(proxy->ClientID());
+		slabRqstManager.AddRequest(niceLevel,numSlabs,handle,proxy);
 		ServiceSlabRequests();
 		return;
 	}
@@ -99,7 +122,9 @@ void Manager::RequestFreeSlabs(unsigned numSlabs, ClientProxy* proxy, int niceLe
 		count = numSlabs-NumFreeSlabs();
 	// this causes dropped wanted segments
 	HarvestWantedSlabs(count);
-	unsigned slabsGiven = slabManager.GetFreeSlabs(freeSlabIDs,numSlabs);
+	unsigned slabsGiven = slabManager.GetFreeSlabs(freeSlabIDs,numSlabs,
+		-1,0,proxy->NumaNode());
+	WarmSlabs(freeSlabIDs,slabsGiven);
 	proxy->TakeFreeSlabs(freeSlabIDs,slabsGiven);
 	if (slabsGiven!=numSlabs) {
 		// this is supposed to be guaranteed/enforced by reservation
@@ -118,20 +143,19 @@ void Manager::ServiceSlabRequests(void)
 		unsigned level = slabRqstManager.LowestLevelPending();
 		const SlabRequestManager::SlabRequest& req = slabRqstManager.FrontRequest(level);
 		slabRqstManager.PopFrontRequest(level);
-		// make sure clientID and clientProxy are still valid
-		int clientID = req.Id();
-		client_iter it = clients.find(clientID);
-		if (it==clients.end()) continue;
-		ClientProxy* proxy = dynamic_cast<ClientProxy*>(it->second);
+		// make sure the clientProxy is still valid
+		ClientSlotTable<ClientProxy>::Handle handle = req.Id();
+		ClientProxy* proxy = proxySlots.FindHandle(handle);
 		if (!proxy || proxy!=req.Arg()) continue;
 		// fulfill one slab of the request
 		uint32_t freeSlabID;
-		slabManager.GetFreeSlabs(&freeSlabID,1);
+		slabManager.GetFreeSlabs(&freeSlabID,1,-1,0,proxy->NumaNode());
+		WarmSlabs(&freeSlabID,1);
 		proxy->TakeFreeSlabs(&freeSlabID,1);
 		// do we need another request?
 		unsigned slabsPending = req.NumSlabs()-1;
 		if (slabsPending)
-			slabRqstManager.AddRequest(level,slabsPending,clientID,proxy);
+			slabRqstManager.AddRequest(level,slabsPending,handle,proxy);
 	}
 }
 
@@ -162,14 +186,12 @@ unsigned Manager::HarvestWantedSlabs(unsigned count)
 		// drop wantedSegments to increase freeSlabs
 		WantedSegment& seg = slabManager.FrontWantedSegment();
 		// erase from client's wantedQueue
-		client_iter it = clients.find(seg.ClientID());
-		if (it==clients.end()) {
+		ClientProxy* proxy = proxySlots.Find(seg.ClientID());
+		if (!proxy) {
 			dbprintf(kWarning,"%s: bad clientID %u\n",__PRETTY_FUNCTION__, seg.ClientID());
 			ReleaseWantedSegment(seg);
 			continue;
 		}
-		ClientProxy* proxy = dynamic_cast<ClientProxy*>(it->second);
-		if (!proxy) continue;
 		proxy->EraseWantedSegment(seg);
 	}
 
@@ -187,6 +209,9 @@ int Manager::IncreaseNumBuffers(unsigned newNumBuffers)
 	if (!newNumBuffers)
 		newNumBuffers = shmMapper.NumBuffers()+1;
 
+	// finish a buffer growing in the background, instead of making another
+	if (bufferGrower && bufferGrower->Busy())
+		shmMapper.Prefaulted(bufferGrower->Wait());
 	shmMapper.NumBuffers(newNumBuffers);
 	if (shmMapper.NumBuffers()!=newNumBuffers) return -1;
 
@@ -200,15 +225,91 @@ int Manager::IncreaseNumBuffers(unsigned newNumBuffers)
 	dbprintf(kNotice,"- Manager now using %d buffer%s\n", newNumBuffers,
 		newNumBuffers>1?"s":"");
 	slabManager.NumBuffers(newNumBuffers);
+	for (unsigned i=0; i<newNumBuffers; i++) {
+		slabManager.SetBufferNode(i,shmMapper.BufferNode(i));
+	}
 	// tell each client
-	for (client_iter i=clients.begin(); i!=clients.end(); ++i) {
-		ClientProxy* proxy = dynamic_cast<ClientProxy*>(i->second);
-		if (!proxy) continue;
-		proxy->CheckBufferParams();
+	for (unsigned i=0; i<proxySlots.size(); i++) {
+		proxySlots[i]->CheckBufferParams();
 	}
 	return 0;
 }
 
+//-----------------------------------------------------------------------------
+void Manager::GrowBuffersAhead(void)
+// prepare the next buffer, to be prefaulted in the background, when the
+// unreserved slabs fall below the watermark (before a reservation fails)
+//-----------------------------------------------------------------------------
+{
+	if (!bufferGrower || bufferGrower->Busy() || shmMapper.Pending())
+		return;
+	if (shmMapper.NumBuffers()>=shmMapper.MaxNumBuffers())
+		return;
+	uint32_t unavailable = slabManager.NumSlabsReserved()
+		+ slabManager.NumSlabsNonreservable();
+	if (slabManager.NumSlabs()>=unavailable+growAheadSlabs)
+		return;
+	try {
+		unsigned bufNum = shmMapper.PrepareBuffer();
+		dbprintf(kInfo,"- Manager growing buffer %u in the background\n", bufNum);
+		bufferGrower->Prefault(shmMapper.BufferBase(bufNum),shmMapper.BufferSize());
+	} catch (std::runtime_error err) {
+		// don't try again for every reservation, growth on demand remains
+		dbprintf(kNotice,"# Manager unable to grow buffers ahead: %s\n", err.what());
+		growAheadSlabs = 0;
+	}
+}
+
+//-----------------------------------------------------------------------------
+void Manager::BufferGrown(void)
+// a buffer prefaulted in the background is ready, so its slabs join
+//-----------------------------------------------------------------------------
+{
+	if (!bufferGrower->Busy())
+		return; // IncreaseNumBuffers already waited for it
+	try {
+		IncreaseNumBuffers(shmMapper.NumBuffers()+1);
+	} catch (std::runtime_error err) {
+		dbprintf(kError,"# Manager growing buffers: %s\n", err.what());
+		return;
+	}
+	ServiceSlabRequests();
+	GrowBuffersAhead();
+}
+
+//-----------------------------------------------------------------------------
+void Manager::ReclaimIdleSlabs(void)
+// once per second, return the memory of slabs free for reclaimIdleSecs
+//-----------------------------------------------------------------------------
+{
+	slabManager.Tick();
+	uint32_t slabIDs[64];
+	unsigned count = slabManager.GetIdleSlabs(slabIDs,64,reclaimIdleSecs);
+	for (unsigned i=0; i<count; i++) {
+		if (!shmMapper.ReclaimSlab(slabIDs[i])) continue;
+		dbprintf(kNotice,"# Manager unable to return idle slab memory, not trying again: %s\n",
+			strerror(errno));
+		WarmSlabs(slabIDs+i,count-i); // only un-marks them
+		reclaimIdleSecs = 0;
+		return;
+	}
+	if (count) {
+		dbprintf(kInfo,"- Manager returned %u idle slab(s) to the OS, %u are cold\n",
+			count, (unsigned)slabManager.NumColdSlabs());
+	}
+}
+
+//-----------------------------------------------------------------------------
+void Manager::WarmSlabs(const uint32_t slabIDs[], unsigned count)
+// cold slabs given out get their memory back, before a producer faults on it
+//-----------------------------------------------------------------------------
+{
+	for (unsigned i=0; i<count; i++) {
+		if (slabManager.Warm(slabIDs[i]))
+			shmMapper.WarmSlab(slabIDs[i]);
+	}
+}
+
 //-----------------------------------------------------------------------------
 SocketDaemon::ClientProxy* Manager::CreateNewClientProxy(ev::loop_ref loop_,
 	int fd, ClientID clientID, SocketDaemon* daemon)
@@ -217,6 +318,8 @@ SocketDaemon::ClientProxy* Manager::CreateNewClientProxy(ev::loop_ref loop_,
 	dbprintf(kDebug, "%s\n", __PRETTY_FUNCTION__);
 	Manager::ClientProxy* newProxy = new Manager::ClientProxy(loop_,fd,clientID,daemon);
 	newProxy->Verbosity(Verbosity());
+	proxySlots.Insert(clientID,newProxy);
+	QueueFlush(newProxy); // what its ctor sent
 	return newProxy;
 }
 
@@ -229,30 +332,51 @@ int Manager::SendRegistration(uint32_t type, int16_t clientID, int16_t groupID,
 
 	// loop over the clients and send
 	int result = 0;
-	for (client_iter i=clients.begin(); i!=clients.end(); ++i) {
-		ClientProxy* proxy = dynamic_cast<ClientProxy*>(i->second);
-		if (!proxy || !proxy->WantRegistrations()) continue;
+	for (unsigned i=0; i<proxySlots.size(); i++) {
+		ClientProxy* proxy = proxySlots[i];
+		if (!proxy->WantRegistrations()) continue;
 		result += proxy->SendRegistration(type,clientID,groupID,msgIDs,count);
 	}
 	return result;
 }
 
 //-----------------------------------------------------------------------------
-void Manager::SendRegistrationsToFD(int fd)
+int Manager::SendRangeRegistration(bool reg, int16_t clientID, int16_t groupID,
+		const uint32_t firstLast[], unsigned numRanges)
+//-----------------------------------------------------------------------------
+{
+	dbprintf(kDebug,"%s\n",__PRETTY_FUNCTION__);
+
+	int result = 0;
+	for (unsigned i=0; i<proxySlots.size(); i++) {
+		ClientProxy* proxy = proxySlots[i];
+		if (!proxy->WantRegistrations()) continue;
+		result += proxy->SendRangeRegistration(reg,clientID,groupID,firstLast,numRanges);
+	}
+	return result;
+}
+
+//-----------------------------------------------------------------------------
+void Manager::SendRegistrationsTo(ClientProxy* requester)
 //-----------------------------------------------------------------------------
 {
 	dbprintf(kDebug,"%s\n",__PRETTY_FUNCTION__);
 	// loop over the clients and send
-	for (client_iter i=clients.begin(); i!=clients.end(); ++i) {
-		ClientProxy* proxy = dynamic_cast<ClientProxy*>(i->second);
-		if (!proxy) continue;
-		proxy->SendRegistrationsToFD(fd);
+	for (unsigned i=0; i<proxySlots.size(); i++) {
+		proxySlots[i]->SendRegistrationsTo(requester);
 	}
 }
 
+//-----------------------------------------------------------------------------
+void Manager::QueueFlush(ClientProxy* proxy)
+//-----------------------------------------------------------------------------
+{
+	sendFlusher->Queue(proxySlots.GetHandle(proxy->ClientID()));
+}
+
 //-----------------------------------------------------------------------------
 void Manager::TakeBlocksAndInfo(const uint32_t blockIDs[], const BlockInfo info[],
-	unsigned count, int16_t srcGroupID)
+	unsigned count, int16_t srcClientID, int16_t srcGroupID)
 // somebody sent these blocks as segments/messages
 //-----------------------------------------------------------------------------
 {
@@ -271,15 +395,60 @@ void Manager::TakeBlocksAndInfo(const uint32_t blockIDs[], const BlockInfo info[
 		stats.rcvdBytes += info[blk].size;
 	}
 	stats.rcvdSegs += count;
-	
-	// loop over the clients and send the segments
-	for (client_iter i=clients.begin(); i!=clients.end(); ++i) {
-		ClientProxy* proxy = dynamic_cast<ClientProxy*>(i->second);
-		if (!proxy || !proxy->Connected()) continue;
-		// don't send back to the same non-zero groupID
-		if (srcGroupID && srcGroupID==proxy->GroupID()) continue;
-		proxy->SendSegments(blockIDs,slabIDs,info,count);
+
+	// sort the segments to the proxies that want them
+	routedProxies.clear();
+	const SubscriptionIndex<ClientProxy>::SubscriberList* subs = 0;
+	const SubscriptionIndex<ClientProxy>::SubscriberList* rangeSubs = 0;
+	uint32_t subsMsgID = 0;
+	for (unsigned blk=0; blk<count; blk++) {
+		uint32_t msgID = info[blk].messageID;
+		if (msgID==kCCIMessageID) {
+			const char* blockPtr = shmMapper.GetBlockPtr(blockIDs[blk]);
+			uint32_t dstClientID = ((const CCIHeader*)blockPtr)->dstClientID;
+			if (dstClientID==kCCIBcastID) {
+				for (unsigned i=0; i<proxySlots.size(); i++) {
+					RouteSegment(proxySlots[i],blk,srcGroupID);
+				}
+			} else {
+				ClientProxy* proxy = proxySlots.Find(dstClientID);
+				if (proxy) RouteSegment(proxy,blk,srcGroupID);
+			}
+			continue;
+		}
+		// runs of segments usually share a msgID
+		if (!blk || msgID!=subsMsgID) {
+			subs = subscriptions.Subscribers(msgID);
+			rangeSubs = subscriptions.RangeSubscribers(msgID);
+			subsMsgID = msgID;
+		}
+		if (subs) {
+			for (unsigned i=0; i<subs->size(); i++) {
+				RouteSegment((*subs)[i],blk,srcGroupID);
+			}
+		}
+		if (rangeSubs) {
+			for (unsigned i=0; i<rangeSubs->size(); i++) {
+				RouteSegment((*rangeSubs)[i],blk,srcGroupID);
+			}
+		}
 	}
+
+	// send the segments to only those proxies
+	for (unsigned i=0; i<routedProxies.size(); i++) {
+		routedProxies[i]->SendRoutedSegments(blockIDs,slabIDs,info,srcClientID);
+	}
+}
+
+//-----------------------------------------------------------------------------
+void Manager::RouteSegment(ClientProxy* proxy, unsigned idx, int16_t srcGroupID)
+//-----------------------------------------------------------------------------
+{
+	if (!proxy->Connected()) return;
+	// don't send back to the same non-zero groupID
+	if (srcGroupID && srcGroupID==proxy->GroupID()) return;
+	if (proxy->RouteSegment(idx))
+		routedProxies.push_back(proxy);
 }
 
 //-----------------------------------------------------------------------------
@@ -330,6 +499,9 @@ void Manager::StaticHastyCleanup(void)
 void Manager::HandleTimer(void)
 //-----------------------------------------------------------------------------
 {
+	if (reclaimIdleSecs)
+		ReclaimIdleSlabs();
+
 	if (Verbosity()<=kNotice) return;
 	
 	stats.uptime = uptime();
@@ -341,6 +513,7 @@ void Manager::HandleTimer(void)
 	stats.numFreeSlabs = slabManager.NumFreeSlabs();
 	stats.numHeldSlabs = slabManager.NumHeldSlabs();
 	stats.numWantedSlabs = slabManager.NumWantedSlabs();
+	stats.numColdSlabs = slabManager.NumColdSlabs();
 	stats.Print(stderr);
 	
 	statsIter = clients.begin();
@@ -373,6 +546,7 @@ void Manager::ErasingClientHook(ClientID clientID,
 //-----------------------------------------------------------------------------
 {
 	dbprintf(kDebug,"%s\n",__PRETTY_FUNCTION__);
+	proxySlots.Erase(clientID);
 	if (statsIter==clients.end())
 		return;
 	// increment statsIter before the client gets erased
@@ -397,6 +571,7 @@ void ManagerStats::Print(FILE* file) const
 	fprintf(file,"  numFreeSlabs: %u\n", numFreeSlabs);
 	fprintf(file,"  numHeldSlabs: %u\n", numHeldSlabs);
 	fprintf(file,"  numWantedSlabs: %u\n", numWantedSlabs);
+	fprintf(file,"  numColdSlabs: %u\n", numColdSlabs);
 
 	fprintf(file,"  rcvdSegs: %llu\n", (unsigned long long)rcvdSegs);
 	fprintf(file,"  rcvdBytes: %llu\n", (unsigned long long)rcvdBytes);
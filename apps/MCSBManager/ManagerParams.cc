@@ -22,6 +22,9 @@
 #include "MCSB/ClientOptions.h"
 #include "MCSB/dbprinter.h"
 #include "MCSB/MCSBVersion.h"
+#include "MCSB/WantedSegment.h"
+#include "MCSB/ShmDefs.h"
+#include "MCSB/SlabManager.h"
 
 #include <unistd.h>
 #include <libgen.h>
@@ -34,6 +37,7 @@ extern const char* kHgRevision_MCSB;
 namespace MCSB {
 
 const char* kDefaultShmNameFormat = "/mcsb-%U.buf%02u";
+const char* kDefaultHugetlbfsDir = "/dev/hugepages";
 
 //-----------------------------------------------------------------------------
 ManagerParams::ManagerParams(void)
@@ -65,12 +69,19 @@ void ManagerParams::SetDefaults(void)
 	
 	ShmNameFmt(kDefaultShmNameFormat);
 	blockSize = kDefaultBlockSize;
+	smallBlockSize = 0;
 	slabSize = kDefaultSlabSize;
 	bufferSize = kDefaultBufferSize;
 	numBlocks = bufferSize/blockSize;
 	numBuffers = kDefaultNumBuffers;
 	maxNumBuffers = kDefaultMaxNumBuffers;
 	nonrsrvblePct = kDefaultNonrsrvblePct;
+	growAheadPct = kDefaultGrowAheadPct;
+	reclaimIdleSecs = 0;
+	hugePageSize = 0;
+	numaNodes = 0;
+	memfdBuffers = 0;
+	dropPriorities.clear();
 }
 
 //-----------------------------------------------------------------------------
@@ -82,7 +93,8 @@ int ManagerParams::Parse(int argc, char* const argv[])
 	optind = 1;
 	bool ctrlSockNameSet = 0;
 	bool shmNameFmtSet = 0;
-	while ((c = getopt(argc,argv,"c:m:fFps:S:b:n:N:r:vh?t")) != -1) {
+	ManagerParams::DropPriority dp;
+	while ((c = getopt(argc,argv,"c:m:fFps:B:S:b:n:N:r:g:I:P:H:M:Avh?t")) != -1) {
 		switch (c) {
 			case 'c':
 				ctrlSockName = ClientOptions::SubstituteUsername(optarg);
@@ -104,6 +116,9 @@ int ManagerParams::Parse(int argc, char* const argv[])
 			case 's':
 				blockSize = strtoul_po2suffix(optarg);
 				break;
+			case 'B':
+				smallBlockSize = strtoul_po2suffix(optarg);
+				break;
 			case 'S':
 				slabSize = strtoul_po2suffix(optarg);
 				break;
@@ -119,6 +134,29 @@ int ManagerParams::Parse(int argc, char* const argv[])
 			case 'r':
 				nonrsrvblePct = strtof(optarg,0);
 				break;
+			case 'g':
+				growAheadPct = strtof(optarg,0);
+				break;
+			case 'I':
+				reclaimIdleSecs = strtoul(optarg,0,0);
+				break;
+			case 'H':
+				hugePageSize = strtoul_po2suffix(optarg);
+				break;
+			case 'M':
+				numaNodes = strtoul(optarg,0,0);
+				break;
+			case 'A':
+				memfdBuffers = 1;
+				break;
+			case 'P':
+				if (!ParseDropPriority(optarg,dp)) {
+					fprintf(stderr, "invalid drop priority \"%s\"\n", optarg);
+					usage(argv[0]);
+					exit(-1);
+				}
+				dropPriorities.push_back(dp);
+				break;
 			case 'v':
 				verbosity++;
 				break;
@@ -151,12 +189,36 @@ int ManagerParams::Parse(int argc, char* const argv[])
 		shmNameFmt += shmNameBase;
 		shmNameFmt += ".buf%02u";
 	}
+	if (hugePageSize && !memfdBuffers && !ShmNameIsPath(shmNameFmt.c_str())) {
+		// huge pages come from files in a hugetlbfs mount
+		shmNameFmt = kDefaultHugetlbfsDir + shmNameFmt;
+	}
 
 	ParamCheck();
 	if (testAndExit) exit(0);
 	return 0;
 }
 
+//-----------------------------------------------------------------------------
+bool ManagerParams::ParseDropPriority(const char* str, DropPriority& dp)
+//	parses "first:priority" or "first-last:priority"
+//-----------------------------------------------------------------------------
+{
+	char* end;
+	dp.first = dp.last = strtoul(str,&end,0);
+	if (end==str) return 0;
+	if (*end=='-') {
+		str = end+1;
+		dp.last = strtoul(str,&end,0);
+		if (end==str) return 0;
+	}
+	if (*end!=':') return 0;
+	str = end+1;
+	dp.priority = strtoul(str,&end,0);
+	if (end==str || *end) return 0;
+	return dp.first<=dp.last && dp.priority<kNumDropPriorities;
+}
+
 //-----------------------------------------------------------------------------
 void ManagerParams::usage(const char* argv0)
 //-----------------------------------------------------------------------------
@@ -177,11 +239,22 @@ void ManagerParams::usage(const char* argv0)
 	fprintf(stderr, "  -F             proceed even if memory locking fails\n");
 	fprintf(stderr, "  -p             playback/non-realtime mode (don't drop blocks)\n");
 	fprintf(stderr, "  -s blockSize   smallest message size in bytes [%u]\n", kDefaultBlockSize);
+	fprintf(stderr, "  -B smallBlock  block size class for smaller messages, which are\n");
+	fprintf(stderr, "                 then not page-aligned, a power of 2 [0, off]\n");
 	fprintf(stderr, "  -S slabSize    largest contiguous message size in bytes [%u]\n", kDefaultSlabSize);
 	fprintf(stderr, "  -b bufferSize  shared memory mapping size in bytes [%u]\n", kDefaultBufferSize);
 	fprintf(stderr, "  -n numBuffers  initial number of buffers [%u]\n", kDefaultNumBuffers);
 	fprintf(stderr, "  -N maxNumBufs  numBuffers growable on demand to this max [%u]\n", kDefaultMaxNumBuffers);
 	fprintf(stderr, "  -r nonrsrvble  percent memory non-reservable by clients [%u%%]\n", kDefaultNonrsrvblePct);
+	fprintf(stderr, "  -g growAhead   grow a buffer in the background below this percent\n");
+	fprintf(stderr, "                 of a buffer's slabs unreserved, 0 for off [%u%%]\n", kDefaultGrowAheadPct);
+	fprintf(stderr, "  -I idleSecs    return memory of slabs free this long to the OS [0, off]\n");
+	fprintf(stderr, "  -H pageSize    back buffers with huge pages, e.g. 2M or 1G [off]\n");
+	fprintf(stderr, "                 (memNameFmt is then under %s unless a path)\n", kDefaultHugetlbfsDir);
+	fprintf(stderr, "  -M numaNodes   bind buffers round robin to NUMA nodes [0, off]\n");
+	fprintf(stderr, "  -A             anonymous (memfd) buffers, passed to clients as fds\n");
+	fprintf(stderr, "  -P mid[-mid]:p drop priority 0-%u of msgIDs, lowest dropped first [%u]\n",
+		kNumDropPriorities-1, kDefaultDropPriority);
 	fprintf(stderr, "  -v             increase verbosity [default %u]\n", kDefaultVerbosity);
 	fprintf(stderr, "  -h             this help\n");
 	fprintf(stderr, "MCSB Version %s", MCSB_VERSION);
@@ -210,6 +283,21 @@ void ManagerParams::ParamCheck(void)
 		p.dbprintf(lvl, "- rounding blockSize up to %u, or %u*pageSize\n", blockSize, pagesPerBlock);
 	}
 
+	if (hugePageSize && (hugePageSize<=pageSize || (hugePageSize&(hugePageSize-1)))) {
+		p.dbprintf(lvl, "- invalid hugePageSize %u, using normal pages\n", hugePageSize);
+		hugePageSize = 0;
+	}
+	if (hugePageSize && hugePageSize%blockSize) {
+		p.dbprintf(lvl, "- blockSize %u does not divide hugePageSize %u, using normal pages\n",
+			blockSize, hugePageSize);
+		hugePageSize = 0;
+	}
+	if (smallBlockSize && (smallBlockSize<kMinSmallBlockSize || smallBlockSize>=blockSize ||
+		(smallBlockSize&(smallBlockSize-1)) || blockSize%smallBlockSize)) {
+		p.dbprintf(lvl, "- invalid smallBlockSize %u, using only blockSize\n", smallBlockSize);
+		smallBlockSize = 0;
+	}
+
 	if (slabSize>INT32_MAX || !slabSize) {
 		slabSize = kDefaultSlabSize;
 		p.dbprintf(lvl, "- invalid slabSize set to default of %u\n", slabSize);
@@ -220,6 +308,15 @@ void ManagerParams::ParamCheck(void)
 		slabSize = blocksPerSlab*blockSize;
 		p.dbprintf(lvl, "- rounding slabSize up to %u, or %u*blockSize\n", slabSize, blocksPerSlab);
 	}
+	if (hugePageSize && slabSize>hugePageSize && slabSize%hugePageSize) {
+		// keep each slab on whole huge pages
+		slabSize = (slabSize/hugePageSize+1)*hugePageSize;
+		blocksPerSlab = slabSize/blockSize;
+		p.dbprintf(lvl, "- rounding slabSize up to %u, a multiple of hugePageSize\n", slabSize);
+	} else if (hugePageSize && slabSize<hugePageSize && hugePageSize%slabSize) {
+		p.dbprintf(lvl, "- slabSize %u does not divide hugePageSize %u, slabs will straddle huge pages\n",
+			slabSize, hugePageSize);
+	}
 
 	if (bufferSize>INT64_MAX || !bufferSize) {
 		bufferSize = kDefaultBufferSize;
@@ -232,7 +329,16 @@ void ManagerParams::ParamCheck(void)
 		p.dbprintf(lvl, "- rounding bufferSize up to %llu, or %u*slabSize\n",
 			(unsigned long long)bufferSize, slabsPerBuffer);
 	}
-	numBlocks = blocksPerSlab*slabsPerBuffer;
+	if (hugePageSize && bufferSize%hugePageSize) {
+		// whole huge pages, without wasting the remainder
+		while (bufferSize%hugePageSize) {
+			bufferSize += slabSize;
+			slabsPerBuffer++;
+		}
+		p.dbprintf(lvl, "- rounding bufferSize up to %llu, a multiple of hugePageSize\n",
+			(unsigned long long)bufferSize);
+	}
+	numBlocks = blocksPerSlab*slabsPerBuffer*(blockSize/IDBlockSize());
 	
 	unsigned kMaxNonrsrvblePct = 80;
 	if (nonrsrvblePct<0) {
@@ -242,6 +348,24 @@ void ManagerParams::ParamCheck(void)
 		nonrsrvblePct = kMaxNonrsrvblePct;
 		p.dbprintf(lvl, "- invalid nonrsrvblePct set to maximum of %g%%\n", nonrsrvblePct);
 	}
+	if (!(growAheadPct>=0 && growAheadPct<=100)) {
+		growAheadPct = kDefaultGrowAheadPct;
+		p.dbprintf(lvl, "- invalid growAheadPct set to default of %g%%\n", growAheadPct);
+	}
+
+	if (numaNodes>SlabManager::kMaxNumaNodes) {
+		numaNodes = SlabManager::kMaxNumaNodes;
+		p.dbprintf(lvl, "- invalid numaNodes set to maximum of %u\n", numaNodes);
+	}
+	if (numaNodes>1 && numBuffers<numaNodes) {
+		// a buffer on each node from the start
+		numBuffers = numaNodes;
+		p.dbprintf(lvl, "- increasing numBuffers to numaNodes (%u)\n", numBuffers);
+	}
+	if (numBuffers>maxNumBuffers) {
+		maxNumBuffers = numBuffers;
+		p.dbprintf(lvl, "- increasing maxNumBuffers to numBuffers (%u)\n", maxNumBuffers);
+	}
 
 	lvl = kInfo;
 	p.dbprintf(lvl, "ManagerParams:\n");
@@ -251,6 +375,7 @@ void ManagerParams::ParamCheck(void)
 	p.dbprintf(lvl, "  allowUnlockedMemory: %d\n", int(allowUnlockedMemory));
 	p.dbprintf(lvl, "  playbackMode: %d\n", int(playbackMode));
 	p.dbprintf(lvl, "  blockSize: %u\n", blockSize);
+	p.dbprintf(lvl, "  smallBlockSize: %u\n", smallBlockSize);
 	p.dbprintf(lvl, "  slabSize: %u\n", slabSize);
 	p.dbprintf(lvl, "  bufferSize: %llu\n", (unsigned long long)bufferSize);
 	p.dbprintf(lvl, "  numBlocks: %u\n", numBlocks);
@@ -259,6 +384,11 @@ void ManagerParams::ParamCheck(void)
 	p.dbprintf(lvl, "  numBuffers: %u\n", numBuffers);
 	p.dbprintf(lvl, "  maxNumBuffers: %u\n", maxNumBuffers);
 	p.dbprintf(lvl, "  nonrsrvblePct: %g\n", nonrsrvblePct);
+	p.dbprintf(lvl, "  growAheadPct: %g\n", growAheadPct);
+	p.dbprintf(lvl, "  reclaimIdleSecs: %u\n", reclaimIdleSecs);
+	p.dbprintf(lvl, "  hugePageSize: %u\n", hugePageSize);
+	p.dbprintf(lvl, "  numaNodes: %u\n", numaNodes);
+	p.dbprintf(lvl, "  memfdBuffers: %d\n", memfdBuffers);
 	p.dbprintf(lvl, "  verbosity: %d\n", verbosity);
 	p.dbprintf(lvl, "  maxNumClients: %u\n", maxNumClients);
 	p.dbprintf(lvl, "  backlog: %u\n", backlog);
@@ -0,0 +1,85 @@
+//=============================================================================
+//	This file is part of MCSB, the Multi-Client Shared Buffer
+//	Copyright (C) 2014  Gregory E. Allen and
+//		Applied Research Laboratories: The University of Texas at Austin
+//
+//	MCSB is free software: you can redistribute it and/or modify it
+//	under the terms of the GNU Lesser General Public License as published
+//	by the Free Software Foundation, either version 2.1 of the License, or
+//	(at your option) any later version.
+//
+//	MCSB is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+//	Lesser General Public License <http://www.gnu.org/licenses/lgpl.html>
+//	for more details.
+//=============================================================================
+#include "MCSB/MsgSampler.h"
+#include "MCSB/ShmDefs.h"
+
+namespace MCSB {
+
+//-----------------------------------------------------------------------------
+void MsgSampler::SetPolicy(uint32_t first, uint32_t last, uint32_t everyNth,
+	float maxRate)
+//-----------------------------------------------------------------------------
+{
+	for (unsigned i=0; i<policies.size(); i++) {
+		if (policies[i].first==first && policies[i].last==last) {
+			policies.erase(policies.begin()+i);
+			break;
+		}
+	}
+	if (everyNth>1 || maxRate>0) {
+		Policy policy = { first, last, everyNth ? everyNth : 1, maxRate };
+		policies.insert(policies.begin(),policy);
+	}
+	// states point into policies, and restart with the new policy
+	states.clear();
+}
+
+//-----------------------------------------------------------------------------
+bool MsgSampler::Keep(int16_t srcClientID, const BlockInfo& info, double now)
+//-----------------------------------------------------------------------------
+{
+	uint32_t msgID = info.messageID;
+	std::map<uint32_t,State>::iterator it = states.find(msgID);
+	if (it==states.end()) {
+		State state = { 0, 0, -1e30 };
+		for (unsigned i=0; i<policies.size(); i++) {
+			if (msgID>=policies[i].first && msgID<=policies[i].last) {
+				state.policy = &policies[i];
+				break;
+			}
+		}
+		if (!state.policy)
+			return true;
+		it = states.insert(std::make_pair(msgID,state)).first;
+	}
+	State& state = it->second;
+
+	bool multiSegment = !info.PackedBatch() && info.numSegments>1;
+	if (multiSegment && info.segmentNumber) {
+		std::map<MessageKey,bool>::iterator pit =
+			partials.find(MessageKey(srcClientID,msgID));
+		// segment 0 went by before this policy, so it was kept
+		if (pit==partials.end())
+			return true;
+		bool keep = pit->second;
+		if (info.segmentNumber+1>=info.numSegments)
+			partials.erase(pit);
+		return keep;
+	}
+
+	const Policy& policy = *state.policy;
+	bool keep = !(state.count++ % policy.everyNth);
+	if (keep && policy.maxRate>0)
+		keep = (now-state.lastKept)*policy.maxRate >= 1.;
+	if (keep)
+		state.lastKept = now;
+	if (multiSegment)
+		partials[MessageKey(srcClientID,msgID)] = keep;
+	return keep;
+}
+
+} // namespace MCSB
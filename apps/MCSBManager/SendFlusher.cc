@@ -0,0 +1,46 @@
+//=============================================================================
+//	This file is part of MCSB, the Multi-Client Shared Buffer
+//	Copyright (C) 2014  Gregory E. Allen and
+//		Applied Research Laboratories: The University of Texas at Austin
+//
+//	MCSB is free software: you can redistribute it and/or modify it
+//	under the terms of the GNU Lesser General Public License as published
+//	by the Free Software Foundation, either version 2.1 of the License, or
+//	(at your option) any later version.
+//
+//	MCSB is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+//	Lesser General Public License <http://www.gnu.org/licenses/lgpl.html>
+//	for more details.
+//=============================================================================
+
+#include "MCSB/SendFlusher.h"
+#include "MCSB/ClientProxy.h"
+
+namespace MCSB {
+
+//-----------------------------------------------------------------------------
+Manager::SendFlusher::SendFlusher(Manager* manager_, ev::loop_ref loop)
+//-----------------------------------------------------------------------------
+:	manager(manager_), check(loop)
+{
+	check.set<Manager::SendFlusher, &Manager::SendFlusher::HandleCheck>(this);
+	ev_set_priority(static_cast<ev_check*>(&check), EV_MINPRI);
+	check.start();
+}
+
+//-----------------------------------------------------------------------------
+void Manager::SendFlusher::HandleCheck(void)
+//-----------------------------------------------------------------------------
+{
+	for (unsigned i=0; i<pending.size(); i++) {
+		// the proxy may have been deleted since it was queued
+		ClientProxy* proxy = manager->proxySlots.FindHandle(pending[i]);
+		if (proxy)
+			proxy->FlushSends();
+	}
+	pending.clear();
+}
+
+} // namespace MCSB
@@ -28,19 +28,26 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 
 namespace MCSB {
 
 
 //-----------------------------------------------------------------------------
 ShmMapper::ShmMapper(const char* nameFmt, bool force_, uint32_t blkSz, uint32_t slbSz,
-	uint32_t numBlks, uint32_t mxNumBufs)
+	uint32_t numBlks, uint32_t mxNumBufs, uint32_t pgSz, unsigned numaNds, bool memfd,
+	uint32_t largeBlkSz)
 //-----------------------------------------------------------------------------
-:	nameFormat(nameFmt), force(force_), blockSize(blkSz), slabSize(slbSz),
-	numBlocks(numBlks), maxNumBuffers(mxNumBufs), lockErrors(0)
+:	nameFormat(nameFmt), force(force_), blockSize(blkSz), largeBlockSize(largeBlkSz), slabSize(slbSz),
+	numBlocks(numBlks), maxNumBuffers(mxNumBufs), numaNodes(numaNds),
+	anonymous(memfd), numBuffers(0), pendingLockErrs(-1), lockErrors(0)
 {
-	ShmHeader init(blkSz,slbSz,numBlks,0,mxNumBufs);
+	ShmHeader init(blkSz,slbSz,numBlks,0,mxNumBufs,pgSz,largeBlkSz);
 	bufSize = init.TotalBufferSize();
+	pageSize = init.pageSize;
+	infoStride = init.infoStride;
 }
 
 
@@ -52,9 +59,13 @@ ShmMapper::~ShmMapper(void)
 		if (munmap((void*)headerVec[bufNum],bufSize)) {
 			fprintf(stderr,"#-- munmap: %s\n", strerror(errno));
 		}
+		if (anonymous) {
+			close(bufferFDs[bufNum]); // freed when the clients have closed theirs
+			continue;
+		}
 		char shmName[100];
 		snprintf(shmName,sizeof(shmName),nameFormat.c_str(),bufNum);
-		if (shm_unlink(shmName)) {
+		if (ShmUnlink(shmName)) {
 			fprintf(stderr,"#-- shm_unlink \"%s\": %s\n", shmName, strerror(errno));
 		}
 	}
@@ -65,7 +76,7 @@ ShmMapper::~ShmMapper(void)
 unsigned ShmMapper::NumBuffers(unsigned n)
 //-----------------------------------------------------------------------------
 {
-	unsigned numBufs = headerVec.size();
+	unsigned numBufs = numBuffers;
 	if (n==numBufs)
 		return n; // no change
 	if (n>maxNumBuffers) {
@@ -77,12 +88,45 @@ unsigned ShmMapper::NumBuffers(unsigned n)
 		return n;
 	}
 	for (unsigned i=numBufs; i<n; i++) {
-		CreateAndMap(i);
+		if (!Pending())
+			CreateAndMap(i);
+		if (pendingLockErrs<0)
+			pendingLockErrs = LockOrTouch(headerVec[i],bufSize);
+		Commit();
 	}
 	return n;
 }
 
 
+//-----------------------------------------------------------------------------
+unsigned ShmMapper::PrepareBuffer(void)
+//-----------------------------------------------------------------------------
+{
+	if (Pending())
+		return numBuffers; // already prepared
+	if (numBuffers>=maxNumBuffers)
+		throw std::runtime_error("ShmMapper::PrepareBuffer beyond maxNumBuffers");
+	CreateAndMap(numBuffers);
+	pendingLockErrs = -1;
+	return numBuffers;
+}
+
+
+//-----------------------------------------------------------------------------
+void ShmMapper::Commit(void)
+// make the pending buffer visible, to clients that map up to numBuffers
+//-----------------------------------------------------------------------------
+{
+	assert(Pending() && pendingLockErrs>=0);
+	lockErrors += pendingLockErrs;
+	pendingLockErrs = -1;
+	numBuffers++;
+	for (unsigned i=0; i<numBuffers; i++) {
+		headerVec[i]->numBuffers = numBuffers;
+	}
+}
+
+
 //-----------------------------------------------------------------------------
 char* ShmMapper::GetBlockPtr(unsigned blockID) const
 //-----------------------------------------------------------------------------
@@ -103,7 +147,7 @@ int ShmMapper::OpenShm(unsigned bufNum, std::string& shmName) const
 	snprintf(name,sizeof(name),nameFormat.c_str(),bufNum);
 	shmName = name;
 
-	int shmFD = shm_open(name, O_RDWR|O_CREAT|O_EXCL, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+	int shmFD = ShmOpen(name, O_RDWR|O_CREAT|O_EXCL, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
 	if (shmFD<0) {
 		std::string err = "shm_open \"" + shmName + "\": ";
 		err += strerror(errno);
@@ -114,6 +158,39 @@ int ShmMapper::OpenShm(unsigned bufNum, std::string& shmName) const
 }
 
 
+//-----------------------------------------------------------------------------
+int ShmMapper::CreateMemfd(unsigned bufNum, std::string& shmName) const
+//-----------------------------------------------------------------------------
+{
+	char name[100];
+	snprintf(name,sizeof(name),nameFormat.c_str(),bufNum);
+	const char* base = strrchr(name,'/'); // memfd names can't contain '/'
+	shmName = base ? base+1 : name;
+
+#if defined(__linux__) && defined(SYS_memfd_create)
+	// from <linux/memfd.h>, not declared by older C libraries
+	enum { kMFD_CLOEXEC = 1, kMFD_ALLOW_SEALING = 2, kMFD_HUGETLB = 4,
+		kMFD_HUGE_SHIFT = 26 };
+	unsigned flags = kMFD_CLOEXEC|kMFD_ALLOW_SEALING;
+	if (pageSize!=uint32_t(getpagesize())) {
+		unsigned log2PageSize = 0;
+		while ((1U<<log2PageSize)<pageSize) log2PageSize++;
+		flags |= kMFD_HUGETLB | (log2PageSize<<kMFD_HUGE_SHIFT);
+	}
+	int shmFD = syscall(SYS_memfd_create, shmName.c_str(), flags);
+#else
+	int shmFD = -1;
+	errno = ENOSYS;
+#endif
+	if (shmFD<0) {
+		std::string err = "memfd_create \"" + shmName + "\": ";
+		err += strerror(errno);
+		throw std::runtime_error(err);
+	}
+	return shmFD;
+}
+
+
 //-----------------------------------------------------------------------------
 void ShmMapper::CreateAndMap(unsigned bufNum)
 //-----------------------------------------------------------------------------
@@ -125,12 +202,12 @@ void ShmMapper::CreateAndMap(unsigned bufNum)
 	int shmFD = -1;
 	std::string shmName;
 	try {
-		shmFD = OpenShm(bufNum,shmName);
+		shmFD = anonymous ? CreateMemfd(bufNum,shmName) : OpenShm(bufNum,shmName);
 	} catch (std::runtime_error err) {
-		if (!force) throw err;
+		if (anonymous || !force) throw err;
 		fprintf(stderr,"#-- %s\n", err.what());
 		fprintf(stderr,"--- force set, trying again\n");
-		if (shm_unlink(shmName.c_str())) {
+		if (ShmUnlink(shmName.c_str())) {
 			fprintf(stderr,"#-- shm_unlink %s error: %s\n", shmName.c_str(), strerror(errno));
 		}
 		shmFD = OpenShm(bufNum,shmName); // try again
@@ -139,48 +216,60 @@ void ShmMapper::CreateAndMap(unsigned bufNum)
 	// ftruncate to allocate zeros
 	if (ftruncate(shmFD,bufSize)) {
 		close(shmFD);
-		shm_unlink(shmName.c_str());
+		if (!anonymous) ShmUnlink(shmName.c_str());
 		std::string err = "ftruncate \"" + shmName + "\": ";
 		err += strerror(errno);
 		throw std::runtime_error(err);
 	}
 
-	// mmap it
-	void* shmBase = mmap(0, bufSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_NORESERVE, shmFD, 0); // whither NORESERVE?
+#ifdef F_ADD_SEALS
+	// clients can't resize it out from under the other mappings
+	if (anonymous && fcntl(shmFD, F_ADD_SEALS, F_SEAL_SHRINK|F_SEAL_GROW|F_SEAL_SEAL)) {
+		fprintf(stderr,"#-- unable to seal \"%s\": %s\n", shmName.c_str(), strerror(errno));
+	}
+#endif
+
+	// mmap it, reserving huge pages so a short pool fails here, not on a fault
+	int flags = MAP_SHARED;
+	if (pageSize==uint32_t(getpagesize()))
+		flags |= MAP_NORESERVE; // whither NORESERVE?
+	void* shmBase = mmap(0, bufSize, PROT_READ|PROT_WRITE, flags, shmFD, 0);
 	if (shmBase == MAP_FAILED) {
 		close(shmFD);
-		shm_unlink(shmName.c_str());
+		if (!anonymous) ShmUnlink(shmName.c_str());
 		std::string err = "mmap \"" + shmName + "\": ";
 		err += strerror(errno);
 		throw std::runtime_error(err);
 	}
 
-	if (close(shmFD)) {
+	if (anonymous) {
+		bufferFDs.push_back(shmFD);
+	} else if (close(shmFD)) {
 		fprintf(stderr,"#-- close(%d) \"%s\": %s\n", shmFD, shmName.c_str(), strerror(errno));
 	}
 
+	// place it before it is first touched, below
+	int node = -1;
+	if (numaNodes>1)
+		node = BindToNode(shmBase, bufSize, bufNum%numaNodes);
+
 	// update our internal state
-	ShmHeader header(blockSize,slabSize,numBlocks,0,maxNumBuffers);
+	ShmHeader header(blockSize,slabSize,numBlocks,0,maxNumBuffers,pageSize,largeBlockSize);
 	ShmHeader* hdr = (ShmHeader*)shmBase;
-	BlockInfo* info = (BlockInfo*)((char*)shmBase + header.infoOffset);
+	char* info = (char*)shmBase + header.infoOffset;
 	char* blk = (char*)shmBase + header.blockOffset;
 	headerVec.push_back(hdr);
 	infoVec.push_back(info);
 	blockVec.push_back(blk);
+	bufferNodes.push_back(node);
 
-	// initialize new hdr from header
+	// initialize new hdr from header (numBuffers is updated on Commit)
 	*hdr = header; // default operator= for ShmHeader
 	hdr->bufferNumber = bufNum;
 
-	// loop over the buffers and update numBuffers
-	unsigned numBufs = bufNum+1;
-	for (unsigned i=0; i<numBufs; i++) {
-		headerVec[i]->numBuffers = numBufs;
-	}
-
-	assert(numBufs == headerVec.size());
-	assert(numBufs == infoVec.size());
-	assert(numBufs == blockVec.size());
+	assert(bufNum+1 == headerVec.size());
+	assert(bufNum+1 == infoVec.size());
+	assert(bufNum+1 == blockVec.size());
 
 #if 0
 	fprintf(stderr, "- created \"%s\" as buffer %u\n", shmName.c_str(), bufNum);
@@ -189,15 +278,99 @@ void ShmMapper::CreateAndMap(unsigned bufNum)
 	float totalMiB = bufSize*(bufNum+1)/1048576.;
 	fprintf(stderr, "- now using %g MiB (%g MiB with overhead)\n", blocksMiB, totalMiB);
 #endif
+}
+
 
-	lockErrors += LockOrTouch(shmBase, bufSize);
+//-----------------------------------------------------------------------------
+int ShmMapper::BindToNode(void* addr, size_t len, unsigned node) const
+//	prefer (not require) the node, so a full node doesn't fail allocation
+//	returns the node, or -1 if unable
+//-----------------------------------------------------------------------------
+{
+#if defined(__linux__) && defined(SYS_mbind)
+	// from <numaif.h>, which would also require linking libnuma
+	enum { kMPOL_PREFERRED = 1, kMPOL_MF_MOVE = 1<<1 };
+	unsigned long nodeMask = 0;
+	errno = EINVAL;
+	if (node<sizeof(nodeMask)*8) {
+		nodeMask = 1UL<<node;
+		if (!syscall(SYS_mbind, addr, len, kMPOL_PREFERRED,
+			&nodeMask, sizeof(nodeMask)*8, kMPOL_MF_MOVE))
+			return node;
+	}
+	fprintf(stderr,"#-- unable to bind buffer memory to NUMA node %u: %s\n", node, strerror(errno));
+#else
+	fprintf(stderr,"#-- NUMA binding is not supported on this platform\n");
+#endif
+	return -1;
+}
+
+
+//-----------------------------------------------------------------------------
+bool ShmMapper::SlabPages(uint32_t slabID, char*& addr, size_t& len) const
+//	the whole pages within a slab, false if none
+//-----------------------------------------------------------------------------
+{
+	unsigned slabsPerBuf = numBlocks/BlocksPerSlab();
+	unsigned bufNum = slabID/slabsPerBuf;
+	if (bufNum>=numBuffers) return false;
+	// blockVec is page aligned, but a slab may not be
+	size_t begin = size_t(slabID%slabsPerBuf)*slabSize;
+	size_t end = begin + slabSize;
+	begin = (begin+pageSize-1)/pageSize*pageSize;
+	end = end/pageSize*pageSize;
+	if (begin>=end) return false;
+	addr = blockVec[bufNum] + begin;
+	len = end - begin;
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+int ShmMapper::ReclaimSlab(uint32_t slabID)
+//-----------------------------------------------------------------------------
+{
+	char* addr;
+	size_t len;
+	if (!SlabPages(slabID,addr,len)) return 0;
+#ifdef MADV_REMOVE
+	// locked pages can't be removed, and the lock is taken again by WarmSlab
+	munlock(addr,len);
+	// frees the shared memory's pages, unlike MADV_DONTNEED (which would
+	// only drop our mapping of them)
+	if (!madvise(addr,len,MADV_REMOVE))
+		return 0;
+	int err = errno;
+	mlock(addr,len);
+	errno = err;
+#else
+	errno = ENOSYS;
+#endif
+	return -1;
+}
+
+
+//-----------------------------------------------------------------------------
+int ShmMapper::WarmSlab(uint32_t slabID)
+//	like LockOrTouch, but quietly
+//-----------------------------------------------------------------------------
+{
+	char* addr;
+	size_t len;
+	if (!SlabPages(slabID,addr,len)) return 0;
+	if (!mlock(addr,len)) return 0;
+	volatile char* p = addr;
+	for (size_t offset=0; offset<len; offset+=pageSize) {
+		p[offset] = 0; // the contents of a free slab don't matter
+	}
+	return -1;
 }
 
 
 //-----------------------------------------------------------------------------
 int ShmMapper::LockOrTouch(const void* addr, size_t len) const
 //	This function is slow because it locks or touches lots of memory
-//	It could be a good candidate for a detached thread
+//	so the Manager's BufferGrower calls it from a background thread
 //	returns the number of errors, which can be accumulated
 //-----------------------------------------------------------------------------
 {
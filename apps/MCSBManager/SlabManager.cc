@@ -28,7 +28,8 @@ SlabManager::SlabManager(uint32_t slabsPerBuf_, uint32_t numBufs,
 	float pctNonreservable_)
 //-----------------------------------------------------------------------------
 :	slabsPerBuf(slabsPerBuf_), numSlabsReserved(0), wantedSlabsHarvested(0),
-	pctNonreservable(pctNonreservable_), numSlabsNonreservable(0)
+	pctNonreservable(pctNonreservable_), numSlabsNonreservable(0),
+	numFreeSlabs(0), numColdSlabs(0), ticks(0), numWantedSlabs(0)
 {
 	assert(pctNonreservable>=0);
 	assert(pctNonreservable<100);
@@ -40,12 +41,16 @@ SlabManager::~SlabManager(void)
 //-----------------------------------------------------------------------------
 {
 	// empty the lists so we can delete the memory
-	while(!freeSlabs.empty())
-		freeSlabs.pop_back();
+	for (unsigned i=0; i<kMaxNumaNodes; i++) {
+		while(!freeSlabs[i].empty())
+			freeSlabs[i].pop_back();
+	}
 	while(!heldSlabs.empty())
 		heldSlabs.pop_back();
-	while(!wantedSlabs.empty())
-		wantedSlabs.pop_back();
+	for (unsigned i=0; i<kNumDropPriorities; i++) {
+		while(!wantedSlabs[i].empty())
+			wantedSlabs[i].pop_back();
+	}
 	// now delete the memory
 	for (unsigned buf=0; buf<NumBuffers(); buf++) {
 		free(infoVec[buf]);
@@ -78,7 +83,7 @@ unsigned SlabManager::NumBuffers(unsigned n)
 		for (unsigned slab=0; slab<slabsPerBuf; slab++) {
 			unsigned slabID = buf*slabsPerBuf+slab;
 			new (newBuf+slab) SlabInfo(slabID); // placement new
-			freeSlabs.push_back(newBuf[slab]);
+			PushFreeSlab(newBuf[slab]);
 		}
 	}
 	// recompute based on new NumSlabs, take ceiling
@@ -86,6 +91,74 @@ unsigned SlabManager::NumBuffers(unsigned n)
 	return n;
 }
 
+//-----------------------------------------------------------------------------
+void SlabManager::SetBufferNode(unsigned bufNum, int node)
+//-----------------------------------------------------------------------------
+{
+	if (bufNum>=NumBuffers()) {
+		throw std::runtime_error("SlabManager::SetBufferNode invalid bufNum");
+	}
+	unsigned newNode = (node<0 || node>=kMaxNumaNodes) ? 0 : node;
+	SlabInfo* buf = infoVec[bufNum];
+	for (unsigned i=0; i<slabsPerBuf; i++) {
+		SlabInfo& slab = buf[i];
+		if (slab.node==newNode) continue;
+		bool isFree = !slab.Held() && !slab.Wanted();
+		if (isFree) {
+			freeSlabs[slab.node].erase(slab);
+			numFreeSlabs--;
+		}
+		slab.node = newNode;
+		if (isFree)
+			PushFreeSlab(slab);
+	}
+}
+
+//-----------------------------------------------------------------------------
+void SlabManager::PushFreeSlab(SlabInfo& slab, bool atFront)
+//	atFront for a freed slab, to be given out next while its pages are warm
+//-----------------------------------------------------------------------------
+{
+	slab.freedAt = ticks;
+	if (atFront)
+		freeSlabs[slab.node].push_front(slab);
+	else
+		freeSlabs[slab.node].push_back(slab);
+	numFreeSlabs++;
+}
+
+//-----------------------------------------------------------------------------
+unsigned SlabManager::GetIdleSlabs(uint32_t slabIDs[], unsigned mxcount, uint32_t idleTicks)
+//	returns number of slabs newly marked cold
+//-----------------------------------------------------------------------------
+{
+	unsigned count = 0;
+	for (unsigned node=0; node<kMaxNumaNodes; node++) {
+		// the least recently freed (and the cold) are at the back
+		SlabList::reverse_iterator it = freeSlabs[node].rbegin();
+		for (; it!=freeSlabs[node].rend() && count<mxcount; ++it) {
+			SlabInfo& slab = *it;
+			if (slab.cold || ticks-slab.freedAt<idleTicks) continue;
+			slab.cold = 1;
+			numColdSlabs++;
+			slabIDs[count++] = slab.SlabID();
+		}
+	}
+	return count;
+}
+
+//-----------------------------------------------------------------------------
+bool SlabManager::Warm(uint32_t slabID)
+//	returns true if the slab was cold
+//-----------------------------------------------------------------------------
+{
+	SlabInfo& slab = GetSlabInfo(slabID);
+	if (!slab.cold) return false;
+	slab.cold = 0;
+	numColdSlabs--;
+	return true;
+}
+
 //-----------------------------------------------------------------------------
 int SlabManager::GetSlabReservation(unsigned nSlabs)
 //-----------------------------------------------------------------------------
@@ -121,15 +194,20 @@ SlabManager::SlabInfo& SlabManager::GetSlabInfo(unsigned slabID) const
 
 //-----------------------------------------------------------------------------
 unsigned SlabManager::GetFreeSlabs(uint32_t slabIDs[], unsigned mxcount,
-	int prodClientID, void* prodArg)
+	int prodClientID, void* prodArg, int prodNode)
 //	returns number of slabs actually returned
 //-----------------------------------------------------------------------------
 {
 	unsigned count = 0;
-	// harvest freeSlabs
-	while (count<mxcount && freeSlabs.size()) {
-		SlabInfo& slab = freeSlabs.front();
-		freeSlabs.pop_front();
+	unsigned node = (prodNode<0 || prodNode>=kMaxNumaNodes) ? 0 : prodNode;
+	// harvest freeSlabs, from the producer's node first
+	while (count<mxcount && numFreeSlabs) {
+		while (freeSlabs[node].empty()) {
+			node = (node+1) % kMaxNumaNodes;
+		}
+		SlabInfo& slab = freeSlabs[node].front();
+		freeSlabs[node].pop_front();
+		numFreeSlabs--;
 		slabIDs[count++] = slab.SlabID();
 		slab.GetFreeSlab();
 		slab.SetProducerParams(prodClientID,prodArg);
@@ -151,7 +229,7 @@ void SlabManager::IncrementHeldRefcnt(const uint32_t slabIDs[], unsigned count)
 				throw std::runtime_error("IncrementHeldRefcnt but slab not held or wanted");
 			} else {
 				// move from wanted to held
-				wantedSlabs.erase(slab);
+				EraseWantedSlab(slab);
 				heldSlabs.push_back(slab);
 				CallStateChangeHandler(kWantedToHeld,slab);
 			}
@@ -174,11 +252,11 @@ void SlabManager::DecrementHeldRefcnt(const uint32_t slabIDs[], unsigned count,
 		// not held, move from held to either wanted or free
 		heldSlabs.erase(slab);
 		if (slab.Wanted()) {
-			wantedSlabs.push_back(slab);
+			PushWantedSlab(slab);
 			CallStateChangeHandler(kHeldToWanted,slab);
 		} else {
 			slab.SetProducerParams();
-			freeSlabs.push_back(slab);
+			PushFreeSlab(slab,true);
 			CallStateChangeHandler(kHeldToFree,slab);
 		}
 	}
@@ -199,7 +277,7 @@ void SlabManager::AddWantedSegmentBlock(void)
 
 //-----------------------------------------------------------------------------
 WantedSegment& SlabManager::GetWantedSegment(uint16_t clientID, uint32_t blockID,
-	uint32_t slabID)
+	uint32_t slabID, unsigned dropPriority)
 // this should never happen for freeSlabs, only held or wanted
 //-----------------------------------------------------------------------------
 {
@@ -215,9 +293,12 @@ WantedSegment& SlabManager::GetWantedSegment(uint16_t clientID, uint32_t blockID
 	// friends are nice
 	seg.clientID = clientID;
 	seg.blockID = blockID;
+	seg.dropPriority = dropPriority<kNumDropPriorities ?
+		dropPriority : kNumDropPriorities-1;
 
 	freeWantedSegs.pop_front();
 	slab.Push(seg);
+	UpdateWantedSlab(slab);
 	return seg;
 }
 
@@ -231,24 +312,64 @@ void SlabManager::ReleaseWantedSegment(WantedSegment& seg, uint32_t slabID)
 	// put the slab into the right list
 	if (!slab.Wanted() && !slab.Held()) {
 		// not held and not wanted, move from wanted to free
-		wantedSlabs.erase(slab);
+		EraseWantedSlab(slab);
 		slab.SetProducerParams();
-		freeSlabs.push_back(slab);
+		PushFreeSlab(slab,true);
 		CallStateChangeHandler(kWantedToFree,slab);
+	} else {
+		UpdateWantedSlab(slab);
 	}
 }
 
+//-----------------------------------------------------------------------------
+void SlabManager::PushWantedSlab(SlabInfo& slab, bool atFront)
+//-----------------------------------------------------------------------------
+{
+	slab.wantedList = slab.WantedDropPriority();
+	if (atFront)
+		wantedSlabs[slab.wantedList].push_front(slab);
+	else
+		wantedSlabs[slab.wantedList].push_back(slab);
+	numWantedSlabs++;
+}
+
+//-----------------------------------------------------------------------------
+void SlabManager::EraseWantedSlab(SlabInfo& slab)
+//-----------------------------------------------------------------------------
+{
+	wantedSlabs[slab.wantedList].erase(slab);
+	numWantedSlabs--;
+}
+
+//-----------------------------------------------------------------------------
+void SlabManager::UpdateWantedSlab(SlabInfo& slab)
+//	a held slab is not in wantedSlabs, it is listed when it stops being held
+//	a slab whose priority fell (e.g. partially harvested) is dropped next
+//-----------------------------------------------------------------------------
+{
+	if (slab.Held() || !slab.Wanted())
+		return;
+	unsigned priority = slab.WantedDropPriority();
+	if (priority==slab.wantedList)
+		return;
+	EraseWantedSlab(slab);
+	PushWantedSlab(slab, priority<slab.wantedList);
+}
+
 //-----------------------------------------------------------------------------
 WantedSegment& SlabManager::FrontWantedSegment(void)
-// from the head of the wantedSlabs, the front WantedSegment
+// from the head of the lowest priority wantedSlabs, the front WantedSegment
 // so a user can drop wanted segments and create more freeSlabs
 // (and causing message/segment loss)
 //-----------------------------------------------------------------------------
 {
-	if (wantedSlabs.empty()) {
+	unsigned level = 0;
+	while (level<kNumDropPriorities && wantedSlabs[level].empty())
+		level++;
+	if (level==kNumDropPriorities) {
 		throw std::runtime_error("SlabManager::FrontWantedSegment with no wanted slabs");
 	}
-	SlabInfo& slab = wantedSlabs.front();
+	SlabInfo& slab = wantedSlabs[level].front();
 	if (!slab.Wanted()) {
 		// this would indicate a deeper problem
 		throw std::runtime_error("SlabManager::FrontWantedSegment slab has no WantedSegments");
@@ -285,6 +406,16 @@ uint32_t SlabManager::SlabInfo::DecrementHeld(unsigned amount)
 	return heldRefcnt;
 }
 
+//-----------------------------------------------------------------------------
+unsigned SlabManager::SlabInfo::WantedDropPriority(void) const
+//-----------------------------------------------------------------------------
+{
+	unsigned level = kNumDropPriorities-1;
+	while (level && !wantedByPriority[level])
+		level--;
+	return level;
+}
+
 //-----------------------------------------------------------------------------
 void SlabManager::SlabInfo::Erase(WantedSegment& seg)
 //-----------------------------------------------------------------------------
@@ -304,6 +435,7 @@ void SlabManager::SlabInfo::Erase(WantedSegment& seg)
 		throw std::runtime_error("SlabInfo::Erase on empty list");
 	}
 	wantedSegs.erase(seg);
+	wantedByPriority[seg.DropPriority()]--;
 }
 
 //-----------------------------------------------------------------------------
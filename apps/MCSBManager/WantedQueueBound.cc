@@ -0,0 +1,72 @@
+//=============================================================================
+//	This file is part of MCSB, the Multi-Client Shared Buffer
+//	Copyright (C) 2014  Gregory E. Allen and
+//		Applied Research Laboratories: The University of Texas at Austin
+//
+//	MCSB is free software: you can redistribute it and/or modify it
+//	under the terms of the GNU Lesser General Public License as published
+//	by the Free Software Foundation, either version 2.1 of the License, or
+//	(at your option) any later version.
+//
+//	MCSB is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+//	Lesser General Public License <http://www.gnu.org/licenses/lgpl.html>
+//	for more details.
+//=============================================================================
+
+#include "MCSB/WantedQueueBound.h"
+
+namespace MCSB {
+
+static const double kSampleInterval = 0.05; // seconds
+static const double kRateWeight = 0.25; // of a new sample
+
+//-----------------------------------------------------------------------------
+WantedQueueBound::WantedQueueBound(void)
+//-----------------------------------------------------------------------------
+:	latency(0), maxBytes(0), maxSegs(kDefaultSegs), drainRate(0),
+	sampleTime(-1), sampleSegs(0)
+{}
+
+//-----------------------------------------------------------------------------
+void WantedQueueBound::SetBudget(float latency_, uint64_t maxBytes_)
+//-----------------------------------------------------------------------------
+{
+	latency = latency_>0 ? latency_ : 0;
+	maxBytes = maxBytes_;
+	maxSegs = kDefaultSegs;
+	// until we measure, assume the client drains the default in time
+	drainRate = latency ? kDefaultSegs/latency : 0;
+	sampleTime = -1;
+}
+
+//-----------------------------------------------------------------------------
+void WantedQueueBound::Update(uint64_t sentSegs, bool backlogged, double now)
+//-----------------------------------------------------------------------------
+{
+	if (!latency) return;
+	if (sampleTime<0) {
+		sampleTime = now;
+		sampleSegs = sentSegs;
+		return;
+	}
+	double dt = now - sampleTime;
+	if (dt<kSampleInterval) return;
+	double rate = (sentSegs-sampleSegs)/dt;
+	sampleTime = now;
+	sampleSegs = sentSegs;
+	if (backlogged) {
+		// the client set the pace
+		drainRate += kRateWeight*(rate-drainRate);
+	} else if (rate>drainRate) {
+		// the producers set the pace, the client could be faster still
+		drainRate = rate;
+	}
+	double segs = drainRate*latency;
+	if (segs<kMinSegs) segs = kMinSegs;
+	if (segs>kMaxSegs) segs = kMaxSegs;
+	maxSegs = unsigned(segs);
+}
+
+} // namespace MCSB
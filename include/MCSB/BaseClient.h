@@ -28,12 +28,15 @@
 
 #include <string>
 #include <map>
+#include <vector>
 #include <unistd.h>
 
 namespace MCSB {
 
 /// This single messageID is invalid/reserved.
 enum { kInvalidMessageID = 0xFFFFFFFF };
+/// The largest messageID that can be registered (the last in a full range).
+enum { kMaxMessageID = 0xFFFFFFFE };
 
 /// A Client that sends and receives MCSB messages procedurally.
 class BaseClient : public dbprinter {
@@ -56,17 +59,52 @@ class BaseClient : public dbprinter {
 	/// Send a message on a msgID from a descriptor (zero-copy).
 	int SendMessage(uint32_t msgID, SendMessageDescriptor& desc, uint32_t len);
 
+	/// \brief Send a small message on a msgID packed with others into a single block (copying).
+	/// The batch is sent when the block is full, when a message is batched on another msgID,
+	/// before any other send, and by FlushMessageBatch, Poll, Flush, and Close.
+	/// Each is received as its own RecvMessageDescriptor. Too large to batch is sent alone.
+	int BatchMessage(uint32_t msgID, const void* msg, uint32_t len);
+	/// Send the batched messages now, returning how many were sent.
+	int FlushMessageBatch(void);
+
 	/// Check for a pending receive message.
 	bool PendingRecvMessage(void);
 	/// Get the next recv message as a descriptor.
 	RecvMessageDescriptor GetRecvMessageDescriptor(void);
+	/// Return released recv messages to the Manager now. Otherwise they are
+	/// batched (see ClientOptions::retireBatchSegs) until Poll or Flush.
+	int FlushRetiredSegments(void);
+	/// \brief Seconds until the batched released messages are due (see
+	/// ClientOptions::retireBatchLatency), 0 if overdue, or negative if none are held.
+	/// A client that waits in its own event loop should call FlushRetiredSegments
+	/// (or Poll) by then; ClientWatcher does this.
+	float RetireBatchTimeout(void);
 
 	/// Register to receive messages with the specified list of msgIDs.
 	int RegisterMsgIDs(const uint32_t msgIDs[], int count);
 	/// Deregister to no longer receive messages with the specified msgIDs.
 	int DeregisterMsgIDs(const uint32_t msgIDs[], int count);
 
-	/// Deregister to no longer receive any messages.
+	/// Register to receive messages with msgIDs from first to last (inclusive).
+	int RegisterMsgIDRange(uint32_t first, uint32_t last);
+	/// Deregister a range previously registered with RegisterMsgIDRange.
+	int DeregisterMsgIDRange(uint32_t first, uint32_t last);
+	/// Register to receive messages with every msgID (the range 0 to kMaxMessageID).
+	int RegisterAllMsgIDs(void) { return RegisterMsgIDRange(0,kMaxMessageID); }
+
+	/// \brief Receive only a sample of the messages with msgIDs from first to last (inclusive).
+	/// Keeps every Nth message, and at most maxRate messages per second (0 for no limit), per msgID.
+	/// The Manager skips the others without holding them for this client.
+	/// everyNth<=1 and maxRate<=0 restores receiving every message.
+	int SetMsgIDSampling(uint32_t first, uint32_t last, uint32_t everyNth, float maxRate=0);
+
+	/// \brief Set the drop priority of messages with msgIDs from first to last (inclusive).
+	/// When the Manager runs out of memory, it drops the messages waiting for this client
+	/// with the lowest priority first: 0 (bulk) through 3 (command and control), default 1.
+	/// A negative priority restores the Manager's configured priority.
+	int SetMsgIDDropPriority(uint32_t first, uint32_t last, int priority);
+
+	/// Deregister to no longer receive any messages (including ranges).
 	void DeregisterAllMsgIDs(void);
 
 	/// Check the control socket, read and handle if it is readable.
@@ -106,6 +144,8 @@ class BaseClient : public dbprinter {
 	unsigned PendingRecvSegments(void) const;
 	/// The total number of segments received since this client connected to the Manager.
 	uint64_t NumSegmentsRcvd(void) const;
+	/// The current time in seconds on the clock that stamps sent messages (compare with RecvMessageDescriptor::SendTime).
+	double CurrentTime(void) const;
 
 	/// Send a sequence token to the Manager (for flushing).
 	int SendSequenceToken(void);
@@ -137,6 +177,15 @@ class BaseClient : public dbprinter {
 		SetRegistrationHandler(Thunk::RegistrationHandler<T,method>, reinterpret_cast<void*>(object));
 	}
 
+	/// Install a callback function that handles msgID range registration events (arg is user data).
+	void SetRangeRegistrationHandler(RangeRegistrationHandler func, void* arg=0);
+	/// Install a callback method that handles msgID range registration events.
+	template <class T, void (T::*method)(bool reg, int16_t clientID, int16_t groupID,
+		const uint32_t firstLast[], unsigned numRanges)>
+	void SetRangeRegistrationHandler(T* object) {
+		SetRangeRegistrationHandler(Thunk::RangeRegistrationHandler<T,method>, reinterpret_cast<void*>(object));
+	}
+
 	/// Accessor for this client's integer groupID (if a groupID was requested).
 	int GroupID(void) const;
 	/// Request a groupID via string (advanced for routing message).
@@ -159,9 +208,17 @@ class BaseClient : public dbprinter {
 	std::pair<DropReportHandler,void*> dropReportHandler;
 	std::pair<ConnectionEventHandler,void*> connectionEventHandler;
 	std::pair<RegistrationHandler,void*> registrationHandler;
+	std::pair<RangeRegistrationHandler,void*> rangeRegistrationHandler;
 
 	typedef std::map<uint32_t,uint32_t> MsgIdMap; // mid -> non-zero count
 	MsgIdMap registeredMsgIDs;
+	typedef std::pair<uint32_t,uint32_t> MsgIdRange; // first, last
+	typedef std::map<MsgIdRange,uint32_t> MsgIdRangeMap; // range -> non-zero count
+	MsgIdRangeMap registeredRanges;
+	typedef std::map<MsgIdRange,std::pair<uint32_t,float> > SamplingMap; // range -> everyNth, maxRate
+	SamplingMap samplingPolicies;
+	typedef std::vector<std::pair<MsgIdRange,int> > DropPriorityList; // range, priority
+	DropPriorityList dropPriorities; // overlapping settings are replayed in order
 
   protected:
 	/// The internal options used for this client.
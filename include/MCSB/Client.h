@@ -23,6 +23,8 @@
 #pragma once
 
 #include "MCSB/BaseClient.h"
+#include "MCSB/LatencyHistogram.h"
+#include <vector>
 
 namespace MCSB {
 
@@ -63,6 +65,38 @@ class Client : public BaseClient {
 		return DeregisterForMsgID(msgID, Thunk::MessageHandlerP<T,method>, reinterpret_cast<void*>(object));
 	}
 
+	/// Register a \RMD callback function to handle received messages with msgIDs from first to last (inclusive).
+	void RegisterForMsgIDRange(uint32_t first, uint32_t last, MessageHandlerFunction mhf, void* arg=0);
+	/// Deregister a \RMD callback function from a range registered with RegisterForMsgIDRange.
+	bool DeregisterForMsgIDRange(uint32_t first, uint32_t last, MessageHandlerFunction mhf, void* arg=0);
+
+	/// Register a \RMD callback method to handle received messages with msgIDs from first to last (inclusive).
+	template <class T, void (T::*method)(const RecvMessageDescriptor& desc)>
+	void RegisterForMsgIDRange(uint32_t first, uint32_t last, T* object) {
+		RegisterForMsgIDRange(first, last, Thunk::MessageHandler<T,method>, reinterpret_cast<void*>(object));
+	}
+	/// Deregister a \RMD callback method from a range registered with RegisterForMsgIDRange.
+	template <class T, void (T::*method)(const RecvMessageDescriptor& desc)>
+	bool DeregisterForMsgIDRange(uint32_t first, uint32_t last, T* object) {
+		return DeregisterForMsgIDRange(first, last, Thunk::MessageHandler<T,method>, reinterpret_cast<void*>(object));
+	}
+
+	/// Register a pointer/length callback method to handle received messages with msgIDs from first to last (inclusive).
+	template <class T, void (T::*method)(uint32_t, const void*, uint32_t)>
+	void RegisterForMsgIDRange(uint32_t first, uint32_t last, T* object) {
+		RegisterForMsgIDRange(first, last, Thunk::MessageHandlerP<T,method>, reinterpret_cast<void*>(object));
+	}
+	/// Deregister a pointer/length callback method from a range registered with RegisterForMsgIDRange.
+	template <class T, void (T::*method)(uint32_t, const void*, uint32_t)>
+	bool DeregisterForMsgIDRange(uint32_t first, uint32_t last, T* object) {
+		return DeregisterForMsgIDRange(first, last, Thunk::MessageHandlerP<T,method>, reinterpret_cast<void*>(object));
+	}
+
+	/// Register a \RMD callback function to handle received messages with every msgID
+	/// (deregister it with DeregisterForMsgIDRange(0,kMaxMessageID,...)).
+	void RegisterForAllMsgs(MessageHandlerFunction mhf, void* arg=0)
+		{ RegisterForMsgIDRange(0, kMaxMessageID, mhf, arg); }
+
 	/// Deregister to eliminate all callbacks and no longer receive any messages.
 	void DeregisterForAllMsgs(void);
 
@@ -75,15 +109,30 @@ class Client : public BaseClient {
 	/// Call any registered callbacks for the passed \RMD (advanced).
 	void HandleRecvMessage(const RecvMessageDescriptor& rmd);
 
+	/// Keep per-msgID histograms of delivery delay and handler residence time (or stop and discard them).
+	void KeepLatencyHistograms(bool keep=1);
+	/// The latency histograms (0 unless kept with KeepLatencyHistograms).
+	const MsgLatencyHistograms* GetLatencyHistograms(void) const { return latencyHistograms; }
+
 	/// This is needed to support SWIG/Python deregistering of Python methods.
 	void* DeregisterForMsgID(uint32_t msgID, MessageHandlerFunction mhf, void* arg,
 		bool (*argsEqualFunc)(void* arg1, void* arg2) );
+	/// This is needed to support SWIG/Python deregistering of Python methods.
+	void* DeregisterForMsgIDRange(uint32_t first, uint32_t last, MessageHandlerFunction mhf,
+		void* arg, bool (*argsEqualFunc)(void* arg1, void* arg2) );
 
   private:
 	void Init(void);
 	int handlingRecvMessage;
+	MsgLatencyHistograms* latencyHistograms;
 	typedef std::multimap<uint32_t, std::pair<MessageHandlerFunction,void*> > MessageHandlerMultiMap;
 	MessageHandlerMultiMap messageHandlers;
+	struct RangeHandler {
+		uint32_t first, last;
+		MessageHandlerFunction mhf;
+		void* arg;
+	};
+	std::vector<RangeHandler> rangeHandlers; // few, so searched linearly
 };
 
 } // namespace MCSB
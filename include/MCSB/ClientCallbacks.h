@@ -52,6 +52,11 @@ enum ConnectionEventTypes {
 typedef void (*RegistrationHandler)(bool reg, int16_t clientID, int16_t groupID,
 	const uint32_t msgIDs[], unsigned count, void* arg);
 
+/// \brief Signature of a callback function to handle msgID range registration events (arg is user data).
+/// firstLast holds numRanges inclusive first,last pairs. If reg: this is a registration, else: this is a de-registration.
+typedef void (*RangeRegistrationHandler)(bool reg, int16_t clientID, int16_t groupID,
+	const uint32_t firstLast[], unsigned numRanges, void* arg);
+
 
 //-----------------------------------------------------------------------------
 /// Thunk implementations, internal details that are excluded from Doxygen.
@@ -74,9 +79,10 @@ void MessageHandlerP(const RecvMessageDescriptor& desc, void* arg)
 //-----------------------------------------------------------------------------
 {
 	uint32_t msgID = desc.MessageID();
-	if (desc.Contiguous()) {
+	const void* buf = desc.ContiguousBuf();
+	if (buf) {
 		(reinterpret_cast<T*>(arg)->*MessageHandlerMethod)
-			(msgID, desc.Buf(), desc.Size());
+			(msgID, buf, desc.TotalSize());
 	} else {
 		std::pair<char*,ptrdiff_t> tmp = GetTempBufferFromRMD(desc);
 		(reinterpret_cast<T*>(arg)->*MessageHandlerMethod)
@@ -115,6 +121,18 @@ void RegistrationHandler(bool reg, int16_t clientID, int16_t groupID,
 		groupID, msgIDs, count);
 }
 
+//-----------------------------------------------------------------------------
+/// A thunk for callback methods to handle msgID range registration events.
+template <class T, void (T::*RangeRegistrationHandlerMethod)(bool reg,
+	int16_t clientID, int16_t groupID, const uint32_t firstLast[], unsigned numRanges)>
+void RangeRegistrationHandler(bool reg, int16_t clientID, int16_t groupID,
+	const uint32_t firstLast[], unsigned numRanges, void* arg)
+//-----------------------------------------------------------------------------
+{
+	(reinterpret_cast<T*>(arg)->*RangeRegistrationHandlerMethod)(reg, clientID,
+		groupID, firstLast, numRanges);
+}
+
 } // namespace Thunk
 } // namespace MCSB
 
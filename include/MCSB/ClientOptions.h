@@ -52,7 +52,12 @@ struct ClientOptions {
 		kDefaultMinProducerSlabs = 4,
 		kDefaultMinConsumerSlabs = 4,
 		kDefaultVerbosity = kNotice,
-		kDefaultProducerNiceLevel = 0
+		kDefaultProducerNiceLevel = 0,
+		kDefaultShmRings = 1,
+		kDefaultWantedQueueBytes = 0,
+		kDefaultContiguousViewBytes = 0,
+		kDefaultRecvBufBytes = (64*1024),
+		kDefaultRetireBatchSegs = 64
 	};
 	// parameters used by clients
 	size_t minProducerBytes;   ///< min number of bytes for producing messages
@@ -63,6 +68,13 @@ struct ClientOptions {
 	std::string clientName;    ///< name of Client, to report to Manager
 	char verbosity;            ///< Client verbosity level
 	char producerNiceLevel;    ///< producer niceness (playback/non-realtime mode)
+	bool shmRings;             ///< receive/retire segments through shared memory rings
+	float wantedQueueLatency;  ///< bound messages waiting in the Manager to this many seconds of measured consumption (0 for a fixed count)
+	size_t wantedQueueBytes;   ///< bound messages waiting in the Manager to this many bytes (0 for no bound)
+	size_t contiguousViewBytes; ///< address space for cached contiguous views of multi-segment messages (0 to copy them instead)
+	size_t recvBufBytes;       ///< capacity of the ring that socket reads from the Manager are parsed in
+	uint32_t retireBatchSegs;  ///< return received segments to the Manager once this many are released (1 for each at once)
+	float retireBatchLatency;  ///< or once the oldest has waited this many seconds (and always on Poll and Flush; ClientWatcher also arms a timer for it)
 
 	/// Values for client-side message CRC computation and verification.
 	typedef enum {
@@ -88,6 +100,21 @@ struct ClientOptions {
 	/// Get a string for the default CrcPolicy.
 	static const char* DefaultCrcStr(void);
 
+	/// Clocks for stamping the sendTime of sent messages (all in seconds since boot).
+	typedef enum {
+		eNoTimestamps = 0, ///< Do not stamp sent messages (sendTime is 0).
+		eMonotonicClock = 1, ///< CLOCK_MONOTONIC.
+		eCoarseClock = 2, ///< CLOCK_MONOTONIC_COARSE (cheaper, but only timer tick resolution).
+		eTscClock = 3, ///< The CPU timestamp counter scaled to CLOCK_MONOTONIC (cheapest, x86 only).
+		kDefaultTimestampClock = eMonotonicClock ///< The default timestamp clock.
+	} TimestampClock;
+	TimestampClock timestampClock; ///< clock for stamping sent messages
+
+	/// Set the TimestampClock from a string ["OFF", "MONOTONIC", "COARSE", "TSC"]
+	TimestampClock SetTimestampClock(const char* clockStr);
+	/// Get the current TimestampClock as a string.
+	const char* TimestampClockStr(void) const;
+
 	/// Parse argc and argv to fill out this ClientOptions struct.
 	int Parse(int argc, char* const argv[]);
 	/// Print this ClientOptions struct (with a prefix) to the specified file stream.
@@ -109,6 +136,7 @@ struct ClientOptions {
 
   private:
 	static const char* kCrcStrs[6];
+	static const char* kTimestampClockStrs[4];
 	std::string usage;
 	void SetDefaults(const char* argv0);
   protected:
@@ -34,19 +34,26 @@ namespace MCSB {
 /// and call Poll whenever it is readable.
 /// If the Client is not connected, ClientWatcher will periodically call Poll,
 /// which will attempt to reconnect the Client to the Manager.
+/// Before the loop waits, it also arms a timer to return any released recv
+/// messages that are still batched (see BaseClient::RetireBatchTimeout) on time.
 class ClientWatcher {
   public:
 	/// \param client  The MCSB Client to be watched and serviced.
 	/// \param loop    The \libev event loop in use (where 0 is default_loop).
 	/// \param period  Waiting period to try reconnecting when disconnected.
 	ClientWatcher(Client& client, ev::loop_ref loop=0, float period=1.);
+	~ClientWatcher(void);
 
   private:
 	Client& client;
 	ev::io readable;
 	ev::timer timer;
+	ev::prepare prepare;
+	ev::timer retireTimer;
 
 	void HandleEvent(void);
+	void HandlePrepare(void);
+	void HandleRetireTimer(void);
 };
 
 } // namespace MCSB
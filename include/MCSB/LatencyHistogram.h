@@ -0,0 +1,109 @@
+//=============================================================================
+//	This file is part of MCSB, the Multi-Client Shared Buffer
+//	Copyright (C) 2014  Gregory E. Allen and
+//		Applied Research Laboratories: The University of Texas at Austin
+//
+//	MCSB is free software: you can redistribute it and/or modify it
+//	under the terms of the GNU Lesser General Public License as published
+//	by the Free Software Foundation, either version 2.1 of the License, or
+//	(at your option) any later version.
+//
+//	MCSB is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+//	Lesser General Public License <http://www.gnu.org/licenses/lgpl.html>
+//	for more details.
+//=============================================================================
+/// \file LatencyHistogram.h
+/// \brief Histograms of message latencies, kept per msgID by a Client.
+
+#ifndef MCSB_LatencyHistogram_h
+#define MCSB_LatencyHistogram_h
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <map>
+
+namespace MCSB {
+
+/// A histogram of latencies with logarithmic buckets (in the style of HdrHistogram).
+
+/// Latencies are kept in nanoseconds. Each power of two is split into
+/// kSubBuckets linear buckets, so a bucket is within 1/kSubBuckets (about 6%)
+/// of the latencies it counts. Negative latencies (e.g. across a coarse clock)
+/// count as zero, and those beyond kMaxBits of nanoseconds (about 18 minutes)
+/// in the last bucket.
+class LatencyHistogram {
+  public:
+	enum { kSubBucketBits = 4, kSubBuckets = 1<<kSubBucketBits };
+	enum { kMaxBits = 40, kNumBuckets = (kMaxBits-kSubBucketBits+1)*kSubBuckets };
+
+	LatencyHistogram(void) { Reset(); }
+
+	/// Record a latency in seconds.
+	void Record(double secs);
+	/// Clear all of the counts.
+	void Reset(void);
+
+	/// The number of latencies recorded.
+	uint64_t Count(void) const { return count; }
+	/// The smallest latency recorded in seconds.
+	double Min(void) const { return count ? minNsecs/1e9 : 0; }
+	/// The largest latency recorded in seconds.
+	double Max(void) const { return maxNsecs/1e9; }
+	/// The mean latency in seconds.
+	double Mean(void) const { return count ? sumNsecs/1e9/count : 0; }
+	/// The latency in seconds that the fraction p (0 to 1) of latencies are at or below.
+	double Percentile(double p) const;
+
+	/// Print a one-line summary (count, min, mean, percentiles, max) to the specified file stream.
+	void Print(const char* prefix="", FILE* f=stderr) const;
+
+	/// The bucket that counts a latency in nanoseconds (advanced).
+	static unsigned BucketIndex(uint64_t nsecs);
+	/// The smallest latency in nanoseconds counted by a bucket (advanced).
+	static uint64_t BucketValue(unsigned idx);
+
+  private:
+	uint64_t count;
+	uint64_t minNsecs;
+	uint64_t maxNsecs;
+	double sumNsecs;
+	uint32_t counts[kNumBuckets];
+};
+
+/// Latency histograms for each msgID received by a Client.
+
+/// The delivery delay is from a message's sendTime (stamped by its producer)
+/// until its handlers are called. The residence time is how long its handlers
+/// took. \see Client::KeepLatencyHistograms
+class MsgLatencyHistograms {
+  public:
+	/// Record the delivery delay of a message in seconds.
+	void RecordDelivery(uint32_t msgID, double secs) { entries[msgID].delivery.Record(secs); }
+	/// Record the handler residence time of a message in seconds.
+	void RecordResidence(uint32_t msgID, double secs) { entries[msgID].residence.Record(secs); }
+
+	/// The delivery delay histogram of a msgID (0 if none were received).
+	const LatencyHistogram* Delivery(uint32_t msgID) const;
+	/// The handler residence time histogram of a msgID (0 if none were received).
+	const LatencyHistogram* Residence(uint32_t msgID) const;
+
+	/// Forget all msgIDs and their histograms.
+	void Reset(void) { entries.clear(); }
+	/// Print a summary of the histograms of every msgID to the specified file stream.
+	void Print(const char* prefix="", FILE* f=stderr) const;
+
+  private:
+	struct Entry {
+		LatencyHistogram delivery;
+		LatencyHistogram residence;
+	};
+	typedef std::map<uint32_t,Entry> EntryMap;
+	EntryMap entries;
+};
+
+} // namespace MCSB
+
+#endif
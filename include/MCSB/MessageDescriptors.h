@@ -171,8 +171,14 @@ class RecvMessageDescriptor : public MessageDescriptor {
 
 	/// Return a pointer to the first/current memory segment in the descriptor.
 	const void* Buf() const;
+	/// \brief Return a pointer to the whole message (TotalSize bytes) in one piece, without copying.
+	/// This is Buf() if Contiguous(). Otherwise the segments are remapped next to each other
+	/// (if ClientOptions::contiguousViewBytes allows and they are page aligned), or it returns 0.
+	const void* ContiguousBuf(void) const;
 	/// The messageID of the received message referred to by this descriptor.
 	uint32_t MessageID(void) const;
+	/// When the message was sent, in seconds on the producer's ClientOptions::TimestampClock (0 if not stamped).
+	double SendTime(void) const;
 
 	/// Advanced constructor using the underlying (opaque) types.
 	explicit RecvMessageDescriptor(RecvMsgSegment* s, ClientImpl* c)
@@ -80,6 +80,7 @@ bool PyMethodsEqual(void* arg1, void* arg2)
 // these are the classes and functions that will be compiled to python
 %ignore MCSB::ClientOptions::ClientOptions(int,char *const []);
 %ignore MCSB::ClientOptions::kCrcStrs; // because it's private
+%ignore MCSB::ClientOptions::kTimestampClockStrs;
 %include "MCSB/ClientOptions.h"
 %include "MCSB/StdClientOptions.h"
 %ignore dbprinter;
@@ -99,6 +100,7 @@ bool PyMethodsEqual(void* arg1, void* arg2)
 %ignore MCSB::BaseClient::SendMessage(uint32_t,void const *,uint32_t);
 %ignore MCSB::BaseClient::SendMessage(uint32_t,struct iovec const [],int);
 %ignore MCSB::BaseClient::SendMessage(uint32_t,SendMessageDescriptor&,uint32_t);
+%ignore MCSB::BaseClient::BatchMessage(uint32_t,void const *,uint32_t);
 %include "MCSB/BaseClient.h"
 %extend MCSB::BaseClient {
 	int fileno(void) const {
@@ -124,6 +126,22 @@ bool PyMethodsEqual(void* arg1, void* arg2)
 		}
 		throw std::runtime_error("SendMessage passed invalid object type");
 	}
+	int BatchMessage(uint32_t msgID, PyObject *pyobj) {
+		if (PyString_Check(pyobj)) {
+			uint32_t len = PyString_Size(pyobj);
+			const char* str = PyString_AsString(pyobj);
+			return self->BatchMessage(msgID,str,len);
+		}
+		if (PyBuffer_Check(pyobj)) {
+			const void* buffer;
+			Py_ssize_t buffer_len;
+			if (PyObject_AsReadBuffer(pyobj,&buffer,&buffer_len)) {
+				throw std::runtime_error("PyObject_AsReadBuffer returned an error");
+			}
+			return self->BatchMessage(msgID,buffer,buffer_len);
+		}
+		throw std::runtime_error("BatchMessage passed invalid object type");
+	}
 }
 
 %ignore MCSB::Client::RegisterForMsgID(uint32_t,MessageHandlerFunction);
@@ -133,6 +151,15 @@ bool PyMethodsEqual(void* arg1, void* arg2)
 %ignore MCSB::Client::DeregisterForMsgID(uint32_t,MessageHandlerFunction,void*);
 %ignore MCSB::Client::DeregisterForMsgID(uint32_t,MessageHandlerFunction,void*,bool (*)(void *,void *));
 %ignore MCSB::Client::DeregisterForMsgID(uint32_t, T*);
+%ignore MCSB::Client::RegisterForMsgIDRange(uint32_t,uint32_t,MessageHandlerFunction);
+%ignore MCSB::Client::RegisterForMsgIDRange(uint32_t,uint32_t,MessageHandlerFunction,void*);
+%ignore MCSB::Client::RegisterForMsgIDRange(uint32_t,uint32_t, T*);
+%ignore MCSB::Client::DeregisterForMsgIDRange(uint32_t,uint32_t,MessageHandlerFunction);
+%ignore MCSB::Client::DeregisterForMsgIDRange(uint32_t,uint32_t,MessageHandlerFunction,void*);
+%ignore MCSB::Client::DeregisterForMsgIDRange(uint32_t,uint32_t,MessageHandlerFunction,void*,bool (*)(void *,void *));
+%ignore MCSB::Client::DeregisterForMsgIDRange(uint32_t,uint32_t, T*);
+%ignore MCSB::Client::RegisterForAllMsgs(MessageHandlerFunction);
+%ignore MCSB::Client::RegisterForAllMsgs(MessageHandlerFunction,void*);
 %include "MCSB/Client.h"
 %extend MCSB::Client {
 	void RegisterForMsgID(uint32_t msgID, PyObject *pyfunc) {
@@ -154,6 +181,20 @@ bool PyMethodsEqual(void* arg1, void* arg2)
 		}
 		return result;
 	}
+	void RegisterForMsgIDRange(uint32_t first, uint32_t last, PyObject *pyfunc) {
+		if (!PyCallable_Check(pyfunc))
+			throw std::runtime_error("RegisterForMsgIDRange passed invalid object type");
+		self->RegisterForMsgIDRange(first, last, &MCSB::PyHandleMessage, (void*)pyfunc);
+		Py_INCREF(pyfunc);
+	}
+	bool DeregisterForMsgIDRange(uint32_t first, uint32_t last, PyObject *pyfunc) {
+		PyObject* mapfunc = (PyObject*)self->DeregisterForMsgIDRange(first, last,
+			&MCSB::PyHandleMessage, (void*)pyfunc, &MCSB::PyMethodsEqual);
+		if (mapfunc) {
+			Py_DECREF(mapfunc);
+		}
+		return !!mapfunc;
+	}
 }
 
 %constant unsigned MAJOR_VERSION = MCSB_MAJOR_VERSION;
@@ -25,6 +25,8 @@
 #include <unistd.h>
 #include <stdexcept>
 #include <assert.h>
+#include <algorithm>
+#include <vector>
 
 extern const char* kHgRevision_MCSB;
 
@@ -40,6 +42,7 @@ void BaseClient::Init(bool connect)
 	SetConnectionEventHandler(0);
 	SetDropReportHandler(0);
 	SetRegistrationHandler(0);
+	SetRangeRegistrationHandler(0);
 	connecting = 0;
 	if (connect)
 		Connect();
@@ -61,6 +64,14 @@ void BaseClient::Close(void)
 	dbprintf(kDebug,"%s\n", __PRETTY_FUNCTION__);
 	if (!cimpl) return;
 	
+	if (cimpl->NumBatchedMessages() && cimpl->Connected()) {
+		try {
+			cimpl->FlushMessageBatch();
+		} catch (std::runtime_error err) {
+			dbprintf(kNotice, "#-- %s\n", err.what());
+		}
+	}
+
 	if (connectionEventHandler.first)
 		(*connectionEventHandler.first)(kDisconnection,connectionEventHandler.second);
 
@@ -121,7 +132,25 @@ bool BaseClient::Connect(void)
 			msgIDs.push_back(mid);
 		}
 		cimpl->RegisterMsgIDs(&msgIDs[0],msgIDs.size());
-		cimpl->SetRegistrationHandler(registrationHandler.first,registrationHandler.second);
+		std::vector<uint32_t> firstLast;
+		MsgIdRangeMap::iterator rit = registeredRanges.begin();
+		for (; rit!=registeredRanges.end(); ++rit) {
+			firstLast.push_back(rit->first.first);
+			firstLast.push_back(rit->first.second);
+		}
+		if (firstLast.size())
+			cimpl->RegisterMsgIDRanges(&firstLast[0],firstLast.size()/2);
+		SamplingMap::iterator sit = samplingPolicies.begin();
+		for (; sit!=samplingPolicies.end(); ++sit) {
+			cimpl->SendSampling(sit->first.first,sit->first.second,
+				sit->second.first,sit->second.second);
+		}
+		DropPriorityList::iterator dit = dropPriorities.begin();
+		for (; dit!=dropPriorities.end(); ++dit) {
+			cimpl->SendDropPriority(dit->first.first,dit->first.second,dit->second);
+		}
+		cimpl->SetRegistrationHandlers(registrationHandler.first,registrationHandler.second,
+			rangeRegistrationHandler.first,rangeRegistrationHandler.second);
 
 	} catch (std::runtime_error err) {
 		Close();
@@ -148,8 +177,10 @@ int BaseClient::Poll(float timeout)
 		Connect();
 	int result = -1;
 	try {
-		if (cimpl && !connecting)
+		if (cimpl && !connecting) {
+			cimpl->FlushMessageBatch();
 			result = cimpl->Poll(timeout);
+		}
 
 	} catch (std::runtime_error err) {
 		Close();
@@ -211,6 +242,55 @@ int BaseClient::SendMessage(uint32_t msgID, SendMessageDescriptor& desc, uint32_
 	return -1;
 }
 
+//-----------------------------------------------------------------------------
+int BaseClient::BatchMessage(uint32_t msgID, const void* msg, uint32_t len)
+//-----------------------------------------------------------------------------
+{
+	if (!cimpl)
+		Connect();
+
+	try {
+		if (cimpl)
+			return cimpl->BatchMessage(msgID,msg,len);
+	} catch (std::runtime_error err) {
+		dbprintf(kNotice, "#-- %s\n", err.what());
+	}
+	return -1;
+}
+
+//-----------------------------------------------------------------------------
+int BaseClient::FlushMessageBatch(void)
+//-----------------------------------------------------------------------------
+{
+	try {
+		if (cimpl)
+			return cimpl->FlushMessageBatch();
+	} catch (std::runtime_error err) {
+		dbprintf(kNotice, "#-- %s\n", err.what());
+	}
+	return -1;
+}
+
+//-----------------------------------------------------------------------------
+int BaseClient::FlushRetiredSegments(void)
+//-----------------------------------------------------------------------------
+{
+	try {
+		if (cimpl)
+			return cimpl->SendRetiredSegments();
+	} catch (std::runtime_error err) {
+		dbprintf(kNotice, "#-- %s\n", err.what());
+	}
+	return -1;
+}
+
+//-----------------------------------------------------------------------------
+float BaseClient::RetireBatchTimeout(void)
+//-----------------------------------------------------------------------------
+{
+	return cimpl ? cimpl->RetireBatchTimeout() : -1;
+}
+
 //-----------------------------------------------------------------------------
 SendMessageDescriptor BaseClient::GetSendMessageDescriptor(uint32_t len,
 	bool contiguous, bool poll)
@@ -288,6 +368,118 @@ int BaseClient::DeregisterMsgIDs(const uint32_t msgIDs[], int count)
 	return deregCount;
 }
 
+//-----------------------------------------------------------------------------
+int BaseClient::RegisterMsgIDRange(uint32_t first, uint32_t last)
+// returns 1 if the range was actually registered (i.e. wasn't already)
+//-----------------------------------------------------------------------------
+{
+	if (first>last || last>kMaxMessageID) {
+		dbprintf(kWarning, "# invalid msgID range %u-%u\n", first, last);
+		return -1;
+	}
+	MsgIdRange range(first,last);
+	MsgIdRangeMap::iterator it = registeredRanges.find(range);
+	if (it!=registeredRanges.end()) {
+		it->second++;
+		return 0;
+	}
+	registeredRanges.insert( std::make_pair(range,1u) );
+
+	try {
+		uint32_t firstLast[2] = { first, last };
+		if (cimpl && cimpl->Connected())
+			cimpl->RegisterMsgIDRanges(firstLast,1);
+	} catch (std::runtime_error err) {
+		dbprintf(kNotice, "#-- %s\n", err.what());
+	}
+	return 1;
+}
+
+//-----------------------------------------------------------------------------
+int BaseClient::DeregisterMsgIDRange(uint32_t first, uint32_t last)
+// returns 1 if the range was actually deregistered
+//-----------------------------------------------------------------------------
+{
+	MsgIdRangeMap::iterator it = registeredRanges.find(MsgIdRange(first,last));
+	if (it==registeredRanges.end()) return 0; // not found
+	if (--(it->second)) return 0;
+	registeredRanges.erase(it);
+
+	// the Manager keeps the union of our ranges, so restore the parts of
+	// any remaining ranges that overlap the one going away
+	std::vector<uint32_t> firstLast;
+	for (it=registeredRanges.begin(); it!=registeredRanges.end(); ++it) {
+		if (it->first.first>last) break;
+		if (it->first.second<first) continue;
+		firstLast.push_back(std::max(first,it->first.first));
+		firstLast.push_back(std::min(last,it->first.second));
+	}
+
+	try {
+		uint32_t range[2] = { first, last };
+		if (cimpl && cimpl->Connected()) {
+			cimpl->DeregisterMsgIDRanges(range,1);
+			if (firstLast.size())
+				cimpl->RegisterMsgIDRanges(&firstLast[0],firstLast.size()/2);
+		}
+	} catch (std::runtime_error err) {
+		dbprintf(kNotice, "#-- %s\n", err.what());
+	}
+	return 1;
+}
+
+//-----------------------------------------------------------------------------
+int BaseClient::SetMsgIDSampling(uint32_t first, uint32_t last, uint32_t everyNth, float maxRate)
+//-----------------------------------------------------------------------------
+{
+	if (first>last) {
+		dbprintf(kWarning, "# invalid msgID range %u-%u\n", first, last);
+		return -1;
+	}
+	MsgIdRange range(first,last);
+	if (everyNth>1 || maxRate>0)
+		samplingPolicies[range] = std::make_pair(everyNth,maxRate);
+	else
+		samplingPolicies.erase(range);
+
+	try {
+		if (cimpl && cimpl->Connected())
+			return cimpl->SendSampling(first,last,everyNth,maxRate);
+	} catch (std::runtime_error err) {
+		dbprintf(kNotice, "#-- %s\n", err.what());
+	}
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+int BaseClient::SetMsgIDDropPriority(uint32_t first, uint32_t last, int priority)
+//-----------------------------------------------------------------------------
+{
+	if (first>last) {
+		dbprintf(kWarning, "# invalid msgID range %u-%u\n", first, last);
+		return -1;
+	}
+	if (priority<0) priority = -1;
+	MsgIdRange range(first,last);
+	// a later setting of the same range supersedes the earlier one
+	DropPriorityList::iterator it = dropPriorities.begin();
+	while (it!=dropPriorities.end()) {
+		if (it->first==range)
+			it = dropPriorities.erase(it);
+		else
+			++it;
+	}
+	dropPriorities.push_back(std::make_pair(range,priority));
+
+	try {
+		if (cimpl && cimpl->Connected())
+			return cimpl->SendDropPriority(first,last,priority);
+	} catch (std::runtime_error err) {
+		dbprintf(kNotice, "#-- %s\n", err.what());
+	}
+	return 0;
+}
+
 //-----------------------------------------------------------------------------
 bool BaseClient::PendingRecvMessage(void)
 //-----------------------------------------------------------------------------
@@ -321,6 +513,22 @@ void BaseClient::DeregisterAllMsgIDs(void)
 		}
 		DeregisterMsgIDs(msgIDs,count);
 	}
+	// and registeredRanges, all at once
+	if (registeredRanges.empty())
+		return;
+	std::vector<uint32_t> firstLast;
+	MsgIdRangeMap::iterator it = registeredRanges.begin();
+	for (; it!=registeredRanges.end(); ++it) {
+		firstLast.push_back(it->first.first);
+		firstLast.push_back(it->first.second);
+	}
+	registeredRanges.clear();
+	try {
+		if (cimpl && cimpl->Connected())
+			cimpl->DeregisterMsgIDRanges(&firstLast[0],firstLast.size()/2);
+	} catch (std::runtime_error err) {
+		dbprintf(kNotice, "#-- %s\n", err.what());
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -379,7 +587,7 @@ int BaseClient::SendManagerEcho(void)
 int BaseClient::Flush(float timeout)
 //-----------------------------------------------------------------------------
 {
-	if (SendSequenceToken()<0)
+	if (FlushMessageBatch()<0 || SendSequenceToken()<0)
 		return -1;
 	while (PendingSequenceTokens()) {
 		if (Poll(timeout)<0)
@@ -402,6 +610,20 @@ void BaseClient::SetRegistrationHandler(RegistrationHandler func, void* arg)
 	}
 }
 
+//-----------------------------------------------------------------------------
+void BaseClient::SetRangeRegistrationHandler(RangeRegistrationHandler func, void* arg)
+//-----------------------------------------------------------------------------
+{
+	rangeRegistrationHandler = std::make_pair(func,arg);
+	try {
+		if (cimpl) {
+			cimpl->SetRangeRegistrationHandler(func,arg);
+		}
+	} catch (std::runtime_error err) {
+		dbprintf(kNotice, "#-- %s\n", err.what());
+	}
+}
+
 //-----------------------------------------------------------------------------
 int BaseClient::RequestGroupID(const char* groupStr_, bool wait)
 //-----------------------------------------------------------------------------
@@ -449,6 +671,8 @@ unsigned BaseClient::PendingRecvSegments(void) const
 	{ return (cimpl && cimpl->Connected()) ? cimpl->PendingRecvSegments() : 0; }
 uint64_t BaseClient::NumSegmentsRcvd(void) const
 	{ return cimpl ? cimpl->NumSegmentsRcvd() : 0; }
+double BaseClient::CurrentTime(void) const
+	{ return cimpl ? cimpl->CurrentTime() : Timestamper::MonotonicTime(); }
 
 const char* GetVersion(void)
 {	return MCSB_VERSION; }
@@ -32,6 +32,7 @@ void Client::Init(void)
 {
 	dbprintf(kDebug,"%s\n", __PRETTY_FUNCTION__);
 	handlingRecvMessage = 0;
+	latencyHistograms = 0;
 }
 
 //-----------------------------------------------------------------------------
@@ -40,6 +41,7 @@ Client::~Client(void)
 {
 	dbprintf(kDebug,"%s\n", __PRETTY_FUNCTION__);
 	DeregisterForAllMsgs();
+	delete latencyHistograms;
 }
 
 //-----------------------------------------------------------------------------
@@ -91,6 +93,8 @@ int Client::Poll(float timeout, bool serviceRecvMessages)
 			 // I'm leaving work undone, so make me readable in the future
 			SendManagerEcho();
 		}
+		// what the handlers released, rather than waiting for the next Poll
+		FlushRetiredSegments();
 	}
 	if (!Connected()) return -1;
 	return result;
@@ -152,6 +156,56 @@ void* Client::DeregisterForMsgID(uint32_t msgID, MessageHandlerFunction mhf,
 	return result;
 }
 
+//-----------------------------------------------------------------------------
+void Client::RegisterForMsgIDRange(uint32_t first, uint32_t last,
+	MessageHandlerFunction mhf, void* arg)
+//-----------------------------------------------------------------------------
+{
+	dbprintf(kDebug,"%s\n", __PRETTY_FUNCTION__);
+	assert(mhf);
+	if (RegisterMsgIDRange(first,last)<0)
+		return;
+	RangeHandler rh = { first, last, mhf, arg };
+	rangeHandlers.push_back(rh);
+}
+
+//-----------------------------------------------------------------------------
+bool Client::DeregisterForMsgIDRange(uint32_t first, uint32_t last,
+	MessageHandlerFunction mhf, void* arg)
+//-----------------------------------------------------------------------------
+{
+	dbprintf(kDebug,"%s\n", __PRETTY_FUNCTION__);
+	for (unsigned i=0; i<rangeHandlers.size(); i++) {
+		RangeHandler& rh = rangeHandlers[i];
+		if (rh.first==first && rh.last==last && rh.mhf==mhf && rh.arg==arg) {
+			rangeHandlers.erase(rangeHandlers.begin()+i);
+			DeregisterMsgIDRange(first,last);
+			return true;
+		}
+	}
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+void* Client::DeregisterForMsgIDRange(uint32_t first, uint32_t last,
+	MessageHandlerFunction mhf, void* arg, bool (*argsEqualFunc)(void* arg1, void* arg2) )
+//	as DeregisterForMsgID, on success returns the arg that was registered
+//-----------------------------------------------------------------------------
+{
+	dbprintf(kDebug,"%s\n", __PRETTY_FUNCTION__);
+	for (unsigned i=0; i<rangeHandlers.size(); i++) {
+		RangeHandler& rh = rangeHandlers[i];
+		if (rh.first==first && rh.last==last && rh.mhf==mhf &&
+			(*argsEqualFunc)(rh.arg, arg)) {
+			void* result = rh.arg;
+			rangeHandlers.erase(rangeHandlers.begin()+i);
+			DeregisterMsgIDRange(first,last);
+			return result;
+		}
+	}
+	return 0;
+}
+
 class IntIncr {
 	int& i;
 	public:
@@ -175,8 +229,9 @@ void Client::HandleRecvMessage(const RecvMessageDescriptor& rmd)
 
 	// build an array of handlers to call
 	unsigned numHandlers = messageHandlers.count(msgID);
-	MessageHandlerFunction funcs[numHandlers];
-	void* args[numHandlers];
+	unsigned maxHandlers = numHandlers + rangeHandlers.size();
+	MessageHandlerFunction funcs[maxHandlers];
+	void* args[maxHandlers];
 	
 	unsigned i = 0;
 	
@@ -189,16 +244,47 @@ void Client::HandleRecvMessage(const RecvMessageDescriptor& rmd)
 	}
 	assert(i==numHandlers);
 
+	// and the rangeHandlers that contain msgID
+	for (unsigned r=0; r<rangeHandlers.size(); r++) {
+		const RangeHandler& rh = rangeHandlers[r];
+		if (msgID<rh.first || msgID>rh.last) continue;
+		funcs[numHandlers] = rh.mhf;
+		args[numHandlers++] = rh.arg;
+	}
+
+	double startTime = 0;
+	if (latencyHistograms) {
+		startTime = CurrentTime();
+		double sendTime = rmd.SendTime();
+		if (sendTime)
+			latencyHistograms->RecordDelivery(msgID, startTime-sendTime);
+	}
+
 	// now we call the handlers, and they can't change the data structure under us
 	for (i=0; i<numHandlers; i++) {
 		(*funcs[i])(rmd,args[i]);
 	}
 
+	if (latencyHistograms && startTime)
+		latencyHistograms->RecordResidence(msgID, CurrentTime()-startTime);
+
 	// warn in case we got an unhandled message
 	if (!numHandlers)
 		dbprintf(kWarning,"# unhandled msgID %u in %s\n", msgID, __PRETTY_FUNCTION__);
 }
 
+//-----------------------------------------------------------------------------
+void Client::KeepLatencyHistograms(bool keep)
+//-----------------------------------------------------------------------------
+{
+	if (keep && !latencyHistograms) {
+		latencyHistograms = new MsgLatencyHistograms;
+	} else if (!keep) {
+		delete latencyHistograms;
+		latencyHistograms = 0;
+	}
+}
+
 //-----------------------------------------------------------------------------
 void Client::DeregisterForAllMsgs(void)
 //-----------------------------------------------------------------------------
@@ -210,6 +296,10 @@ void Client::DeregisterForAllMsgs(void)
 		MessageHandlerMultiMap::iterator begin = messageHandlers.begin();
 		DeregisterForMsgID( begin->first, begin->second.first, begin->second.second );
 	}
+	while (!rangeHandlers.empty()) {
+		const RangeHandler& rh = rangeHandlers.back();
+		DeregisterForMsgIDRange( rh.first, rh.last, rh.mhf, rh.arg );
+	}
 }
 
 } // namespace MCSB
@@ -25,17 +25,36 @@
 #include <errno.h>
 #include <cstring>
 #include <stdexcept>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 
 namespace MCSB {
 
+//-----------------------------------------------------------------------------
+static int CurrentNumaNode(void)
+//	the NUMA node this thread is running on, or -1 if unknown
+//-----------------------------------------------------------------------------
+{
+#if defined(__linux__) && defined(SYS_getcpu)
+	unsigned cpu, node;
+	if (!syscall(SYS_getcpu, &cpu, &node, 0))
+		return node;
+#endif
+	return -1;
+}
+
 //-----------------------------------------------------------------------------
 ClientImpl::ClientImpl(int fd, const ClientOptions& opts_)
 //-----------------------------------------------------------------------------
-:	SocketEndpoint(fd,opts_.verbosity,kMaxCtrlMsgSize),
-	opts(opts_), clientID(-1),
+:	SocketEndpoint(fd,opts_.verbosity,opts_.recvBufBytes),
+	opts(opts_), timestamper(opts_.timestampClock), ringRequested(0), ringActive(0), retireViaSocket(0),
+	deliveryPaused(0), clientID(-1),
 	numProdSlabs(0), numProdSlabsRqstd(0), numConsSlabs(0), numConsSlabsRqstd(0),
-	sequenceTokenSent(0), sequenceTokenRcvd(0), dropReportHandler(0,0),
+	sequenceTokenSent(0), sequenceTokenRcvd(0),
+	batchDesc(0), batchMsgID(0), batchBytes(0), retiredSince(-1), dropReportHandler(0,0),
 	connectionEventHandler(0,0), registrationHandler(0,0),
+	rangeRegistrationHandler(0,0),
 	crcErrors(0), sendCallingPoll(0)
 {
 	dbprintf(kDebug,"%s\n",__PRETTY_FUNCTION__);
@@ -45,6 +64,15 @@ ClientImpl::ClientImpl(int fd, const ClientOptions& opts_)
 	if (opts.producerNiceLevel) {
 		SendProdNiceLevel(opts.producerNiceLevel);
 	}
+	// so the Manager can give us slabs in memory local to us
+	int node = CurrentNumaNode();
+	if (node>=0) {
+		SendNumaNode(node);
+	}
+	if (opts.wantedQueueLatency>0 || opts.wantedQueueBytes) {
+		SendWantedQueueBudget(opts.wantedQueueLatency,opts.wantedQueueBytes);
+	}
+	recvMgr.MaxViewBytes(opts.contiguousViewBytes);
 }
 
 //-----------------------------------------------------------------------------
@@ -52,11 +80,52 @@ ClientImpl::~ClientImpl(void)
 //-----------------------------------------------------------------------------
 {
 	dbprintf(kDebug,"%s\n",__PRETTY_FUNCTION__);
+	if (batchDesc)
+		sendMgr.ReleaseMessageDescriptor(batchDesc);
 	if (close(FD())) {
 		dbprintf(kError, "#-- close error: %s\n", strerror(errno));
 	}
 }
 
+//-----------------------------------------------------------------------------
+int ClientImpl::Poll(float timeout)
+//-----------------------------------------------------------------------------
+{
+	// before (maybe) waiting, the manager gets any batched retirements
+	SendRetiredSegments();
+
+	unsigned drained = DrainDeliveryRing();
+	if (!drained)
+		return SocketEndpoint::Poll(timeout);
+	// don't block, but don't starve the control messages either
+	int res = SocketEndpoint::Poll(0);
+	return res<0 ? res : drained+res;
+}
+
+//-----------------------------------------------------------------------------
+unsigned ClientImpl::DrainDeliveryRing(void)
+// returns the number of blockIDs taken from the ring
+//-----------------------------------------------------------------------------
+{
+	if (!ringActive || deliveryPaused) return 0;
+
+	enum { kMaxPop = 256 };
+	uint32_t blockIDs[kMaxPop];
+	unsigned total = 0;
+	while (true) {
+		unsigned count = ring.Pop(ShmRing::kDelivery,blockIDs,kMaxPop);
+		if (count) {
+			HandleBlockIDs(blockIDs,count);
+			total += count;
+			continue;
+		}
+		// going idle, ask for a doorbell, then make sure we didn't miss one
+		ring.ArmDoorbell(ShmRing::kDelivery);
+		if (ring.Empty(ShmRing::kDelivery)) break;
+	}
+	return total;
+}
+
 //-----------------------------------------------------------------------------
 int ClientImpl::SendRegistration(uint32_t type, const uint32_t msgIDs[], unsigned count)
 //-----------------------------------------------------------------------------
@@ -66,6 +135,15 @@ int ClientImpl::SendRegistration(uint32_t type, const uint32_t msgIDs[], unsigne
 	return SocketEndpoint::SendRegistration(type,clientID,groupID,msgIDs,count);
 }
 
+//-----------------------------------------------------------------------------
+int ClientImpl::SendRangeRegistration(bool reg, const uint32_t firstLast[], unsigned numRanges)
+//-----------------------------------------------------------------------------
+{
+	dbprintf(kDebug,"%s\n",__PRETTY_FUNCTION__);
+	while(clientID<0) Poll();
+	return SocketEndpoint::SendRangeRegistration(reg,clientID,groupID,firstLast,numRanges);
+}
+
 //-----------------------------------------------------------------------------
 int ClientImpl::SendRetiredSlabs(void)
 //-----------------------------------------------------------------------------
@@ -83,15 +161,91 @@ int ClientImpl::SendRetiredSlabs(void)
 int ClientImpl::SendRetiredSegments(void)
 //-----------------------------------------------------------------------------
 {
+	retiredSince = -1;
 	unsigned numRetiredSegments = recvMgr.NumRetiredSegments();
 	if (numRetiredSegments) {
 		uint32_t blockIDs[numRetiredSegments];
 		recvMgr.GetRetiredSegments(blockIDs,numRetiredSegments);
+		if (ringActive && !retireViaSocket) {
+			if (ring.Push(ShmRing::kRetirement,blockIDs,numRetiredSegments)) {
+				if (ring.TakeDoorbell(ShmRing::kRetirement))
+					SendRingDoorbell();
+				return numRetiredSegments*sizeof(uint32_t);
+			}
+			// retirements must stay in order, so the manager drains first
+			dbprintf(kInfo,"- client[%d] retirement ring full, using the socket\n", clientID);
+			retireViaSocket = 1;
+			SendShmRing(kShmRing_Paused);
+		}
 		return SendBlockIDs(blockIDs,numRetiredSegments);
 	}
 	return 0;
 }
 
+//-----------------------------------------------------------------------------
+float ClientImpl::RetireBatchTimeout(void) const
+// seconds until RetireSegments would send what it holds (0 if overdue),
+// for a client that may not call back into us before then
+//-----------------------------------------------------------------------------
+{
+	if (!recvMgr.NumRetiredSegments())
+		return -1;
+	if (retiredSince<0)
+		return 0;
+	double wait = retiredSince + opts.retireBatchLatency - uptimer::CurrentTime();
+	return wait>0 ? wait : 0;
+}
+
+//-----------------------------------------------------------------------------
+int ClientImpl::RetireSegments(void)
+// send the retired segments once opts.retireBatchSegs of them are waiting,
+// or the first has waited opts.retireBatchLatency (Poll sends them anyway)
+//-----------------------------------------------------------------------------
+{
+	unsigned numRetiredSegments = recvMgr.NumRetiredSegments();
+	if (!numRetiredSegments)
+		return 0;
+	if (numRetiredSegments>=opts.retireBatchSegs)
+		return SendRetiredSegments();
+	double now = uptimer::CurrentTime();
+	if (retiredSince<0)
+		retiredSince = now;
+	if (now-retiredSince>=opts.retireBatchLatency)
+		return SendRetiredSegments();
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+int ClientImpl::SubmitBlocksAndInfo(const uint32_t blockIDs[],
+	const BlockInfo info[], unsigned count)
+// through the submission ring if we have one, else the socket
+//-----------------------------------------------------------------------------
+{
+	if (!ringActive)
+		return SendBlocksAndInfo(blockIDs,info,count);
+
+	unsigned submitted = 0;
+	bool rang = false;
+	while (submitted<count) {
+		unsigned toSubmit = count-submitted;
+		if (toSubmit>ring.Capacity())
+			toSubmit = ring.Capacity();
+		if (ring.Submit(blockIDs+submitted,info+submitted,toSubmit)) {
+			submitted += toSubmit;
+			continue;
+		}
+		// full, so make sure the manager is draining and wait for room
+		if (!rang) {
+			SendRingDoorbell();
+			rang = true;
+		}
+		if (Poll(.001)<0) return -1;
+	}
+	if (ring.TakeDoorbell(ShmRing::kSubmission))
+		SendRingDoorbell();
+	return count;
+}
+
 //-----------------------------------------------------------------------------
 int ClientImpl::SendMessage(uint32_t msgID, const void* msg, uint32_t len)
 // a copying interface
@@ -229,13 +383,17 @@ ClientImpl::SendMsgDesc
 }
 
 //-----------------------------------------------------------------------------
-int ClientImpl::SendMessage(uint32_t msgID, SendMsgDesc desc, uint32_t len)
+int ClientImpl::SendMessage(uint32_t msgID, SendMsgDesc desc, uint32_t len,
+	bool packedBatch)
 // send the zero-copy message and release the descriptor
 //-----------------------------------------------------------------------------
 {
 	dbprintf(kDebug,"%s\n",__PRETTY_FUNCTION__);
 
 	ClientSendManager::DescriptorReleaser releaser(desc,sendMgr);
+	// keep the order messages were given to us in
+	if (batchDesc && !packedBatch)
+		FlushMessageBatch();
 	const SendMsgSegment* seg = desc;
 	if (!seg) {
 		throw std::runtime_error("null descriptor passed to SendMessage");
@@ -270,17 +428,84 @@ int ClientImpl::SendMessage(uint32_t msgID, SendMsgDesc desc, uint32_t len)
 	}
 	// loop over and fill out the number of segments actually used
 	unsigned segmentsUsed = segIdx;
-	double sendTime = 0; // FIXME
+	double sendTime = 0;
+	if (opts.timestampClock!=ClientOptions::eNoTimestamps)
+		sendTime = timestamper.Now();
 	for (unsigned segIdx=0; segIdx<segmentsUsed; segIdx++) {
 		blockInfo[segIdx].numSegments = segmentsUsed;
 		blockInfo[segIdx].sendTime = sendTime;
 	}
-	int result = SendBlocksAndInfo(blockIDs,&blockInfo[0],segmentsUsed);
+	if (packedBatch) {
+		if (segmentsUsed!=1)
+			throw std::runtime_error("ClientImpl::SendMessage packed batch spans segments");
+		blockInfo[0].segmentNumber = BlockInfo::kPackedBatch;
+	}
+	int result = SubmitBlocksAndInfo(blockIDs,&blockInfo[0],segmentsUsed);
 	SendRetiredSlabs();
 	//if (result>0) sendMsgCount++; FIXME?
 	return result>0 ? len : result; // return message length if successful
 }
 
+//-----------------------------------------------------------------------------
+int ClientImpl::BatchMessage(uint32_t msgID, const void* msg, uint32_t len)
+// copy a small message into the packed batch (see BlockInfo)
+//-----------------------------------------------------------------------------
+{
+	dbprintf(kDebug,"%s\n",__PRETTY_FUNCTION__);
+
+	const uint32_t kAlign = BlockInfo::kPackedAlign;
+	uint32_t capacity = shm.LargeBlockSize();
+	if (batchDesc && msgID!=batchMsgID)
+		FlushMessageBatch();
+	// this message starts aligned, and the trailer grows by a length
+	uint32_t offset = (batchBytes+kAlign-1) & ~(kAlign-1);
+	uint32_t trailer = (batchLens.size()+2)*sizeof(uint32_t);
+	if (batchDesc && (len>capacity || offset+len+trailer>capacity)) {
+		FlushMessageBatch();
+		offset = 0;
+		trailer = 2*sizeof(uint32_t);
+	}
+	if (len+trailer>capacity) // too large to batch
+		return SendMessage(msgID,msg,len);
+
+	if (!batchDesc) {
+		batchDesc = GetSendMsgDesc(capacity);
+		batchMsgID = msgID;
+	}
+	memcpy((char*)batchDesc->Buf()+offset, msg, len);
+	batchBytes = offset+len;
+	batchLens.push_back(len);
+	return len;
+}
+
+//-----------------------------------------------------------------------------
+int ClientImpl::FlushMessageBatch(void)
+// send the packed batch, returning the number of messages in it
+//-----------------------------------------------------------------------------
+{
+	if (!batchDesc) return 0;
+	dbprintf(kDebug,"%s\n",__PRETTY_FUNCTION__);
+
+	SendMsgDesc desc = batchDesc;
+	batchDesc = 0;
+	unsigned count = batchLens.size();
+	uint32_t len = batchBytes;
+	if (count>1) {
+		// the trailer follows the last message, 4-byte aligned
+		len = (len+sizeof(uint32_t)-1) & ~(sizeof(uint32_t)-1);
+		uint32_t* trailer = (uint32_t*)((char*)desc->Buf()+len);
+		for (unsigned i=0; i<count; i++)
+			trailer[i] = batchLens[i];
+		trailer[count] = count;
+		len += (count+1)*sizeof(uint32_t);
+	}
+	batchBytes = 0;
+	batchLens.clear();
+	// a batch of one is sent as an ordinary message
+	int result = SendMessage(batchMsgID,desc,len,count>1);
+	return result<0 ? result : count;
+}
+
 //-----------------------------------------------------------------------------
 int ClientImpl::SendCCI(uint32_t cciMsgID, const void* msg, uint32_t len)
 //-----------------------------------------------------------------------------
@@ -330,7 +555,7 @@ bool ClientImpl::PendingRecvMessage(void)
 {
 	bool result = recvMgr.PendingMessage();
 	// this retired any invalid segments (checksum or multi-seg problems)
-	SendRetiredSegments();
+	RetireSegments();
 	return result;
 }
 
@@ -351,7 +576,7 @@ ClientImpl::RecvMsgDesc ClientImpl::GetRecvMsgDesc(void)
 	}
 
 	// this may have retired segments
-	if (recvMgr.NumRetiredSegments()) SendRetiredSegments();
+	RetireSegments();
 	return desc;
 }
 
@@ -363,7 +588,7 @@ void ClientImpl::ReleaseRecvMsgDesc(RecvMsgDesc desc)
 
 	recvMgr.ReleaseMessageDescriptor(desc);
 	// this retired segments
-	SendRetiredSegments();
+	RetireSegments();
 }
 
 //-----------------------------------------------------------------------------
@@ -387,11 +612,56 @@ void ClientImpl::HandleCtrlString(uint32_t which, const char* str)
 			dbprintf(kInfo,"- client mapped %u buffer(s)\n", numBuffers);
 			ComputeAndSendNumSlabs();
 			} break;
+		case kCtrlString_ShmRingName:
+			if (ringActive) {
+				MoveToRing(str);
+				break;
+			}
+			try {
+				ring.Open(str);
+				SendShmRing(kShmRing_Attached);
+			} catch (std::runtime_error err) {
+				dbprintf(kNotice,"# client[%d] not using ShmRing: %s\n", clientID, err.what());
+				SendShmRing(kShmRing_Failed);
+			}
+			break;
 		default:
 			dbprintf(kNotice,"# unknown CtrlString type %u in %s\n", which, __PRETTY_FUNCTION__);
 	}
 }
 
+//-----------------------------------------------------------------------------
+void ClientImpl::MoveToRing(const char* name)
+// the manager offers a larger ring, and delivers on the socket until
+// kShmRing_Active (after which it also drains the new one)
+//-----------------------------------------------------------------------------
+{
+	DrainDeliveryRing();
+	deliveryPaused = 1;
+	ShmRing larger;
+	try {
+		larger.Open(name);
+	} catch (std::runtime_error err) {
+		dbprintf(kNotice,"# client[%d] keeping ShmRing: %s\n", clientID, err.what());
+		SendShmRing(kShmRing_Failed);
+		return;
+	}
+	// what we put in this one so far, the manager takes before moving
+	ring.Swap(larger);
+	SendShmRing(kShmRing_Attached);
+	dbprintf(kInfo,"- client[%d] using ShmRing, capacity %u\n", clientID, ring.Capacity());
+}
+
+//-----------------------------------------------------------------------------
+void ClientImpl::HandleShmFDs(uint32_t firstBufNum, const int fds[], unsigned count)
+//-----------------------------------------------------------------------------
+{
+	dbprintf(kDebug,"%s\n",__PRETTY_FUNCTION__);
+	unsigned numBuffers = shm.MapFDs(firstBufNum,fds,count);
+	dbprintf(kInfo,"- client mapped %u anonymous buffer(s)\n", numBuffers);
+	ComputeAndSendNumSlabs();
+}
+
 //-----------------------------------------------------------------------------
 int ClientImpl::ComputeAndSendNumSlabs(void)
 //-----------------------------------------------------------------------------
@@ -407,7 +677,7 @@ int ClientImpl::ComputeAndSendNumSlabs(void)
 	if (prod<1) prod = 1;
 	if (cons<1) cons = 1;
 
-	sendMgr.SetSizeParams(blockSize,slabSize);
+	sendMgr.SetSizeParams(blockSize,slabSize,shm.LargeBlockSize());
 	sendMgr.SetNumTotalSlabs(shm.NumBuffers()*shm.SlabsPerBuffer());
 
 	if (prod==numProdSlabs && cons==numConsSlabs)
@@ -441,6 +711,12 @@ void ClientImpl::HandleNumSlabs(uint32_t prodSlabs, uint32_t consSlabs)
 		sprintf(err,"Manager denied request for numProdSlabs: %u, numConsSlabs: %u", numProdSlabsRqstd, numConsSlabsRqstd);
 		throw std::runtime_error(err);
 	}
+
+	// the manager sizes the rings from our consumer slabs
+	if (opts.shmRings && !ringRequested) {
+		ringRequested = 1;
+		SendShmRing(kShmRing_Request);
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -489,12 +765,59 @@ void ClientImpl::HandleBlockIDs(const uint32_t blockIDs[], unsigned count)
 	recvMgr.AddSegments(blockIDs,blockPtrs,blockInfoPtrs,count);
 }
 
+//-----------------------------------------------------------------------------
+void ClientImpl::HandleShmRing(uint32_t state)
+//-----------------------------------------------------------------------------
+{
+	dbprintf(kDebug,"%s\n",__PRETTY_FUNCTION__);
+	if (!ring.Mapped()) {
+		dbprintf(kNotice,"# unexpected ShmRing state %u in %s\n", state, __PRETTY_FUNCTION__);
+		return;
+	}
+	switch (state) {
+		case kShmRing_Active:
+			// everything the manager sent on the socket before this is handled
+			if (ringActive) { // it is back from a pause
+				deliveryPaused = 0;
+				DrainDeliveryRing();
+				break;
+			}
+			// and we tell it the same before using the rings ourselves
+			SendShmRing(kShmRing_Active);
+			ringActive = 1;
+			dbprintf(kInfo,"- client[%d] using ShmRing, capacity %u\n", clientID, ring.Capacity());
+			DrainDeliveryRing();
+			break;
+		case kShmRing_Paused:
+			// the manager delivers on the socket, after what's in the ring
+			DrainDeliveryRing();
+			deliveryPaused = 1;
+			SendShmRing(kShmRing_PauseAck);
+			break;
+		case kShmRing_PauseAck:
+			// the manager drained our retirements, so we can go back
+			if (!retireViaSocket) break;
+			retireViaSocket = 0;
+			SendShmRing(kShmRing_Active);
+			break;
+		default:
+			dbprintf(kNotice,"# unexpected ShmRing state %u in %s\n", state, __PRETTY_FUNCTION__);
+	}
+}
+
 //-----------------------------------------------------------------------------
 void ClientImpl::HandleRegistration(uint32_t type, int16_t clientID,
 	int16_t groupID, const uint32_t msgIDs[], unsigned count)
 //-----------------------------------------------------------------------------
 {
 	dbprintf(kDebug,"%s\n",__PRETTY_FUNCTION__);
+	if (type==kRegType_RangeList) {
+		if (rangeRegistrationHandler.first && (count&1)) {
+			(*rangeRegistrationHandler.first)(msgIDs[0],clientID,groupID,
+				msgIDs+1,count/2,rangeRegistrationHandler.second);
+		}
+		return;
+	}
 	if (registrationHandler.first) {
 		if (type!=kRegType_RegisterList && type!=kRegType_DeregisterList)
 			return;
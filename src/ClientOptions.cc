@@ -43,6 +43,10 @@ const char* ClientOptions::kCrcStrs[] = {
 	"OFF", "SET", "VERIFY", "ON", "DEFAULT", "UNKNOWN"
 };
 
+const char* ClientOptions::kTimestampClockStrs[] = {
+	"OFF", "MONOTONIC", "COARSE", "TSC"
+};
+
 //-----------------------------------------------------------------------------
 ClientOptions::ClientOptions(const char* argv0, const char* usage_)
 //-----------------------------------------------------------------------------
@@ -63,7 +67,15 @@ void ClientOptions::SetDefaults(const char* argv0)
 	SetDefaultClientName(argv0);
 	verbosity = kDefaultVerbosity;
 	producerNiceLevel = kDefaultProducerNiceLevel;
+	shmRings = kDefaultShmRings;
+	wantedQueueLatency = 0;
+	wantedQueueBytes = kDefaultWantedQueueBytes;
+	contiguousViewBytes = kDefaultContiguousViewBytes;
+	recvBufBytes = kDefaultRecvBufBytes;
+	retireBatchSegs = kDefaultRetireBatchSegs;
+	retireBatchLatency = 1e-3;
 	crcPolicy = kDefaultCrcPolicy;
+	timestampClock = kDefaultTimestampClock;
 }
 
 //-----------------------------------------------------------------------------
@@ -99,6 +111,14 @@ void ClientOptions::PrintUsage(const char* argv0, FILE* f)
 	fprintf(f, "  -c str    ctrlSockName [\"%s\"]\n", ctrlSockName.c_str());
 	fprintf(f, "  -n str    clientName [\"%s\"]\n", clientName.c_str());
 	fprintf(f, "  -p str    crcPolicy string [\"%s\"]\n", DefaultCrcStr());
+	fprintf(f, "  -t str    timestampClock string [\"%s\"]\n", kTimestampClockStrs[kDefaultTimestampClock]);
+	fprintf(f, "  -R        disable shmRings (segments only through the socket)\n");
+	fprintf(f, "  -l float  wantedQueueLatency in seconds [0, a fixed count]\n");
+	fprintf(f, "  -w uint   wantedQueueBytes [0, no bound]\n");
+	fprintf(f, "  -V uint   contiguousViewBytes [0, copy multi-segment messages]\n");
+	fprintf(f, "  -r uint   recvBufBytes [%u]\n", kDefaultRecvBufBytes);
+	fprintf(f, "  -e uint   retireBatchSegs [%u]\n", kDefaultRetireBatchSegs);
+	fprintf(f, "  -E float  retireBatchLatency in seconds [0.001]\n");
 	fprintf(f, "  -v        increase verbosity\n");
 }
 
@@ -115,7 +135,7 @@ int ClientOptions::Parse(int argc, char* const argv[],
 //-----------------------------------------------------------------------------
 {
 	int c;
-	std::string optstring = ":b:B:s:S:c:n:i:p:vh?";
+	std::string optstring = ":b:B:s:S:c:n:i:p:t:Rl:w:V:r:e:E:vh?";
 	if (xtraOpts)
 		optstring += xtraOpts;
 	optind = 1;
@@ -145,6 +165,30 @@ int ClientOptions::Parse(int argc, char* const argv[],
 			case 'p':
 				SetCrcPolicy(optarg);
 				break;
+			case 't':
+				SetTimestampClock(optarg);
+				break;
+			case 'R':
+				shmRings = 0;
+				break;
+			case 'l':
+				wantedQueueLatency = strtof(optarg,0);
+				break;
+			case 'w':
+				wantedQueueBytes = strtoul_po2suffix(optarg);
+				break;
+			case 'V':
+				contiguousViewBytes = strtoul_po2suffix(optarg);
+				break;
+			case 'r':
+				recvBufBytes = strtoul_po2suffix(optarg);
+				break;
+			case 'e':
+				retireBatchSegs = strtoul(optarg,0,0);
+				break;
+			case 'E':
+				retireBatchLatency = strtof(optarg,0);
+				break;
 			case 'v':
 				verbosity++;
 				break;
@@ -183,8 +227,16 @@ void ClientOptions::Print(const char* prefix, FILE* f) const
 	fprintf(f, "%sctrlSockName: \"%s\"\n", prefix, ctrlSockName.c_str());
 	fprintf(f, "%sclientName: \"%s\"\n", prefix, clientName.c_str());
 	fprintf(f, "%scrcPolicyStr: %s\n", prefix, CrcPolicyStr());
+	fprintf(f, "%stimestampClock: %s\n", prefix, TimestampClockStr());
 	fprintf(f, "%sverbosity: %u\n", prefix, verbosity);
 	fprintf(f, "%sproducerNiceLevel: %u\n", prefix, producerNiceLevel);
+	fprintf(f, "%sshmRings: %u\n", prefix, shmRings);
+	fprintf(f, "%swantedQueueLatency: %g\n", prefix, wantedQueueLatency);
+	fprintf(f, "%swantedQueueBytes: %lu\n", prefix, (unsigned long)wantedQueueBytes);
+	fprintf(f, "%scontiguousViewBytes: %lu\n", prefix, (unsigned long)contiguousViewBytes);
+	fprintf(f, "%srecvBufBytes: %lu\n", prefix, (unsigned long)recvBufBytes);
+	fprintf(f, "%sretireBatchSegs: %u\n", prefix, retireBatchSegs);
+	fprintf(f, "%sretireBatchLatency: %g\n", prefix, retireBatchLatency);
 }
 
 //-----------------------------------------------------------------------------
@@ -269,6 +321,32 @@ const char* ClientOptions::DefaultCrcStr(void)
 	return kCrcStrs[eDefaultCrcs];
 }
 
+//-----------------------------------------------------------------------------
+const char* ClientOptions::TimestampClockStr(void) const
+//-----------------------------------------------------------------------------
+{
+	if (timestampClock<eNoTimestamps || timestampClock>eTscClock)
+		return kTimestampClockStrs[kDefaultTimestampClock];
+	return kTimestampClockStrs[timestampClock];
+}
+
+//-----------------------------------------------------------------------------
+ClientOptions::TimestampClock ClientOptions::SetTimestampClock(const char* clockStr)
+//-----------------------------------------------------------------------------
+{
+	for (unsigned i=eNoTimestamps; i<=eTscClock; i++) {
+		if (!strncmp(clockStr,kTimestampClockStrs[i],10)) {
+			return timestampClock = (TimestampClock)i;
+		}
+	}
+
+	// unknown string specified
+	fprintf(stderr, "### Unknown timestamp clock \"%s\" specified, using default \"%s\"\n",
+		clockStr, kTimestampClockStrs[kDefaultTimestampClock]);
+	fprintf(stderr, "### timestamp clock options are OFF, MONOTONIC, COARSE, or TSC\n");
+	return timestampClock = kDefaultTimestampClock;
+}
+
 //-----------------------------------------------------------------------------
 const std::string& ClientOptions::SetDefaultClientName(std::string& s, const char* argv0)
 //-----------------------------------------------------------------------------
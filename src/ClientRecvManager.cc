@@ -35,6 +35,7 @@ ClientRecvManager::~ClientRecvManager(void)
 {
 	while (!freeSegs.empty()) freeSegs.pop_back();
 	while (!pendingSegs.empty()) pendingSegs.pop_back();
+	while (!unpackedSegs.empty()) unpackedSegs.pop_back();
 	while (!busySegs.empty()) busySegs.pop_back();
 	while (!retiredSegs.empty()) retiredSegs.pop_back();
 
@@ -73,6 +74,9 @@ void ClientRecvManager::AddSegments(const uint32_t blockIDs[],
 		seg.next = 0; // we'll deal with this when we check pendingSegs
 		seg.blockInfo = blockInfoPtrs[i];
 		seg.refcnt = 1;
+		seg.parent = 0;
+		seg.crcState = 0;
+		seg.view = 0;
 		pendingSegs.push_back(seg);
 	}
 	numSegmentsRcvd += count;
@@ -97,9 +101,22 @@ ClientRecvManager::MessageDescriptor ClientRecvManager::GetMessageDescriptor(voi
 		pendingMsg = 0;
 		return result;
 	}
+	if (unpackedSegs.size()) return NextUnpacked();
 	
 	while (pendingSegs.size()) {
 		RecvMsgSegment& seg0 = pendingSegs.front();
+		if (seg0.blockInfo->PackedBatch()) {
+			pendingSegs.pop_front();
+			if (UnpackBatch(seg0)) {
+				// held until its last message is released
+				busySegs.push_back(seg0);
+				result = NextUnpacked();
+				break;
+			}
+			// a malformed batch, so drop this seg
+			retiredSegs.push_back(seg0);
+			continue;
+		}
 		unsigned segmentNumber = seg0.blockInfo->segmentNumber;
 		unsigned numSegments = seg0.blockInfo->numSegments;
 		if (segmentNumber || !numSegments || numSegments>numConsSlabs) {
@@ -156,6 +173,22 @@ void ClientRecvManager::ReleaseMessageDescriptor(MessageDescriptor desc)
 //-----------------------------------------------------------------------------
 {
 	RecvMsgSegment* seg = desc;
+	if (seg && seg->parent) {
+		// a message from a packed batch, retire the batch after the last
+		RecvMsgSegment* batch = seg->parent;
+		busySegs.erase(*seg);
+		seg->parent = 0;
+		freeSegs.push_back(*seg);
+		if (!batch->dec()) {
+			busySegs.erase(*batch);
+			retiredSegs.push_back(*batch);
+		}
+		return;
+	}
+	if (seg && seg->view) {
+		views.Release(seg->view);
+		seg->view = 0;
+	}
 	while (seg) {
 		// move from busySegs to retiredSegs
 		busySegs.erase(*seg);
@@ -164,6 +197,74 @@ void ClientRecvManager::ReleaseMessageDescriptor(MessageDescriptor desc)
 	}
 }
 
+//-----------------------------------------------------------------------------
+const void* ClientRecvManager::ContiguousView(MessageDescriptor desc)
+//-----------------------------------------------------------------------------
+{
+	if (desc->Contiguous()) return desc->buf;
+	if (!desc->view) {
+		unsigned numSegments = desc->NumSegments();
+		struct iovec iov[numSegments];
+		desc->GetIovec(iov,numSegments);
+		desc->view = views.Acquire(iov,numSegments);
+	}
+	return desc->view;
+}
+
+//-----------------------------------------------------------------------------
+bool ClientRecvManager::UnpackBatch(RecvMsgSegment& batch)
+// split a packed batch (see BlockInfo) into a segment per message in
+// unpackedSegs, sharing batch's block, and return false if malformed
+//-----------------------------------------------------------------------------
+{
+	const char* buf = (const char*)batch.buf;
+	uint32_t size = batch.size;
+	if (size<sizeof(uint32_t) || size%sizeof(uint32_t)) return 0;
+	const uint32_t* trailerEnd = (const uint32_t*)(buf+size);
+	uint32_t count = trailerEnd[-1];
+	if (!count || count>=size/sizeof(uint32_t)) return 0;
+	const uint32_t* lens = trailerEnd-1-count;
+	uint32_t trailerOffset = (const char*)lens-buf;
+
+	// check every message fits before the trailer
+	uint32_t offset = 0;
+	for (uint32_t i=0; i<count; i++) {
+		if (offset>trailerOffset || lens[i]>trailerOffset-offset) return 0;
+		offset += lens[i];
+		offset = (offset+BlockInfo::kPackedAlign-1) & ~(BlockInfo::kPackedAlign-1);
+	}
+
+	offset = 0;
+	for (uint32_t i=0; i<count; i++) {
+		if (!freeSegs.size()) AddMsgSegBlock();
+		RecvMsgSegment& seg = freeSegs.front();
+		freeSegs.pop_front();
+		seg.buf = (void*)(buf+offset);
+		seg.size = lens[i];
+		seg.blockID = batch.blockID;
+		seg.next = 0;
+		seg.blockInfo = batch.blockInfo;
+		seg.refcnt = 1;
+		seg.parent = &batch;
+		unpackedSegs.push_back(seg);
+		offset += lens[i];
+		offset = (offset+BlockInfo::kPackedAlign-1) & ~(BlockInfo::kPackedAlign-1);
+	}
+	batch.refcnt = count;
+	batch.next = 0;
+	return 1;
+}
+
+//-----------------------------------------------------------------------------
+ClientRecvManager::MessageDescriptor ClientRecvManager::NextUnpacked(void)
+//-----------------------------------------------------------------------------
+{
+	RecvMsgSegment& seg = unpackedSegs.front();
+	unpackedSegs.pop_front();
+	busySegs.push_back(seg);
+	return &seg;
+}
+
 //-----------------------------------------------------------------------------
 unsigned ClientRecvManager::GetRetiredSegments(uint32_t blockIDs[],
 	unsigned maxCount)
@@ -186,8 +287,12 @@ void ClientRecvManager::PrintState(const char* prefix) const
 {
 	fprintf(stderr,"%sfreeSegs.size: %lu\n", prefix, freeSegs.size());
 	fprintf(stderr,"%spendingSegs.size: %lu\n", prefix, pendingSegs.size());
+	fprintf(stderr,"%sunpackedSegs.size: %lu\n", prefix, unpackedSegs.size());
 	fprintf(stderr,"%sbusySegs.size: %lu\n", prefix, busySegs.size());
 	fprintf(stderr,"%sretiredSegs.size: %lu\n", prefix, retiredSegs.size());
+	fprintf(stderr,"%sviews: { num: %u, bytes: %lu, hits: %llu, misses: %llu }\n",
+		prefix, views.NumViews(), (unsigned long)views.MappedBytes(),
+		(unsigned long long)views.NumHits(), (unsigned long long)views.NumMisses());
 }
 
 } // namespace MCSB
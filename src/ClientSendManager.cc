@@ -28,7 +28,7 @@ namespace MCSB {
 //-----------------------------------------------------------------------------
 ClientSendManager::ClientSendManager(void)
 //-----------------------------------------------------------------------------
-:	blockSize(0), slabSize(0), blocksPerSlab(0),
+:	blockSize(0), slabSize(0), blocksPerSlab(0), blocksPerLarge(1),
 	maxWorkingSlabs(1), slabsHeld(0), segs(0)
 {
 	AddMsgSegBlock();
@@ -48,6 +48,7 @@ ClientSendManager::~ClientSendManager(void)
 
 	while (!freeSlabs.empty()) freeSlabs.pop_back();
 	while (!workingSlabs.empty()) workingSlabs.pop_back();
+	while (!smallSlabs.empty()) smallSlabs.pop_back();
 	while (!fullSlabs.empty()) fullSlabs.pop_back();
 	while (!retiredSlabs.empty()) retiredSlabs.pop_back();
 
@@ -58,13 +59,17 @@ ClientSendManager::~ClientSendManager(void)
 }
 
 //-----------------------------------------------------------------------------
-void ClientSendManager::SetSizeParams(uint32_t blockSz, uint32_t slabSz)
+void ClientSendManager::SetSizeParams(uint32_t blockSz, uint32_t slabSz,
+	uint32_t largeBlockSz)
 //-----------------------------------------------------------------------------
 {
 	blockSize = blockSz;
 	slabSize = slabSz;
 	blocksPerSlab = slabSize/blockSize;
 	assert(slabSize==blocksPerSlab*blockSize);
+	blocksPerLarge = 1;
+	if (largeBlockSz>blockSize && !(largeBlockSz%blockSize) && !(slabSize%largeBlockSz))
+		blocksPerLarge = largeBlockSz/blockSize;
 }
 
 //-----------------------------------------------------------------------------
@@ -122,7 +127,7 @@ unsigned ClientSendManager::SlabInfo::Alloc(unsigned blocks)
 
 //-----------------------------------------------------------------------------
 SendMsgSegment*
-	ClientSendManager::GetSegment(unsigned nBlocks, bool noFreeSlabs)
+	ClientSendManager::GetSegment(unsigned nBlocks, bool noFreeSlabs, bool small)
 // get a single contiguous segment, optionally disallow harvesting freeSlabs
 //-----------------------------------------------------------------------------
 {
@@ -130,12 +135,13 @@ SendMsgSegment*
 		throw std::runtime_error("ClientSendManager::GetSegment: nBlocks exceeds blocksPerSlab");
 	}
 	
+	SlabList& working = small ? smallSlabs : workingSlabs;
 	SlabList::iterator it;
 	bool found = 0;
 	
 	if (nBlocks<blocksPerSlab) {
-		// look for room in workingSlabs to allocate nBlocks
-		for (it = workingSlabs.begin(); it!=workingSlabs.end(); ++it) {
+		// look for room in the working slabs to allocate nBlocks
+		for (it = working.begin(); it!=working.end(); ++it) {
 			unsigned blocksLeft = blocksPerSlab - it->BlocksUsed();
 			if (blocksLeft>=nBlocks) { // we found a place
 				found = 1;
@@ -151,9 +157,9 @@ SendMsgSegment*
 		}
 		SlabInfo& info = freeSlabs.front();
 		freeSlabs.pop_front();
-		workingSlabs.push_back(info);
+		working.push_back(info);
 		info.Working(1);
-		it = SlabList::iterator(&workingSlabs.back()); // point at the new element
+		it = SlabList::iterator(&working.back()); // point at the new element
 	}
 
 	// --- we will allocate a segment from the slab at *it
@@ -174,18 +180,18 @@ SendMsgSegment*
 	seg.blockID = slab.SlabID()*blocksPerSlab + blockIndex;
 	seg.next = 0;
 
-	// if full, remove from workingSlabs
+	// if full, remove from the working slabs
 	unsigned blocksLeft = blocksPerSlab-slab.BlocksUsed();
 	if (!blocksLeft) {
 		// this block is full
-		workingSlabs.erase(it);
+		working.erase(it);
 		slab.Working(0);
 		fullSlabs.push_back(slab); // not retired because we just alloc'd
 	}
 
-	// check whether we need to reduce workingSlabs
-	if (workingSlabs.size()>maxWorkingSlabs)
-		MaxWorkingSlabs(maxWorkingSlabs);
+	// check whether we need to reduce the working slabs
+	if (working.size()>maxWorkingSlabs)
+		TrimWorkingSlabs(working);
 
 	return &seg;
 }
@@ -199,6 +205,11 @@ ClientSendManager::MessageDescriptor
 
 	unsigned nBlocks = (len-1+blockSize)/blockSize;
 	if (!nBlocks) nBlocks = 1; // even empty messages need a block
+	if (blocksPerLarge>1) {
+		if (nBlocks<blocksPerLarge)
+			return GetSegment(nBlocks,0,1); // the small class
+		nBlocks = (nBlocks+blocksPerLarge-1)/blocksPerLarge*blocksPerLarge;
+	}
 	if (contiguous || nBlocks<=blocksPerSlab)
 		return GetSegment(nBlocks);
 
@@ -234,9 +245,19 @@ unsigned ClientSendManager::MaxWorkingSlabs(unsigned maxSlabs)
 //-----------------------------------------------------------------------------
 {
 	maxWorkingSlabs = maxSlabs;
-	while (workingSlabs.size()>maxWorkingSlabs) {
-		SlabInfo& info = workingSlabs.front();
-		workingSlabs.pop_front();
+	TrimWorkingSlabs(workingSlabs);
+	TrimWorkingSlabs(smallSlabs);
+	return maxWorkingSlabs;
+}
+
+//-----------------------------------------------------------------------------
+void ClientSendManager::TrimWorkingSlabs(SlabList& working)
+//	reduce working to maxWorkingSlabs by removing the oldest
+//-----------------------------------------------------------------------------
+{
+	while (working.size()>maxWorkingSlabs) {
+		SlabInfo& info = working.front();
+		working.pop_front();
 		info.Working(0);
 		if (info.Refcount()) {
 			fullSlabs.push_back(info);
@@ -244,7 +265,6 @@ unsigned ClientSendManager::MaxWorkingSlabs(unsigned maxSlabs)
 			retiredSlabs.push_back(info);
 		}
 	}
-	return maxWorkingSlabs;
 }
 
 //-----------------------------------------------------------------------------
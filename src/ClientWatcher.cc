@@ -30,10 +30,16 @@ ClientWatcher::ClientWatcher(Client& client_, ev::loop_ref loop, float period)
 
 	readable.loop = loop;
 	timer.loop = loop;
+	prepare.loop = loop;
+	retireTimer.loop = loop;
 
 	readable.set<ClientWatcher, &ClientWatcher::HandleEvent>(this);
 	timer.set<ClientWatcher, &ClientWatcher::HandleEvent>(this);
 	timer.set(period,period);
+	prepare.set<ClientWatcher, &ClientWatcher::HandlePrepare>(this);
+	prepare.start();
+	ev_unref(prepare.loop); // the prepare alone must not keep the loop running
+	retireTimer.set<ClientWatcher, &ClientWatcher::HandleRetireTimer>(this);
 
 	int fd = client.FD();
 	if (fd>=0) {
@@ -43,6 +49,14 @@ ClientWatcher::ClientWatcher(Client& client_, ev::loop_ref loop, float period)
 	}
 }
 
+//-----------------------------------------------------------------------------
+ClientWatcher::~ClientWatcher(void)
+//-----------------------------------------------------------------------------
+{
+	ev_ref(prepare.loop);
+	prepare.stop();
+}
+
 //-----------------------------------------------------------------------------
 void ClientWatcher::HandleEvent(void)
 //-----------------------------------------------------------------------------
@@ -60,4 +74,22 @@ void ClientWatcher::HandleEvent(void)
 	}
 }
 
+//-----------------------------------------------------------------------------
+void ClientWatcher::HandlePrepare(void)
+// the loop is about to wait, maybe with released messages still batched
+//-----------------------------------------------------------------------------
+{
+	if (retireTimer.is_active()) return;
+	float timeout = client.RetireBatchTimeout();
+	if (timeout>=0)
+		retireTimer.start(timeout,0);
+}
+
+//-----------------------------------------------------------------------------
+void ClientWatcher::HandleRetireTimer(void)
+//-----------------------------------------------------------------------------
+{
+	client.FlushRetiredSegments();
+}
+
 } // namespace MCSB
@@ -0,0 +1,133 @@
+//=============================================================================
+//	This file is part of MCSB, the Multi-Client Shared Buffer
+//	Copyright (C) 2014  Gregory E. Allen and
+//		Applied Research Laboratories: The University of Texas at Austin
+//
+//	MCSB is free software: you can redistribute it and/or modify it
+//	under the terms of the GNU Lesser General Public License as published
+//	by the Free Software Foundation, either version 2.1 of the License, or
+//	(at your option) any later version.
+//
+//	MCSB is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+//	Lesser General Public License <http://www.gnu.org/licenses/lgpl.html>
+//	for more details.
+//=============================================================================
+
+#include "MCSB/LatencyHistogram.h"
+
+#include <string.h>
+
+namespace MCSB {
+
+//-----------------------------------------------------------------------------
+void LatencyHistogram::Record(double secs)
+//-----------------------------------------------------------------------------
+{
+	uint64_t nsecs = 0;
+	if (secs>0)
+		nsecs = uint64_t(secs*1e9 + 0.5);
+	counts[BucketIndex(nsecs)]++;
+	if (!count || nsecs<minNsecs)
+		minNsecs = nsecs;
+	if (nsecs>maxNsecs)
+		maxNsecs = nsecs;
+	sumNsecs += nsecs;
+	count++;
+}
+
+//-----------------------------------------------------------------------------
+void LatencyHistogram::Reset(void)
+//-----------------------------------------------------------------------------
+{
+	count = 0;
+	minNsecs = maxNsecs = 0;
+	sumNsecs = 0;
+	memset(counts,0,sizeof(counts));
+}
+
+//-----------------------------------------------------------------------------
+double LatencyHistogram::Percentile(double p) const
+//-----------------------------------------------------------------------------
+{
+	if (!count) return 0;
+	uint64_t rank = uint64_t(p*count + 0.5);
+	if (rank<1) rank = 1;
+	uint64_t seen = 0;
+	unsigned idx = 0;
+	for (; idx<kNumBuckets-1; idx++) {
+		seen += counts[idx];
+		if (seen>=rank) break;
+	}
+	// the middle of the bucket, but within what was recorded
+	uint64_t nsecs = (BucketValue(idx) + BucketValue(idx+1)-1) / 2;
+	if (nsecs<minNsecs) nsecs = minNsecs;
+	if (nsecs>maxNsecs) nsecs = maxNsecs;
+	return nsecs/1e9;
+}
+
+//-----------------------------------------------------------------------------
+void LatencyHistogram::Print(const char* prefix, FILE* f) const
+//-----------------------------------------------------------------------------
+{
+	fprintf(f, "%scount %llu, min %.1f, mean %.1f, p50 %.1f, p99 %.1f, p99.9 %.1f, max %.1f usec\n",
+		prefix, (unsigned long long)count, Min()*1e6, Mean()*1e6, Percentile(.5)*1e6,
+		Percentile(.99)*1e6, Percentile(.999)*1e6, Max()*1e6);
+}
+
+//-----------------------------------------------------------------------------
+unsigned LatencyHistogram::BucketIndex(uint64_t nsecs)
+//-----------------------------------------------------------------------------
+{
+	if (nsecs < 2*kSubBuckets)
+		return nsecs;
+	unsigned msb = 63 - __builtin_clzll(nsecs);
+	if (msb>=kMaxBits)
+		return kNumBuckets-1;
+	unsigned shift = msb - kSubBucketBits;
+	return shift*kSubBuckets + (nsecs>>shift);
+}
+
+//-----------------------------------------------------------------------------
+uint64_t LatencyHistogram::BucketValue(unsigned idx)
+//-----------------------------------------------------------------------------
+{
+	if (idx < 2*kSubBuckets)
+		return idx;
+	unsigned shift = idx/kSubBuckets - 1;
+	uint64_t top = idx%kSubBuckets + kSubBuckets;
+	return top << shift;
+}
+
+//-----------------------------------------------------------------------------
+const LatencyHistogram* MsgLatencyHistograms::Delivery(uint32_t msgID) const
+//-----------------------------------------------------------------------------
+{
+	EntryMap::const_iterator it = entries.find(msgID);
+	if (it==entries.end() || !it->second.delivery.Count()) return 0;
+	return &it->second.delivery;
+}
+
+//-----------------------------------------------------------------------------
+const LatencyHistogram* MsgLatencyHistograms::Residence(uint32_t msgID) const
+//-----------------------------------------------------------------------------
+{
+	EntryMap::const_iterator it = entries.find(msgID);
+	if (it==entries.end() || !it->second.residence.Count()) return 0;
+	return &it->second.residence;
+}
+
+//-----------------------------------------------------------------------------
+void MsgLatencyHistograms::Print(const char* prefix, FILE* f) const
+//-----------------------------------------------------------------------------
+{
+	for (EntryMap::const_iterator it=entries.begin(); it!=entries.end(); ++it) {
+		fprintf(f, "%smsgID %u delivery:  ", prefix, it->first);
+		it->second.delivery.Print("",f);
+		fprintf(f, "%smsgID %u residence: ", prefix, it->first);
+		it->second.residence.Print("",f);
+	}
+}
+
+} // namespace MCSB
@@ -21,10 +21,12 @@
 
 #include "MCSB/SocketEndpoint.h"
 #include "MCSB/ShmClient.h"
+#include "MCSB/ShmRing.h"
 #include "MCSB/ClientOptions.h"
 #include "MCSB/ClientSendManager.h"
 #include "MCSB/ClientRecvManager.h"
 #include "MCSB/ClientCallbacks.h"
+#include "MCSB/Timestamper.h"
 
 namespace MCSB {
 
@@ -33,6 +35,9 @@ class ClientImpl : public SocketEndpoint {
 	ClientImpl(int fd, const ClientOptions& opts);
 	~ClientImpl(void);
 
+	// drains the delivery ring before (and instead of blocking on) the socket
+	int Poll(float timeout=-1.);
+
 	int16_t ClientID(void) const { return clientID; }
 	int16_t RequestGroupID(const char* groupStr, bool wait=1);
 	
@@ -40,6 +45,11 @@ class ClientImpl : public SocketEndpoint {
 		{ return SendRegistration(kRegType_RegisterList,msgIDs,count); }
 	int DeregisterMsgIDs(uint32_t msgIDs[], unsigned count)
 		{ return SendRegistration(kRegType_DeregisterList,msgIDs,count); }
+	// firstLast holds numRanges inclusive first,last pairs
+	int RegisterMsgIDRanges(const uint32_t firstLast[], unsigned numRanges)
+		{ return SendRangeRegistration(true,firstLast,numRanges); }
+	int DeregisterMsgIDRanges(const uint32_t firstLast[], unsigned numRanges)
+		{ return SendRangeRegistration(false,firstLast,numRanges); }
 
 	// copying sends
 	int SendMessage(uint32_t msgID, const void* msg, uint32_t len);
@@ -51,19 +61,34 @@ class ClientImpl : public SocketEndpoint {
 	// get a descriptor where we can place the message data for sending
 	SendMsgDesc GetSendMsgDesc(uint32_t len, bool contiguous=1, bool poll=1);
 	// send the zero-copy message and release the descriptor
-	int SendMessage(uint32_t msgID, SendMsgDesc desc, uint32_t len);
+	int SendMessage(uint32_t msgID, SendMsgDesc desc, uint32_t len,
+		bool packedBatch=0);
 	// release the descriptor without sending
 	void ReleaseSendMsgDesc(SendMsgDesc desc);
 
+	// copy a small message into a batch packed into a single block,
+	// sent when full, on a different msgID, or any other send or flush
+	int BatchMessage(uint32_t msgID, const void* msg, uint32_t len);
+	int FlushMessageBatch(void); // returns the number of messages sent
+	unsigned NumBatchedMessages(void) const { return batchLens.size(); }
+
 	// methods for receiving messages via descriptors
 	bool PendingRecvMessage(void);
 	RecvMsgDesc GetRecvMsgDesc(void);
 	void ReleaseRecvMsgDesc(RecvMsgDesc desc);
+	// remapped if segmented (as opts.contiguousViewBytes allows), or 0
+	const void* ContiguousView(RecvMsgDesc desc)
+		{ return recvMgr.ContiguousView(desc); }
+
+	int SendRetiredSegments(void); // now, rather than batched
+	float RetireBatchTimeout(void) const; // until they must be sent, <0 if none
 
 	unsigned PendingRecvSegments(void) const
 		{ return recvMgr.NumPendingSegments(); }
 	uint64_t NumSegmentsRcvd(void) const
 		{ return recvMgr.NumSegmentsRcvd(); }
+	// on the clock that stamps sent messages
+	double CurrentTime(void) const { return timestamper.Now(); }
 
 	uint32_t BlockSize(void) const { return shm.BlockSize(); }
 	uint32_t SlabSize(void) const { return shm.SlabSize(); }
@@ -72,8 +97,9 @@ class ClientImpl : public SocketEndpoint {
 	uint32_t MaxSendMessageSize(void) const { return numProdSlabs*SlabSize(); }
 	uint32_t MaxRecvMessageSize(void) const { return numConsSlabs*SlabSize(); }
 
-	int SendSequenceToken(void)
-		{ return SocketEndpoint::SendSequenceToken(++sequenceTokenSent); }
+	int SendSequenceToken(void) // after any batched retirements
+		{ SendRetiredSegments();
+			return SocketEndpoint::SendSequenceToken(++sequenceTokenSent); }
 	unsigned PendingSequenceTokens(void) const;
 	
 	// handling dropped segment handler (arg is user data)
@@ -88,7 +114,16 @@ class ClientImpl : public SocketEndpoint {
 	// handling registration events (arg is user data)
 	void SetRegistrationHandler(RegistrationHandler func, void* arg=0)
 		{ registrationHandler = std::make_pair(func,arg);
-			SendRegistrationsWanted(!!func); }
+			SendRegistrationsWanted(func || rangeRegistrationHandler.first); }
+	void SetRangeRegistrationHandler(RangeRegistrationHandler func, void* arg=0)
+		{ rangeRegistrationHandler = std::make_pair(func,arg);
+			SendRegistrationsWanted(func || registrationHandler.first); }
+	// both at once, with a single request for the current registrations
+	void SetRegistrationHandlers(RegistrationHandler func, void* arg,
+		RangeRegistrationHandler rangeFunc, void* rangeArg)
+		{ registrationHandler = std::make_pair(func,arg);
+			rangeRegistrationHandler = std::make_pair(rangeFunc,rangeArg);
+			SendRegistrationsWanted(func || rangeFunc); }
 
 	// CCI interfaces
 	int SendCCI(uint32_t cciMsgID, const void* msg, uint32_t len);
@@ -98,33 +133,52 @@ class ClientImpl : public SocketEndpoint {
   protected:
 	ShmClient shm;
 	ClientOptions opts;
+	Timestamper timestamper;
 	ClientSendManager sendMgr;
 	ClientRecvManager recvMgr;
+	ShmRing ring;
+	bool ringRequested;
+	bool ringActive;
+	bool retireViaSocket; // the retirement ring filled up, until kShmRing_PauseAck
+	bool deliveryPaused;  // the manager's delivery ring, until kShmRing_Active
 	int16_t clientID;
 	uint32_t numProdSlabs, numProdSlabsRqstd;
 	uint32_t numConsSlabs, numConsSlabsRqstd;
 	uint32_t sequenceTokenSent;
 	uint32_t sequenceTokenRcvd;
 	std::vector<BlockInfo> blockInfo;
+	SendMsgDesc batchDesc; // being packed
+	uint32_t batchMsgID;
+	uint32_t batchBytes;
+	std::vector<uint32_t> batchLens;
+	double retiredSince; // when retired segments began waiting, <0 if none
 	std::pair<DropReportHandler,void*> dropReportHandler;
 	std::pair<ConnectionEventHandler,void*> connectionEventHandler;
 	std::pair<RegistrationHandler,void*> registrationHandler;
+	std::pair<RangeRegistrationHandler,void*> rangeRegistrationHandler;
 
 	uint64_t crcErrors;
 	uint64_t sendCallingPoll;
 
 	int SendRegistration(uint32_t type, const uint32_t msgIDs[], unsigned count);
+	int SendRangeRegistration(bool reg, const uint32_t firstLast[], unsigned numRanges);
 	int SendRetiredSlabs(void);
-	int SendRetiredSegments(void);
+	int RetireSegments(void); // sends them per opts.retireBatch*
+	int SubmitBlocksAndInfo(const uint32_t blockIDs[], const BlockInfo info[], unsigned count);
+	unsigned DrainDeliveryRing(void);
 	int SendSequenceToken(uint32_t token); // make protected
 
 	void HandleClientID(int16_t id);
 	void HandleCtrlString(uint32_t which, const char* str);
+	void MoveToRing(const char* name);
+	void HandleShmFDs(uint32_t firstBufNum, const int fds[], unsigned count);
 	int ComputeAndSendNumSlabs(void);
 	void HandleNumSlabs(uint32_t prodSlabs, uint32_t consSlabs);
 	void HandleDropReport(uint32_t segs, uint32_t bytes);
 	void HandleSlabIDs(const uint32_t slabIDs[], unsigned count);
 	void HandleBlockIDs(const uint32_t blockIDs[], unsigned count);
+	void HandleShmRing(uint32_t state);
+	void HandleRingDoorbell(void) { DrainDeliveryRing(); }
 	void HandleManagerEcho(const void* ptr, uint16_t len) {} // do nothing
 	void HandleRegistration(uint32_t type, int16_t clientID, int16_t groupID, const uint32_t msgIDs[], unsigned count);
 
@@ -20,6 +20,7 @@
 #pragma once
 
 #include "MCSB/MessageSegment.h"
+#include "MCSB/ShmViewCache.h"
 
 #include <stdint.h>
 #include <sys/uio.h>
@@ -38,7 +39,8 @@ class ClientRecvManager {
 		const BlockInfo* blockInfoPtrs[], unsigned count);
 	unsigned GetRetiredSegments(uint32_t blockIDs[], unsigned maxCount); // returns count
 	unsigned NumFreeSegments(void) const { return freeSegs.size(); }
-	unsigned NumPendingSegments(void) const { return pendingSegs.size(); }
+	unsigned NumPendingSegments(void) const
+		{ return pendingSegs.size()+unpackedSegs.size(); }
 	unsigned NumBusySegments(void) const { return busySegs.size(); }
 	unsigned NumRetiredSegments(void) const { return retiredSegs.size(); }
 
@@ -46,6 +48,10 @@ class ClientRecvManager {
 	bool PendingMessage(void);
 	MessageDescriptor GetMessageDescriptor(void); // next message
 	void ReleaseMessageDescriptor(MessageDescriptor desc);
+	// the whole message in one piece, remapped if segmented, or 0
+	const void* ContiguousView(MessageDescriptor desc);
+	void MaxViewBytes(size_t n) { views.MaxBytes(n); }
+	const ShmViewCache& Views(void) const { return views; }
 
 	uint64_t NumSegmentsRcvd(void) const { return numSegmentsRcvd; }
 	unsigned NumConsSlabs(unsigned n) { return numConsSlabs=n; }
@@ -56,13 +62,17 @@ class ClientRecvManager {
 	typedef IntrusiveList<RecvMsgSegment> MsgSegList;
 	MsgSegList freeSegs;    // unused/empty
 	MsgSegList pendingSegs; // received but unchecked
+	MsgSegList unpackedSegs; // messages split from a packed batch, not yet gotten
 	MsgSegList busySegs;    // checked and potentially in use
 	MsgSegList retiredSegs; // ready to be sent back to manager
 	RecvMsgSegment* pendingMsg; // helper for PendingMessages
 	uint32_t numConsSlabs;
 	uint64_t numSegmentsRcvd;
 	std::vector<RecvMsgSegment*> segs;
+	ShmViewCache views;
 	void AddMsgSegBlock(void);
+	bool UnpackBatch(RecvMsgSegment& batch);
+	MessageDescriptor NextUnpacked(void);
 };
 
 } // namespace MCSB
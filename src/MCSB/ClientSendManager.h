@@ -33,12 +33,18 @@ class SendMsgSegment;
 // this class holds a pool of producer slabs and manages the policy
 // for allocating space in the pool for sending messages
 
+// When largeBlockSize is a multiple of blockSize, there are two block-size
+// classes: messages smaller than largeBlockSize are packed in blocks of
+// blockSize into small slabs, and the rest are allocated in whole large
+// blocks from other slabs, so that they stay page-aligned. A slab is of
+// one class from when it is taken from freeSlabs until it is retired.
+
 class ClientSendManager {
   public:
 	ClientSendManager(void);
 	~ClientSendManager(void);
 
-	void SetSizeParams(uint32_t blockSz, uint32_t slabSz);
+	void SetSizeParams(uint32_t blockSz, uint32_t slabSz, uint32_t largeBlockSz=0);
 	void SetNumTotalSlabs(uint32_t numTotalSlabs);
 	unsigned MaxWorkingSlabs(unsigned mxWorkingSlabs);
 	unsigned MaxWorkingSlabs(void) const { return maxWorkingSlabs; }
@@ -49,7 +55,7 @@ class ClientSendManager {
 
 	unsigned SlabsHeld(void) const { return slabsHeld; }
 	unsigned NumFreeSlabs(void) const { return freeSlabs.size(); }
-	unsigned NumWorkingSlabs(void) const { return workingSlabs.size(); }
+	unsigned NumWorkingSlabs(void) const { return workingSlabs.size() + smallSlabs.size(); }
 	unsigned NumFullSlabs(void) const { return fullSlabs.size(); }
 	unsigned NumRetiredSlabs(void) const { return retiredSlabs.size(); }
 
@@ -63,10 +69,11 @@ class ClientSendManager {
 	uint32_t blockSize;
 	uint32_t slabSize;
 	unsigned blocksPerSlab;
+	unsigned blocksPerLarge; // blocks in a large block, 1 for a single class
 	unsigned maxWorkingSlabs;
 	unsigned slabsHeld;
 
-	SendMsgSegment* GetSegment(unsigned nBlocks, bool noFreeSlabs=0);
+	SendMsgSegment* GetSegment(unsigned nBlocks, bool noFreeSlabs=0, bool small=0);
 
 	class SlabInfo;
 	typedef IntrusiveList<SlabInfo> SlabList;
@@ -74,6 +81,7 @@ class ClientSendManager {
 	// slabs move from freeSlabs -> workingSlabs -> fullSlabs -> retiredSlabs
 	SlabList freeSlabs;    // slabs completely unused
 	SlabList workingSlabs; // where allocation is currently occurring
+	SlabList smallSlabs;   // the same, for the small block-size class
 	SlabList fullSlabs;    // completely allocated, but non-zero refcount
 	SlabList retiredSlabs; // slabs no longer in use
 
@@ -86,6 +94,7 @@ class ClientSendManager {
 
 	std::vector<SendMsgSegment*> segs;
 	void AddMsgSegBlock(void);
+	void TrimWorkingSlabs(SlabList& working);
 };
 
 //-----------------------------------------------------------------------------
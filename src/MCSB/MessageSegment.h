@@ -66,15 +66,19 @@ class RecvMsgSegment :
 	public IntrusiveList<RecvMsgSegment>::Hook
 {
   public:
-	RecvMsgSegment(void): blockInfo(0), refcnt(1) {}
+	RecvMsgSegment(void): blockInfo(0), refcnt(1), parent(0), crcState(0), view(0) {}
 	const void* Buf(void) const { return buf; }
 	const RecvMsgSegment* Next(void) const { return static_cast<RecvMsgSegment*>(next); }
 	uint32_t MessageID(void) const { return blockInfo->messageID; }
+	double SendTime(void) const { return blockInfo->sendTime; }
 	bool ValidCRC(bool ignoreZeros, bool allSegs=1) const;
 	size_t CopyToBuffer(void* dst, size_t maxlen) const;
   protected:
 	const BlockInfo* blockInfo;
 	unsigned refcnt;
+	RecvMsgSegment* parent; // the packed batch segment this message is in
+	mutable int crcState; // of a packed batch: 0 unchecked, 1 valid, -1 invalid
+	const void* view; // of the whole message, remapped to be contiguous
 	friend class ClientRecvManager;
 	friend class RecvMessageDescriptor;
 	void inc(void) { ++refcnt; }
@@ -35,10 +35,14 @@ class ShmClient { // maps for a client
 	void NameFormat(const char* nameFmt); // set once after empty ctor
 
 	unsigned MapBuffers(void); // will map additional buffers if available
+	// or, instead of a nameFmt, map anonymous buffers from their fds
+	// (passed by the Manager), taking ownership of (and closing) the fds
+	unsigned MapFDs(unsigned firstBufNum, const int fds[], unsigned count);
 	unsigned NumBuffers(void) const { return headerVec.size(); }
 
 	const ShmHeader* GetShmHeader(unsigned bufNum=0) const { return headerVec[bufNum]; }
 	uint32_t BlockSize(void) const { return blockSize; }
+	uint32_t LargeBlockSize(void) const { return largeBlockSize; }
 	uint32_t SlabSize(void) const { return slabSize; }
 	uint32_t SlabsPerBuffer(void) const
 		{ return numBlocks*blockSize/slabSize; }
@@ -51,7 +55,7 @@ class ShmClient { // maps for a client
 	char* GetWriteableBlockPtr(unsigned blockID) const;
 
 	const BlockInfo* GetBlockInfo(unsigned bufNum, unsigned blockOffset) const
-		{ return infoVec[bufNum] + blockOffset; }
+		{ return (const BlockInfo*)(infoVec[bufNum] + blockOffset*infoStride); }
 	const char* GetBlockPtr(unsigned bufNum, unsigned blockOffset) const
 		{ return blockVec[bufNum] + blockOffset*blockSize; }
 	char* GetWriteableBlockPtr(unsigned bufNum, unsigned blockOffset) const
@@ -60,20 +64,25 @@ class ShmClient { // maps for a client
   protected:
 	std::string nameFormat;
 	uint32_t blockSize;
+	uint32_t largeBlockSize;
 	uint32_t slabSize;
 	uint32_t numBlocks; // in a single buffer
 	size_t bufSize;     // of a single buffer
 	size_t blksSize;    // in a single buffer
 	unsigned blocksPerSlab;
+	uint32_t infoStride; // between BlockInfos, as negotiated in the header
 	std::vector<const ShmHeader*> headerVec; // of length numBuffers
-	std::vector<const BlockInfo*> infoVec;
+	std::vector<const char*> infoVec;
 	std::vector<const char*> blockVec;
 	std::vector<char*> blockVecWrt;
 
 	void Initialize(void);
+	void Initialize(const ShmHeader& hdr);
 	void GetFirstHeader(ShmHeader& hdr);
+	void ReadHeader(int shmFD, const std::string& shmName, ShmHeader& hdr) const;
 	int OpenShm(unsigned bufNum, std::string& shmName) const;
 	void Map(unsigned bufNum, const ShmHeader* refhdr);
+	void Map(unsigned bufNum, const ShmHeader* refhdr, int shmFD, const std::string& shmName);
 };
 
 } // namespace MCSB
@@ -22,14 +22,30 @@
 // A single shared memory buffer consists of:
 //  - a ShmHeader (padded up to kMappingAlignment)
 //  - a vector of BlockInfo structures of length blocksPerBuffer (also padded)
+//    each at a stride of infoStride bytes (a multiple of the cache line, v2)
 //  - a vector of blocks of length blocksPerBuffer
 
 // The entire buffer is mapped read-write by the manager
 // Each client maps the entire buffer read-only (for consuming data), and
 // then optionally remaps (elsewhere) the blocks as writeable (for producing)
 
+// A blockID counts blocks of blockSize. If largeBlockSize is larger (v3),
+// blockSize is a small block-size class: producers pack messages smaller
+// than largeBlockSize into slabs of small blocks, and allocate the others in
+// whole large blocks from other slabs, so only those stay page-aligned.
+
+// The blocks and the buffer are aligned to pageSize, which is larger than
+// the system page size when the buffer is backed by huge pages. A buffer
+// name with no '/' after the first character is a POSIX shared memory
+// object, otherwise it is a file path, e.g. in a hugetlbfs mount.
+
+// Version 2 gives each BlockInfo its own cache line, so the manager writing
+// one does not invalidate the line that consumers are reading a neighbour
+// from. Version 1 buffers (packed BlockInfos) are still accepted by clients.
+
 #include <stdint.h>
 #include <stddef.h>
+#include <sys/types.h>
 
 namespace MCSB {
 
@@ -52,22 +68,38 @@ struct ShmHeader {
 	uint32_t slabSize;        // a multiple of a block
 	uint32_t numBlocks;       // in this buffer
 	uint32_t infoSize;        // of a BlockInfo
+	uint32_t pageSize;        // blockOffset and the sizes are multiples
+	uint32_t infoStride;      // between BlockInfos (version 2 and later)
+	uint32_t largeBlockSize;  // a multiple of blockSize (version 3 and later)
 
 	enum { kSyncWord = 0x4D435342 }; // 'MCSB'
-	enum { kVersion = 1 };
+	enum { kVersion = 3 };
+	enum { kMinVersion = 1 }; // oldest layout a client can read
+	enum { kCacheLineSize = 64 };
 	
 	ShmHeader(void) : numBuffers(0) {}
 	ShmHeader(uint32_t blkSz, uint32_t slbSz, uint32_t numBlks,
-		uint32_t numBufs=1, uint32_t mxNumBufs=1);
+		uint32_t numBufs=1, uint32_t mxNumBufs=1, uint32_t pgSz=0,
+		uint32_t largeBlkSz=0);
 	
 	static uint32_t PaddedSize(void);
 	bool ValidHeader(void) const;
+	uint32_t InfoStride(void) const
+		{ return shmVersion<2 ? infoSize : infoStride; }
+	uint32_t LargeBlockSize(void) const
+		{ return shmVersion<3 ? blockSize : largeBlockSize; }
 	size_t TotalBlocksSize(void) const;
 	size_t TotalBufferSize(void) const;
 	bool IsContiguous(unsigned startBlock, unsigned runLen) const;
 };
 
 
+// open and unlink a buffer by name, as shm_open and shm_unlink
+bool ShmNameIsPath(const char* name);
+int ShmOpen(const char* name, int oflag, mode_t mode);
+int ShmUnlink(const char* name);
+
+
 //-----------------------------------------------------------------------------
 // BlockInfo is in shared memory, maintained by the manager and accessed
 // (read only) by clients
@@ -78,12 +110,20 @@ class BlockInfo {
 	uint32_t messageID;
 	uint32_t size;    // possibly spanning multiple contiguous blocks
 	uint32_t crc32c;    // of the segment
-	uint16_t segmentNumber; // 0 to numSegments-1
+	uint16_t segmentNumber; // 0 to numSegments-1, or kPackedBatch
 	uint16_t numSegments;   // when segmenting larger messages
 	double   sendTime;  // in seconds
 
+	// a single segment (numSegments==1) holding several small messages
+	// for the same messageID, packed 8-byte aligned from the start of the
+	// segment and followed by a trailer: uint32_t lengths[count], then
+	// uint32_t count as the last word (size includes the trailer)
+	enum { kPackedBatch = 0xFFFF, kPackedAlign = 8 };
+	bool PackedBatch(void) const
+		{ return segmentNumber==kPackedBatch && numSegments==1; }
+
 	BlockInfo(void);
-	static uint32_t PaddedSize(unsigned numBlockInfos);
+	static uint32_t PaddedSize(unsigned numBlockInfos, uint32_t stride);
 };
 
 
@@ -0,0 +1,128 @@
+//=============================================================================
+//	This file is part of MCSB, the Multi-Client Shared Buffer
+//	Copyright (C) 2014  Gregory E. Allen and
+//		Applied Research Laboratories: The University of Texas at Austin
+//
+//	MCSB is free software: you can redistribute it and/or modify it
+//	under the terms of the GNU Lesser General Public License as published
+//	by the Free Software Foundation, either version 2.1 of the License, or
+//	(at your option) any later version.
+//
+//	MCSB is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+//	Lesser General Public License <http://www.gnu.org/licenses/lgpl.html>
+//	for more details.
+//=============================================================================
+
+#ifndef MCSB_ShmRing_h
+#define MCSB_ShmRing_h
+#pragma once
+
+// A ShmRing is a small shared memory object holding single-producer
+// single-consumer rings between the manager and one client:
+//  - kDelivery: manager -> client, blockIDs of segments to be received
+//  - kRetirement: client -> manager, blockIDs of segments retired (in order)
+//  - kSubmission: client -> manager, segments sent (blockID and BlockInfo)
+// The socket is still used for control, and for a doorbell that is only sent
+// when the ring's consumer has gone idle (see ArmDoorbell/TakeDoorbell).
+
+#include "MCSB/ShmDefs.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+namespace MCSB {
+
+//-----------------------------------------------------------------------------
+// the indices of one ring, each on its own cache line
+//-----------------------------------------------------------------------------
+
+struct ShmRingIndex {
+	uint32_t head;      // next entry to write, written only by the producer
+	char pad0[60];
+	uint32_t tail;      // next entry to read, written only by the consumer
+	char pad1[60];
+	uint32_t doorbell;  // set by an idle consumer, cleared by the producer
+	char pad2[60];
+};
+
+// an entry of the kSubmission ring, what kCtrlMsgID_BlocksAndInfo carries
+struct ShmRingSubmission {
+	uint32_t blockID;
+	uint32_t reserved;
+	BlockInfo info;
+};
+
+struct ShmRingHeader {
+	uint32_t syncWord;
+	uint32_t ringVersion;
+	uint32_t capacity;        // entries in each ring, a power of 2
+	uint32_t entryOffset;     // from this to the kDelivery ring's entries
+	uint32_t submitOffset;    // from this to the kSubmission ring's entries
+	char pad[44];
+	ShmRingIndex index[3];
+
+	enum { kSyncWord = 0x474E4952 }; // 'RING'
+	enum { kVersion = 1 };
+};
+
+//-----------------------------------------------------------------------------
+
+class ShmRing {
+  public:
+	enum { kDelivery = 0, kRetirement = 1, kSubmission = 2 };
+	enum { kMinCapacity = 256, kMaxCapacity = 1<<20 };
+
+	ShmRing(void);
+	~ShmRing(void);
+
+	// the manager creates (capacity is rounded up to a power of 2)
+	void Create(const char* name, uint32_t minCapacity);
+	// the client opens what the manager created
+	void Open(const char* name);
+	// remove the name once both sides have it mapped
+	void Unlink(void);
+	// unmap (and unlink), as the destructor does
+	void Close(void);
+	// exchange mappings, when the manager replaces a ring with a larger one
+	void Swap(ShmRing& other);
+
+	bool Mapped(void) const { return hdr!=0; }
+	const std::string& Name(void) const { return shmName; }
+	uint32_t Capacity(void) const { return capacity; }
+
+	// the producer of ring pushes all of ids[], or returns false if no room
+	bool Push(unsigned ring, const uint32_t ids[], unsigned count);
+	// the consumer of ring pops up to maxCount, returning the number popped
+	unsigned Pop(unsigned ring, uint32_t ids[], unsigned maxCount);
+	bool Empty(unsigned ring) const;
+
+	// the kSubmission ring, with the same semantics as Push and Pop
+	bool Submit(const uint32_t blockIDs[], const BlockInfo info[], unsigned count);
+	unsigned TakeSubmissions(uint32_t blockIDs[], BlockInfo info[], unsigned maxCount);
+
+	// the consumer of ring arms its doorbell when it is about to go idle,
+	// and must then check Empty() again before sleeping
+	void ArmDoorbell(unsigned ring);
+	// the producer of ring calls this after Push, and rings if it returns true
+	bool TakeDoorbell(unsigned ring);
+
+  protected:
+	ShmRingHeader* hdr;
+	uint32_t* entries[2];
+	ShmRingSubmission* submissions;
+	uint32_t capacity;
+	size_t mapSize;
+	std::string shmName;
+	bool linked;
+
+	void Map(int shmFD, bool init);
+	static size_t MapSize(uint32_t capacity);
+	uint32_t Room(unsigned ring, uint32_t& head) const;
+	uint32_t Pending(unsigned ring, uint32_t& tail) const;
+};
+
+} // namespace MCSB
+
+#endif
@@ -0,0 +1,80 @@
+//=============================================================================
+//	This file is part of MCSB, the Multi-Client Shared Buffer
+//	Copyright (C) 2014  Gregory E. Allen and
+//		Applied Research Laboratories: The University of Texas at Austin
+//
+//	MCSB is free software: you can redistribute it and/or modify it
+//	under the terms of the GNU Lesser General Public License as published
+//	by the Free Software Foundation, either version 2.1 of the License, or
+//	(at your option) any later version.
+//
+//	MCSB is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+//	Lesser General Public License <http://www.gnu.org/licenses/lgpl.html>
+//	for more details.
+//=============================================================================
+
+#ifndef MCSB_ShmViewCache_h
+#define MCSB_ShmViewCache_h
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/uio.h>
+#include <map>
+#include <vector>
+
+namespace MCSB {
+
+//-----------------------------------------------------------------------------
+// ShmViewCache makes read-only contiguous views of messages that span
+// several segments, by remapping the segments' shared memory pages next to
+// each other in a reserved range of address space (Linux mremap of a shared
+// mapping with old_size 0), so no bytes are copied. Every segment must start
+// on a page, and every segment but the last must be a whole number of pages.
+// Views are kept (by the pages they map) for reuse, and those not in use are
+// unmapped, least recently used first, to stay within maxBytes.
+//-----------------------------------------------------------------------------
+
+class ShmViewCache {
+  public:
+	ShmViewCache(size_t maxBytes=0); // 0 disables views
+	~ShmViewCache(void);
+
+	void MaxBytes(size_t n); // unmapping idle views over the new bound
+	size_t MaxBytes(void) const { return maxBytes; }
+	size_t MappedBytes(void) const { return mappedBytes; }
+	unsigned NumViews(void) const { return views.size(); }
+	uint64_t NumHits(void) const { return numHits; }
+	uint64_t NumMisses(void) const { return numMisses; }
+
+	// a view of the iovec, in use until released, or 0 if it can't be made
+	const void* Acquire(const struct iovec iov[], int iovcnt);
+	void Release(const void* view);
+
+  protected:
+	struct View {
+		char* addr;
+		size_t len;
+		unsigned users;
+		uint64_t lastUse;
+	};
+	typedef std::vector<uintptr_t> Key; // page-aligned base and length of each segment
+	typedef std::map<Key,View> ViewMap;
+	ViewMap views;
+	std::map<const void*,ViewMap::iterator> byAddr;
+	size_t maxBytes;
+	size_t mappedBytes;
+	size_t pageSize;
+	uint64_t useCount;
+	uint64_t numHits;
+	uint64_t numMisses;
+
+	bool Evict(size_t needBytes); // returns whether needBytes now fit
+	void Unmap(ViewMap::iterator it);
+};
+
+} // namespace MCSB
+
+#endif
@@ -23,6 +23,7 @@
 #include "MCSB/dbprinter.h"
 #include <stdint.h>
 #include <vector>
+#include <deque>
 
 namespace MCSB {
 
@@ -30,12 +31,14 @@ class BlockInfo;
 
 class SocketEndpoint : public dbprinter {
   public:
-	SocketEndpoint(int fd, int verbosity=0, unsigned recvBufCapacity=kMaxCtrlMsgSize);
+	SocketEndpoint(int fd, int verbosity=0, unsigned recvBufCapacity=kDefaultRecvBufSize);
 	virtual ~SocketEndpoint(void);
 
 	int Poll(float timeout=-1.);
 	int FD(void) const { return sockFD; }
 
+	// the largest payload the peer has said it can receive
+	unsigned MaxSendPayload(void) const { return sendPayloadMax; }
 	int SendCtrlMsg(uint16_t msgID, const void* ptr, uint16_t len);
 	int SendCtrlMsg(uint16_t msgID, const void* ptrs[], uint16_t lens[]);
 	int SendBlockIDs(const uint32_t blockIDs[], unsigned count);
@@ -47,6 +50,8 @@ class SocketEndpoint : public dbprinter {
 	int SendDropReportAck(void)
 		{ return SendCtrlMsg(kCtrlMsgID_DropReportAck,(void*)0,0); }
 	int SendRegistration(uint32_t type, int16_t cltID, int16_t grpID, const uint32_t msgIDs[], unsigned count);
+	// firstLast holds numRanges inclusive first,last pairs
+	int SendRangeRegistration(bool reg, int16_t cltID, int16_t grpID, const uint32_t firstLast[], unsigned numRanges);
 	int SendSequenceToken(uint32_t token)
 		{ return SendCtrlMsg(kCtrlMsgID_SequenceToken,&token,sizeof(token)); }
 	int SendClientPID(int32_t pid)
@@ -58,6 +63,17 @@ class SocketEndpoint : public dbprinter {
 		{ return SendCtrlMsg(kCtrlMsgID_ManagerEcho,ptr,len); }
 	int SendProdNiceLevel(int lvl)
 		{ return SendCtrlMsg(kCtrlMsgID_ProdNiceLevel,&lvl,sizeof(lvl)); }
+	int SendNumaNode(int32_t node)
+		{ return SendCtrlMsg(kCtrlMsgID_NumaNode,&node,sizeof(node)); }
+	int SendShmRing(uint32_t state)
+		{ return SendCtrlMsg(kCtrlMsgID_ShmRing,&state,sizeof(state)); }
+	int SendRingDoorbell(void)
+		{ return SendCtrlMsg(kCtrlMsgID_RingDoorbell,(void*)0,0); }
+	int SendSampling(uint32_t first, uint32_t last, uint32_t everyNth, float maxRate);
+	int SendDropPriority(uint32_t first, uint32_t last, int32_t priority);
+	int SendWantedQueueBudget(float latency, uint64_t maxBytes);
+	// the fds are duplicated by the send, and remain owned by the caller
+	int SendShmFDs(uint32_t firstBufNum, const int fds[], unsigned count);
 
 	unsigned GetSendSockBufSize(void) { return GetSockBufSize(1); }
 	unsigned GetRecvSockBufSize(void) { return GetSockBufSize(0); }
@@ -68,21 +84,66 @@ class SocketEndpoint : public dbprinter {
 
 	bool Connected(void) const { return !sendFailed; }
 
+	// when deferring, sends are buffered in order until FlushSends()
+	void DeferSends(bool defer=true);
+	int FlushSends(void);
+	// or only as much as the socket takes without blocking, keeping the rest
+	int FlushSomeSends(void);
+	unsigned PendingSendBytes(void) const { return sendBuf.size()-sendBufHead; }
+	// past this many pending bytes, a deferred send fails (0 is no limit)
+	void LimitSendQueue(unsigned bytes) { sendQueueLimit = bytes; }
+
   protected:
 	int sockFD;
+	// a ring of recvBufCap bytes, from recvHead, followed by room for
+	// copying the start of a control message that wraps so it is contiguous
+	// (both grow when a larger control message arrives)
 	std::vector<char> recvBuf;
+	unsigned recvBufCap;
+	unsigned recvHead;
 	unsigned recvBufLen;
+	unsigned recvIncomplete; // size of the control message Parse stopped in
+	unsigned sendPayloadMax;
+	uint32_t peerFeatures; // kPeerFeature_* bits
+	std::vector<uint32_t> pendingIDs; // deferred, encoded when next flushed
+	std::vector<char> idRunsBuf;
 	bool sendFailed;
 	bool validPeer;
 	bool throwOnPeerDisconnect;
 	int16_t groupID;
+	bool deferSends;
+	std::vector<char> sendBuf;
+	unsigned sendBufHead; // already sent, by FlushSomeSends
+	unsigned sendQueueLimit;
+	std::vector<int> sendFDs; // dups, passed with the next byte sent
+	// ShmFDs frames past kMaxFDs pending fds wait in batches, each with the
+	// sendBuf offset of its first frame, that no send goes past until the
+	// batch moves up to sendFDs
+	typedef std::pair<unsigned,std::vector<int> > HeldFDs;
+	std::deque<HeldFDs> heldFDs;
+	std::deque<int> recvFDs;  // received, not yet claimed by a ShmFDsMsg
 
 	unsigned GetSockBufSize(bool send);
 	void SetSockBufSize(unsigned size, bool send);
 	int SetSocketOptions(void);
 	static int PollFD(int fd, float timeout=-1, short events=0);
-	int Parse(void);
+	int Recv(void);
+	void ParseRecvBuf(void);
+	unsigned ContiguousRecvBytes(void);
+	void GrowRecvBuf(unsigned msgSize);
+	int Parse(uint32_t* blockIDs, unsigned bytesToParse);
+	void DispatchIDs(uint32_t* ids, unsigned count);
+	void DecodeIDRuns(const void* ptr, unsigned len);
 	int SendValidatePeer(void);
+	int SendBytes(const char* buf, unsigned len, const int fds[]=0, unsigned numFDs=0,
+		bool wait=true);
+	void CloseFDs(std::vector<int>& fds);
+	void CloseSendFDs(void); // and heldFDs
+	void NextSendFDs(void);
+	void DeferSend(const void* ptr, unsigned len);
+	int SendRawIDs(const uint32_t ids[], unsigned count);
+	int SendIDRuns(const uint32_t ids[], unsigned count);
+	void EncodePendingIDs(void);
 
 	// all called from inside of Poll()
 	void LocalHandleCtrlMsg(uint16_t msgID, const void* ptr, uint16_t len);
@@ -103,8 +164,18 @@ class SocketEndpoint : public dbprinter {
 	virtual void HandleRegistration(uint32_t type, int16_t clientID, int16_t groupID, const uint32_t msgIDs[], unsigned count);
 	virtual void HandleValidatePeer(uint32_t magic, uint32_t protoVersion);
 	virtual void HandleProdNiceLevel(int32_t lvl);
+	virtual void HandleNumaNode(int32_t node);
+	virtual void HandleShmRing(uint32_t state);
+	virtual void HandleRingDoorbell(void);
+	virtual void HandleSampling(uint32_t first, uint32_t last, uint32_t everyNth, float maxRate);
+	virtual void HandleDropPriority(uint32_t first, uint32_t last, int32_t priority);
+	virtual void HandleWantedQueueBudget(float latency, uint64_t maxBytes);
+	// takes ownership of the fds, and must close them
+	virtual void HandleShmFDs(uint32_t firstBufNum, const int fds[], unsigned count);
 
 	virtual int HandleSendWouldBlock(void);
+	virtual void HandleSendsDeferred(void) {} // sendBuf became non-empty
+	virtual void HandleSendQueueOverflow(void) {} // before the send fails
 
 };
 
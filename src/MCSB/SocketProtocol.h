@@ -45,16 +45,62 @@ namespace MCSB {
 //		previously received (and blockIDs must be retired in order).
 //		To send a run, a client sends kCtrlMsgID_BlocksAndInfo.
 //-----------------------------------------------------------------------------
+//	A client may ask for a ShmRing (see ShmRing.h) with kCtrlMsgID_ShmRing:
+//		Client kShmRing_Request -> Manager creates it, sends kCtrlString_ShmRingName
+//		Client kShmRing_Attached (or kShmRing_Failed) -> Manager unlinks the name
+//		Manager kShmRing_Active -> from here on, the blockIDs that the manager
+//		delivers go through the ring instead of the socket
+//		Client kShmRing_Active -> from here on, the client's retired blockIDs
+//		and its sent segments (BlocksAndInfo) go through the rings, and the
+//		manager drains them before parsing anything it receives on the socket
+//	kCtrlMsgID_RingDoorbell is sent (either way) only when the peer had gone
+//	idle. On a doorbell, the receiver drains its rings.
+//	When the ring it produces (delivery or retirement) is full, a side sends
+//	kShmRing_Paused and then those blockIDs on the socket. The receiver
+//	drains that ring, stops draining it, and answers kShmRing_PauseAck. The
+//	sender then goes back to the ring with kShmRing_Active, and the receiver
+//	drains it again once it reaches that, after the socket's blockIDs.
+//	When a client's slabs outgrow its ShmRing, the manager delivers on the
+//	socket and sends the kCtrlString_ShmRingName of a larger one. The client
+//	drains its delivery ring, moves to the new one, and answers
+//	kShmRing_Attached (or kShmRing_Failed, to keep the old). The manager
+//	drains the old ring, and answers kShmRing_Active as after a pause.
+//-----------------------------------------------------------------------------
+//	A Manager with anonymous (memfd) buffers sends kCtrlMsgID_ShmFDs in place
+//	of kCtrlString_ShmName. The buffers' descriptors travel as SCM_RIGHTS
+//	ancillary data that arrives no later than the message's first byte, so
+//	the receiver queues them and takes ShmFDsMsg::count when it parses it.
+//-----------------------------------------------------------------------------
+//	kCtrlMsgID_ValidatePeer carries kProtocolMagic and kProtocolVersion (and
+//	a receiver ignores any words after those). Right after it, each side
+//	sends kCtrlMsgID_PeerCaps with the largest control message payload it can
+//	receive (up to CtrlMsgHdr::kMaxLargePayloadSize). Older peers ignore it
+//	as unknown, and never send it, so until it arrives a side sends no
+//	payload larger than kMaxPayloadSize. PeerCapsMsg::features has the
+//	kPeerFeature_* bits of what its sender can decode (0 if left off, or
+//	from an older peer). Later PeerCapsMsg fields are appended, and a
+//	receiver ignores the ones it does not know.
+//-----------------------------------------------------------------------------
+//	With kPeerFeature_IDRuns, blockIDs and slabIDs may instead be sent as
+//	kCtrlMsgID_IDRuns: a uint32_t count of IDs, then for each run of
+//	consecutive IDs, two varints (7 bits per byte, least significant first,
+//	high bit set on all but the last byte): the zigzag-encoded difference of
+//	its first ID from the one after the previous run (initially 0), and its
+//	length-1. The payload is zero padded to a multiple of 4 bytes.
+//-----------------------------------------------------------------------------
 
 enum { kProtocolMagic = 0x4253434D }; // little endian 'MCSB'
 enum { kProtocolVersion = 1 };
 
+enum { kPeerFeature_IDRuns = 1 };
+
 enum { kMaxNumBlocks = 0x7FFFFFFF };
 enum { kSlabMask = 0x80000000 };
 
 struct CtrlMsgHdr {
 	enum { kToken = 0xFFFFFFFF };
-	enum { kMaxPayloadSize = 1024 };
+	enum { kMaxPayloadSize = 1024 };		// always accepted
+	enum { kMaxLargePayloadSize = 0xFFFC };	// if negotiated (fits length)
 	uint32_t token;	// = kToken
 	uint16_t msgID;
 	uint16_t length;
@@ -64,6 +110,7 @@ struct CtrlMsgHdr {
 };
 
 enum { kMaxCtrlMsgSize = sizeof(CtrlMsgHdr)+CtrlMsgHdr::kMaxPayloadSize };
+enum { kDefaultRecvBufSize = 64*1024 }; // read from the socket at once
 
 enum {	// these are the message IDs used in control messages
 	kCtrlMsgID_ValidatePeer = 0,	// exchanged both ways on startup
@@ -83,31 +130,86 @@ enum {	// these are the message IDs used in control messages
 									// Manager gives client updates (when requested)
 	kCtrlMsgID_MaxRegistration=43,
 	kCtrlMsgID_ProdNiceLevel,		// Client tells Manager
+	kCtrlMsgID_ShmRing,				// ShmRing negotiation (see kShmRing_*)
+	kCtrlMsgID_RingDoorbell,		// either way, a ShmRing has new entries
+	kCtrlMsgID_Sampling,			// Client sets a SamplingMsg policy
+	kCtrlMsgID_DropPriority,		// Client sets a DropPriorityMsg
+	kCtrlMsgID_WantedQueueBudget,	// Client sets a WantedQueueBudgetMsg
+	kCtrlMsgID_NumaNode,			// Client tells Manager where it runs
+	kCtrlMsgID_ShmFDs,				// Manager passes buffer fds (ShmFDsMsg)
+	kCtrlMsgID_IDRuns,				// either way, encoded blockIDs/slabIDs
+	kCtrlMsgID_PeerCaps,			// either way, after ValidatePeer
 };
 
 enum {	// these are the "which" parameters for CtrlString
 	kCtrlString_ShmName = 1,		// Manager tells Client on connection
 	kCtrlString_ClientName,			// Client tells Manager on connection
-	kCtrlString_GroupID				// Client tells Manager
+	kCtrlString_GroupID,			// Client tells Manager
+	kCtrlString_ShmRingName			// Manager tells Client, when requested
+};
+
+enum {	// these are the "state" parameters for ShmRing messages
+	kShmRing_Request = 0,			// Client asks for a ShmRing
+	kShmRing_Attached,				// Client has mapped the ShmRing
+	kShmRing_Failed,				// Client could not map the ShmRing
+	kShmRing_Active,				// sender is now (again) using the ShmRing
+	kShmRing_Paused,				// sender's ring was full, using the socket
+	kShmRing_PauseAck				// receiver drained it and stopped draining
 };
 
 enum {	// these are the "type" parameters for Registration messages
 	kRegType_RegisterList = 0,		// register a list of msgIDs
 	kRegType_DeregisterList,		// deregister a list of msgIDs
 	kRegType_RegisterAllMsgs,		// de/register for all msgIDs (bool param)
+	kRegType_RangeList,				// de/register ranges of msgIDs (bool param,
+									//   then inclusive first,last pairs)
 };
 
+enum { kMaxRegMsgID = 0xFFFFFFFE };	// kCCIMessageID cannot be registered
+
 struct RegistrationMsgHdr {
 	int16_t clientID;
 	int16_t groupID;
 	RegistrationMsgHdr(int16_t cid, int16_t gid): clientID(cid), groupID(gid) {}
 };
 
-struct RegistrationMsg : public RegistrationMsgHdr {
-	enum { kMaxMsgIDs =
-		(CtrlMsgHdr::kMaxPayloadSize-sizeof(RegistrationMsgHdr))/sizeof(uint32_t) };
-	uint32_t msgIDs[kMaxMsgIDs];
-	RegistrationMsg(int16_t cid, int16_t gid): RegistrationMsgHdr(cid,gid) {}
+// Client asks to receive only a sample of the messages with msgIDs in
+// [first,last]: every Nth, and/or at most maxRate per second (per msgID).
+// everyNth<=1 and maxRate<=0 clears the policy.
+struct SamplingMsg {
+	uint32_t first, last;
+	uint32_t everyNth;
+	float maxRate;
+};
+
+// Client sets the priority with which the Manager drops its wanted (not yet
+// delivered) segments with msgIDs in [first,last] under overload. Lower
+// priorities are dropped first, a negative priority restores the default.
+struct DropPriorityMsg {
+	uint32_t first, last;
+	int32_t priority;
+};
+
+// Client bounds the segments waiting for it in the Manager: to latency
+// seconds of its measured drain rate (or a fixed count if 0), and to
+// maxBytes (or no byte bound if 0). Beyond these, the oldest are dropped.
+struct WantedQueueBudgetMsg {
+	float latency;
+	uint32_t reserved;
+	uint64_t maxBytes;
+};
+
+// What its sender can receive (only maxPayload is required)
+struct PeerCapsMsg {
+	uint32_t maxPayload;
+	uint32_t features;	// kPeerFeature_* bits
+};
+
+// Manager passes the descriptors of buffers [firstBufNum,firstBufNum+count)
+struct ShmFDsMsg {
+	enum { kMaxFDs = 16 }; // per message, and pending in a deferred send
+	uint32_t firstBufNum;
+	uint32_t count;
 };
 
 } // namespace MCSB
@@ -0,0 +1,61 @@
+//=============================================================================
+//	This file is part of MCSB, the Multi-Client Shared Buffer
+//	Copyright (C) 2014  Gregory E. Allen and
+//		Applied Research Laboratories: The University of Texas at Austin
+//
+//	MCSB is free software: you can redistribute it and/or modify it
+//	under the terms of the GNU Lesser General Public License as published
+//	by the Free Software Foundation, either version 2.1 of the License, or
+//	(at your option) any later version.
+//
+//	MCSB is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+//	Lesser General Public License <http://www.gnu.org/licenses/lgpl.html>
+//	for more details.
+//=============================================================================
+
+#ifndef MCSB_Timestamper_h
+#define MCSB_Timestamper_h
+#pragma once
+
+#include "MCSB/ClientOptions.h"
+
+#include <stdint.h>
+
+namespace MCSB {
+
+//-----------------------------------------------------------------------------
+// Timestamper reads the clock chosen for stamping BlockInfo::sendTime.
+// Every clock shares the epoch of CLOCK_MONOTONIC, so one process's reading
+// can be compared with a stamp from another. The TSC is calibrated against
+// CLOCK_MONOTONIC when constructed (taking a few milliseconds), and then
+// re-anchored to it about once a second so that it doesn't drift.
+//-----------------------------------------------------------------------------
+
+class Timestamper {
+  public:
+	explicit Timestamper(ClientOptions::TimestampClock clk);
+
+	double Now(void) const; // in seconds, even if eNoTimestamps
+	ClientOptions::TimestampClock Clock(void) const { return clock; }
+
+	static double MonotonicTime(void);
+	static double CoarseTime(void);
+
+  protected:
+	ClientOptions::TimestampClock clock;
+	mutable uint64_t tscAnchor;   // a TSC reading
+	mutable double anchorTime;    // CLOCK_MONOTONIC at tscAnchor
+	mutable double tscPeriod;     // in seconds per tick
+	mutable uint64_t anchorTicks; // between re-anchorings
+
+	enum { kCalibrationUsecs = 5000 };
+	static uint64_t ReadTSC(void); // 0 if there isn't one
+	void CalibrateTSC(void);
+	void Anchor(void) const;
+};
+
+} // namespace MCSB
+
+#endif
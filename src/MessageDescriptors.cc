@@ -111,8 +111,12 @@ void SendMessageDescriptor::Fill(uint8_t val)
 //-----------------------------------------------------------------------------
 uint32_t RecvMessageDescriptor::MessageID(void) const
 { return static_cast<RecvMsgSegment*>(seg)->MessageID(); }
+double RecvMessageDescriptor::SendTime(void) const
+{ return static_cast<RecvMsgSegment*>(seg)->SendTime(); }
 const void* RecvMessageDescriptor::Buf(void) const
 { return static_cast<RecvMsgSegment*>(seg)->Buf(); }
+const void* RecvMessageDescriptor::ContiguousBuf(void) const
+{ return seg->Contiguous() ? Buf() : cimpl->ContiguousView(static_cast<RecvMsgSegment*>(seg)); }
 //-----------------------------------------------------------------------------
 
 
@@ -89,6 +89,12 @@ bool MessageSegment::IovecMatch(const struct iovec iov[], int iovcnt) const
 bool RecvMsgSegment::ValidCRC(bool ignoreZeros, bool allSegs) const
 //-----------------------------------------------------------------------------
 {
+	if (parent) {
+		// the crc32c covers the whole batch, so check it once for all
+		if (!parent->crcState)
+			parent->crcState = parent->ValidCRC(ignoreZeros,0) ? 1 : -1;
+		return parent->crcState>0;
+	}
 	const RecvMsgSegment* seg = this;
 	while (seg) {
 		if (ignoreZeros && !seg->blockInfo->crc32c) {
@@ -34,8 +34,8 @@ namespace MCSB {
 //-----------------------------------------------------------------------------
 ShmClient::ShmClient(const char* nameFmt)
 //-----------------------------------------------------------------------------
-:	nameFormat(nameFmt), blockSize(0), slabSize(0), numBlocks(0),
-	bufSize(0), blksSize(0), blocksPerSlab(0)
+:	nameFormat(nameFmt), blockSize(0), largeBlockSize(0), slabSize(0), numBlocks(0),
+	bufSize(0), blksSize(0), blocksPerSlab(0), infoStride(0)
 {
 	if (nameFormat.size())
 		Initialize();
@@ -48,6 +48,9 @@ void ShmClient::NameFormat(const char* nameFmt)
 {
 	std::string newNameFormat(nameFmt);
 
+	if (nameFormat.empty() && headerVec.size()) {
+		throw std::runtime_error("ShmClient::NameFormat after MapFDs");
+	}
 	if (nameFormat.size()) {
 		if (nameFormat==newNameFormat) {
 			NumBuffers(); // check for more buffers
@@ -67,14 +70,24 @@ void ShmClient::Initialize(void)
 {
 	ShmHeader hdr;
 	GetFirstHeader(hdr);
+	Initialize(hdr);
+	Map(0, &hdr);
+	MapBuffers();
+}
+
+
+//-----------------------------------------------------------------------------
+void ShmClient::Initialize(const ShmHeader& hdr)
+//-----------------------------------------------------------------------------
+{
 	blockSize = hdr.blockSize;
+	largeBlockSize = hdr.LargeBlockSize();
 	slabSize = hdr.slabSize;
 	numBlocks = hdr.numBlocks;
 	bufSize = hdr.TotalBufferSize();
 	blksSize = hdr.TotalBlocksSize();
-	Map(0, &hdr);
-	MapBuffers();
 	blocksPerSlab = SlabSize()/BlockSize();
+	infoStride = hdr.InfoStride();
 }
 
 
@@ -98,7 +111,7 @@ unsigned ShmClient::MapBuffers(void)
 //-----------------------------------------------------------------------------
 {
 	unsigned bufsMapped = headerVec.size();
-	if (!bufsMapped) return bufsMapped;
+	if (!bufsMapped || nameFormat.empty()) return bufsMapped;
 	volatile unsigned bufsAvailable = headerVec[0]->numBuffers;
 	if (bufsMapped==bufsAvailable)
 		return bufsMapped; // no change
@@ -115,6 +128,44 @@ unsigned ShmClient::MapBuffers(void)
 }
 
 
+//-----------------------------------------------------------------------------
+unsigned ShmClient::MapFDs(unsigned firstBufNum, const int fds[], unsigned count)
+//-----------------------------------------------------------------------------
+{
+	try {
+		if (nameFormat.size())
+			throw std::runtime_error("ShmClient::MapFDs after NameFormat");
+		for (unsigned i=0; i<count; i++) {
+			unsigned bufNum = firstBufNum+i;
+			if (bufNum<headerVec.size())
+				continue; // already mapped
+			if (bufNum>headerVec.size())
+				throw std::runtime_error("ShmClient::MapFDs skipped a buffer");
+			char name[32];
+			snprintf(name,sizeof(name),"fd %d",fds[i]);
+			std::string shmName(name);
+			if (!bufNum) {
+				ShmHeader hdr;
+				ReadHeader(fds[i],shmName,hdr);
+				Initialize(hdr);
+				Map(bufNum,&hdr,fds[i],shmName);
+			} else {
+				Map(bufNum,headerVec[0],fds[i],shmName);
+			}
+		}
+	} catch (std::runtime_error err) {
+		for (unsigned i=0; i<count; i++) close(fds[i]);
+		throw;
+	}
+	for (unsigned i=0; i<count; i++) {
+		if (close(fds[i])) {
+			fprintf(stderr,"#-- close(%d): %s\n", fds[i], strerror(errno));
+		}
+	}
+	return headerVec.size();
+}
+
+
 //-----------------------------------------------------------------------------
 const BlockInfo* ShmClient::GetBlockInfo(unsigned blockID) const
 //-----------------------------------------------------------------------------
@@ -150,7 +201,7 @@ int ShmClient::OpenShm(unsigned bufNum, std::string& shmName) const
 	snprintf(name,sizeof(name),nameFormat.c_str(),bufNum);
 	shmName = name;
 
-	int shmFD = shm_open(name, O_RDWR, S_IRUSR|S_IRGRP|S_IROTH);
+	int shmFD = ShmOpen(name, O_RDWR, S_IRUSR|S_IRGRP|S_IROTH);
 	if (shmFD<0) {
 		std::string err = "shm_open \"" + shmName + "\": ";
 		err += strerror(errno);
@@ -167,34 +218,37 @@ void ShmClient::GetFirstHeader(ShmHeader& hdr)
 {
 	std::string shmName;
 	int shmFD = OpenShm(0,shmName);
-	
-	// map the header
-	void* shmBase = mmap(0, ShmHeader::PaddedSize(), PROT_READ, MAP_SHARED|MAP_NORESERVE, shmFD, 0);
-	if (shmBase == MAP_FAILED) {
+	try {
+		ReadHeader(shmFD,shmName,hdr);
+	} catch (std::runtime_error err) {
 		close(shmFD);
-		std::string err = "mmap \"" + shmName + "\": ";
-		err += strerror(errno);
-		throw std::runtime_error(err);
+		throw;
+	}
+	if (close(shmFD)) {
+		fprintf(stderr,"#-- close(%d) \"%s\": %s\n", shmFD, shmName.c_str(), strerror(errno));
 	}
-	const ShmHeader* shmHdr = (const ShmHeader*)shmBase;
-	
-	// verify that header is valid
+}
+
+
+//-----------------------------------------------------------------------------
+void ShmClient::ReadHeader(int shmFD, const std::string& shmName, ShmHeader& hdr) const
+//-----------------------------------------------------------------------------
+{
+	// read the header (not mapped, a huge page mapping would need its size)
 	for (int i=0; i<100; i++) {
-		if (shmHdr->ValidHeader()) break;
+		if (pread(shmFD,&hdr,sizeof(hdr),0)!=ssize_t(sizeof(hdr))) {
+			std::string err = "read \"" + shmName + "\": ";
+			err += strerror(errno);
+			throw std::runtime_error(err);
+		}
+		// verify that header is valid
+		if (hdr.ValidHeader()) break;
 		fprintf(stderr,"#-- shared memory header invalid, trying again\n");
 		usleep(10);
 	}
-	if (!shmHdr->ValidHeader()) {
+	if (!hdr.ValidHeader()) {
 		throw std::runtime_error("shared memory header invalid");
 	}
-	hdr = *((ShmHeader*)shmBase);
-
-	// unmap the header
-	munmap(shmBase,ShmHeader::PaddedSize());
-	
-	if (close(shmFD)) {
-		fprintf(stderr,"#-- close(%d) \"%s\": %s\n", shmFD, shmName.c_str(), strerror(errno));
-	}
 }
 
 
@@ -207,13 +261,30 @@ void ShmClient::Map(unsigned bufNum, const ShmHeader* refhdr)
 	int shmFD = -1;
 	std::string shmName;
 	shmFD = OpenShm(bufNum,shmName);
+	try {
+		Map(bufNum,refhdr,shmFD,shmName);
+	} catch (std::runtime_error err) {
+		close(shmFD);
+		throw;
+	}
 
+	if (close(shmFD)) {
+		fprintf(stderr,"#-- close(%d) \"%s\": %s\n", shmFD, shmName.c_str(), strerror(errno));
+	}
+
+//	fprintf(stderr, "- attached to \"%s\" as buffer %u\n", shmName.c_str(), bufNum);
+}
+
+
+//-----------------------------------------------------------------------------
+void ShmClient::Map(unsigned bufNum, const ShmHeader* refhdr, int shmFD, const std::string& shmName)
+//-----------------------------------------------------------------------------
+{
 	// mmap RO the whole thing
 	void* shmBaseRO = mmap(0, bufSize, PROT_READ, MAP_SHARED|MAP_NORESERVE, shmFD, 0);
 	if (shmBaseRO == MAP_FAILED) {
 		std::string err = "mmap RO \"" + shmName + "\": ";
 		err += strerror(errno);
-		close(shmFD);
 		throw std::runtime_error(err);
 	}
 	// mmap RW just the blocks
@@ -222,7 +293,6 @@ void ShmClient::Map(unsigned bufNum, const ShmHeader* refhdr)
 		std::string err = "mmap RW \"" + shmName + "\": ";
 		err += strerror(errno);
 		munmap(shmBaseRO,bufSize);
-		close(shmFD);
 		throw std::runtime_error(err);
 	}
 
@@ -231,7 +301,7 @@ void ShmClient::Map(unsigned bufNum, const ShmHeader* refhdr)
 	assert(bufNum == infoVec.size());
 	assert(bufNum == blockVec.size());
 	const ShmHeader* hdr = (const ShmHeader*)shmBaseRO;
-	const BlockInfo* info = (const BlockInfo*)((const char*)shmBaseRO + refhdr->infoOffset);
+	const char* info = (const char*)shmBaseRO + refhdr->infoOffset;
 	const char* blk = (const char*)shmBaseRO + refhdr->blockOffset;
 	headerVec.push_back(hdr);
 	infoVec.push_back(info);
@@ -240,12 +310,6 @@ void ShmClient::Map(unsigned bufNum, const ShmHeader* refhdr)
 	// update more internal state
 	assert(bufNum == blockVecWrt.size());
 	blockVecWrt.push_back((char*)shmBaseRW);
-
-	if (close(shmFD)) {
-		fprintf(stderr,"#-- close(%d) \"%s\": %s\n", shmFD, shmName.c_str(), strerror(errno));
-	}
-
-//	fprintf(stderr, "- attached to \"%s\" as buffer %u\n", shmName.c_str(), bufNum);
 }
 
 
@@ -20,20 +20,30 @@
 #include <unistd.h>
 #include <cstdio>
 #include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
 
 
 namespace MCSB {
 
 //-----------------------------------------------------------------------------
 ShmHeader::ShmHeader(uint32_t blkSz, uint32_t slbSz, uint32_t numBlks,
-	uint32_t numBufs, uint32_t mxNumBufs)
+	uint32_t numBufs, uint32_t mxNumBufs, uint32_t pgSz, uint32_t largeBlkSz)
 //-----------------------------------------------------------------------------
 :	syncWord(0), shmVersion(kVersion), bufferNumber(0), numBuffers(numBufs),
 	maxNumBuffers(mxNumBufs), blockSize(blkSz), slabSize(slbSz),
-	numBlocks(numBlks), infoSize(sizeof(BlockInfo))
+	numBlocks(numBlks), infoSize(sizeof(BlockInfo)), pageSize(pgSz),
+	largeBlockSize(largeBlkSz)
 {
+	if (largeBlockSize<blockSize)
+		largeBlockSize = blockSize;
+	uint32_t sysPageSize = getpagesize();
+	if (pageSize<sysPageSize)
+		pageSize = sysPageSize;
+	infoStride = (infoSize + kCacheLineSize-1) & (-kCacheLineSize); // round to cache line
 	infoOffset = PaddedSize();
-	blockOffset = infoOffset + BlockInfo::PaddedSize(numBlocks);
+	blockOffset = infoOffset + BlockInfo::PaddedSize(numBlocks,infoStride);
+	blockOffset = (blockOffset + pageSize-1) & (-pageSize); // round to pageSize
 	if (numBuffers>maxNumBuffers) {
 		fprintf(stderr, "#- increasing maxNumBuffers (%u) to specified numBuffers (%u)\n", maxNumBuffers, numBuffers);
 		maxNumBuffers = numBuffers;
@@ -47,7 +57,10 @@ bool ShmHeader::ValidHeader(void) const
 //-----------------------------------------------------------------------------
 {
 	if (syncWord != kSyncWord) return 0;
-	if (shmVersion != kVersion) return 0;
+	if (shmVersion < kMinVersion || shmVersion > kVersion) return 0;
+	if (infoSize != sizeof(BlockInfo)) return 0;
+	if (InfoStride() < infoSize) return 0;
+	if (!blockSize || LargeBlockSize()%blockSize) return 0;
 	return 1;
 }
 
@@ -66,8 +79,8 @@ uint32_t ShmHeader::PaddedSize(void)
 size_t ShmHeader::TotalBlocksSize(void) const
 //-----------------------------------------------------------------------------
 {
-	int pagesize = getpagesize();
-	return (size_t(blockSize) * numBlocks + pagesize-1) & (-pagesize);;
+	size_t pagesize = pageSize;
+	return (size_t(blockSize) * numBlocks + pagesize-1) & (-pagesize);
 }
 
 
@@ -75,9 +88,7 @@ size_t ShmHeader::TotalBlocksSize(void) const
 size_t ShmHeader::TotalBufferSize(void) const
 //-----------------------------------------------------------------------------
 {
-	size_t totSize = PaddedSize() + BlockInfo::PaddedSize(numBlocks);
-	totSize += TotalBlocksSize();
-	return totSize;
+	return blockOffset + TotalBlocksSize();
 }
 
 
@@ -91,6 +102,34 @@ bool ShmHeader::IsContiguous(unsigned startBlock, unsigned runLen) const
 }
 
 
+//-----------------------------------------------------------------------------
+bool ShmNameIsPath(const char* name)
+//-----------------------------------------------------------------------------
+{
+	return name[0] && strchr(name+1,'/');
+}
+
+
+//-----------------------------------------------------------------------------
+int ShmOpen(const char* name, int oflag, mode_t mode)
+//-----------------------------------------------------------------------------
+{
+	if (ShmNameIsPath(name))
+		return open(name, oflag, mode);
+	return shm_open(name, oflag, mode);
+}
+
+
+//-----------------------------------------------------------------------------
+int ShmUnlink(const char* name)
+//-----------------------------------------------------------------------------
+{
+	if (ShmNameIsPath(name))
+		return unlink(name);
+	return shm_unlink(name);
+}
+
+
 //-----------------------------------------------------------------------------
 BlockInfo::BlockInfo(void)
 //-----------------------------------------------------------------------------
@@ -100,11 +139,11 @@ BlockInfo::BlockInfo(void)
 
 
 //-----------------------------------------------------------------------------
-uint32_t BlockInfo::PaddedSize(unsigned numBlockInfos)
+uint32_t BlockInfo::PaddedSize(unsigned numBlockInfos, uint32_t stride)
 //-----------------------------------------------------------------------------
 {
 	int pagesize = getpagesize();
-	uint32_t paddedSize = (sizeof(BlockInfo)*numBlockInfos + pagesize-1) & (-pagesize); // round to pagesize
+	uint32_t paddedSize = (stride*numBlockInfos + pagesize-1) & (-pagesize); // round to pagesize
 	return paddedSize;
 }
 
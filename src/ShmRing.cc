@@ -0,0 +1,316 @@
+//=============================================================================
+//	This file is part of MCSB, the Multi-Client Shared Buffer
+//	Copyright (C) 2014  Gregory E. Allen and
+//		Applied Research Laboratories: The University of Texas at Austin
+//
+//	MCSB is free software: you can redistribute it and/or modify it
+//	under the terms of the GNU Lesser General Public License as published
+//	by the Free Software Foundation, either version 2.1 of the License, or
+//	(at your option) any later version.
+//
+//	MCSB is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+//	Lesser General Public License <http://www.gnu.org/licenses/lgpl.html>
+//	for more details.
+//=============================================================================
+
+#include "MCSB/ShmRing.h"
+
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdexcept>
+#include <algorithm>
+
+namespace MCSB {
+
+//-----------------------------------------------------------------------------
+ShmRing::ShmRing(void)
+//-----------------------------------------------------------------------------
+:	hdr(0), submissions(0), capacity(0), mapSize(0), linked(0)
+{
+	entries[0] = entries[1] = 0;
+}
+
+//-----------------------------------------------------------------------------
+ShmRing::~ShmRing(void)
+//-----------------------------------------------------------------------------
+{
+	Close();
+}
+
+//-----------------------------------------------------------------------------
+void ShmRing::Close(void)
+//-----------------------------------------------------------------------------
+{
+	if (hdr && munmap((void*)hdr,mapSize)) {
+		fprintf(stderr,"#-- munmap: %s\n", strerror(errno));
+	}
+	Unlink();
+	hdr = 0;
+	entries[0] = entries[1] = 0;
+	submissions = 0;
+	capacity = 0;
+	mapSize = 0;
+}
+
+//-----------------------------------------------------------------------------
+void ShmRing::Swap(ShmRing& other)
+//-----------------------------------------------------------------------------
+{
+	std::swap(hdr,other.hdr);
+	std::swap(entries[0],other.entries[0]);
+	std::swap(entries[1],other.entries[1]);
+	std::swap(submissions,other.submissions);
+	std::swap(capacity,other.capacity);
+	std::swap(mapSize,other.mapSize);
+	shmName.swap(other.shmName);
+	std::swap(linked,other.linked);
+}
+
+//-----------------------------------------------------------------------------
+size_t ShmRing::MapSize(uint32_t cap)
+//-----------------------------------------------------------------------------
+{
+	return sizeof(ShmRingHeader) + 2*cap*sizeof(uint32_t)
+		+ cap*sizeof(ShmRingSubmission);
+}
+
+//-----------------------------------------------------------------------------
+void ShmRing::Create(const char* name, uint32_t minCapacity)
+//-----------------------------------------------------------------------------
+{
+	if (hdr) {
+		throw std::runtime_error("ShmRing::Create when already mapped");
+	}
+	capacity = kMinCapacity;
+	while (capacity<minCapacity && capacity<kMaxCapacity)
+		capacity *= 2;
+	mapSize = MapSize(capacity);
+	shmName = name;
+
+	int shmFD = shm_open(name, O_RDWR|O_CREAT|O_EXCL, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+	if (shmFD<0 && errno==EEXIST) {
+		// left behind by a manager that did not exit cleanly
+		shm_unlink(name);
+		shmFD = shm_open(name, O_RDWR|O_CREAT|O_EXCL, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+	}
+	if (shmFD<0) {
+		std::string err = "shm_open \"" + shmName + "\": ";
+		err += strerror(errno);
+		throw std::runtime_error(err);
+	}
+	linked = 1;
+	if (ftruncate(shmFD,mapSize)) {
+		std::string err = "ftruncate \"" + shmName + "\": ";
+		err += strerror(errno);
+		close(shmFD);
+		Unlink();
+		throw std::runtime_error(err);
+	}
+	try {
+		Map(shmFD,1);
+	} catch(std::runtime_error err) {
+		Unlink();
+		throw;
+	}
+}
+
+//-----------------------------------------------------------------------------
+void ShmRing::Open(const char* name)
+//-----------------------------------------------------------------------------
+{
+	if (hdr) {
+		throw std::runtime_error("ShmRing::Open when already mapped");
+	}
+	shmName = name;
+	int shmFD = shm_open(name, O_RDWR, S_IRUSR|S_IRGRP|S_IROTH);
+	if (shmFD<0) {
+		std::string err = "shm_open \"" + shmName + "\": ";
+		err += strerror(errno);
+		throw std::runtime_error(err);
+	}
+	struct stat st;
+	if (fstat(shmFD,&st) || (size_t)st.st_size<sizeof(ShmRingHeader)) {
+		close(shmFD);
+		throw std::runtime_error("ShmRing \"" + shmName + "\" too small");
+	}
+	mapSize = st.st_size;
+	Map(shmFD,0);
+}
+
+//-----------------------------------------------------------------------------
+void ShmRing::Map(int shmFD, bool init)
+//-----------------------------------------------------------------------------
+{
+	void* base = mmap(0, mapSize, PROT_READ|PROT_WRITE, MAP_SHARED, shmFD, 0);
+	if (close(shmFD)) {
+		fprintf(stderr,"#-- close(%d) \"%s\": %s\n", shmFD, shmName.c_str(), strerror(errno));
+	}
+	if (base == MAP_FAILED) {
+		std::string err = "mmap \"" + shmName + "\": ";
+		err += strerror(errno);
+		throw std::runtime_error(err);
+	}
+	ShmRingHeader* h = (ShmRingHeader*)base;
+
+	if (init) {
+		// ftruncate gave us zeros
+		h->ringVersion = ShmRingHeader::kVersion;
+		h->capacity = capacity;
+		h->entryOffset = sizeof(ShmRingHeader);
+		h->submitOffset = h->entryOffset + 2*capacity*sizeof(uint32_t);
+		__atomic_store_n(&h->syncWord, (uint32_t)ShmRingHeader::kSyncWord, __ATOMIC_RELEASE);
+	} else {
+		uint32_t cap = h->capacity;
+		if (__atomic_load_n(&h->syncWord,__ATOMIC_ACQUIRE)!=ShmRingHeader::kSyncWord ||
+			h->ringVersion!=ShmRingHeader::kVersion || !cap || (cap&(cap-1)) ||
+			h->entryOffset<sizeof(ShmRingHeader) ||
+			h->entryOffset+2*cap*sizeof(uint32_t)>mapSize ||
+			h->submitOffset<sizeof(ShmRingHeader) || (h->submitOffset&7) ||
+			h->submitOffset+cap*sizeof(ShmRingSubmission)>mapSize) {
+			munmap(base,mapSize);
+			throw std::runtime_error("ShmRing \"" + shmName + "\" header invalid");
+		}
+		capacity = cap;
+	}
+
+	hdr = h;
+	entries[0] = (uint32_t*)((char*)base + hdr->entryOffset);
+	entries[1] = entries[0] + capacity;
+	submissions = (ShmRingSubmission*)((char*)base + hdr->submitOffset);
+}
+
+//-----------------------------------------------------------------------------
+void ShmRing::Unlink(void)
+//-----------------------------------------------------------------------------
+{
+	if (!linked) return;
+	linked = 0;
+	if (shm_unlink(shmName.c_str())) {
+		fprintf(stderr,"#-- shm_unlink \"%s\": %s\n", shmName.c_str(), strerror(errno));
+	}
+}
+
+//-----------------------------------------------------------------------------
+uint32_t ShmRing::Room(unsigned ring, uint32_t& head) const
+// for the producer of ring: the free entries, starting at head
+//-----------------------------------------------------------------------------
+{
+	const ShmRingIndex& idx = hdr->index[ring];
+	head = idx.head; // only we write it
+	return capacity-(head-__atomic_load_n(&idx.tail,__ATOMIC_ACQUIRE));
+}
+
+//-----------------------------------------------------------------------------
+uint32_t ShmRing::Pending(unsigned ring, uint32_t& tail) const
+// for the consumer of ring: the filled entries, starting at tail
+//-----------------------------------------------------------------------------
+{
+	const ShmRingIndex& idx = hdr->index[ring];
+	tail = idx.tail; // only we write it
+	return __atomic_load_n(&idx.head,__ATOMIC_ACQUIRE)-tail;
+}
+
+//-----------------------------------------------------------------------------
+bool ShmRing::Push(unsigned ring, const uint32_t ids[], unsigned count)
+//-----------------------------------------------------------------------------
+{
+	uint32_t head;
+	if (Room(ring,head)<count)
+		return false;
+	uint32_t* ent = entries[ring];
+	uint32_t mask = capacity-1;
+	for (unsigned i=0; i<count; i++)
+		ent[(head+i)&mask] = ids[i];
+	__atomic_store_n(&hdr->index[ring].head,head+count,__ATOMIC_RELEASE);
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+unsigned ShmRing::Pop(unsigned ring, uint32_t ids[], unsigned maxCount)
+//-----------------------------------------------------------------------------
+{
+	uint32_t tail;
+	unsigned count = Pending(ring,tail);
+	if (count>maxCount)
+		count = maxCount;
+	const uint32_t* ent = entries[ring];
+	uint32_t mask = capacity-1;
+	for (unsigned i=0; i<count; i++)
+		ids[i] = ent[(tail+i)&mask];
+	__atomic_store_n(&hdr->index[ring].tail,tail+count,__ATOMIC_RELEASE);
+	return count;
+}
+
+//-----------------------------------------------------------------------------
+bool ShmRing::Submit(const uint32_t blockIDs[], const BlockInfo info[], unsigned count)
+//-----------------------------------------------------------------------------
+{
+	uint32_t head;
+	if (Room(kSubmission,head)<count)
+		return false;
+	uint32_t mask = capacity-1;
+	for (unsigned i=0; i<count; i++) {
+		ShmRingSubmission& sub = submissions[(head+i)&mask];
+		sub.blockID = blockIDs[i];
+		sub.info = info[i];
+	}
+	__atomic_store_n(&hdr->index[kSubmission].head,head+count,__ATOMIC_RELEASE);
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+unsigned ShmRing::TakeSubmissions(uint32_t blockIDs[], BlockInfo info[], unsigned maxCount)
+//-----------------------------------------------------------------------------
+{
+	uint32_t tail;
+	unsigned count = Pending(kSubmission,tail);
+	if (count>maxCount)
+		count = maxCount;
+	uint32_t mask = capacity-1;
+	for (unsigned i=0; i<count; i++) {
+		const ShmRingSubmission& sub = submissions[(tail+i)&mask];
+		blockIDs[i] = sub.blockID;
+		info[i] = sub.info;
+	}
+	__atomic_store_n(&hdr->index[kSubmission].tail,tail+count,__ATOMIC_RELEASE);
+	return count;
+}
+
+//-----------------------------------------------------------------------------
+bool ShmRing::Empty(unsigned ring) const
+//-----------------------------------------------------------------------------
+{
+	const ShmRingIndex& idx = hdr->index[ring];
+	return __atomic_load_n(&idx.head,__ATOMIC_ACQUIRE)==
+		__atomic_load_n(&idx.tail,__ATOMIC_ACQUIRE);
+}
+
+//-----------------------------------------------------------------------------
+void ShmRing::ArmDoorbell(unsigned ring)
+// the store must be visible before we look at head again (and the producer
+// must publish head before looking at doorbell), or a wakeup can be lost
+//-----------------------------------------------------------------------------
+{
+	__atomic_store_n(&hdr->index[ring].doorbell,1,__ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+//-----------------------------------------------------------------------------
+bool ShmRing::TakeDoorbell(unsigned ring)
+//-----------------------------------------------------------------------------
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	uint32_t* bell = &hdr->index[ring].doorbell;
+	if (!__atomic_load_n(bell,__ATOMIC_RELAXED))
+		return false;
+	return __atomic_exchange_n(bell,0,__ATOMIC_ACQ_REL);
+}
+
+} // namespace MCSB
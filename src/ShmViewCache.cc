@@ -0,0 +1,150 @@
+//=============================================================================
+//	This file is part of MCSB, the Multi-Client Shared Buffer
+//	Copyright (C) 2014  Gregory E. Allen and
+//		Applied Research Laboratories: The University of Texas at Austin
+//
+//	MCSB is free software: you can redistribute it and/or modify it
+//	under the terms of the GNU Lesser General Public License as published
+//	by the Free Software Foundation, either version 2.1 of the License, or
+//	(at your option) any later version.
+//
+//	MCSB is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+//	Lesser General Public License <http://www.gnu.org/licenses/lgpl.html>
+//	for more details.
+//=============================================================================
+
+#include "MCSB/ShmViewCache.h"
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <cstdio>
+#include <cstring>
+#include <errno.h>
+
+namespace MCSB {
+
+//-----------------------------------------------------------------------------
+ShmViewCache::ShmViewCache(size_t maxBytes_)
+//-----------------------------------------------------------------------------
+:	maxBytes(maxBytes_), mappedBytes(0), pageSize(sysconf(_SC_PAGESIZE)),
+	useCount(0), numHits(0), numMisses(0)
+{
+}
+
+//-----------------------------------------------------------------------------
+ShmViewCache::~ShmViewCache(void)
+//-----------------------------------------------------------------------------
+{
+	while (views.size())
+		Unmap(views.begin());
+}
+
+//-----------------------------------------------------------------------------
+void ShmViewCache::MaxBytes(size_t n)
+//-----------------------------------------------------------------------------
+{
+	maxBytes = n;
+	Evict(0);
+}
+
+//-----------------------------------------------------------------------------
+const void* ShmViewCache::Acquire(const struct iovec iov[], int iovcnt)
+//-----------------------------------------------------------------------------
+{
+	if (!maxBytes || iovcnt<1) return 0;
+
+	Key key(2*iovcnt);
+	size_t totalLen = 0;
+	for (int i=0; i<iovcnt; i++) {
+		uintptr_t base = (uintptr_t)iov[i].iov_base;
+		size_t len = (iov[i].iov_len+pageSize-1) & ~(pageSize-1);
+		if (base%pageSize) return 0;
+		if (i<iovcnt-1 && len!=iov[i].iov_len) return 0;
+		key[2*i] = base;
+		key[2*i+1] = len;
+		totalLen += len;
+	}
+
+	ViewMap::iterator it = views.find(key);
+	if (it!=views.end()) {
+		numHits++;
+		it->second.users++;
+		it->second.lastUse = ++useCount;
+		return it->second.addr;
+	}
+	numMisses++;
+	if (!Evict(totalLen)) return 0;
+
+#ifdef MREMAP_FIXED
+	// reserve the address space, then replace it segment by segment
+	void* window = mmap(0, totalLen, PROT_NONE,
+		MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+	if (window==MAP_FAILED) return 0;
+	char* addr = (char*)window;
+	size_t offset = 0;
+	for (int i=0; i<iovcnt; i++) {
+		void* seg = mremap((void*)key[2*i], 0, key[2*i+1],
+			MREMAP_MAYMOVE|MREMAP_FIXED, addr+offset);
+		if (seg==MAP_FAILED) {
+			// e.g. huge pages, or not a shared mapping
+			munmap(window,totalLen);
+			return 0;
+		}
+		offset += key[2*i+1];
+	}
+
+	View view = { addr, totalLen, 1, ++useCount };
+	it = views.insert(std::make_pair(key,view)).first;
+	byAddr[addr] = it;
+	mappedBytes += totalLen;
+	return addr;
+#else
+	return 0;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+void ShmViewCache::Release(const void* view)
+//-----------------------------------------------------------------------------
+{
+	std::map<const void*,ViewMap::iterator>::iterator it = byAddr.find(view);
+	if (it==byAddr.end() || !it->second->second.users) return;
+	it->second->second.users--;
+	// only now can a view over the bound be unmapped
+	if (mappedBytes>maxBytes) Evict(0);
+}
+
+//-----------------------------------------------------------------------------
+bool ShmViewCache::Evict(size_t needBytes)
+// unmap idle views, least recently used first, so that needBytes fit
+//-----------------------------------------------------------------------------
+{
+	while (mappedBytes+needBytes>maxBytes) {
+		ViewMap::iterator lru = views.end();
+		for (ViewMap::iterator it=views.begin(); it!=views.end(); ++it) {
+			if (it->second.users) continue;
+			if (lru==views.end() || it->second.lastUse<lru->second.lastUse)
+				lru = it;
+		}
+		if (lru==views.end()) return needBytes<=maxBytes;
+		Unmap(lru);
+	}
+	return 1;
+}
+
+//-----------------------------------------------------------------------------
+void ShmViewCache::Unmap(ViewMap::iterator it)
+//-----------------------------------------------------------------------------
+{
+	View& view = it->second;
+	if (munmap(view.addr,view.len)) {
+		fprintf(stderr,"#-- munmap: %s\n", strerror(errno));
+	}
+	mappedBytes -= view.len;
+	byAddr.erase(view.addr);
+	views.erase(it);
+}
+
+} // namespace MCSB
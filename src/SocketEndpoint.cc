@@ -39,13 +39,48 @@ namespace MCSB {
 static int olvl = kNotice;
 
 //-----------------------------------------------------------------------------
-SocketEndpoint::SocketEndpoint(int fd, int vb, unsigned recvBufCap)
+static unsigned PutVarint(unsigned char* p, uint32_t val)
+// returns the number of bytes (at most 5) written
 //-----------------------------------------------------------------------------
-:	dbprinter(vb), sockFD(fd), recvBuf(recvBufCap), recvBufLen(0), sendFailed(0),
-	validPeer(0), throwOnPeerDisconnect(1), groupID(0)
 {
+	unsigned n = 0;
+	while (val>=0x80) {
+		p[n++] = (unsigned char)(val | 0x80);
+		val >>= 7;
+	}
+	p[n++] = (unsigned char)val;
+	return n;
+}
+
+//-----------------------------------------------------------------------------
+static bool GetVarint(const unsigned char*& p, const unsigned char* end, uint32_t& val)
+// returns false if truncated
+//-----------------------------------------------------------------------------
+{
+	val = 0;
+	for (unsigned shift=0; shift<35 && p<end; shift+=7) {
+		unsigned char byte = *p++;
+		val |= uint32_t(byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+			return true;
+	}
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+SocketEndpoint::SocketEndpoint(int fd, int vb, unsigned recvBufCap_)
+//-----------------------------------------------------------------------------
+:	dbprinter(vb), sockFD(fd), recvBufCap(recvBufCap_), recvHead(0), recvBufLen(0),
+	recvIncomplete(0), sendPayloadMax(CtrlMsgHdr::kMaxPayloadSize), peerFeatures(0),
+	sendFailed(0),
+	validPeer(0), throwOnPeerDisconnect(1), groupID(0), deferSends(0), sendBufHead(0),
+	sendQueueLimit(0)
+{
+	// whole uint32_ts, so that blockIDs never wrap
+	recvBufCap &= ~(sizeof(uint32_t)-1);
 	if (recvBufCap<kMaxCtrlMsgSize)
-		recvBuf.resize(kMaxCtrlMsgSize);
+		recvBufCap = kMaxCtrlMsgSize;
+	recvBuf.resize(recvBufCap+kMaxCtrlMsgSize);
 
 	SetSocketOptions();
 	SendValidatePeer();
@@ -55,6 +90,43 @@ SocketEndpoint::SocketEndpoint(int fd, int vb, unsigned recvBufCap)
 SocketEndpoint::~SocketEndpoint(void)
 //-----------------------------------------------------------------------------
 {
+	CloseSendFDs();
+	while (recvFDs.size()) {
+		close(recvFDs.front());
+		recvFDs.pop_front();
+	}
+}
+
+//-----------------------------------------------------------------------------
+void SocketEndpoint::CloseFDs(std::vector<int>& fds)
+//-----------------------------------------------------------------------------
+{
+	for (unsigned i=0; i<fds.size(); i++)
+		close(fds[i]);
+	fds.clear();
+}
+
+//-----------------------------------------------------------------------------
+void SocketEndpoint::CloseSendFDs(void)
+//-----------------------------------------------------------------------------
+{
+	CloseFDs(sendFDs);
+	while (heldFDs.size()) {
+		CloseFDs(heldFDs.front().second);
+		heldFDs.pop_front();
+	}
+}
+
+//-----------------------------------------------------------------------------
+void SocketEndpoint::NextSendFDs(void)
+// sendFDs went with the first byte sent, the next held batch goes next
+//-----------------------------------------------------------------------------
+{
+	CloseFDs(sendFDs);
+	if (heldFDs.size()) {
+		sendFDs.swap(heldFDs.front().second);
+		heldFDs.pop_front();
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -108,10 +180,65 @@ int SocketEndpoint::Poll(float timeout)
 		if (!res) return 0;
 	}
 
-	// read the socket into recvBuf
-	unsigned bytesToRead = recvBuf.size() - recvBufLen;
-	
-	int res = recv(sockFD, &recvBuf[recvBufLen], bytesToRead, 0);
+	int res = Recv();
+	if (res>0)
+		ParseRecvBuf();
+	return res;
+}
+
+//-----------------------------------------------------------------------------
+int SocketEndpoint::Recv(void)
+//	read the socket into recvBuf, without parsing
+//	returns the result of recv, or 0 if it would block
+//-----------------------------------------------------------------------------
+{
+	unsigned bytesToRead = recvBufCap - recvBufLen;
+	if (!bytesToRead) return 0;
+
+	// fill the ring to its end and then (wrapping) up to recvHead
+	unsigned tail = recvHead + recvBufLen;
+	if (tail>=recvBufCap) tail -= recvBufCap;
+	struct iovec vec[2];
+	vec[0].iov_base = &recvBuf[tail];
+	vec[0].iov_len = recvBufCap - tail;
+	vec[1].iov_base = &recvBuf[0];
+	vec[1].iov_len = 0;
+	if (vec[0].iov_len>bytesToRead) {
+		vec[0].iov_len = bytesToRead;
+	} else {
+		vec[1].iov_len = bytesToRead - vec[0].iov_len;
+	}
+
+	// recvmsg, to also receive any fds (see kCtrlMsgID_ShmFDs)
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(ShmFDsMsg::kMaxFDs*sizeof(int))];
+	} ctrl;
+	struct msghdr msgh;
+	memset(&msgh,0,sizeof(struct msghdr));
+	msgh.msg_iov = vec;
+	msgh.msg_iovlen = vec[1].iov_len ? 2 : 1;
+	msgh.msg_control = ctrl.buf;
+	msgh.msg_controllen = sizeof(ctrl.buf);
+
+	int flags = 0;
+	#ifdef MSG_CMSG_CLOEXEC
+		flags = MSG_CMSG_CLOEXEC;	// don't leak buffer fds to children (Linux)
+	#endif
+
+	int res = recvmsg(sockFD, &msgh, flags);
+	if (res>=0) {
+		struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msgh);
+		for (; cmsg; cmsg = CMSG_NXTHDR(&msgh,cmsg)) {
+			if (cmsg->cmsg_level!=SOL_SOCKET || cmsg->cmsg_type!=SCM_RIGHTS)
+				continue;
+			unsigned numFDs = (cmsg->cmsg_len - CMSG_LEN(0))/sizeof(int);
+			const int* fds = (const int*)CMSG_DATA(cmsg);
+			recvFDs.insert(recvFDs.end(),fds,fds+numFDs);
+		}
+		if (msgh.msg_flags & MSG_CTRUNC)
+			dbprintf(kWarning,"# received fds truncated\n");
+	}
 	if (res<0) {
 		if (errno == EINTR) return 0;
 		if (errno == EAGAIN) return 0;
@@ -125,27 +252,74 @@ int SocketEndpoint::Poll(float timeout)
 		return res;
 	}
 	recvBufLen += res;
+	return res;
+}
 
-	// parse the pending recvBufBytes in recvBuf[]
-	// call Parse until it returns 0
+//-----------------------------------------------------------------------------
+void SocketEndpoint::ParseRecvBuf(void)
+//	parse the pending recvBufBytes in recvBuf[]
+//-----------------------------------------------------------------------------
+{
+	// call Parse until it returns 0, in place and around the ring
+	recvIncomplete = 0;
 	while (recvBufLen>0) {
-		int bytesParsed = Parse();
+		unsigned bytes = ContiguousRecvBytes();
+		int bytesParsed = Parse((uint32_t*)&recvBuf[recvHead], bytes);
 		if (!bytesParsed) break;
-		// copy the unconsumed portion down to the base
-		memmove(&recvBuf[0], &recvBuf[bytesParsed], recvBufLen-bytesParsed);
+		recvHead += bytesParsed;
+		if (recvHead>=recvBufCap) recvHead -= recvBufCap;
 		recvBufLen -= bytesParsed;
 	}
+	if (!recvBufLen)
+		recvHead = 0; // so the next Recv needs no wrap
+	else if (recvIncomplete>recvBuf.size()-recvBufCap)
+		GrowRecvBuf(recvIncomplete);
+}
 
-	return res;
+//-----------------------------------------------------------------------------
+void SocketEndpoint::GrowRecvBuf(unsigned msgSize)
+// make room for a (negotiated large) control message to be received and
+// then parsed contiguously, with the pending bytes unwrapped to the base
+//-----------------------------------------------------------------------------
+{
+	unsigned slack = (msgSize+sizeof(uint32_t)-1) & ~(sizeof(uint32_t)-1);
+	unsigned cap = recvBufCap<slack ? slack : recvBufCap;
+	dbprintf(kDebug,"- SocketEndpoint recvBuf %u grows to %u\n", recvBufCap, cap);
+
+	std::vector<char> buf(cap+slack);
+	unsigned toEnd = recvBufCap - recvHead;
+	if (toEnd>recvBufLen) toEnd = recvBufLen;
+	memcpy(&buf[0], &recvBuf[recvHead], toEnd);
+	memcpy(&buf[toEnd], &recvBuf[0], recvBufLen-toEnd);
+	recvBuf.swap(buf);
+	recvBufCap = cap;
+	recvHead = 0;
 }
 
 //-----------------------------------------------------------------------------
-int SocketEndpoint::Parse(void)
+unsigned SocketEndpoint::ContiguousRecvBytes(void)
+// the bytes from recvHead that can be parsed in place: any control message
+// that starts there is complete, if it has all been received
+//-----------------------------------------------------------------------------
+{
+	unsigned slack = recvBuf.size() - recvBufCap;
+	unsigned toEnd = recvBufCap - recvHead;
+	if (recvBufLen<=toEnd) return recvBufLen;
+	if (toEnd>=slack) return toEnd;
+	// near the end, so copy the wrapped start of the ring past its end
+	unsigned wrapped = recvBufLen - toEnd;
+	if (wrapped>slack-toEnd)
+		wrapped = slack-toEnd;
+	memcpy(&recvBuf[recvBufCap], &recvBuf[0], wrapped);
+	return toEnd+wrapped;
+}
+
+//-----------------------------------------------------------------------------
+int SocketEndpoint::Parse(uint32_t* blockIDs, unsigned bytesToParse)
 // returns the number of bytes consumed
 //-----------------------------------------------------------------------------
 {
-	uint32_t* blockIDs = (uint32_t*) &recvBuf[0];
-	unsigned bytesToParse = recvBufLen;
+	const unsigned recvBytes = bytesToParse;
 	if (bytesToParse<sizeof(uint32_t)) return 0;
 
 	while (1) {
@@ -161,14 +335,7 @@ int SocketEndpoint::Parse(void)
 		}
 		if (count) {
 			if (!validPeer) LocalHandleCtrlMsg(-1,0,0); // let him throw
-			if (blockIDs[0]&kSlabMask) { // slabs
-				// take out the masks
-				for (unsigned i=0; i<count; i++)
-					blockIDs[i] &= ~kSlabMask;
-				HandleSlabIDs(blockIDs,count);
-			} else { // blocks
-				HandleBlockIDs(blockIDs,count);
-			}
+			DispatchIDs(blockIDs,count);
 			blockIDs += count;
 			bytesToParse -= count*4;
 			continue;
@@ -182,12 +349,14 @@ int SocketEndpoint::Parse(void)
 		unsigned msgSize = sizeof(CtrlMsgHdr)+hdr->length;
 		assert(!(hdr->length & (sizeof(uint32_t)-1))); // length is multiple of uint32_t
 
-		if (bytesToParse<msgSize) break; // incomplete msg
+		// before waiting for the rest, which might never fit
+		if (hdr->length>CtrlMsgHdr::kMaxLargePayloadSize) {
+			throw std::runtime_error("protocol error: control message len>CtrlMsgHdr::kMaxLargePayloadSize");
+		}
 
-		if (hdr->length>CtrlMsgHdr::kMaxPayloadSize) {
-			std::string err = "protocol error: control message len>CtrlMsgHdr::kMaxPayloadSize";
-			err += strerror(errno);
-			throw std::runtime_error(err);
+		if (bytesToParse<msgSize) { // incomplete msg
+			recvIncomplete = msgSize;
+			break;
 		}
 
 		// call the handler on the received control message
@@ -196,7 +365,7 @@ int SocketEndpoint::Parse(void)
 		blockIDs = (uint32_t*)(ptr + hdr->length);
 		bytesToParse -= msgSize;
 	}
-	return recvBufLen - bytesToParse;
+	return recvBytes - bytesToParse;
 }
 
 //-----------------------------------------------------------------------------
@@ -235,6 +404,71 @@ int SocketEndpoint::PollFD(int fd, float timeout, short events)
 	return 0;
 }
 
+//-----------------------------------------------------------------------------
+void SocketEndpoint::DispatchIDs(uint32_t* ids, unsigned count)
+// to HandleBlockIDs or HandleSlabIDs, in runs of the same kind
+//-----------------------------------------------------------------------------
+{
+	while (count) {
+		unsigned num = 1;
+		while (num<count && (ids[0]&kSlabMask)==(ids[num]&kSlabMask))
+			num++;
+		if (ids[0]&kSlabMask) { // slabs
+			// take out the masks
+			for (unsigned i=0; i<num; i++)
+				ids[i] &= ~kSlabMask;
+			HandleSlabIDs(ids,num);
+		} else { // blocks
+			HandleBlockIDs(ids,num);
+		}
+		ids += num;
+		count -= num;
+	}
+}
+
+//-----------------------------------------------------------------------------
+void SocketEndpoint::DecodeIDRuns(const void* ptr, unsigned len)
+// a kCtrlMsgID_IDRuns payload (see SocketProtocol.h)
+//-----------------------------------------------------------------------------
+{
+	if (len<sizeof(uint32_t)) {
+		throw std::runtime_error("kCtrlMsgID_IDRuns incorrect size");
+	}
+	uint32_t count = *((const uint32_t*)ptr);
+	if (count>kMaxNumBlocks) {
+		throw std::runtime_error("kCtrlMsgID_IDRuns invalid count");
+	}
+
+	// dispatched a chunk at a time
+	enum { kMaxIDs = 1024 };
+	uint32_t ids[kMaxIDs];
+	unsigned num = 0;
+	const unsigned char* p = (const unsigned char*)ptr + sizeof(uint32_t);
+	const unsigned char* end = (const unsigned char*)ptr + len;
+	uint32_t next = 0;
+	while (count) {
+		uint32_t zigzag, run;
+		if (!GetVarint(p,end,zigzag) || !GetVarint(p,end,run)) {
+			throw std::runtime_error("kCtrlMsgID_IDRuns truncated");
+		}
+		if (run>=count) {
+			throw std::runtime_error("kCtrlMsgID_IDRuns run exceeds count");
+		}
+		count -= run+1;
+		uint32_t id = next + ((zigzag>>1) ^ -(zigzag&1));
+		for (uint32_t i=0; i<=run; i++) {
+			ids[num++] = id++;
+			if (num==kMaxIDs) {
+				DispatchIDs(ids,num);
+				num = 0;
+			}
+		}
+		next = id;
+	}
+	if (num)
+		DispatchIDs(ids,num);
+}
+
 //-----------------------------------------------------------------------------
 void SocketEndpoint::LocalHandleCtrlMsg(uint16_t msgID, const void* ptr, uint16_t len)
 //	handle the messages that are locally dealt with
@@ -270,6 +504,7 @@ void SocketEndpoint::LocalHandleCtrlMsg(uint16_t msgID, const void* ptr, uint16_
 	  case kCtrlMsgID_Registration+kRegType_RegisterList:
 	  case kCtrlMsgID_Registration+kRegType_DeregisterList:
 	  case kCtrlMsgID_Registration+kRegType_RegisterAllMsgs:
+	  case kCtrlMsgID_Registration+kRegType_RangeList:
 	  {
 		const RegistrationMsgHdr* hdr = (const RegistrationMsgHdr*)ptr;
 		const uint32_t* msgIDs = (const uint32_t*)(hdr+1);
@@ -303,11 +538,26 @@ void SocketEndpoint::LocalHandleCtrlMsg(uint16_t msgID, const void* ptr, uint16_
 	  } break;
 	  case kCtrlMsgID_ValidatePeer: {
 		uint32_t* vals = ((uint32_t*)ptr);
-		if (len != 2*sizeof(uint32_t)) {
+		if (len<2*sizeof(uint32_t)) {
 			throw std::runtime_error("error: kCtrlMsgID_ValidatePeer message invalid size");
 		}
+		// any later words are from a future version, and ignored
 		HandleValidatePeer(vals[0],vals[1]);
 	  } break;
+	  case kCtrlMsgID_PeerCaps: {
+		const PeerCapsMsg* caps = (const PeerCapsMsg*)ptr;
+		if (len<sizeof(caps->maxPayload)) {
+			throw std::runtime_error("error: kCtrlMsgID_PeerCaps message invalid size");
+		}
+		if (caps->maxPayload>CtrlMsgHdr::kMaxPayloadSize) {
+			// the peer can receive large control messages
+			sendPayloadMax = caps->maxPayload & ~(sizeof(uint32_t)-1);
+			if (sendPayloadMax>CtrlMsgHdr::kMaxLargePayloadSize)
+				sendPayloadMax = CtrlMsgHdr::kMaxLargePayloadSize;
+		}
+		if (len>=sizeof(caps->maxPayload)+sizeof(caps->features))
+			peerFeatures = caps->features;
+	  } break;
 	  case kCtrlMsgID_NumSlabs: {
 		if (len != 2*sizeof(uint32_t)) {
 			throw std::runtime_error("kCtrlMsgID_NumSlabs incorrect size");
@@ -349,6 +599,63 @@ void SocketEndpoint::LocalHandleCtrlMsg(uint16_t msgID, const void* ptr, uint16_
 		}
 		HandleProdNiceLevel(*((const int32_t*)ptr));
 	  } break;
+	  case kCtrlMsgID_NumaNode: {
+		if (len != sizeof(int32_t)) {
+			throw std::runtime_error("kCtrlMsgID_NumaNode incorrect size");
+		}
+		HandleNumaNode(*((const int32_t*)ptr));
+	  } break;
+	  case kCtrlMsgID_ShmRing: {
+		if (len != sizeof(uint32_t)) {
+			throw std::runtime_error("kCtrlMsgID_ShmRing incorrect size");
+		}
+		HandleShmRing(*((const uint32_t*)ptr));
+	  } break;
+	  case kCtrlMsgID_RingDoorbell: {
+		if (len) {
+			throw std::runtime_error("kCtrlMsgID_RingDoorbell message invalid size");
+		}
+		HandleRingDoorbell();
+	  } break;
+	  case kCtrlMsgID_Sampling: {
+		if (len != sizeof(SamplingMsg)) {
+			throw std::runtime_error("kCtrlMsgID_Sampling incorrect size");
+		}
+		const SamplingMsg* msg = (const SamplingMsg*)ptr;
+		HandleSampling(msg->first, msg->last, msg->everyNth, msg->maxRate);
+	  } break;
+	  case kCtrlMsgID_DropPriority: {
+		if (len != sizeof(DropPriorityMsg)) {
+			throw std::runtime_error("kCtrlMsgID_DropPriority incorrect size");
+		}
+		const DropPriorityMsg* msg = (const DropPriorityMsg*)ptr;
+		HandleDropPriority(msg->first, msg->last, msg->priority);
+	  } break;
+	  case kCtrlMsgID_WantedQueueBudget: {
+		if (len != sizeof(WantedQueueBudgetMsg)) {
+			throw std::runtime_error("kCtrlMsgID_WantedQueueBudget incorrect size");
+		}
+		const WantedQueueBudgetMsg* msg = (const WantedQueueBudgetMsg*)ptr;
+		HandleWantedQueueBudget(msg->latency, msg->maxBytes);
+	  } break;
+	  case kCtrlMsgID_ShmFDs: {
+		if (len != sizeof(ShmFDsMsg)) {
+			throw std::runtime_error("kCtrlMsgID_ShmFDs incorrect size");
+		}
+		const ShmFDsMsg* msg = (const ShmFDsMsg*)ptr;
+		if (msg->count>ShmFDsMsg::kMaxFDs || msg->count>recvFDs.size()) {
+			throw std::runtime_error("kCtrlMsgID_ShmFDs without its fds");
+		}
+		int fds[ShmFDsMsg::kMaxFDs];
+		for (unsigned i=0; i<msg->count; i++) {
+			fds[i] = recvFDs.front();
+			recvFDs.pop_front();
+		}
+		HandleShmFDs(msg->firstBufNum, fds, msg->count);
+	  } break;
+	  case kCtrlMsgID_IDRuns: {
+		DecodeIDRuns(ptr,len);
+	  } break;
 
 	  default:
 		HandleCtrlMsg(msgID,ptr,len);
@@ -388,8 +695,8 @@ int SocketEndpoint::SendCtrlMsg(uint16_t msgID, const void* ptrs[], uint16_t len
 		vec[numArgs+1].iov_base = (void*) ptrs[numArgs];
 		vec[numArgs+1].iov_len = lens[numArgs];
 	}
- 	if (totalLen>CtrlMsgHdr::kMaxPayloadSize) {
-		throw std::runtime_error("protocol error: can't send control message larger than kMaxCtrlMsgSize");
+ 	if (totalLen>sendPayloadMax) {
+		throw std::runtime_error("protocol error: can't send control message larger than the peer's MaxSendPayload()");
 	}
 
 	// prepend CtrlMsgHdr 
@@ -399,6 +706,12 @@ int SocketEndpoint::SendCtrlMsg(uint16_t msgID, const void* ptrs[], uint16_t len
 	msgh.msg_iovlen = numArgs+1;
 	totalLen += sizeof(hdr);
 
+	if (deferSends) {
+		for (unsigned i=0; i<=numArgs; i++)
+			DeferSend(vec[i].iov_base,vec[i].iov_len);
+		return totalLen;
+	}
+
 	int flags = 0;
 	#ifdef MSG_NOSIGNAL
 		flags = MSG_NOSIGNAL;	// we don't want SIGPIPE (Linux)
@@ -421,8 +734,7 @@ int SocketEndpoint::SendCtrlMsg(uint16_t msgID, const void* ptrs[], uint16_t len
 		totalSent += sent;
 		if (totalSent==totalLen) break;
 		// advance the iovec and msghdr by sent
-		// FIXME: this needs testing
-		while (sent-msgh.msg_iov->iov_len>0) {
+		while (msgh.msg_iovlen && (size_t)sent>=msgh.msg_iov->iov_len) {
 			sent -= msgh.msg_iov->iov_len;
 			msgh.msg_iov++;
 			msgh.msg_iovlen--;
@@ -438,28 +750,89 @@ int SocketEndpoint::SendCtrlMsg(uint16_t msgID, const void* ptrs[], uint16_t len
 
 //-----------------------------------------------------------------------------
 int SocketEndpoint::SendBlockIDs(const uint32_t blockIDs[], unsigned count)
-// returns number of bytes written
+// returns number of bytes written (or deferred, before any encoding)
 //-----------------------------------------------------------------------------
 {
 	if (sendFailed)
 		throw std::runtime_error("send error: refusing after send failure");
-	
+
+	if (!(peerFeatures & kPeerFeature_IDRuns))
+		return SendRawIDs(blockIDs,count);
+	if (deferSends) {
+		// gathered across calls, so that runs can span them
+		bool wasEmpty = sendBuf.empty() && pendingIDs.empty();
+		pendingIDs.insert(pendingIDs.end(),blockIDs,blockIDs+count);
+		if (wasEmpty && count)
+			HandleSendsDeferred();
+		return sizeof(uint32_t)*count;
+	}
+	return SendIDRuns(blockIDs,count);
+}
+
+//-----------------------------------------------------------------------------
+int SocketEndpoint::SendRawIDs(const uint32_t blockIDs[], unsigned count)
+// returns number of bytes written
+//-----------------------------------------------------------------------------
+{
+	unsigned len = sizeof(uint32_t)*count;
+	if (deferSends) {
+		DeferSend(blockIDs,len);
+		return len;
+	}
+	return SendBytes((const char*)blockIDs,len);
+}
+
+//-----------------------------------------------------------------------------
+int SocketEndpoint::SendBytes(const char* pay, unsigned len, const int fds[], unsigned numFDs,
+	bool wait)
+// returns number of bytes written
+// numFDs fds are passed (as SCM_RIGHTS) with the first byte sent
+// if !wait, returns early (maybe 0) instead of calling HandleSendWouldBlock
+//-----------------------------------------------------------------------------
+{
 	int flags = 0;
 	#ifdef MSG_NOSIGNAL
 		flags = MSG_NOSIGNAL;	// we don't want SIGPIPE (Linux)
 	#endif
 
-	unsigned len = sizeof(uint32_t)*count;
-	const char* pay = (const char*)blockIDs;
 	unsigned totalSent = 0;
+
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(ShmFDsMsg::kMaxFDs*sizeof(int))];
+	} ctrl;
+	if (numFDs>ShmFDsMsg::kMaxFDs)
+		throw std::runtime_error("send error: too many fds");
 	
-	while (totalSent<len) {
-		int sent = send(sockFD,pay,len,flags);
+	while (len) {
+		int sent;
+		if (!numFDs) {
+			sent = send(sockFD,pay,len,flags);
+		} else {
+			struct iovec vec;
+			vec.iov_base = (void*)pay;
+			vec.iov_len = len;
+			struct msghdr msgh;
+			memset(&msgh,0,sizeof(struct msghdr));
+			msgh.msg_iov = &vec;
+			msgh.msg_iovlen = 1;
+			msgh.msg_control = ctrl.buf;
+			msgh.msg_controllen = CMSG_SPACE(numFDs*sizeof(int));
+			struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msgh);
+			cmsg->cmsg_level = SOL_SOCKET;
+			cmsg->cmsg_type = SCM_RIGHTS;
+			cmsg->cmsg_len = CMSG_LEN(numFDs*sizeof(int));
+			memcpy(CMSG_DATA(cmsg),fds,numFDs*sizeof(int));
+			sent = sendmsg(sockFD,&msgh,flags);
+			if (sent>0) numFDs = 0; // they went with the first byte
+		}
 		if (sent<0) {
 			if (errno == EINTR) continue;
-			if (errno == EAGAIN || errno == EWOULDBLOCK)
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				if (!wait) break;
 				if (HandleSendWouldBlock())
 					continue;
+			}
 			sendFailed = 1;
 			std::string err = "send error: ";
 			err += strerror(errno);
@@ -473,6 +846,169 @@ int SocketEndpoint::SendBlockIDs(const uint32_t blockIDs[], unsigned count)
 	return totalSent;
 }
 
+//-----------------------------------------------------------------------------
+int SocketEndpoint::SendIDRuns(const uint32_t ids[], unsigned count)
+// as kCtrlMsgID_IDRuns, or as plain IDs where that would be no smaller
+// returns number of bytes written
+//-----------------------------------------------------------------------------
+{
+	enum { kMaxRunBytes = 10 }; // two varints
+	if (count<4) // 16 bytes, no encoding is smaller
+		return SendRawIDs(ids,count);
+
+	idRunsBuf.resize(sendPayloadMax);
+	unsigned char* buf = (unsigned char*)&idRunsBuf[0];
+	int result = 0;
+	while (count) {
+		// encode as many runs as fit
+		unsigned len = sizeof(uint32_t);
+		unsigned num = 0;
+		uint32_t next = 0;
+		while (num<count && len+kMaxRunBytes<=sendPayloadMax) {
+			unsigned run = 1;
+			while (num+run<count && ids[num+run]==ids[num]+run)
+				run++;
+			uint32_t delta = ids[num] - next;
+			len += PutVarint(buf+len, (delta<<1) ^ -(delta>>31));
+			len += PutVarint(buf+len, run-1);
+			next = ids[num] + run;
+			num += run;
+		}
+		*((uint32_t*)buf) = num;
+		while (len & (sizeof(uint32_t)-1))
+			buf[len++] = 0;
+
+		if (sizeof(CtrlMsgHdr)+len < sizeof(uint32_t)*num)
+			result += SendCtrlMsg(kCtrlMsgID_IDRuns,buf,len);
+		else
+			result += SendRawIDs(ids,num);
+		ids += num;
+		count -= num;
+	}
+	return result;
+}
+
+//-----------------------------------------------------------------------------
+void SocketEndpoint::EncodePendingIDs(void)
+// the IDs deferred by SendBlockIDs go into sendBuf
+//-----------------------------------------------------------------------------
+{
+	std::vector<uint32_t> ids;
+	ids.swap(pendingIDs);
+	SendIDRuns(&ids[0],ids.size());
+	ids.clear();
+	pendingIDs.swap(ids); // keeping its capacity
+}
+
+//-----------------------------------------------------------------------------
+void SocketEndpoint::DeferSend(const void* ptr, unsigned len)
+//-----------------------------------------------------------------------------
+{
+	bool wasEmpty = sendBuf.empty() && pendingIDs.empty();
+	if (pendingIDs.size())
+		EncodePendingIDs(); // they were sent first
+	if (sendQueueLimit && PendingSendBytes()+len>sendQueueLimit) {
+		HandleSendQueueOverflow();
+		sendFailed = 1;
+		throw std::runtime_error("send error: the peer is too far behind");
+	}
+	const char* p = (const char*)ptr;
+	sendBuf.insert(sendBuf.end(),p,p+len);
+	if (wasEmpty && len)
+		HandleSendsDeferred();
+}
+
+//-----------------------------------------------------------------------------
+int SocketEndpoint::FlushSends(void)
+// send everything deferred with a single send
+// returns number of bytes written
+//-----------------------------------------------------------------------------
+{
+	if (pendingIDs.size())
+		EncodePendingIDs();
+	if (sendBuf.empty())
+		return 0;
+	int result = 0;
+	try {
+		if (sendFailed)
+			throw std::runtime_error("send error: refusing after send failure");
+		while (heldFDs.size()) {
+			unsigned len = heldFDs.front().first - sendBufHead;
+			result += SendBytes(&sendBuf[sendBufHead],len,
+				sendFDs.size() ? &sendFDs[0] : 0, sendFDs.size());
+			sendBufHead += len;
+			NextSendFDs();
+		}
+		result += SendBytes(&sendBuf[sendBufHead],PendingSendBytes(),
+			sendFDs.size() ? &sendFDs[0] : 0, sendFDs.size());
+	} catch(std::runtime_error err) {
+		sendBuf.clear();
+		sendBufHead = 0;
+		CloseSendFDs();
+		throw;
+	}
+	sendBuf.clear(); // keeps its capacity
+	sendBufHead = 0;
+	CloseFDs(sendFDs);
+	return result;
+}
+
+//-----------------------------------------------------------------------------
+int SocketEndpoint::FlushSomeSends(void)
+// send what the socket will take now of everything deferred
+// returns number of bytes written, PendingSendBytes() are left
+//-----------------------------------------------------------------------------
+{
+	if (pendingIDs.size())
+		EncodePendingIDs();
+	if (sendBuf.empty())
+		return 0;
+	int result = 0;
+	try {
+		if (sendFailed)
+			throw std::runtime_error("send error: refusing after send failure");
+		while (PendingSendBytes()) {
+			unsigned len = PendingSendBytes();
+			if (heldFDs.size())
+				len = heldFDs.front().first - sendBufHead;
+			int sent = SendBytes(&sendBuf[sendBufHead],len,
+				sendFDs.size() ? &sendFDs[0] : 0, sendFDs.size(), false);
+			if (!sent)
+				break;
+			result += sent;
+			sendBufHead += sent;
+			NextSendFDs();
+			if ((unsigned)sent<len)
+				break;
+		}
+	} catch(std::runtime_error err) {
+		sendBuf.clear();
+		sendBufHead = 0;
+		CloseSendFDs();
+		throw;
+	}
+	if (sendBufHead==sendBuf.size()) {
+		sendBuf.clear(); // keeps its capacity
+		sendBufHead = 0;
+	} else if (sendBufHead>=sendBuf.size()/2) {
+		// drop the sent front, once at least half of it has gone
+		sendBuf.erase(sendBuf.begin(),sendBuf.begin()+sendBufHead);
+		for (unsigned i=0; i<heldFDs.size(); i++)
+			heldFDs[i].first -= sendBufHead;
+		sendBufHead = 0;
+	}
+	return result;
+}
+
+//-----------------------------------------------------------------------------
+void SocketEndpoint::DeferSends(bool defer)
+//-----------------------------------------------------------------------------
+{
+	deferSends = defer;
+	if (!defer)
+		FlushSends();
+}
+
 //-----------------------------------------------------------------------------
 int SocketEndpoint::SendSlabIDs(const uint32_t slabIDs[], unsigned count)
 // returns number of bytes written
@@ -510,7 +1046,7 @@ int SocketEndpoint::SendBlocksAndInfo(const uint32_t blockNums[],
 	const BlockInfo blockInfo[], unsigned count)
 //-----------------------------------------------------------------------------
 {
-	unsigned maxPerSend = CtrlMsgHdr::kMaxPayloadSize/(sizeof(uint32_t)+sizeof(BlockInfo));
+	unsigned maxPerSend = sendPayloadMax/(sizeof(uint32_t)+sizeof(BlockInfo));
 	unsigned totalSent = 0;
 
 	while (count) {
@@ -567,22 +1103,22 @@ int SocketEndpoint::SendGroupID(int16_t gid, bool setLocal)
 int SocketEndpoint::SendRegistration(uint32_t type, int16_t cltID, int16_t grpID, const uint32_t msgIDs[], unsigned count)
 //-----------------------------------------------------------------------------
 {
-	if (type>kRegType_RegisterAllMsgs) {
+	if (type>kRegType_RangeList) {
 		throw std::runtime_error("SendRegistration error: invalid value for type");
 	}
 
-	RegistrationMsg message(cltID,grpID);
+	RegistrationMsgHdr hdr(cltID,grpID);
+	const unsigned maxMsgIDs = (sendPayloadMax-sizeof(RegistrationMsgHdr))/sizeof(uint32_t);
 
 	int ret = 0;
 	while (count) {
 		unsigned sendingCount = count;
-		if (sendingCount>RegistrationMsg::kMaxMsgIDs)
-			sendingCount = RegistrationMsg::kMaxMsgIDs;
+		if (sendingCount>maxMsgIDs)
+			sendingCount = maxMsgIDs;
 		
-		memcpy(message.msgIDs,msgIDs,sendingCount*sizeof(uint32_t));
-		unsigned len = sizeof(RegistrationMsgHdr) + sendingCount*sizeof(uint32_t);
-
-		ret += SendCtrlMsg(kCtrlMsgID_Registration+type,(void*)&message,len);
+		const void* ptrs[3] = { &hdr, msgIDs, 0 };
+		uint16_t lens[3] = { sizeof(hdr), (uint16_t)(sendingCount*sizeof(uint32_t)), 0 };
+		ret += SendCtrlMsg(kCtrlMsgID_Registration+type,ptrs,lens);
 
 		count -= sendingCount;
 		msgIDs += sendingCount;
@@ -591,12 +1127,123 @@ int SocketEndpoint::SendRegistration(uint32_t type, int16_t cltID, int16_t grpID
 	return ret;
 }
 
+//-----------------------------------------------------------------------------
+int SocketEndpoint::SendRangeRegistration(bool reg, int16_t cltID, int16_t grpID, const uint32_t firstLast[], unsigned numRanges)
+//-----------------------------------------------------------------------------
+{
+	RegistrationMsgHdr hdr(cltID,grpID);
+	uint32_t regParam = reg;
+	const unsigned maxRanges = (sendPayloadMax-sizeof(RegistrationMsgHdr)-sizeof(regParam))
+		/(2*sizeof(uint32_t));
+
+	int ret = 0;
+	while (numRanges) {
+		unsigned sendingRanges = numRanges;
+		if (sendingRanges>maxRanges)
+			sendingRanges = maxRanges;
+
+		// every chunk repeats the reg param, so each stands alone
+		const void* ptrs[4] = { &hdr, &regParam, firstLast, 0 };
+		uint16_t lens[4] = { sizeof(hdr), sizeof(regParam),
+			(uint16_t)(2*sendingRanges*sizeof(uint32_t)), 0 };
+		ret += SendCtrlMsg(kCtrlMsgID_Registration+kRegType_RangeList,ptrs,lens);
+
+		numRanges -= sendingRanges;
+		firstLast += 2*sendingRanges;
+	}
+
+	return ret;
+}
+
+//-----------------------------------------------------------------------------
+int SocketEndpoint::SendSampling(uint32_t first, uint32_t last, uint32_t everyNth, float maxRate)
+//-----------------------------------------------------------------------------
+{
+	SamplingMsg msg = { first, last, everyNth, maxRate };
+	return SendCtrlMsg(kCtrlMsgID_Sampling,&msg,sizeof(msg));
+}
+
+//-----------------------------------------------------------------------------
+int SocketEndpoint::SendDropPriority(uint32_t first, uint32_t last, int32_t priority)
+//-----------------------------------------------------------------------------
+{
+	DropPriorityMsg msg = { first, last, priority };
+	return SendCtrlMsg(kCtrlMsgID_DropPriority,&msg,sizeof(msg));
+}
+
+//-----------------------------------------------------------------------------
+int SocketEndpoint::SendWantedQueueBudget(float latency, uint64_t maxBytes)
+//-----------------------------------------------------------------------------
+{
+	WantedQueueBudgetMsg msg = { latency, 0, maxBytes };
+	return SendCtrlMsg(kCtrlMsgID_WantedQueueBudget,&msg,sizeof(msg));
+}
+
+//-----------------------------------------------------------------------------
+int SocketEndpoint::SendShmFDs(uint32_t firstBufNum, const int fds[], unsigned count)
+// returns number of bytes written
+//-----------------------------------------------------------------------------
+{
+	if (sendFailed)
+		throw std::runtime_error("send error: refusing after send failure");
+
+	int result = 0;
+	while (count) {
+		ShmFDsMsg msg = { firstBufNum, count };
+		if (msg.count>ShmFDsMsg::kMaxFDs)
+			msg.count = ShmFDsMsg::kMaxFDs;
+		struct {
+			CtrlMsgHdr hdr;
+			ShmFDsMsg msg;
+		} frame = { CtrlMsgHdr(kCtrlMsgID_ShmFDs,sizeof(msg)), msg };
+
+		if (!deferSends) {
+			result += SendBytes((const char*)&frame,sizeof(frame),fds,msg.count);
+		} else {
+			// the deferred bytes carry the fds, so dup them until the flush
+			std::vector<int> dups;
+			for (unsigned i=0; i<msg.count; i++) {
+				int fd = fcntl(fds[i],F_DUPFD_CLOEXEC,0);
+				if (fd<0) {
+					std::string err = "SendShmFDs dup error: ";
+					err += strerror(errno);
+					CloseFDs(dups);
+					throw std::runtime_error(err);
+				}
+				dups.push_back(fd);
+			}
+			if (pendingIDs.size())
+				EncodePendingIDs(); // so the frame goes at sendBuf.size()
+			// too many for one send, they wait for a later one instead
+			if (heldFDs.empty() && sendFDs.size()+msg.count<=ShmFDsMsg::kMaxFDs)
+				sendFDs.insert(sendFDs.end(),dups.begin(),dups.end());
+			else if (heldFDs.size() && heldFDs.back().second.size()+msg.count<=ShmFDsMsg::kMaxFDs)
+				heldFDs.back().second.insert(heldFDs.back().second.end(),dups.begin(),dups.end());
+			else
+				heldFDs.push_back(HeldFDs(sendBuf.size(),dups));
+			DeferSend(&frame,sizeof(frame));
+			result += sizeof(frame);
+		}
+		firstBufNum += msg.count;
+		fds += msg.count;
+		count -= msg.count;
+	}
+	return result;
+}
+
 //-----------------------------------------------------------------------------
 int SocketEndpoint::SendValidatePeer(void)
 //-----------------------------------------------------------------------------
 {
 	uint32_t vals[2] = { kProtocolMagic, kProtocolVersion };
-	return SendCtrlMsg(kCtrlMsgID_ValidatePeer,vals,sizeof(vals));
+	int result = SendCtrlMsg(kCtrlMsgID_ValidatePeer,vals,sizeof(vals));
+	if (result<0) return result;
+	// a separate message, that older peers ignore as unknown
+	// (recvBuf grows for anything up to kMaxLargePayloadSize)
+	PeerCapsMsg caps;
+	caps.maxPayload = CtrlMsgHdr::kMaxLargePayloadSize;
+	caps.features = kPeerFeature_IDRuns;
+	return SendCtrlMsg(kCtrlMsgID_PeerCaps,&caps,sizeof(caps));
 }
 
 //-----------------------------------------------------------------------------
@@ -753,6 +1400,21 @@ void SocketEndpoint::HandleRegistrationsWanted(bool wantNew, bool wantCurrent)
 {	dbprintf(olvl,"# %s\n", __PRETTY_FUNCTION__); }
 void SocketEndpoint::HandleProdNiceLevel(int32_t lvl)
 {	dbprintf(olvl,"# %s\n", __PRETTY_FUNCTION__); }
+void SocketEndpoint::HandleNumaNode(int32_t node)
+{	dbprintf(olvl,"# %s\n", __PRETTY_FUNCTION__); }
+void SocketEndpoint::HandleShmRing(uint32_t state)
+{	dbprintf(olvl,"# %s\n", __PRETTY_FUNCTION__); }
+void SocketEndpoint::HandleRingDoorbell(void)
+{	dbprintf(olvl,"# %s\n", __PRETTY_FUNCTION__); }
+void SocketEndpoint::HandleSampling(uint32_t first, uint32_t last, uint32_t everyNth, float maxRate)
+{	dbprintf(olvl,"# %s\n", __PRETTY_FUNCTION__); }
+void SocketEndpoint::HandleDropPriority(uint32_t first, uint32_t last, int32_t priority)
+{	dbprintf(olvl,"# %s\n", __PRETTY_FUNCTION__); }
+void SocketEndpoint::HandleWantedQueueBudget(float latency, uint64_t maxBytes)
+{	dbprintf(olvl,"# %s\n", __PRETTY_FUNCTION__); }
+void SocketEndpoint::HandleShmFDs(uint32_t firstBufNum, const int fds[], unsigned count)
+{	dbprintf(olvl,"# %s\n", __PRETTY_FUNCTION__);
+	for (unsigned i=0; i<count; i++) close(fds[i]); }
 //-----------------------------------------------------------------------------
 void SocketEndpoint::HandleCtrlMsg(uint16_t msgID, const void* ptr, uint16_t len)
 {	dbprintf(olvl,"# %s\n", __PRETTY_FUNCTION__); }
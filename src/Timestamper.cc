@@ -0,0 +1,118 @@
+//=============================================================================
+//	This file is part of MCSB, the Multi-Client Shared Buffer
+//	Copyright (C) 2014  Gregory E. Allen and
+//		Applied Research Laboratories: The University of Texas at Austin
+//
+//	MCSB is free software: you can redistribute it and/or modify it
+//	under the terms of the GNU Lesser General Public License as published
+//	by the Free Software Foundation, either version 2.1 of the License, or
+//	(at your option) any later version.
+//
+//	MCSB is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+//	Lesser General Public License <http://www.gnu.org/licenses/lgpl.html>
+//	for more details.
+//=============================================================================
+
+#include "MCSB/Timestamper.h"
+
+#include <time.h>
+#include <unistd.h>
+
+namespace MCSB {
+
+//-----------------------------------------------------------------------------
+Timestamper::Timestamper(ClientOptions::TimestampClock clk)
+//-----------------------------------------------------------------------------
+:	clock(clk), tscAnchor(0), anchorTime(0), tscPeriod(0), anchorTicks(0)
+{
+	if (clock==ClientOptions::eTscClock)
+		CalibrateTSC();
+}
+
+//-----------------------------------------------------------------------------
+double Timestamper::Now(void) const
+//-----------------------------------------------------------------------------
+{
+	switch (clock) {
+		case ClientOptions::eCoarseClock:
+			return CoarseTime();
+		case ClientOptions::eTscClock: {
+			uint64_t ticks = ReadTSC() - tscAnchor;
+			if (ticks>anchorTicks) {
+				Anchor();
+				ticks = ReadTSC() - tscAnchor;
+			}
+			return anchorTime + ticks*tscPeriod;
+		}
+		default:
+			return MonotonicTime();
+	}
+}
+
+//-----------------------------------------------------------------------------
+double Timestamper::MonotonicTime(void)
+//-----------------------------------------------------------------------------
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+//-----------------------------------------------------------------------------
+double Timestamper::CoarseTime(void)
+//-----------------------------------------------------------------------------
+{
+	struct timespec ts;
+#ifdef CLOCK_MONOTONIC_COARSE
+	clock_gettime(CLOCK_MONOTONIC_COARSE,&ts);
+#else
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+#endif
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+//-----------------------------------------------------------------------------
+uint64_t Timestamper::ReadTSC(void)
+//-----------------------------------------------------------------------------
+{
+#if defined(__x86_64__) || defined(__i386__)
+	uint32_t lo, hi;
+	__asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+	return (uint64_t(hi) << 32) | lo;
+#else
+	return 0;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+void Timestamper::CalibrateTSC(void)
+//-----------------------------------------------------------------------------
+{
+	tscAnchor = ReadTSC();
+	anchorTime = MonotonicTime();
+	usleep(kCalibrationUsecs);
+	if (ReadTSC()<=tscAnchor) {
+		// no usable TSC, so fall back
+		clock = ClientOptions::eMonotonicClock;
+		return;
+	}
+	Anchor();
+}
+
+//-----------------------------------------------------------------------------
+void Timestamper::Anchor(void) const
+// refine the period over the interval since the last anchor, and start anew
+//-----------------------------------------------------------------------------
+{
+	uint64_t tsc = ReadTSC();
+	double now = MonotonicTime();
+	if (tsc>tscAnchor && now>anchorTime)
+		tscPeriod = (now-anchorTime)/(tsc-tscAnchor);
+	tscAnchor = tsc;
+	anchorTime = now;
+	anchorTicks = uint64_t(1/tscPeriod); // about a second
+}
+
+} // namespace MCSB
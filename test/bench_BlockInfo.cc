@@ -0,0 +1,143 @@
+//=============================================================================
+//	This file is part of MCSB, the Multi-Client Shared Buffer
+//	Copyright (C) 2014  Gregory E. Allen and
+//		Applied Research Laboratories: The University of Texas at Austin
+//
+//	MCSB is free software: you can redistribute it and/or modify it
+//	under the terms of the GNU Lesser General Public License as published
+//	by the Free Software Foundation, either version 2.1 of the License, or
+//	(at your option) any later version.
+//
+//	MCSB is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+//	Lesser General Public License <http://www.gnu.org/licenses/lgpl.html>
+//	for more details.
+//=============================================================================
+
+// Compare the packed (version 1) and cache-line strided (version 2) BlockInfo
+// layouts. One thread stands in for the manager, filling in the BlockInfo of
+// every fourth block, while consumer threads read the BlockInfo of the blocks
+// in between, as they would when scanning a slab of received segments.
+// With the packed layout these share cache lines with the writes.
+
+#include "MCSB/ShmDefs.h"
+#include "MCSB/uptimer.h"
+
+#include <pthread.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+enum { kNumInfos = 4096 };
+
+struct BenchArgs {
+	char* infos;
+	uint32_t stride;
+	volatile bool stop;
+	unsigned nextReader;
+	uint64_t count[64]; // per thread, index*8 to keep them apart
+};
+
+//-----------------------------------------------------------------------------
+const MCSB::BlockInfo* Info(const BenchArgs* args, unsigned i)
+//-----------------------------------------------------------------------------
+{
+	return (const MCSB::BlockInfo*)(args->infos + i*args->stride);
+}
+
+//-----------------------------------------------------------------------------
+void* Writer(void* arg)
+//-----------------------------------------------------------------------------
+{
+	BenchArgs* args = (BenchArgs*)arg;
+	uint64_t n = 0;
+	while (!args->stop) {
+		for (unsigned i=0; i<kNumInfos; i+=4) {
+			volatile MCSB::BlockInfo* info = (volatile MCSB::BlockInfo*)Info(args,i);
+			info->messageID = n;
+			info->size = i;
+			info->sendTime = n;
+			n++;
+		}
+	}
+	args->count[0] = n;
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+void* Reader(void* arg)
+//-----------------------------------------------------------------------------
+{
+	BenchArgs* args = (BenchArgs*)arg;
+	unsigned idx = __sync_add_and_fetch(&args->nextReader,1);
+	uint64_t n = 0, sum = 0;
+	while (!args->stop) {
+		for (unsigned i=0; i<kNumInfos; i++) {
+			if (!(i%4)) continue; // the writer's
+			const volatile MCSB::BlockInfo* info = Info(args,i);
+			sum += info->messageID + info->size;
+			n++;
+		}
+	}
+	args->count[idx*8] = n + (sum&1);
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+void Bench(const char* what, uint32_t stride, unsigned numReaders, double secs)
+//-----------------------------------------------------------------------------
+{
+	std::vector<char> mem(kNumInfos*stride + MCSB::ShmHeader::kCacheLineSize);
+	uintptr_t base = (uintptr_t)&mem[0];
+	base = (base + MCSB::ShmHeader::kCacheLineSize-1) & -(uintptr_t)MCSB::ShmHeader::kCacheLineSize;
+
+	BenchArgs args;
+	memset(&args, 0, sizeof(args));
+	args.infos = (char*)base;
+	args.stride = stride;
+	args.stop = false;
+
+	std::vector<pthread_t> threads(numReaders+1);
+	pthread_create(&threads[0], 0, Writer, &args);
+	for (unsigned i=0; i<numReaders; i++)
+		pthread_create(&threads[i+1], 0, Reader, &args);
+	double t0 = MCSB::uptimer::CurrentTime();
+	usleep(useconds_t(secs*1e6));
+	args.stop = true;
+	for (unsigned i=0; i<threads.size(); i++)
+		pthread_join(threads[i], 0);
+	double elapsed = MCSB::uptimer::CurrentTime() - t0;
+
+	uint64_t reads = 0;
+	for (unsigned i=1; i<=numReaders; i++)
+		reads += args.count[i*8];
+	printf("%-8s stride %3u  writes %7.1f M/s  reads %7.1f M/s\n", what, stride,
+		args.count[0]/elapsed/1e6, reads/elapsed/1e6);
+}
+
+} // anonymous namespace
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* const argv[])
+//-----------------------------------------------------------------------------
+{
+	if (argc>1 && argv[1][0]=='-') {
+		fprintf(stderr, "usage: %s [numReaders [seconds]]\n", argv[0]);
+		return 0;
+	}
+	unsigned numReaders = argc>1 ? atoi(argv[1]) : 3;
+	double secs = argc>2 ? atof(argv[2]) : 1;
+	if (numReaders<1) numReaders = 1;
+	if (numReaders>7) numReaders = 7;
+
+	MCSB::ShmHeader hdr(4096,4096,kNumInfos);
+	printf("%u readers, %u BlockInfos of %u bytes\n", numReaders, kNumInfos, hdr.infoSize);
+	Bench("packed", hdr.infoSize, numReaders, secs);
+	Bench("strided", hdr.InfoStride(), numReaders, secs);
+	return 0;
+}
@@ -0,0 +1,108 @@
+//=============================================================================
+//	This file is part of MCSB, the Multi-Client Shared Buffer
+//	Copyright (C) 2014  Gregory E. Allen and
+//		Applied Research Laboratories: The University of Texas at Austin
+//
+//	MCSB is free software: you can redistribute it and/or modify it
+//	under the terms of the GNU Lesser General Public License as published
+//	by the Free Software Foundation, either version 2.1 of the License, or
+//	(at your option) any later version.
+//
+//	MCSB is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+//	Lesser General Public License <http://www.gnu.org/licenses/lgpl.html>
+//	for more details.
+//=============================================================================
+
+// Compare buffer throughput backed by normal pages vs. huge pages.
+// Blocks are written through a client's RW mapping and read back through
+// its RO mapping, in random order so that TLB reach matters.
+// Huge pages need a hugetlbfs mount and a pool, e.g. (as root):
+//   echo 256 > /proc/sys/vm/nr_hugepages
+
+#include "MCSB/ShmMapper.h"
+#include "MCSB/ShmClient.h"
+#include "MCSB/uptimer.h"
+#include "MCSB/ClientOptions.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+//-----------------------------------------------------------------------------
+int Bench(const char* what, const char* nameFmt, uint32_t pgSz,
+	uint32_t blkSz, uint64_t bufSz, unsigned passes)
+//-----------------------------------------------------------------------------
+{
+	uint32_t numBlks = bufSz/blkSz;
+	uint32_t slbSz = blkSz;
+	try {
+		MCSB::ShmMapper mapper(nameFmt, true, blkSz, slbSz, numBlks, 1, pgSz);
+		mapper.NumBuffers(1);
+		MCSB::ShmClient client(nameFmt);
+
+		// a random order of the blocks
+		std::vector<uint32_t> order(numBlks);
+		for (uint32_t i=0; i<numBlks; i++)
+			order[i] = i;
+		srand(1);
+		for (uint32_t i=numBlks-1; i>0; i--)
+			std::swap(order[i], order[rand()%(i+1)]);
+
+		std::vector<char> src(blkSz, 1);
+		double writeSecs = 0, readSecs = 0;
+		uint64_t sum = 0;
+		for (unsigned pass=0; pass<passes; pass++) {
+			double t0 = MCSB::uptimer::CurrentTime();
+			for (uint32_t i=0; i<numBlks; i++) {
+				char* ptr = client.GetWriteableBlockPtr(order[i]);
+				memcpy(ptr, &src[0], blkSz);
+			}
+			double t1 = MCSB::uptimer::CurrentTime();
+			for (uint32_t i=0; i<numBlks; i++) {
+				const uint64_t* ptr = (const uint64_t*)client.GetBlockPtr(order[numBlks-1-i]);
+				for (uint32_t j=0; j<blkSz/sizeof(uint64_t); j+=8)
+					sum += ptr[j]; // a word from each cache line
+			}
+			double t2 = MCSB::uptimer::CurrentTime();
+			if (pass) { // the first pass faults the pages in
+				writeSecs += t1-t0;
+				readSecs += t2-t1;
+			}
+		}
+		double bytes = double(numBlks)*blkSz*(passes-1);
+		printf("%-12s pageSize %8u  write %7.2f GB/s  read %7.2f GB/s  (%llx)\n",
+			what, mapper.PageSize(), bytes/writeSecs/1e9, bytes/readSecs/1e9,
+			(unsigned long long)sum);
+	} catch (std::runtime_error err) {
+		printf("%-12s skipped: %s\n", what, err.what());
+		return 1;
+	}
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* const argv[])
+//-----------------------------------------------------------------------------
+{
+	if (argc>1 && argv[1][0]=='-') {
+		fprintf(stderr, "usage: %s [bufferSize [blockSize [hugePageSize [hugetlbfsDir]]]]\n", argv[0]);
+		return 0;
+	}
+	uint64_t bufSz = argc>1 ? MCSB::strtoul_po2suffix(argv[1]) : 256*1024*1024;
+	uint32_t blkSz = argc>2 ? MCSB::strtoul_po2suffix(argv[2]) : 8*1024;
+	uint32_t hugeSz = argc>3 ? MCSB::strtoul_po2suffix(argv[3]) : 2*1024*1024;
+	std::string dir = argc>4 ? argv[4] : "/dev/hugepages";
+	unsigned passes = 11;
+
+	printf("bufferSize %llu, blockSize %u\n", (unsigned long long)bufSz, blkSz);
+	Bench("normal", "/mcsb-bench.buf%02u", 0, blkSz, bufSz, passes);
+	std::string hugeFmt = dir + "/mcsb-bench.buf%02u";
+	Bench("huge", hugeFmt.c_str(), hugeSz, blkSz, bufSz, passes);
+	return 0;
+}
@@ -43,6 +43,7 @@ class MyTester : public MCSB::ClientTester {
 	void HandleMessage1(const MCSB::RecvMessageDescriptor& desc) {
 		dbprintf(kInfo, "client[%d] %s\n", id, __PRETTY_FUNCTION__);
 		HandleMessage2(desc.MessageID(), desc.Buf(), desc.Size());
+		assert(desc.SendTime()>0);
 		rmdList.push_back(desc);
 		if (rmdList.size()>4) {
 			MCSB::RecvMessageDescriptor rmd = rmdList.front();
@@ -77,6 +78,7 @@ int MyTester::RunClient(void)
 	dbprintf(kInfo, "client[%d] using msgID %d\n", id, msgID);
 	
 	MCSB::Client client(opts);
+	client.KeepLatencyHistograms();
 
 	// several ways to handle messages
 	client.RegisterForMsgID(msgID,&MyTester::HandleMessageF,this);
@@ -193,6 +195,16 @@ int MyTester::RunClient(void)
 		client.HandleRecvMessage(rmd);
 	}
 
+	// pack small messages into a batch, each is handled separately
+	for (int i=0; i<200; i++) {
+		sendSeq++;
+		int res = client.BatchMessage(msgID,&sendSeq,sizeof(sendSeq));
+		assert(res==sizeof(sendSeq));
+	}
+	assert(client.FlushMessageBatch()>1);
+	assert(!client.FlushMessageBatch());
+	while(sequence!=sendSeq) client.Poll();
+
 	int lvl = kInfo;
 	dbprintf(lvl, "client[%d] BlockSize %u\n", id, client.BlockSize());
 	dbprintf(lvl, "client[%d] SlabSize %u\n", id, client.SlabSize());
@@ -202,6 +214,13 @@ int MyTester::RunClient(void)
 	dbprintf(lvl, "client[%d] MaxRecvMessageSize %u\n", id, client.MaxRecvMessageSize());
 	dbprintf(lvl, "client[%d] FD %u\n", id, client.FD());
 	dbprintf(lvl, "client[%d] ClientID %u\n", id, client.ClientID());
+
+	// every message was stamped and handled
+	const MCSB::MsgLatencyHistograms* hists = client.GetLatencyHistograms();
+	assert(hists->Delivery(msgID)->Count()==(uint64_t)sendSeq);
+	assert(hists->Residence(msgID)->Count()==(uint64_t)sendSeq);
+	if (Verbosity()>=lvl)
+		hists->Print("- ");
 	
 	client.SendSequenceToken();
 	while (client.PendingSequenceTokens()) {
@@ -22,9 +22,13 @@
 
 #include "MCSB/ClientRecvManager.h"
 #include "MCSB/ShmDefs.h"
+#include "MCSB/crc32c.h"
 
 #include <assert.h>
 #include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <stdexcept>
 #include <vector>
 
@@ -116,12 +120,227 @@ int test1(void)
 	return 0;
 }
 
+//-----------------------------------------------------------------------------
+uint32_t PackBatch(uint32_t* block, uint32_t blockSize, unsigned count)
+// pack count messages of lengths 1 to count, each filled with its length
+//-----------------------------------------------------------------------------
+{
+	char* buf = (char*)block;
+	uint32_t offset = 0;
+	for (unsigned i=0; i<count; i++) {
+		uint32_t len = i+1;
+		memset(buf+offset, len, len);
+		offset = (offset+len+MCSB::BlockInfo::kPackedAlign-1)
+			& ~(MCSB::BlockInfo::kPackedAlign-1);
+	}
+	offset = (offset+3) & ~3;
+	uint32_t* trailer = (uint32_t*)(buf+offset);
+	for (unsigned i=0; i<count; i++)
+		trailer[i] = i+1;
+	trailer[count] = count;
+	assert(offset+(count+1)*sizeof(uint32_t)<=blockSize);
+	return offset+(count+1)*sizeof(uint32_t);
+}
+
+//-----------------------------------------------------------------------------
+int test2(void)
+// packed batches
+//-----------------------------------------------------------------------------
+{
+	MCSB::ClientRecvManager recvMgr;
+	recvMgr.NumConsSlabs(4);
+
+	const uint32_t kBlockSize = 1024;
+	std::vector<uint32_t> block(2*kBlockSize/sizeof(uint32_t));
+	uint32_t blockIDs[] = {7,8};
+	const void* blockPtrs[] = { &block[0], &block[kBlockSize/sizeof(uint32_t)] };
+	MCSB::BlockInfo blockInfo[2];
+	const MCSB::BlockInfo* blockInfoPtrs[] = { &blockInfo[0], &blockInfo[1] };
+	for (unsigned i=0; i<2; i++) {
+		blockInfo[i].messageID = 5+i;
+		blockInfo[i].segmentNumber = MCSB::BlockInfo::kPackedBatch;
+		blockInfo[i].numSegments = 1;
+	}
+
+	// two batches give 30+20 separate messages, in order
+	unsigned counts[] = {30,20};
+	for (unsigned b=0; b<2; b++) {
+		blockInfo[b].size = PackBatch((uint32_t*)blockPtrs[b],kBlockSize,counts[b]);
+		blockInfo[b].crc32c = MCSB::crc32c(blockPtrs[b],blockInfo[b].size);
+	}
+	recvMgr.AddSegments(blockIDs,blockPtrs,blockInfoPtrs,2);
+	std::vector<RecvMessageDescriptor> descs;
+	for (unsigned b=0; b<2; b++) {
+		for (unsigned i=0; i<counts[b]; i++) {
+			assert(recvMgr.PendingMessage());
+			RecvMessageDescriptor desc = recvMgr.GetMessageDescriptor();
+			assert(desc->NumSegments()==1);
+			assert(desc->MessageID()==5+b);
+			assert(desc->BlockID()==blockIDs[b]);
+			assert(desc->Size()==i+1);
+			assert(!((uintptr_t)desc->Buf()%MCSB::BlockInfo::kPackedAlign));
+			assert(((const char*)desc->Buf())[i]==(char)(i+1));
+			assert(desc->ValidCRC(0));
+			descs.push_back(desc);
+		}
+	}
+	assert(!recvMgr.PendingMessage());
+
+	// each batch is retired only after all its messages are released,
+	// and in any order
+	for (unsigned i=0; i<counts[0]; i++) {
+		assert(!recvMgr.NumRetiredSegments());
+		recvMgr.ReleaseMessageDescriptor(descs[counts[0]-1-i]);
+	}
+	assert(recvMgr.NumRetiredSegments()==1);
+	for (unsigned i=0; i<counts[1]; i++)
+		recvMgr.ReleaseMessageDescriptor(descs[counts[0]+i]);
+	uint32_t retiredBlocks[2];
+	assert(recvMgr.GetRetiredSegments(retiredBlocks,2)==2);
+	assert(retiredBlocks[0]==7 && retiredBlocks[1]==8);
+	assert(!recvMgr.NumBusySegments());
+
+	// a bad crc32c fails every message in the batch
+	blockInfo[0].size = PackBatch(&block[0],kBlockSize,3);
+	blockInfo[0].crc32c = 1;
+	recvMgr.AddSegments(blockIDs,blockPtrs,blockInfoPtrs,1);
+	assert(recvMgr.NumPendingSegments()==1);
+	for (unsigned i=0; i<3; i++) {
+		RecvMessageDescriptor desc = recvMgr.GetMessageDescriptor();
+		assert(desc && !desc->ValidCRC(0));
+		if (!i) assert(recvMgr.NumPendingSegments()==2);
+		recvMgr.ReleaseMessageDescriptor(desc);
+	}
+	assert(recvMgr.GetRetiredSegments(retiredBlocks,2)==1);
+
+	// malformed batches are dropped
+	uint32_t badSizes[] = {0, 2, 6};
+	for (unsigned i=0; i<4; i++) {
+		blockInfo[0].size = PackBatch(&block[0],kBlockSize,3);
+		if (i<3) {
+			blockInfo[0].size = badSizes[i];
+		} else {
+			// lengths that run into the trailer
+			block[blockInfo[0].size/sizeof(uint32_t)-2] = 100;
+		}
+		recvMgr.AddSegments(blockIDs,blockPtrs,blockInfoPtrs,1);
+		assert(!recvMgr.PendingMessage());
+		assert(recvMgr.GetRetiredSegments(retiredBlocks,2)==1);
+	}
+	assert(!recvMgr.NumBusySegments());
+	assert(!recvMgr.NumPendingSegments());
+
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+int test3(void)
+// contiguous views of multi-segment messages
+//-----------------------------------------------------------------------------
+{
+	MCSB::ClientRecvManager recvMgr;
+	recvMgr.NumConsSlabs(4);
+
+	// shared pages, as the blocks are, each filled with its page number
+	const uint32_t kPage = sysconf(_SC_PAGESIZE);
+	const unsigned kNumPages = 8;
+	char* pages = (char*)mmap(0, kNumPages*kPage, PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	assert(pages!=MAP_FAILED);
+	for (unsigned i=0; i<kNumPages; i++)
+		memset(pages+i*kPage, i, kPage);
+
+	// a message in 3 segments: pages 5-6, page 1, and part of page 3
+	uint32_t blockIDs[] = {5,1,3};
+	const void* blockPtrs[] = { pages+5*kPage, pages+kPage, pages+3*kPage };
+	uint32_t sizes[] = { 2*kPage, kPage, 100 };
+	MCSB::BlockInfo blockInfo[3];
+	const MCSB::BlockInfo* blockInfoPtrs[] = { &blockInfo[0], &blockInfo[1], &blockInfo[2] };
+	for (unsigned i=0; i<3; i++) {
+		blockInfo[i].messageID = 9;
+		blockInfo[i].size = sizes[i];
+		blockInfo[i].segmentNumber = i;
+		blockInfo[i].numSegments = 3;
+	}
+	uint32_t retiredBlocks[3];
+
+	// views are disabled by default
+	recvMgr.AddSegments(blockIDs,blockPtrs,blockInfoPtrs,3);
+	RecvMessageDescriptor desc = recvMgr.GetMessageDescriptor();
+	assert(desc && !recvMgr.ContiguousView(desc));
+	recvMgr.ReleaseMessageDescriptor(desc);
+	recvMgr.GetRetiredSegments(retiredBlocks,3);
+
+	recvMgr.MaxViewBytes(16*kPage);
+	for (unsigned n=0; n<2; n++) {
+		recvMgr.AddSegments(blockIDs,blockPtrs,blockInfoPtrs,3);
+		desc = recvMgr.GetMessageDescriptor();
+		const char* view = (const char*)recvMgr.ContiguousView(desc);
+		assert(view);
+		assert(view==recvMgr.ContiguousView(desc));
+		unsigned offset = 0;
+		for (unsigned i=0; i<3; i++) {
+			for (unsigned j=0; j<sizes[i]; j++) {
+				unsigned page = blockIDs[i]+j/kPage;
+				assert(view[offset+j]==(char)page);
+			}
+			offset += sizes[i];
+		}
+		// the view maps the pages themselves
+		pages[kPage] = 42;
+		assert(view[2*kPage]==42);
+		pages[kPage] = 1;
+		recvMgr.ReleaseMessageDescriptor(desc);
+		recvMgr.GetRetiredSegments(retiredBlocks,3);
+	}
+	// the second was the cached view
+	assert(recvMgr.Views().NumHits()==1);
+	assert(recvMgr.Views().NumMisses()==1);
+	assert(recvMgr.Views().MappedBytes()==4*kPage);
+
+	// a segment that doesn't start a page can't be remapped
+	blockPtrs[1] = pages+kPage+64;
+	recvMgr.AddSegments(blockIDs,blockPtrs,blockInfoPtrs,3);
+	desc = recvMgr.GetMessageDescriptor();
+	assert(!recvMgr.ContiguousView(desc));
+	recvMgr.ReleaseMessageDescriptor(desc);
+	recvMgr.GetRetiredSegments(retiredBlocks,3);
+	blockPtrs[1] = pages+kPage;
+
+	// nor one, other than the last, that doesn't end a page
+	blockInfo[0].size = kPage+1;
+	recvMgr.AddSegments(blockIDs,blockPtrs,blockInfoPtrs,3);
+	desc = recvMgr.GetMessageDescriptor();
+	assert(!recvMgr.ContiguousView(desc));
+	recvMgr.ReleaseMessageDescriptor(desc);
+	recvMgr.GetRetiredSegments(retiredBlocks,3);
+	blockInfo[0].size = sizes[0];
+
+	// a view in use is kept, idle views are unmapped to fit the bound
+	recvMgr.AddSegments(blockIDs,blockPtrs,blockInfoPtrs,3);
+	desc = recvMgr.GetMessageDescriptor();
+	assert(recvMgr.ContiguousView(desc));
+	recvMgr.MaxViewBytes(2*kPage);
+	assert(recvMgr.Views().NumViews()==1);
+	recvMgr.ReleaseMessageDescriptor(desc);
+	recvMgr.GetRetiredSegments(retiredBlocks,3);
+	assert(!recvMgr.Views().NumViews());
+	assert(!recvMgr.Views().MappedBytes());
+
+	munmap(pages, kNumPages*kPage);
+	return 0;
+}
+
 //-----------------------------------------------------------------------------
 int main(int argc, char* const argv[])
 //-----------------------------------------------------------------------------
 {
 	int result = test1();
 	if (result) return result;
+	result = test2();
+	if (result) return result;
+	result = test3();
+	if (result) return result;
 	fprintf(stderr,"=== PASS ===\n");
 	return result;
 }
@@ -0,0 +1,214 @@
+//=============================================================================
+//	This file is part of MCSB, the Multi-Client Shared Buffer
+//	Copyright (C) 2014  Gregory E. Allen and
+//		Applied Research Laboratories: The University of Texas at Austin
+//
+//	MCSB is free software: you can redistribute it and/or modify it
+//	under the terms of the GNU Lesser General Public License as published
+//	by the Free Software Foundation, either version 2.1 of the License, or
+//	(at your option) any later version.
+//
+//	MCSB is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+//	Lesser General Public License <http://www.gnu.org/licenses/lgpl.html>
+//	for more details.
+//=============================================================================
+// always assert for tests, even in Release
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+// A consumer grows its consumer slabs past what its ShmRing was sized for.
+// The manager offers a larger ring, and with it nothing pauses. A consumer
+// that refuses it keeps the small one: deliveries and retirements fill the
+// rings and pause them, and then go back to the rings once drained, with
+// everything still in order.
+
+#include "MCSB/TestingClientOptions.h"
+#include "MCSB/Manager.h"
+#include "MCSB/SocketClient.h"
+#include "MCSB/ClientImpl.h"
+#include "MCSB/ClientImplWatcher.h"
+#include "rand_buf.h"
+
+#include <ev++.h>
+#include <unistd.h>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+class RingClient : public MCSB::ClientImpl {
+//-----------------------------------------------------------------------------
+  public:
+	RingClient(int fd, const MCSB::ClientOptions& opts, bool refuse)
+	:	ClientImpl(fd,opts), refuseLarger(refuse), numRefused(0) {}
+	void GrowConsumerSlabs(uint32_t n)
+		{ opts.minConsumerSlabs = n; ComputeAndSendNumSlabs(); }
+	bool RingActive(void) const { return ringActive; }
+	bool DeliveryPaused(void) const { return deliveryPaused; }
+	bool RetireViaSocket(void) const { return retireViaSocket; }
+	bool DeliveryRingPending(void) const
+		{ return !ring.Empty(MCSB::ShmRing::kDelivery); }
+	uint32_t RingCapacity(void) const { return ring.Capacity(); }
+	unsigned NumRefused(void) const { return numRefused; }
+  protected:
+	bool refuseLarger;
+	unsigned numRefused;
+	void HandleCtrlString(uint32_t which, const char* str) {
+		if (which==MCSB::kCtrlString_ShmRingName && ringActive && refuseLarger) {
+			// as if it could not be mapped
+			DrainDeliveryRing();
+			deliveryPaused = 1;
+			SendShmRing(MCSB::kShmRing_Failed);
+			numRefused++;
+			return;
+		}
+		ClientImpl::HandleCtrlString(which,str);
+	}
+};
+
+enum { kMsgID = 1, kMsgSize = 64, kConsSlabs = 64 };
+
+static ev::default_loop* loop;
+static uint32_t numSent, numRcvd;
+
+//-----------------------------------------------------------------------------
+void Send(MCSB::ClientImpl& prod, unsigned count)
+//-----------------------------------------------------------------------------
+{
+	for (unsigned i=0; i<count; i++) {
+		MCSB::ClientImpl::SendMsgDesc smd = prod.GetSendMsgDesc(kMsgSize);
+		uint32_t seed = numSent++;
+		MCSB::set_rand_buf((uint32_t*)smd->Buf(), kMsgSize/sizeof(uint32_t), seed);
+		prod.SendMessage(kMsgID,smd,kMsgSize);
+		if (!(i%16))
+			loop->run(EVRUN_NOWAIT);
+	}
+}
+
+//-----------------------------------------------------------------------------
+void Receive(RingClient& cons, std::vector<MCSB::ClientImpl::RecvMsgDesc>& held,
+	bool& sawPause)
+// until all that was sent is held, and the manager delivers into the ring
+//-----------------------------------------------------------------------------
+{
+	for (unsigned tries=0; tries<100000; tries++) {
+		loop->run(EVRUN_NOWAIT);
+		cons.Poll(0);
+		if (cons.DeliveryPaused())
+			sawPause = 1;
+		while (cons.PendingRecvMessage()) {
+			MCSB::ClientImpl::RecvMsgDesc rmd = cons.GetRecvMsgDesc();
+			assert(rmd->Size()==kMsgSize);
+			uint32_t seed = numRcvd++;
+			unsigned errs = MCSB::verify_rand_buf((const uint32_t*)rmd->Buf(),
+				kMsgSize/sizeof(uint32_t), seed);
+			assert(!errs); // in order
+			held.push_back(rmd);
+		}
+		if (numRcvd==numSent && !cons.DeliveryPaused())
+			return;
+	}
+	fprintf(stderr,"### received %u of %u, delivery paused %d\n",
+		numRcvd, numSent, cons.DeliveryPaused());
+	assert(0);
+}
+
+//-----------------------------------------------------------------------------
+void Round(MCSB::ClientImpl& prod, RingClient& cons, unsigned count, bool pauses)
+//-----------------------------------------------------------------------------
+{
+	uint32_t capacity = cons.RingCapacity();
+	std::vector<MCSB::ClientImpl::RecvMsgDesc> held;
+	bool deliveryPaused = 0;
+	Send(prod,count);
+	Receive(cons,held,deliveryPaused);
+
+	// back to the ring
+	Send(prod,16);
+	for (int i=0; i<10; i++)
+		loop->run(EVRUN_NOWAIT);
+	bool ringUsed = cons.DeliveryRingPending();
+	Receive(cons,held,deliveryPaused);
+
+	// released at once, more than the retirement ring holds
+	for (unsigned i=0; i<held.size(); i++)
+		cons.ReleaseRecvMsgDesc(held[i]);
+	bool retirePaused = cons.RetireViaSocket();
+	for (unsigned tries=0; cons.RetireViaSocket() && tries<100000; tries++) {
+		loop->run(EVRUN_NOWAIT);
+		cons.Poll(0);
+	}
+	fprintf(stderr,"- ring capacity %u, held %u, delivery paused %d, ring used %d, retirement paused %d\n",
+		capacity, (unsigned)held.size(), deliveryPaused, ringUsed, retirePaused);
+	assert(deliveryPaused==pauses && ringUsed && retirePaused==pauses);
+	assert(!cons.RetireViaSocket());
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* const argv[])
+//-----------------------------------------------------------------------------
+{
+	MCSB::TestingClientOptions opts(argc,argv);
+	// 16 blocks per slab, so rings start at ShmRing::kMinCapacity
+	std::vector<const char*> margs(opts.ManagerArgv(), opts.ManagerArgv()+opts.ManagerArgc());
+	margs.push_back("-s4096");
+	margs.push_back("-S65536");
+	margs.push_back("-b8388608");
+	margs.push_back(0);
+	MCSB::ManagerParams mparms(margs.size()-1, (char* const*)&margs[0]);
+	opts.minProducerBytes = opts.minConsumerBytes = 0;
+	opts.minProducerSlabs = 4;
+	opts.minConsumerSlabs = 1;
+
+	ev::default_loop defaultLoop;
+	loop = &defaultLoop;
+	MCSB::Manager manager(mparms, defaultLoop);
+	defaultLoop.run(EVRUN_NOWAIT);
+
+	try {
+		MCSB::ClientImpl prod(MCSB::OpenSocketClient(opts.ctrlSockName.c_str()), opts);
+		MCSB::ClientImplWatcher watcher(&prod,defaultLoop);
+		for (int refuse=0; refuse<2; refuse++) {
+			// polled only here, so its delivery ring can fill
+			RingClient cons(MCSB::OpenSocketClient(opts.ctrlSockName.c_str()), opts, refuse);
+			while (!cons.RingActive()) {
+				defaultLoop.run(EVRUN_NOWAIT);
+				cons.Poll(0);
+			}
+			uint32_t smallCapacity = cons.RingCapacity();
+			cons.GrowConsumerSlabs(kConsSlabs);
+			for (unsigned tries=0; tries<100000; tries++) {
+				defaultLoop.run(EVRUN_NOWAIT);
+				cons.Poll(0);
+				bool offered = refuse ? cons.NumRefused()
+					: cons.RingCapacity()>smallCapacity;
+				if (offered && !cons.DeliveryPaused()) break;
+			}
+			fprintf(stderr,"- ring capacity %u, grown to %u, refused %u\n",
+				smallCapacity, cons.RingCapacity(), cons.NumRefused());
+			assert(cons.NumConsumerSlabs()==kConsSlabs && !cons.DeliveryPaused());
+			assert(refuse ? cons.NumRefused()==1 : cons.RingCapacity()>smallCapacity);
+			uint32_t mid = kMsgID;
+			cons.RegisterMsgIDs(&mid,1);
+			for (int i=0; i<10; i++)
+				defaultLoop.run(EVRUN_NOWAIT);
+
+			// twice, since the second needs what the first retired
+			numSent = numRcvd = 0;
+			unsigned count = 3*smallCapacity;
+			Round(prod,cons,count,refuse);
+			Round(prod,cons,count,refuse);
+			cons.DeregisterMsgIDs(&mid,1);
+			for (int i=0; i<10; i++)
+				defaultLoop.run(EVRUN_NOWAIT);
+		}
+	} catch (std::runtime_error err) {
+		fprintf(stderr,"#-- %s\n", err.what());
+		return -1;
+	}
+
+	for (int i=0; i<10; i++)
+		defaultLoop.run(EVRUN_NOWAIT);
+	return 0;
+}
@@ -227,6 +227,54 @@ int test4(void)
 	return 0;
 }
 
+//-----------------------------------------------------------------------------
+int test5(void)
+// verify that small messages pack apart from the page-aligned large ones
+//-----------------------------------------------------------------------------
+{
+	fprintf(stderr,"=== test5 ===\n");
+
+	MCSB::ClientSendManager sendMgr;
+
+	const uint32_t blockSize = 256;
+	const uint32_t largeBlockSize = 8192;
+	const uint32_t blocksPerLarge = largeBlockSize/blockSize;
+	const uint32_t slabSize = largeBlockSize*32;
+	const uint32_t blocksPerSlab = slabSize/blockSize;
+	sendMgr.SetSizeParams(blockSize,slabSize,largeBlockSize);
+
+	uint32_t slabIDs[] = {0,1,2,3};
+	const unsigned numSlabs = sizeof(slabIDs)/sizeof(uint32_t);
+	sendMgr.AddFreeSlabs(slabIDs, slabPtrs, numSlabs);
+
+	SendMessageSegment* small1 = sendMgr.GetMessageDescriptor(64);
+	SendMessageSegment* small2 = sendMgr.GetMessageDescriptor(300);
+	SendMessageSegment* large1 = sendMgr.GetMessageDescriptor(largeBlockSize+1);
+	SendMessageSegment* small3 = sendMgr.GetMessageDescriptor(100);
+	SendMessageSegment* large2 = sendMgr.GetMessageDescriptor(largeBlockSize);
+	assert(small1->Size()==blockSize);
+	assert(small2->BlockID()==small1->BlockID()+1);
+	assert(small2->Size()==2*blockSize);
+	assert(small3->BlockID()==small2->BlockID()+2);
+	assert(large1->Size()==2*largeBlockSize);
+	assert(large1->BlockID()/blocksPerSlab != small1->BlockID()/blocksPerSlab);
+	assert(large2->BlockID()==large1->BlockID()+2*blocksPerLarge);
+	assert((size_t)large1->Buf()%largeBlockSize==0);
+	assert((size_t)large2->Buf()%largeBlockSize==0);
+	assert(sendMgr.NumWorkingSlabs()==2);
+
+	sendMgr.ReleaseMessageDescriptor(small1);
+	sendMgr.ReleaseMessageDescriptor(small2);
+	sendMgr.ReleaseMessageDescriptor(small3);
+	sendMgr.ReleaseMessageDescriptor(large1);
+	sendMgr.ReleaseMessageDescriptor(large2);
+	sendMgr.FlushWorkingSlabs();
+	assert(sendMgr.NumWorkingSlabs()==0);
+	assert(sendMgr.NumRetiredSlabs()==2);
+
+	return 0;
+}
+
 //-----------------------------------------------------------------------------
 int main(int argc, char* const argv[])
 //-----------------------------------------------------------------------------
@@ -239,6 +287,8 @@ int main(int argc, char* const argv[])
 	if (result) return result;
 	result = test4();
 	if (result) return result;
+	result = test5();
+	if (result) return result;
 	fprintf(stderr,"=== PASS ===\n");
 	return result;
 }
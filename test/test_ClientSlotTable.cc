@@ -0,0 +1,103 @@
+//=============================================================================
+//	This file is part of MCSB, the Multi-Client Shared Buffer
+//	Copyright (C) 2014  Gregory E. Allen and
+//		Applied Research Laboratories: The University of Texas at Austin
+//
+//	MCSB is free software: you can redistribute it and/or modify it
+//	under the terms of the GNU Lesser General Public License as published
+//	by the Free Software Foundation, either version 2.1 of the License, or
+//	(at your option) any later version.
+//
+//	MCSB is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+//	Lesser General Public License <http://www.gnu.org/licenses/lgpl.html>
+//	for more details.
+//=============================================================================
+
+// always assert for tests, even in Release
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include "MCSB/ClientSlotTable.h"
+#include <cstdio>
+#include <cassert>
+
+struct Proxy {
+	int id;
+};
+
+typedef MCSB::ClientSlotTable<Proxy> SlotTable;
+
+//-----------------------------------------------------------------------------
+int test1(void)
+//-----------------------------------------------------------------------------
+{
+	const unsigned maxID = 100;
+	SlotTable table(maxID);
+	Proxy proxies[maxID+1];
+
+	assert(0==table.size());
+	assert(!table.Find(0));
+	assert(!table.Find(maxID+1000));
+	assert(SlotTable::kInvalidHandle==table.GetHandle(0));
+	assert(!table.FindHandle(SlotTable::kInvalidHandle));
+
+	// insert every ID
+	SlotTable::Handle handles[maxID+1];
+	for (unsigned i=0; i<=maxID; i++) {
+		proxies[i].id = i;
+		handles[i] = table.Insert(i,&proxies[i]);
+		assert(handles[i]==table.GetHandle(i));
+		assert(&proxies[i]==table.FindHandle(handles[i]));
+	}
+	assert(maxID+1==table.size());
+
+	// erase the even IDs
+	for (unsigned i=0; i<=maxID; i+=2) {
+		table.Erase(i);
+		table.Erase(i); // duplicate
+		assert(!table.Find(i));
+		assert(!table.FindHandle(handles[i]));
+	}
+	assert(maxID/2==table.size());
+
+	// the odd IDs are still found, and iteration covers them exactly once
+	unsigned seen = 0;
+	for (unsigned i=0; i<table.size(); i++) {
+		Proxy* p = table[i];
+		assert(p->id & 1);
+		assert(p==table.Find(p->id));
+		seen++;
+	}
+	assert(seen==maxID/2);
+	for (unsigned i=1; i<=maxID; i+=2) {
+		assert(&proxies[i]==table.FindHandle(handles[i]));
+	}
+
+	// reuse an ID, the stale handle must not match
+	Proxy reused = { 0 };
+	SlotTable::Handle h = table.Insert(0,&reused);
+	assert(h!=handles[0]);
+	assert(!table.FindHandle(handles[0]));
+	assert(&reused==table.FindHandle(h));
+	assert(&reused==table.Find(0));
+
+	// erase everything
+	for (unsigned i=0; i<=maxID; i++)
+		table.Erase(i);
+	assert(0==table.size());
+	assert(!table.FindHandle(h));
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* const argv[])
+//-----------------------------------------------------------------------------
+{
+	int result = test1();
+	if (result) return result;
+	fprintf(stderr,"=== PASS ===\n");
+	return result;
+}
@@ -30,11 +30,12 @@
 class MyTester : public MCSB::ClientTester {
   public:
 	MyTester(int argc, char* const argv[])
-		: MCSB::ClientTester(argc,argv), sequence(0) {}
+		: MCSB::ClientTester(argc,argv), sequence(0), holding(false) {}
    ~MyTester(void) {}
 	int RunClient(void);
   protected:
 	int sequence;
+	bool holding;
 	std::list<MCSB::RecvMessageDescriptor> rmdList;
 	void HandleMessage(const MCSB::RecvMessageDescriptor& desc) {
 		dbprintf(kInfo, "client[%d] %s\n", id, __PRETTY_FUNCTION__);
@@ -44,7 +45,10 @@ class MyTester : public MCSB::ClientTester {
 		dbprintf(kInfo, "client[%d] recvSeq %d\n", id, recvSeq);
 		assert(recvSeq==sequence+1 || recvSeq==sequence);
 		sequence = recvSeq;
+		if (holding)
+			rmdList.push_back(desc);
 	}
+	void Tick(void) {}
 };
 
 //-----------------------------------------------------------------------------
@@ -55,6 +59,9 @@ int MyTester::RunClient(void)
 	uint32_t msgID = id;
 	dbprintf(kInfo, "client[%d] using msgID %d\n", id, msgID);
 	
+	// released messages are batched, so the watcher has to return them
+	opts.retireBatchSegs = 64;
+	opts.retireBatchLatency = 0.02;
 	MCSB::Client client(opts);
 
 	ev::default_loop loop;
@@ -92,7 +99,27 @@ int MyTester::RunClient(void)
 	while(sequence!=sendSeq) {
 		loop.run(EVLOOP_ONESHOT);
 	}
-	
+
+	// hold a message past its handler, then release it while idle
+	holding = true;
+	sendSeq++;
+	client.SendMessage(msgID,&sendSeq,sizeof(sendSeq));
+	while(sequence!=sendSeq) {
+		loop.run(EVLOOP_ONESHOT);
+	}
+	holding = false;
+	assert(rmdList.size()==1 && client.RetireBatchTimeout()<0);
+	rmdList.clear();
+	assert(client.RetireBatchTimeout()>=0);
+	// nothing else will wake the loop, except this guard
+	ev::timer guard(loop);
+	guard.set<MyTester,&MyTester::Tick>(this);
+	guard.start(0.1,0.1);
+	for (int i=0; i<20 && client.RetireBatchTimeout()>=0; i++) {
+		loop.run(EVLOOP_ONESHOT);
+	}
+	assert(client.RetireBatchTimeout()<0);
+
 	return 0;
 }
 
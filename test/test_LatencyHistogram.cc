@@ -0,0 +1,90 @@
+//=============================================================================
+//	This file is part of MCSB, the Multi-Client Shared Buffer
+//	Copyright (C) 2014  Gregory E. Allen and
+//		Applied Research Laboratories: The University of Texas at Austin
+//
+//	MCSB is free software: you can redistribute it and/or modify it
+//	under the terms of the GNU Lesser General Public License as published
+//	by the Free Software Foundation, either version 2.1 of the License, or
+//	(at your option) any later version.
+//
+//	MCSB is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+//	Lesser General Public License <http://www.gnu.org/licenses/lgpl.html>
+//	for more details.
+//=============================================================================
+
+// always assert for tests, even in Release
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include "MCSB/LatencyHistogram.h"
+#include "MCSB/Timestamper.h"
+
+#include <cassert>
+#include <cmath>
+#include <unistd.h>
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* const argv[])
+//-----------------------------------------------------------------------------
+{
+	// buckets are contiguous, and each is within 1/kSubBuckets of its values
+	typedef MCSB::LatencyHistogram LH;
+	for (unsigned idx=0; idx<LH::kNumBuckets-1; idx++) {
+		uint64_t lo = LH::BucketValue(idx);
+		uint64_t hi = LH::BucketValue(idx+1)-1;
+		assert(LH::BucketIndex(lo)==idx);
+		assert(LH::BucketIndex(hi)==idx);
+		assert((hi-lo)*LH::kSubBuckets <= lo || lo<2*LH::kSubBuckets);
+	}
+	assert(LH::BucketIndex(~0ULL)==LH::kNumBuckets-1);
+
+	// 1 to 1000 usec
+	LH hist;
+	for (unsigned i=1; i<=1000; i++)
+		hist.Record(i*1e-6);
+	hist.Record(-1); // counts as zero
+	assert(hist.Count()==1001);
+	assert(hist.Min()==0);
+	assert(fabs(hist.Max()-1e-3)<1e-12);
+	assert(fabs(hist.Mean()-500.5e-6*1000/1001)<1e-9);
+	double p50 = hist.Percentile(.5);
+	double p99 = hist.Percentile(.99);
+	assert(fabs(p50-500e-6) < 500e-6/LH::kSubBuckets);
+	assert(fabs(p99-990e-6) < 990e-6/LH::kSubBuckets);
+	assert(hist.Percentile(1)<=hist.Max());
+	hist.Print("# ");
+	hist.Reset();
+	assert(!hist.Count() && !hist.Percentile(.5));
+
+	MCSB::MsgLatencyHistograms msgHists;
+	msgHists.RecordResidence(7, 1e-6);
+	assert(!msgHists.Delivery(7));
+	assert(msgHists.Residence(7)->Count()==1);
+	assert(!msgHists.Residence(8));
+
+	// every clock agrees with CLOCK_MONOTONIC
+	MCSB::ClientOptions::TimestampClock clocks[] = {
+		MCSB::ClientOptions::eMonotonicClock,
+		MCSB::ClientOptions::eCoarseClock,
+		MCSB::ClientOptions::eTscClock
+	};
+	for (unsigned c=0; c<sizeof(clocks)/sizeof(clocks[0]); c++) {
+		MCSB::Timestamper ts(clocks[c]);
+		double prev = 0;
+		for (unsigned i=0; i<100; i++) {
+			double now = ts.Now();
+			double mono = MCSB::Timestamper::MonotonicTime();
+			assert(fabs(now-mono) < .02); // within a coarse tick or two
+			assert(now >= prev-1e-6);
+			prev = now;
+			usleep(100);
+		}
+	}
+
+	printf("PASS\n");
+	return 0;
+}
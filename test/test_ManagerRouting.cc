@@ -0,0 +1,185 @@
+//=============================================================================
+//	This file is part of MCSB, the Multi-Client Shared Buffer
+//	Copyright (C) 2014  Gregory E. Allen and
+//		Applied Research Laboratories: The University of Texas at Austin
+//
+//	MCSB is free software: you can redistribute it and/or modify it
+//	under the terms of the GNU Lesser General Public License as published
+//	by the Free Software Foundation, either version 2.1 of the License, or
+//	(at your option) any later version.
+//
+//	MCSB is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+//	Lesser General Public License <http://www.gnu.org/licenses/lgpl.html>
+//	for more details.
+//=============================================================================
+
+// Benchmark of the manager's segment routing cost versus number of clients.
+// Consumers are SocketEndpoints on socketpairs that retire what they get,
+// and segments are injected straight into Manager::TakeBlocksAndInfo.
+// Reports the manager's CPU time per routed (delivered) segment.
+
+#include "MCSB/TestingClientOptions.h"
+#include "MCSB/Manager.h"
+#include "MCSB/SocketEndpoint.h"
+
+#include <ev++.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <stdexcept>
+
+//-----------------------------------------------------------------------------
+double ThreadCPUTime(void)
+//-----------------------------------------------------------------------------
+{
+	timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID,&ts);
+	return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+//-----------------------------------------------------------------------------
+class BenchManager : public MCSB::Manager {
+// exposes the slabManager so we can act as a producer
+//-----------------------------------------------------------------------------
+  public:
+	BenchManager(const MCSB::ManagerParams& p, ev::loop_ref loop)
+		: MCSB::Manager(p,loop) {}
+	uint32_t GetFreeSlab(void) {
+		uint32_t slabID;
+		if (!slabManager.GetFreeSlabs(&slabID,1))
+			throw std::runtime_error("BenchManager: no free slabs");
+		return slabID;
+	}
+	void AddClient(int fd) { AddConnectedClient(loop,fd); }
+};
+
+//-----------------------------------------------------------------------------
+class BenchConsumer : public MCSB::SocketEndpoint {
+// the far side of a ClientProxy, retires every segment it receives
+//-----------------------------------------------------------------------------
+  public:
+	BenchConsumer(int fd): MCSB::SocketEndpoint(fd), clientID(-1), rcvdSegs(0) {}
+	int16_t clientID;
+	uint64_t rcvdSegs;
+  protected:
+	void HandleClientID(int16_t cid) { clientID = cid; }
+	void HandleBlockIDs(const uint32_t blockIDs[], unsigned count) {
+		rcvdSegs += count;
+		SendBlockIDs(blockIDs,count);
+	}
+	void HandleCtrlString(uint32_t which, const char* str) {}
+	void HandleNumSlabs(uint32_t prodSlabs, uint32_t consSlabs) {}
+	void HandleRegistration(uint32_t type, int16_t cid, int16_t gid,
+		const uint32_t msgIDs[], unsigned count) {}
+};
+
+//-----------------------------------------------------------------------------
+double RunBench(MCSB::ManagerParams& mparms, unsigned numClients,
+	unsigned numMsgIDs, unsigned iterations)
+// returns manager CPU seconds per routed segment
+//-----------------------------------------------------------------------------
+{
+	ev::default_loop loop;
+	BenchManager manager(mparms,loop);
+	std::vector<BenchConsumer*> consumers;
+
+	// connect the consumers, each registers for one msgID
+	for (unsigned i=0; i<numClients; i++) {
+		int fds[2];
+		if (socketpair(PF_LOCAL, SOCK_STREAM, 0, fds)) {
+			perror("socketpair error");
+			exit(-1);
+		}
+		manager.AddClient(fds[0]);
+		BenchConsumer* cons = new BenchConsumer(fds[1]);
+		consumers.push_back(cons);
+		loop.run(EVRUN_NOWAIT);
+		while (cons->clientID<0)
+			cons->Poll(0);
+		cons->SendNumSlabs(0,1);
+		uint32_t msgID = i%numMsgIDs;
+		cons->SendRegistration(MCSB::kRegType_RegisterList,cons->clientID,0,&msgID,1);
+		loop.run(EVRUN_NOWAIT);
+		cons->Poll(0);
+	}
+
+	// one producer slab, one block per msgID
+	uint32_t slabID = manager.GetFreeSlab();
+	uint32_t blockIDs[numMsgIDs];
+	MCSB::BlockInfo info[numMsgIDs];
+	for (unsigned i=0; i<numMsgIDs; i++) {
+		blockIDs[i] = slabID*manager.BlocksPerSlab() + i;
+		info[i].messageID = i;
+		info[i].size = 64;
+		info[i].numSegments = 1;
+	}
+
+	double cpu = 0;
+	uint64_t expected = 0;
+	for (unsigned it=0; it<iterations; it++) {
+		// route, and let the loop flush the sends
+		double t0 = ThreadCPUTime();
+		manager.TakeBlocksAndInfo(blockIDs,info,numMsgIDs,0,0);
+		loop.run(EVRUN_NOWAIT);
+		cpu += ThreadCPUTime()-t0;
+		expected += numClients;
+		// consumers retire, then the manager handles the retirements
+		for (unsigned i=0; i<numClients; i++)
+			consumers[i]->Poll(0);
+		t0 = ThreadCPUTime();
+		loop.run(EVRUN_NOWAIT);
+		cpu += ThreadCPUTime()-t0;
+	}
+
+	uint64_t rcvd = 0;
+	for (unsigned i=0; i<numClients; i++) {
+		rcvd += consumers[i]->rcvdSegs;
+		delete consumers[i];
+	}
+	if (rcvd!=expected) {
+		fprintf(stderr,"# %u clients: received %llu segments, expected %llu\n",
+			numClients, (unsigned long long)rcvd, (unsigned long long)expected);
+	}
+	for (int i=0; i<10; i++)
+		loop.run(EVRUN_NOWAIT);
+	return rcvd ? cpu/rcvd : 0;
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* const argv[])
+//-----------------------------------------------------------------------------
+{
+	MCSB::TestingClientOptions opts(argc,argv);
+	MCSB::ManagerParams mparms(opts.ManagerArgc(), opts.ManagerArgv());
+	mparms.verbosity = MCSB::kWarning;
+	mparms.maxNumClients = 1100;
+	mparms.blockSize = 4096;
+	mparms.slabSize = 16*mparms.blockSize;
+	mparms.bufferSize = 256*mparms.slabSize;
+	mparms.maxNumBuffers = 8;
+	mparms.ParamCheck();
+
+	// we need 2 fds per client
+	struct rlimit rl;
+	getrlimit(RLIMIT_NOFILE,&rl);
+	if (rl.rlim_cur<2500 && rl.rlim_max>=2500) {
+		rl.rlim_cur = 2500;
+		setrlimit(RLIMIT_NOFILE,&rl);
+	}
+
+	const unsigned numMsgIDs = 10;
+	const unsigned iterations = 2000;
+	unsigned numClients[] = { 10, 100, 1000 };
+	for (unsigned i=0; i<sizeof(numClients)/sizeof(unsigned); i++) {
+		double secs = RunBench(mparms,numClients[i],numMsgIDs,iterations);
+		printf("%5u clients: %8.1f ns manager CPU per routed segment\n",
+			numClients[i], secs*1e9);
+	}
+	fprintf(stderr,"=== PASS ===\n");
+	return 0;
+}
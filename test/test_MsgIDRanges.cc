@@ -0,0 +1,207 @@
+//=============================================================================
+//	This file is part of MCSB, the Multi-Client Shared Buffer
+//	Copyright (C) 2014  Gregory E. Allen and
+//		Applied Research Laboratories: The University of Texas at Austin
+//
+//	MCSB is free software: you can redistribute it and/or modify it
+//	under the terms of the GNU Lesser General Public License as published
+//	by the Free Software Foundation, either version 2.1 of the License, or
+//	(at your option) any later version.
+//
+//	MCSB is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+//	Lesser General Public License <http://www.gnu.org/licenses/lgpl.html>
+//	for more details.
+//=============================================================================
+// always assert for tests, even in Release
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include "MCSB/Client.h"
+#include "MCSB/Manager.h"
+#include "MCSB/TestingClientOptions.h"
+
+#include <cstdio>
+#include <cassert>
+
+class RangeHelper {
+  public:
+	RangeHelper(const MCSB::ClientOptions& clientOptions);
+	MCSB::Client& Client(void) { return client; }
+	void HandleMessage(uint32_t msgID, const void* msg, uint32_t len)
+		{ messagesReceived++; lastMsgID = msgID; }
+	void HandleExactMessage(uint32_t msgID, const void* msg, uint32_t len)
+		{ exactReceived++; }
+	void HandleRangeRegistration(bool reg, int16_t clientID, int16_t groupID,
+		const uint32_t firstLast[], unsigned numRanges);
+	int messagesReceived, exactReceived;
+	uint32_t lastMsgID;
+	int rangesRegistered, rangesDeregistered;
+  private:
+	MCSB::Client client;
+	void ConnectionEventHandler(int which) {
+		ev::default_loop loop;
+		loop.run(EVRUN_NOWAIT);
+	}
+};
+
+//-----------------------------------------------------------------------------
+RangeHelper::RangeHelper(const MCSB::ClientOptions& clientOptions)
+//-----------------------------------------------------------------------------
+:	messagesReceived(0), exactReceived(0), lastMsgID(0),
+	rangesRegistered(0), rangesDeregistered(0),
+	client(clientOptions,0)
+{
+	client.SetConnectionEventHandler<RangeHelper,
+		&RangeHelper::ConnectionEventHandler>(this);
+	while (!client.Connect()) usleep(10000);
+}
+
+//-----------------------------------------------------------------------------
+void RangeHelper::HandleRangeRegistration(bool reg, int16_t clientID,
+	int16_t groupID, const uint32_t firstLast[], unsigned numRanges)
+//-----------------------------------------------------------------------------
+{
+	for (unsigned i=0; i<numRanges; i++) {
+		printf("HandleRangeRegistration %s (cid %d/gid %d) [ %u-%u ]\n",
+			reg?"reg":"dereg", clientID, groupID, firstLast[2*i], firstLast[2*i+1]);
+	}
+	if (reg) rangesRegistered += numRanges;
+	else rangesDeregistered += numRanges;
+}
+
+//-----------------------------------------------------------------------------
+void Spin(RangeHelper* helpers[], int count)
+//-----------------------------------------------------------------------------
+{
+	ev::default_loop loop;
+	for (int iter=0; iter<10; iter++) {
+		for (int i=0; i<count; i++) {
+			loop.run(EVRUN_NOWAIT);
+			helpers[i]->Client().Poll(0.01);
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+int test1(MCSB::ClientOptions &opts)
+//-----------------------------------------------------------------------------
+{
+	RangeHelper recorder(opts);
+	RangeHelper ranger(opts);
+	RangeHelper watcher(opts);
+	RangeHelper* helpers[3] = { &recorder, &ranger, &watcher };
+
+	watcher.Client().SetRangeRegistrationHandler<RangeHelper,
+		&RangeHelper::HandleRangeRegistration>(&watcher);
+	Spin(helpers,3);
+
+	// a recorder takes everything, a bridge takes a range and one exact msgID
+	recorder.Client().RegisterForAllMsgs(
+		MCSB::Thunk::MessageHandlerP<RangeHelper,&RangeHelper::HandleMessage>,&recorder);
+	ranger.Client().RegisterForMsgIDRange<RangeHelper,
+		&RangeHelper::HandleMessage>(100,199,&ranger);
+	ranger.Client().RegisterForMsgID<RangeHelper,
+		&RangeHelper::HandleExactMessage>(150,&ranger);
+	Spin(helpers,3);
+	assert(2==watcher.rangesRegistered);
+
+	const uint32_t msgIDs[] = { 5, 100, 150, 199, 200, MCSB::kMaxMessageID };
+	const int numMsgIDs = sizeof(msgIDs)/sizeof(msgIDs[0]);
+	for (int i=0; i<numMsgIDs; i++) {
+		watcher.Client().SendMessage(msgIDs[i],&i,sizeof(i));
+	}
+	Spin(helpers,3);
+	fprintf(stderr, "recorder received %d, ranger %d+%d\n",
+		recorder.messagesReceived, ranger.messagesReceived, ranger.exactReceived);
+	assert(numMsgIDs==recorder.messagesReceived);
+	assert(MCSB::kMaxMessageID==recorder.lastMsgID);
+	// msgID 150 matches both, but is delivered (and handled) once per handler
+	assert(3==ranger.messagesReceived);
+	assert(1==ranger.exactReceived);
+	assert(0==watcher.messagesReceived);
+
+	// the exact registration outlives the range
+	bool found = ranger.Client().DeregisterForMsgIDRange<RangeHelper,
+		&RangeHelper::HandleMessage>(100,199,&ranger);
+	assert(found);
+	Spin(helpers,3);
+	assert(1==watcher.rangesDeregistered);
+	watcher.Client().SendMessage(120,0,0);
+	watcher.Client().SendMessage(150,0,0);
+	Spin(helpers,3);
+	assert(numMsgIDs+2==recorder.messagesReceived);
+	assert(3==ranger.messagesReceived);
+	assert(2==ranger.exactReceived);
+
+	// a late watcher gets the current ranges
+	RangeHelper late(opts);
+	RangeHelper* helpers4[4] = { &recorder, &ranger, &watcher, &late };
+	late.Client().SetRangeRegistrationHandler<RangeHelper,
+		&RangeHelper::HandleRangeRegistration>(&late);
+	Spin(helpers4,4);
+	assert(1==late.rangesRegistered);
+
+	// closing deregisters the recorder's range
+	recorder.Client().Close();
+	Spin(helpers4+1,3); // polling would reconnect the recorder
+	assert(2==watcher.rangesDeregistered);
+	assert(1==late.rangesDeregistered);
+
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+int test2(MCSB::ClientOptions &opts)
+//-----------------------------------------------------------------------------
+{
+	// a display samples every 10th message of a range
+	RangeHelper display(opts);
+	RangeHelper producer(opts);
+	RangeHelper* helpers[2] = { &display, &producer };
+
+	display.Client().RegisterForMsgIDRange<RangeHelper,
+		&RangeHelper::HandleMessage>(300,399,&display);
+	display.Client().SetMsgIDSampling(300,399,10);
+	Spin(helpers,2);
+
+	for (int i=0; i<100; i++) {
+		producer.Client().SendMessage(300+i%2,&i,sizeof(i));
+	}
+	Spin(helpers,2);
+	fprintf(stderr, "display received %d of 100\n", display.messagesReceived);
+	assert(10==display.messagesReceived);
+
+	// and then every message again
+	display.Client().SetMsgIDSampling(300,399,1);
+	Spin(helpers,2);
+	for (int i=0; i<100; i++) {
+		producer.Client().SendMessage(300,&i,sizeof(i));
+	}
+	Spin(helpers,2);
+	assert(110==display.messagesReceived);
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* const argv[])
+//-----------------------------------------------------------------------------
+{
+	MCSB::TestingClientOptions opts(argc,argv);
+
+	ev::default_loop loop;
+	MCSB::ManagerParams mparms(opts.ManagerArgc(), opts.ManagerArgv());
+	MCSB::Manager manager(mparms, loop);
+	loop.run(EVRUN_NOWAIT);
+
+	int result = test1(opts);
+	if (!result)
+		result = test2(opts);
+	if (!result)
+		fprintf(stderr,"=== PASS ===\n");
+	else
+		printf("- result is %d\n", result);
+	return result;
+}
@@ -0,0 +1,107 @@
+//=============================================================================
+//	This file is part of MCSB, the Multi-Client Shared Buffer
+//	Copyright (C) 2014  Gregory E. Allen and
+//		Applied Research Laboratories: The University of Texas at Austin
+//
+//	MCSB is free software: you can redistribute it and/or modify it
+//	under the terms of the GNU Lesser General Public License as published
+//	by the Free Software Foundation, either version 2.1 of the License, or
+//	(at your option) any later version.
+//
+//	MCSB is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+//	Lesser General Public License <http://www.gnu.org/licenses/lgpl.html>
+//	for more details.
+//=============================================================================
+// always assert for tests, even in Release
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include "MCSB/MsgSampler.h"
+#include "MCSB/ShmDefs.h"
+#include <cstdio>
+#include <cassert>
+
+//-----------------------------------------------------------------------------
+MCSB::BlockInfo Seg(uint32_t msgID, unsigned seg=0, unsigned numSegs=1)
+//-----------------------------------------------------------------------------
+{
+	MCSB::BlockInfo info;
+	info.messageID = msgID;
+	info.segmentNumber = seg;
+	info.numSegments = numSegs;
+	return info;
+}
+
+//-----------------------------------------------------------------------------
+int test1(void)
+//-----------------------------------------------------------------------------
+{
+	MCSB::MsgSampler sampler;
+	assert(sampler.Empty());
+	assert(sampler.Keep(1,Seg(7),0.));
+
+	// every 4th message of msgIDs 10..19, counted per msgID
+	sampler.SetPolicy(10,19,4,0);
+	assert(!sampler.Empty());
+	unsigned kept10 = 0, kept11 = 0;
+	for (unsigned i=0; i<100; i++) {
+		kept10 += sampler.Keep(1,Seg(10),0.);
+		kept11 += sampler.Keep(1,Seg(11),0.);
+		assert(sampler.Keep(1,Seg(20),0.)); // outside the range
+	}
+	assert(25==kept10 && 25==kept11);
+
+	// whole messages: later segments follow segment 0
+	sampler.SetPolicy(10,19,2,0);
+	for (unsigned i=0; i<10; i++) {
+		bool keep = sampler.Keep(1,Seg(12,0,3),0.);
+		assert(keep==!(i&1));
+		assert(keep==sampler.Keep(1,Seg(12,1,3),0.));
+		assert(keep==sampler.Keep(1,Seg(12,2,3),0.));
+	}
+
+	// two producers interleaving segments of the same msgID:
+	// each message is still kept or skipped as a whole
+	for (unsigned i=0; i<10; i++) {
+		bool keep1 = sampler.Keep(1,Seg(13,0,2),0.);
+		bool keep2 = sampler.Keep(2,Seg(13,0,2),0.);
+		assert(keep1!=keep2);
+		assert(keep2==sampler.Keep(2,Seg(13,1,2),0.));
+		assert(keep1==sampler.Keep(1,Seg(13,1,2),0.));
+	}
+
+	// at most 10 per second, offered at 1000 per second
+	sampler.SetPolicy(10,19,0,10);
+	unsigned kept = 0;
+	for (unsigned i=0; i<2000; i++) {
+		kept += sampler.Keep(1,Seg(15),i*.001);
+	}
+	assert(20==kept);
+
+	// the most recent policy wins where they overlap
+	sampler.SetPolicy(15,15,3,0);
+	kept = 0;
+	for (unsigned i=0; i<30; i++) {
+		kept += sampler.Keep(1,Seg(15),0.);
+	}
+	assert(10==kept);
+
+	// clearing the policies
+	sampler.SetPolicy(15,15,1,0);
+	sampler.SetPolicy(10,19,0,0);
+	assert(sampler.Empty());
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* const argv[])
+//-----------------------------------------------------------------------------
+{
+	int result = test1();
+	if (result) return result;
+	fprintf(stderr,"=== PASS ===\n");
+	return result;
+}
@@ -23,7 +23,9 @@
 #include "MCSB/ShmMapper.h"
 #include "MCSB/ShmClient.h"
 
+#include <unistd.h>
 #include <cstdio>
+#include <cstring>
 #include <cassert>
 #include <stdexcept>
 
@@ -66,6 +68,8 @@ int main()
 			assert(clientHdr->blockSize == blkSz);
 			assert(clientHdr->numBlocks == blksPerBuf);
 			assert(clientHdr->maxNumBuffers == maxNumBufs);
+			assert(clientHdr->shmVersion == MCSB::ShmHeader::kVersion);
+			assert(clientHdr->InfoStride() % MCSB::ShmHeader::kCacheLineSize == 0);
 		}
 
 		// verify that BlockInfo mapped
@@ -74,6 +78,9 @@ int main()
 		for (unsigned i=0; i<totNumBlocks; i++) {
 			MCSB::BlockInfo* mapperBi = mapper.GetBlockInfo(i);
 			const MCSB::BlockInfo* clientBi = client.GetBlockInfo(i);
+			if (i%blksPerBuf) // a cache line apart
+				assert((const char*)clientBi - (const char*)client.GetBlockInfo(i-1)
+					== (ptrdiff_t)client.GetShmHeader()->InfoStride());
 			errs += MCSB::set_and_verify_rand_buf(mapperBi, clientBi, sizeof(MCSB::BlockInfo), seed);
 			if (errs) {
 				fprintf(stderr,"### %d errors while verifying BlockInfo at block %d\n", errs, i);
@@ -149,6 +156,96 @@ int main()
 	} catch (std::runtime_error err) {
 	}
 
+	try { // a larger (e.g. huge) page size aligns the blocks and sizes
+		uint32_t pgSz = 64*1024;
+		const char* pgNameFmt = "/MCSB-pgbuf%02u.mem";
+		MCSB::ShmMapper mapper(pgNameFmt, force, blkSz, slbSz, blksPerBuf+1, maxNumBufs, pgSz);
+		mapper.NumBuffers(2);
+		MCSB::ShmClient client(pgNameFmt);
+		assert(client.NumBuffers()==2);
+		const MCSB::ShmHeader* hdr = client.GetShmHeader(0);
+		assert(hdr->pageSize==pgSz);
+		assert(hdr->blockOffset%pgSz==0);
+		assert(hdr->TotalBlocksSize()%pgSz==0);
+		assert(hdr->TotalBufferSize()%pgSz==0);
+		uint32_t seed = 1;
+		for (unsigned i=0; i<2*(blksPerBuf+1); i++) {
+			char* clientBp = client.GetWriteableBlockPtr(i);
+			const char* mapperBp = mapper.GetBlockPtr(i);
+			errs += MCSB::set_and_verify_rand_buf(clientBp, mapperBp, blkSz, seed);
+		}
+		if (errs) {
+			fprintf(stderr,"### %d errors with pageSize %u\n", errs, pgSz);
+			return errs;
+		}
+	} catch (std::runtime_error err) {
+		fprintf(stderr,"#-- %s\n", err.what());
+		return -1;
+	}
+
+	try { // a prepared buffer is invisible to clients until committed
+		const char* prepNameFmt = "/MCSB-prepbuf%02u.mem";
+		MCSB::ShmMapper mapper(prepNameFmt, force, blkSz, slbSz, blksPerBuf, maxNumBufs);
+		mapper.NumBuffers(1);
+		MCSB::ShmClient client(prepNameFmt);
+		unsigned bufNum = mapper.PrepareBuffer();
+		assert(bufNum==1 && mapper.Pending());
+		assert(mapper.PrepareBuffer()==bufNum);
+		assert(mapper.NumBuffers()==1 && client.MapBuffers()==1);
+		mapper.Prefaulted(mapper.LockOrTouch(mapper.BufferBase(bufNum),mapper.BufferSize()));
+		mapper.NumBuffers(3);
+		assert(!mapper.Pending() && client.MapBuffers()==3);
+		// an idle slab's memory is returned (and reads back zeros)
+		uint32_t slabID = blksPerBuf/(slbSz/blkSz); // the first of the second buffer
+		char* bp = mapper.GetBlockPtr(slabID*(slbSz/blkSz));
+		memset(bp,1,slbSz);
+		assert(!mapper.ReclaimSlab(slabID));
+		const char* cbp = client.GetBlockPtr(slabID*(slbSz/blkSz));
+		for (unsigned i=0; i<slbSz; i+=blkSz)
+			assert(!cbp[i]);
+		mapper.WarmSlab(slabID); // may fail to lock
+		memset(bp,2,slbSz);
+		assert(cbp[slbSz-1]==2);
+	} catch (std::runtime_error err) {
+		fprintf(stderr,"#-- %s\n", err.what());
+		return -1;
+	}
+
+	try { // anonymous buffers are mapped from their fds, not by name
+		MCSB::ShmMapper mapper(nameFmt, 0, blkSz, slbSz, blksPerBuf, maxNumBufs, 0, 0, true);
+		mapper.NumBuffers(2);
+		assert(mapper.Anonymous());
+		MCSB::ShmClient client;
+		int fds[3];
+		for (unsigned i=0; i<2; i++)
+			fds[i] = dup(mapper.BufferFD(i));
+		assert(client.MapFDs(0,fds,2)==2);
+		mapper.NumBuffers(3);
+		for (unsigned i=0; i<3; i++)
+			fds[i] = dup(mapper.BufferFD(i));
+		assert(client.MapFDs(0,fds,3)==3); // skips those already mapped
+		assert(client.MapBuffers()==3);
+		try {
+			client.NameFormat(nameFmt);
+			assert(0);
+		} catch (std::runtime_error err) {
+		}
+		assert(ftruncate(mapper.BufferFD(0),0)); // sealed
+		uint32_t seed = 1;
+		for (unsigned i=0; i<3*blksPerBuf; i++) {
+			char* clientBp = client.GetWriteableBlockPtr(i);
+			const char* mapperBp = mapper.GetBlockPtr(i);
+			errs += MCSB::set_and_verify_rand_buf(clientBp, mapperBp, blkSz, seed);
+		}
+		if (errs) {
+			fprintf(stderr,"### %d errors with anonymous buffers\n", errs);
+			return errs;
+		}
+	} catch (std::runtime_error err) {
+		fprintf(stderr,"#-- %s\n", err.what());
+		return -1;
+	}
+
 	fprintf(stderr, "==== PASS ====\n");
 
 	return 0;
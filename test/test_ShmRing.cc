@@ -0,0 +1,164 @@
+//=============================================================================
+//	This file is part of MCSB, the Multi-Client Shared Buffer
+//	Copyright (C) 2014  Gregory E. Allen and
+//		Applied Research Laboratories: The University of Texas at Austin
+//
+//	MCSB is free software: you can redistribute it and/or modify it
+//	under the terms of the GNU Lesser General Public License as published
+//	by the Free Software Foundation, either version 2.1 of the License, or
+//	(at your option) any later version.
+//
+//	MCSB is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+//	Lesser General Public License <http://www.gnu.org/licenses/lgpl.html>
+//	for more details.
+//=============================================================================
+
+// always assert for tests, even in Release
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include "MCSB/ShmRing.h"
+
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+#include <unistd.h>
+
+
+//-----------------------------------------------------------------------------
+bool push_pop(MCSB::ShmRing& prod, MCSB::ShmRing& cons, unsigned ring,
+	uint32_t& next, unsigned count)
+// push count ids from next, then pop them from the other side, in order
+//-----------------------------------------------------------------------------
+{
+	std::vector<uint32_t> ids(count);
+	for (unsigned i=0; i<count; i++)
+		ids[i] = next+i;
+	if (!prod.Push(ring,&ids[0],count)) return false;
+	if (cons.Empty(ring)) return false;
+	std::vector<uint32_t> got(count+1);
+	// in two pops, so a partial pop leaves the rest in place
+	unsigned half = count/2;
+	if (cons.Pop(ring,&got[0],half)!=half) return false;
+	if (cons.Pop(ring,&got[half],count+1-half)!=count-half) return false;
+	if (!cons.Empty(ring)) return false;
+	for (unsigned i=0; i<count; i++)
+		if (got[i]!=next+i) return false;
+	next += count;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+int main()
+//-----------------------------------------------------------------------------
+{
+	char name[64];
+	snprintf(name,sizeof(name),"/test_ShmRing.%d",int(getpid()));
+
+	try {
+		MCSB::ShmRing mgr, client;
+		if (mgr.Mapped()) return -1;
+		// the capacity is rounded up to a power of 2
+		mgr.Create(name,300);
+		if (!mgr.Mapped() || mgr.Capacity()!=512) return -1;
+		client.Open(name);
+		if (client.Capacity()!=512 || client.Name()!=name) return -1;
+		mgr.Unlink();
+		const unsigned cap = client.Capacity();
+
+		// each direction, as the manager and client use them
+		for (unsigned ring=MCSB::ShmRing::kDelivery; ring<=MCSB::ShmRing::kRetirement; ring++) {
+			MCSB::ShmRing& prod = ring==MCSB::ShmRing::kDelivery ? mgr : client;
+			MCSB::ShmRing& cons = ring==MCSB::ShmRing::kDelivery ? client : mgr;
+			uint32_t next = 1000*ring;
+			uint32_t ids[2];
+			if (!cons.Empty(ring) || cons.Pop(ring,ids,2)!=0) return -1;
+
+			// in order, and wrapping around several times
+			for (unsigned i=0; i<10; i++)
+				if (!push_pop(prod,cons,ring,next,cap/3+i)) return -1;
+
+			// full, wrapped: all or nothing
+			std::vector<uint32_t> fill(cap);
+			for (unsigned i=0; i<cap; i++)
+				fill[i] = next+i;
+			if (!prod.Push(ring,&fill[0],cap-1)) return -1;
+			if (prod.Push(ring,&fill[cap-1],2)) return -1;
+			if (!prod.Push(ring,&fill[cap-1],1)) return -1;
+			if (prod.Push(ring,ids,1)) return -1;
+			std::vector<uint32_t> got(cap);
+			if (cons.Pop(ring,&got[0],cap)!=cap || got!=fill) return -1;
+			if (!cons.Empty(ring)) return -1;
+			next += cap;
+			if (!push_pop(prod,cons,ring,next,cap)) return -1;
+
+			// the doorbell is taken once per arm
+			if (prod.TakeDoorbell(ring)) return -1;
+			cons.ArmDoorbell(ring);
+			if (!prod.TakeDoorbell(ring)) return -1;
+			if (prod.TakeDoorbell(ring)) return -1;
+			// and only from the ring that armed it
+			cons.ArmDoorbell(ring);
+			if (prod.TakeDoorbell(1-ring)) return -1;
+			if (!prod.TakeDoorbell(ring)) return -1;
+		}
+
+		// the submission ring carries the BlockInfo along
+		{
+			uint32_t blockIDs[3] = { 7, 8, 9 };
+			MCSB::BlockInfo info[3];
+			for (unsigned i=0; i<3; i++) {
+				info[i].messageID = 100+i;
+				info[i].size = 1000*i;
+				info[i].numSegments = 1;
+			}
+			uint32_t gotIDs[4];
+			MCSB::BlockInfo gotInfo[4];
+			for (unsigned n=0; n<cap; n+=3) {
+				if (!client.Submit(blockIDs,info,3)) return -1;
+				if (mgr.TakeSubmissions(gotIDs,gotInfo,4)!=3) return -1;
+				for (unsigned i=0; i<3; i++)
+					if (gotIDs[i]!=blockIDs[i] || gotInfo[i].messageID!=100+i
+						|| gotInfo[i].size!=1000*i) return -1;
+			}
+			std::vector<uint32_t> fill(cap);
+			std::vector<MCSB::BlockInfo> fillInfo(cap);
+			if (!client.Submit(&fill[0],&fillInfo[0],cap)) return -1;
+			if (client.Submit(blockIDs,info,1)) return -1;
+			if (mgr.TakeSubmissions(&fill[0],&fillInfo[0],cap)!=cap) return -1;
+			if (!mgr.Empty(MCSB::ShmRing::kSubmission)) return -1;
+		}
+
+		// a larger ring replaces it, as when a client's slabs grow
+		MCSB::ShmRing larger;
+		larger.Create(name,3000);
+		if (larger.Capacity()!=4096) return -1;
+		mgr.Swap(larger);
+		if (mgr.Capacity()!=4096 || larger.Capacity()!=cap) return -1;
+		larger.Close();
+		if (larger.Mapped() || larger.Capacity()) return -1;
+		client.Close();
+		client.Open(name);
+		mgr.Unlink();
+		uint32_t next = 0;
+		if (!push_pop(mgr,client,MCSB::ShmRing::kDelivery,next,4096)) return -1;
+	} catch (std::runtime_error err) {
+		fprintf(stderr,"- %s\n", err.what());
+		return -1;
+	}
+
+	try {
+		// once unlinked, it can't be opened
+		MCSB::ShmRing client;
+		client.Open(name);
+		return -1;
+	} catch (std::runtime_error err) {
+		fprintf(stderr,"- %s\n", err.what());
+	}
+
+	fprintf(stderr,"=== PASS ===\n");
+	return 0;
+}
@@ -221,6 +221,90 @@ int main()
 		return -1;
 	}
 
+	try { // verify low drop priorities are harvested first
+		slabMgr.GetFreeSlabs(slabIDs,count);
+		for (unsigned i=0; i<count; i++) {
+			unsigned prio = (count-1-i) % MCSB::kNumDropPriorities;
+			slabMgr.GetWantedSegment(i,slabIDs[i],slabIDs[i],prio);
+		}
+		// a slab is kept as long as its highest priority segment
+		slabMgr.GetWantedSegment(count,slabIDs[0],slabIDs[0],0);
+		slabMgr.DecrementHeldRefcnt(slabIDs,count);
+		if (slabMgr.NumWantedSlabs()!=count) return -1;
+		unsigned total = 0;
+		for (unsigned p=0; p<MCSB::kNumDropPriorities; p++)
+			total += slabMgr.NumWantedSlabs(p);
+		if (total!=count) return -1;
+		// slabs are harvested whole, in nondecreasing priority
+		unsigned lastPrio = 0, numSegs = 0;
+		uint32_t lastSlab = -1;
+		while (slabMgr.NumWantedSlabs()) {
+			MCSB::WantedSegment& seg = slabMgr.FrontWantedSegment();
+			uint32_t slabID = seg.BlockID();
+			if (slabID!=lastSlab) {
+				if (lastSlab!=uint32_t(-1) && slabMgr.GetSlabInfo(lastSlab).Wanted())
+					return -1;
+				unsigned prio = slabMgr.GetSlabInfo(slabID).WantedDropPriority();
+				if (prio<lastPrio) return -1;
+				lastPrio = prio;
+				lastSlab = slabID;
+			}
+			slabMgr.ReleaseWantedSegment(seg,slabID);
+			numSegs++;
+		}
+		if (numSegs!=count+1) return -1;
+		if (slabMgr.NumFreeSlabs()!=slabsPerBuf*maxNumBufs) return -1;
+	} catch (std::runtime_error err) {
+		fprintf(stderr,"- %s\n", err.what());
+		return -1;
+	}
+
+	try { // verify free slabs are given from the producer's NUMA node first
+		MCSB::SlabManager numaMgr(slabsPerBuf, 4);
+		for (unsigned buf=0; buf<4; buf++)
+			numaMgr.SetBufferNode(buf, buf&1);
+		if (numaMgr.NumFreeSlabs(0)!=2*slabsPerBuf) return -1;
+		if (numaMgr.NumFreeSlabs(1)!=2*slabsPerBuf) return -1;
+		uint32_t ids[3*slabsPerBuf];
+		if (numaMgr.GetFreeSlabs(ids,3*slabsPerBuf,-1,0,1)!=3*slabsPerBuf) return -1;
+		for (unsigned i=0; i<3*slabsPerBuf; i++) {
+			unsigned node = numaMgr.GetSlabInfo(ids[i]).Node();
+			if (node!=(i<2*slabsPerBuf ? 1u : 0u)) return -1;
+		}
+		// returned slabs go back to their own node
+		numaMgr.DecrementHeldRefcnt(ids,3*slabsPerBuf);
+		if (numaMgr.NumFreeSlabs(1)!=2*slabsPerBuf) return -1;
+		if (numaMgr.NumFreeSlabs()!=4*slabsPerBuf) return -1;
+	} catch (std::runtime_error err) {
+		fprintf(stderr,"- %s\n", err.what());
+		return -1;
+	}
+
+	try { // verify slabs free past the idle window go cold, and are used last
+		MCSB::SlabManager idleMgr(slabsPerBuf, 1);
+		uint32_t ids[slabsPerBuf];
+		if (idleMgr.GetFreeSlabs(ids,2)!=2) return -1;
+		idleMgr.Tick();
+		idleMgr.Tick();
+		idleMgr.DecrementHeldRefcnt(ids,2); // freed 0 ticks ago
+		uint32_t coldIDs[slabsPerBuf];
+		unsigned numCold = idleMgr.GetIdleSlabs(coldIDs,slabsPerBuf,2);
+		if (numCold!=slabsPerBuf-2 || idleMgr.NumColdSlabs()!=numCold) return -1;
+		for (unsigned i=0; i<numCold; i++) {
+			if (coldIDs[i]==ids[0] || coldIDs[i]==ids[1]) return -1;
+			if (!idleMgr.GetSlabInfo(coldIDs[i]).Cold()) return -1;
+		}
+		if (idleMgr.GetIdleSlabs(coldIDs,slabsPerBuf,2)!=0) return -1; // once
+		// the warm ones are given first, most recently freed first
+		if (idleMgr.GetFreeSlabs(ids+2,3)!=3) return -1;
+		if (ids[2]!=ids[1] || ids[3]!=ids[0]) return -1;
+		if (!idleMgr.Warm(ids[4]) || idleMgr.Warm(ids[4])) return -1;
+		if (idleMgr.NumColdSlabs()!=numCold-1) return -1;
+	} catch (std::runtime_error err) {
+		fprintf(stderr,"- %s\n", err.what());
+		return -1;
+	}
+
 	fprintf(stderr,"=== PASS ===\n");
 	return 0;
 }
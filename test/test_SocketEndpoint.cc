@@ -20,12 +20,528 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <stdexcept>
+#include <vector>
+
+// a few fds, passed immediately and then deferred (and more than fit one message)
+static const unsigned kNumFDs = 3 + MCSB::ShmFDsMsg::kMaxFDs + 1;
+
+//-----------------------------------------------------------------------------
+class FDEndpoint : public MCSB::SocketEndpoint {
+//-----------------------------------------------------------------------------
+  public:
+	FDEndpoint(int fd): SocketEndpoint(fd), numFDs(0), errs(0) {}
+	unsigned numFDs;
+	unsigned errs;
+  protected:
+	void HandleShmFDs(uint32_t firstBufNum, const int fds[], unsigned count) {
+		if (firstBufNum!=numFDs) errs++;
+		for (unsigned i=0; i<count; i++) {
+			struct stat st;
+			if (fstat(fds[i],&st)) errs++; // not a valid fd
+			close(fds[i]);
+		}
+		numFDs += count;
+	}
+};
+
+//-----------------------------------------------------------------------------
+class RingEndpoint : public MCSB::SocketEndpoint {
+//-----------------------------------------------------------------------------
+// a small recvBuf, so that runs of blockIDs and echoes wrap around it often
+// (until a large echo grows it)
+  public:
+	RingEndpoint(int fd): SocketEndpoint(fd,0,MCSB::kMaxCtrlMsgSize+44),
+		nextID(0), numEchoes(0), numInfoMsgs(0), numInfoBlocks(0),
+		numRegMsgs(0), numRegIDs(0), errs(0) {}
+	static unsigned EchoWords(unsigned n) {
+		if (n%100==99) // a large control message
+			return MCSB::CtrlMsgHdr::kMaxLargePayloadSize/sizeof(uint32_t) - n%7;
+		return n%256;
+	}
+	uint32_t nextID;
+	unsigned numEchoes;
+	unsigned numInfoMsgs, numInfoBlocks;
+	unsigned numRegMsgs, numRegIDs;
+	unsigned errs;
+  protected:
+	void HandleBlocksAndInfo(const uint32_t blockIDs[], const MCSB::BlockInfo info[], unsigned count) {
+		for (unsigned i=0; i<count; i++)
+			if (blockIDs[i]!=numInfoBlocks++) errs++;
+		numInfoMsgs++;
+	}
+	void HandleRegistration(uint32_t type, int16_t clientID, int16_t groupID, const uint32_t msgIDs[], unsigned count) {
+		for (unsigned i=0; i<count; i++)
+			if (msgIDs[i]!=numRegIDs++) errs++;
+		numRegMsgs++;
+	}
+	void HandleBlockIDs(const uint32_t blockIDs[], unsigned count) {
+		for (unsigned i=0; i<count; i++)
+			if (blockIDs[i]!=nextID++) errs++;
+	}
+	void HandleManagerEcho(const void* ptr, uint16_t len) {
+		const uint32_t* vals = (const uint32_t*)ptr;
+		if (len!=EchoWords(numEchoes)*sizeof(uint32_t)) errs++;
+		for (unsigned i=0; i<len/sizeof(uint32_t); i++)
+			if (vals[i]!=numEchoes) errs++;
+		numEchoes++;
+	}
+};
+
+//-----------------------------------------------------------------------------
+int test_ring(void)
+// IDs and control messages straddling the end of the recv ring
+//-----------------------------------------------------------------------------
+{
+	int fd[2];
+	int res = socketpair(PF_LOCAL, SOCK_STREAM, 0, fd);
+	if (res<0) {
+		perror("socketpair error");
+		return -1;
+	}
+
+	unsigned numSent = 0;
+	uint32_t nextID = 0;
+	RingEndpoint ring(fd[0]);
+	try {
+		MCSB::SocketEndpoint sender(fd[1]);
+		sender.Poll(1.); // takes the ring's ValidatePeer, so it can send large
+		if (sender.MaxSendPayload()!=MCSB::CtrlMsgHdr::kMaxLargePayloadSize) {
+			fprintf(stderr,"### MaxSendPayload %u not negotiated\n", sender.MaxSendPayload());
+			return -1;
+		}
+		uint32_t ids[300];
+		static uint32_t vals[MCSB::CtrlMsgHdr::kMaxLargePayloadSize/sizeof(uint32_t)];
+		for (; numSent<2000; numSent++) {
+			unsigned count = numSent%300 + 1;
+			for (unsigned i=0; i<count; i++)
+				ids[i] = nextID++;
+			sender.SendBlockIDs(ids,count);
+			unsigned len = RingEndpoint::EchoWords(numSent);
+			for (unsigned i=0; i<len; i++)
+				vals[i] = numSent;
+			sender.SendManagerEcho(vals,len*sizeof(uint32_t));
+			if (!(numSent%16))
+				while (ring.Poll(0)>0);
+		}
+
+		// these each fit one large control message
+		const unsigned kNumInfo = 500, kNumRegIDs = 5000;
+		std::vector<uint32_t> regIDs(kNumRegIDs);
+		std::vector<MCSB::BlockInfo> info(kNumInfo);
+		for (unsigned i=0; i<kNumRegIDs; i++)
+			regIDs[i] = i;
+		sender.SendBlocksAndInfo(&regIDs[0],&info[0],kNumInfo);
+		sender.SendRegistration(MCSB::kRegType_RegisterList,1,2,&regIDs[0],kNumRegIDs);
+		while (ring.numRegIDs<kNumRegIDs && ring.Poll(1.)>0);
+
+		if (ring.numInfoMsgs!=1 || ring.numInfoBlocks!=kNumInfo
+				|| ring.numRegMsgs!=1 || ring.numRegIDs!=kNumRegIDs) {
+			fprintf(stderr,"### large messages: %u BlocksAndInfo for %u blocks, %u Registrations for %u IDs\n",
+				ring.numInfoMsgs, ring.numInfoBlocks, ring.numRegMsgs, ring.numRegIDs);
+			return -1;
+		}
+	} catch (std::runtime_error err) {
+		fprintf(stderr,"#-- %s\n", err.what());
+		return -1;
+	}
+	close(fd[1]);
+	close(fd[0]);
+
+	if (ring.numEchoes!=numSent || ring.nextID!=nextID || ring.errs) {
+		fprintf(stderr,"### ring received %u of %u echoes, %u of %u IDs, %u errors\n",
+			ring.numEchoes, numSent, ring.nextID, nextID, ring.errs);
+		return -1;
+	}
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+int test_partial_flush(void)
+// FlushSomeSends keeps what a full socket won't take, in order
+//-----------------------------------------------------------------------------
+{
+	int fd[2];
+	int res = socketpair(PF_LOCAL, SOCK_STREAM, 0, fd);
+	if (res<0) {
+		perror("socketpair error");
+		return -1;
+	}
+
+	uint32_t nextID = 0;
+	unsigned numFlushes = 0, numPartial = 0;
+	RingEndpoint ring(fd[0]);
+	try {
+		MCSB::SocketEndpoint sender(fd[1]);
+		sender.SetSendSockBufSize(4096);
+		sender.DeferSends();
+		uint32_t ids[1000];
+		while (nextID<200000) {
+			for (unsigned i=0; i<1000; i++)
+				ids[i] = nextID++;
+			sender.SendBlockIDs(ids,1000);
+			sender.FlushSomeSends();
+			numFlushes++;
+			if (sender.PendingSendBytes())
+				numPartial++;
+			if (!(numFlushes%8))
+				while (ring.Poll(0)>0);
+		}
+		while (sender.PendingSendBytes()) {
+			ring.Poll(.1);
+			sender.FlushSomeSends();
+		}
+		while (ring.nextID<nextID && ring.Poll(1.)>0);
+	} catch (std::runtime_error err) {
+		fprintf(stderr,"#-- %s\n", err.what());
+		return -1;
+	}
+	close(fd[1]);
+	close(fd[0]);
+
+	if (!numPartial || ring.nextID!=nextID || ring.errs) {
+		fprintf(stderr,"### partial flushes %u of %u, received %u of %u IDs, %u errors\n",
+			numPartial, numFlushes, ring.nextID, nextID, ring.errs);
+		return -1;
+	}
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+class DrainingEndpoint : public MCSB::SocketEndpoint {
+//-----------------------------------------------------------------------------
+// a sender whose full socket is drained by its peer, so that
+// large control messages are sent in several partial sendmsg calls
+  public:
+	DrainingEndpoint(int fd, MCSB::SocketEndpoint& p):
+		SocketEndpoint(fd), numWouldBlock(0), peer(p) {}
+	unsigned numWouldBlock;
+  protected:
+	MCSB::SocketEndpoint& peer;
+	int HandleSendWouldBlock(void) {
+		numWouldBlock++;
+		peer.Poll(.1);
+		return 1;
+	}
+};
+
+//-----------------------------------------------------------------------------
+int test_partial_sendmsg(void)
+// a large frame through a small SO_SNDBUF, without deferring it
+//-----------------------------------------------------------------------------
+{
+	int fd[2];
+	int res = socketpair(PF_LOCAL, SOCK_STREAM, 0, fd);
+	if (res<0) {
+		perror("socketpair error");
+		return -1;
+	}
+
+	const unsigned kNumMsgs = 20;
+	const unsigned kNumRegIDs =
+		(MCSB::CtrlMsgHdr::kMaxLargePayloadSize-sizeof(MCSB::RegistrationMsgHdr))/sizeof(uint32_t);
+	RingEndpoint ring(fd[0]);
+	unsigned numWouldBlock = 0;
+	try {
+		DrainingEndpoint sender(fd[1],ring);
+		sender.Poll(1.); // takes the ring's ValidatePeer, so it can send large
+		sender.SetSendSockBufSize(4096);
+		std::vector<uint32_t> regIDs(kNumRegIDs);
+		for (unsigned n=0; n<kNumMsgs; n++) {
+			for (unsigned i=0; i<kNumRegIDs; i++)
+				regIDs[i] = n*kNumRegIDs + i;
+			sender.SendRegistration(MCSB::kRegType_RegisterList,1,2,&regIDs[0],kNumRegIDs);
+		}
+		numWouldBlock = sender.numWouldBlock;
+		while (ring.numRegIDs<kNumMsgs*kNumRegIDs && ring.Poll(1.)>0);
+	} catch (std::runtime_error err) {
+		fprintf(stderr,"#-- %s\n", err.what());
+		return -1;
+	}
+	close(fd[1]);
+	close(fd[0]);
+
+	if (!numWouldBlock || ring.numRegMsgs!=kNumMsgs
+			|| ring.numRegIDs!=kNumMsgs*kNumRegIDs || ring.errs) {
+		fprintf(stderr,"### %u would-blocks, %u of %u Registrations for %u of %u IDs, %u errors\n",
+			numWouldBlock, ring.numRegMsgs, kNumMsgs, ring.numRegIDs,
+			kNumMsgs*kNumRegIDs, ring.errs);
+		return -1;
+	}
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+int test_held_fds(void)
+// deferred ShmFDs past kMaxFDs go out with later partial flushes, in time
+//-----------------------------------------------------------------------------
+{
+	int fd[2];
+	int res = socketpair(PF_LOCAL, SOCK_STREAM, 0, fd);
+	if (res<0) {
+		perror("socketpair error");
+		return -1;
+	}
+
+	const unsigned kChunk = 5, kNumChunks = 10;
+	unsigned numFlushes = 0;
+	FDEndpoint receiver(fd[0]);
+	try {
+		MCSB::SocketEndpoint sender(fd[1]);
+		sender.SetSendSockBufSize(4096);
+		sender.DeferSends();
+		int fds[kChunk];
+		for (unsigned i=0; i<kChunk; i++)
+			fds[i] = STDERR_FILENO;
+		uint32_t slabIDs[1000];
+		for (unsigned i=0; i<1000; i++)
+			slabIDs[i] = i;
+		for (unsigned n=0; n<kNumChunks; n++) {
+			sender.SendShmFDs(n*kChunk,fds,kChunk);
+			sender.SendSlabIDs(slabIDs,1000); // more than the socket takes
+		}
+		while (sender.PendingSendBytes()) {
+			sender.FlushSomeSends();
+			numFlushes++;
+			receiver.Poll(.1);
+		}
+		while (receiver.numFDs<kChunk*kNumChunks && receiver.Poll(1.)>0);
+	} catch (std::runtime_error err) {
+		fprintf(stderr,"#-- %s\n", err.what());
+		return -1;
+	}
+	close(fd[1]);
+	close(fd[0]);
+
+	if (receiver.numFDs!=kChunk*kNumChunks || receiver.errs || numFlushes<2) {
+		fprintf(stderr,"### received %u of %u fds in %u flushes, %u errors\n",
+			receiver.numFDs, kChunk*kNumChunks, numFlushes, receiver.errs);
+		return -1;
+	}
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+class LimitedEndpoint : public MCSB::SocketEndpoint {
+//-----------------------------------------------------------------------------
+// counts the deferred sends that overflowed its send queue
+  public:
+	LimitedEndpoint(int fd): SocketEndpoint(fd), numOverflows(0) {}
+	unsigned numOverflows;
+  protected:
+	void HandleSendQueueOverflow(void) { numOverflows++; }
+};
+
+//-----------------------------------------------------------------------------
+int test_send_queue_limit(void)
+// deferred control messages to a peer that stopped reading fail at the limit
+//-----------------------------------------------------------------------------
+{
+	int fd[2];
+	int res = socketpair(PF_LOCAL, SOCK_STREAM, 0, fd);
+	if (res<0) {
+		perror("socketpair error");
+		return -1;
+	}
+
+	const unsigned kLimit = 64*1024;
+	unsigned numSent = 0, maxPending = 0;
+	bool failed = 0;
+	LimitedEndpoint sender(fd[1]);
+	sender.SetSendSockBufSize(4096);
+	sender.LimitSendQueue(kLimit);
+	sender.DeferSends();
+	uint32_t slabIDs[100];
+	for (unsigned i=0; i<100; i++)
+		slabIDs[i] = i;
+	try {
+		while (numSent<10000) {
+			sender.SendSlabIDs(slabIDs,100);
+			sender.FlushSomeSends();
+			numSent++;
+			if (sender.PendingSendBytes()>maxPending)
+				maxPending = sender.PendingSendBytes();
+		}
+	} catch (std::runtime_error err) {
+		failed = 1;
+	}
+	close(fd[1]);
+	close(fd[0]);
+
+	if (!failed || sender.numOverflows!=1 || sender.Connected() || maxPending>kLimit) {
+		fprintf(stderr,"### sent %u, failed %d, %u overflows, %u pending at most\n",
+			numSent, failed, sender.numOverflows, maxPending);
+		return -1;
+	}
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+class IDsEndpoint : public MCSB::SocketEndpoint {
+//-----------------------------------------------------------------------------
+  public:
+	IDsEndpoint(int fd): SocketEndpoint(fd) {}
+	std::vector<uint32_t> ids; // slabIDs with their kSlabMask
+  protected:
+	void HandleBlockIDs(const uint32_t blockIDs[], unsigned count)
+		{ ids.insert(ids.end(),blockIDs,blockIDs+count); }
+	void HandleSlabIDs(const uint32_t slabIDs[], unsigned count) {
+		for (unsigned i=0; i<count; i++)
+			ids.push_back(slabIDs[i] | MCSB::kSlabMask);
+	}
+};
+
+//-----------------------------------------------------------------------------
+int test_id_runs(void)
+// blockIDs and slabIDs encoded as kCtrlMsgID_IDRuns, sent and deferred
+//-----------------------------------------------------------------------------
+{
+	int fd[2];
+	int res = socketpair(PF_LOCAL, SOCK_STREAM, 0, fd);
+	if (res<0) {
+		perror("socketpair error");
+		return -1;
+	}
+
+	std::vector<uint32_t> sent;
+	IDsEndpoint rcvr(fd[0]);
+	try {
+		MCSB::SocketEndpoint sender(fd[1]);
+		sender.Poll(1.); // takes the kPeerFeature_IDRuns
+		srand(1);
+		uint32_t ids[2000];
+		for (unsigned n=0; n<400; n++) {
+			// runs of adjacent IDs, small and large jumps (both ways)
+			unsigned count = rand()%2000 + 1;
+			uint32_t id = rand() & ~MCSB::kSlabMask;
+			for (unsigned i=0; i<count; i++) {
+				ids[i] = id;
+				int r = rand()%16;
+				id += r<12 ? 1 : r<15 ? rand()%64-32 : rand();
+				id &= ~MCSB::kSlabMask;
+			}
+			sender.DeferSends(n&1); // alternately gathered across sends
+			if (n%3) {
+				sender.SendBlockIDs(ids,count);
+				sent.insert(sent.end(),ids,ids+count);
+			} else {
+				sender.SendSlabIDs(ids,count);
+				for (unsigned i=0; i<count; i++)
+					sent.push_back(ids[i] | MCSB::kSlabMask);
+			}
+			while (rcvr.Poll(0)>0);
+		}
+		sender.DeferSends(false);
+		while (rcvr.ids.size()<sent.size() && rcvr.Poll(1.)>0);
+	} catch (std::runtime_error err) {
+		fprintf(stderr,"#-- %s\n", err.what());
+		return -1;
+	}
+	close(fd[1]);
+	close(fd[0]);
+
+	if (rcvr.ids!=sent) {
+		fprintf(stderr,"### IDRuns received %u IDs, sent %u\n",
+			(unsigned)rcvr.ids.size(), (unsigned)sent.size());
+		return -1;
+	}
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+int test_raw_peer(bool sendCaps)
+// a peer that sends, and accepts, only the 2-word ValidatePeer of version 1
+// (and then sendCaps: a PeerCaps with kPeerFeature_IDRuns)
+//-----------------------------------------------------------------------------
+{
+	int fd[2];
+	int res = socketpair(PF_LOCAL, SOCK_STREAM, 0, fd);
+	if (res<0) {
+		perror("socketpair error");
+		return -1;
+	}
+
+	// with trailing words (as a later version might send), to be ignored
+	uint32_t validate[2+6] = { MCSB::kProtocolMagic, MCSB::kProtocolVersion };
+	MCSB::CtrlMsgHdr hdr(MCSB::kCtrlMsgID_ValidatePeer,sizeof(validate));
+	if (write(fd[1],&hdr,sizeof(hdr))!=sizeof(hdr)
+			|| write(fd[1],validate,sizeof(validate))!=sizeof(validate)) {
+		perror("write error");
+		return -1;
+	}
+	if (sendCaps) {
+		MCSB::PeerCapsMsg caps;
+		caps.maxPayload = MCSB::CtrlMsgHdr::kMaxPayloadSize;
+		caps.features = MCSB::kPeerFeature_IDRuns;
+		MCSB::CtrlMsgHdr capsHdr(MCSB::kCtrlMsgID_PeerCaps,sizeof(caps));
+		if (write(fd[1],&capsHdr,sizeof(capsHdr))!=sizeof(capsHdr)
+				|| write(fd[1],&caps,sizeof(caps))!=sizeof(caps)) {
+			perror("write error");
+			return -1;
+		}
+	}
+
+	std::vector<uint32_t> sent;
+	try {
+		MCSB::SocketEndpoint ep(fd[0]);
+		ep.Poll(1.);
+		if (ep.MaxSendPayload()!=MCSB::CtrlMsgHdr::kMaxPayloadSize) {
+			fprintf(stderr,"### MaxSendPayload %u without PeerCaps\n", ep.MaxSendPayload());
+			return -1;
+		}
+		uint32_t ids[100];
+		for (unsigned i=0; i<100; i++)
+			ids[i] = 1000+i;
+		ep.SendBlockIDs(ids,100);
+		sent.insert(sent.end(),ids,ids+100);
+		ep.SendSlabIDs(ids,100);
+		for (unsigned i=0; i<100; i++)
+			sent.push_back(ids[i] | MCSB::kSlabMask);
+	} catch (std::runtime_error err) {
+		fprintf(stderr,"#-- %s\n", err.what());
+		return -1;
+	}
+	close(fd[0]);
+
+	std::vector<uint32_t> words;
+	uint32_t buf[256];
+	ssize_t n;
+	while ((n = read(fd[1],buf,sizeof(buf)))>0)
+		words.insert(words.end(),buf,buf+n/sizeof(uint32_t));
+	close(fd[1]);
+
+	// as the old peer parses it: control messages, and raw IDs
+	std::vector<uint32_t> ids;
+	unsigned numCtrl = 0, numRuns = 0, errs = 0;
+	for (unsigned i=0; i<words.size(); i++) {
+		if (words[i]!=MCSB::CtrlMsgHdr::kToken) {
+			ids.push_back(words[i]);
+			continue;
+		}
+		const MCSB::CtrlMsgHdr* h = (const MCSB::CtrlMsgHdr*)&words[i];
+		if (!numCtrl++ && (h->msgID!=MCSB::kCtrlMsgID_ValidatePeer
+				|| h->length!=2*sizeof(uint32_t)))
+			errs++; // what version 1 requires
+		if (h->msgID==MCSB::kCtrlMsgID_IDRuns)
+			numRuns++;
+		i += (sizeof(*h)+h->length)/sizeof(uint32_t) - 1;
+	}
+	// without the feature, only raw IDs (which it cannot decode otherwise)
+	bool wrong = sendCaps ? (ids.size() || !numRuns) : (ids!=sent || numRuns);
+	if (wrong || errs) {
+		fprintf(stderr,"### %s peer received %u raw IDs of %u, %u IDRuns, %u errors\n",
+			sendCaps ? "IDRuns" : "old", (unsigned)ids.size(), (unsigned)sent.size(),
+			numRuns, errs);
+		return -1;
+	}
+	return 0;
+}
 
 //-----------------------------------------------------------------------------
 int test_child(int fd)
@@ -73,6 +589,16 @@ int test_child(int fd)
 		client.SendManagerEcho();
 		client.SendProdNiceLevel(1);
 
+		int fds[kNumFDs];
+		for (unsigned i=0; i<kNumFDs; i++) {
+			fds[i] = STDERR_FILENO;
+		}
+		client.SendShmFDs(0,fds,3);
+		client.DeferSends();
+		client.SendShmFDs(3,fds+3,kNumFDs-3);
+		client.SendManagerEcho();
+		client.DeferSends(false);
+
 		usleep(100000);
 
 		unsigned sendSize = 0;
@@ -114,6 +640,23 @@ int test_child(int fd)
 int main()
 //-----------------------------------------------------------------------------
 {
+	if (test_ring())
+		return -1;
+	if (test_partial_flush())
+		return -1;
+	if (test_partial_sendmsg())
+		return -1;
+	if (test_held_fds())
+		return -1;
+	if (test_send_queue_limit())
+		return -1;
+	if (test_id_runs())
+		return -1;
+	if (test_raw_peer(false))
+		return -1;
+	if (test_raw_peer(true))
+		return -1;
+
 	int fd[2];
 	int res = socketpair(PF_LOCAL, SOCK_STREAM, 0, fd);
 	if (res<0) {
@@ -130,7 +673,7 @@ int main()
 	
 	close(fd[1]);
 
-	MCSB::SocketEndpoint client( fd[0] );
+	FDEndpoint client( fd[0] );
 	int status;
 
 	// poll the socket until the peer disconnects (and exception)
@@ -153,6 +696,11 @@ int main()
 	if ( WIFEXITED(status) )
 		childResult = WEXITSTATUS(status);
 	
+	if (client.numFDs!=kNumFDs || client.errs) {
+		fprintf(stderr,"### received %u of %u fds, %u errors\n", client.numFDs, kNumFDs, client.errs);
+		return -1;
+	}
+
 	if (!childResult)
 		fprintf(stderr,"PASS\n");
 	
@@ -0,0 +1,153 @@
+//=============================================================================
+//	This file is part of MCSB, the Multi-Client Shared Buffer
+//	Copyright (C) 2014  Gregory E. Allen and
+//		Applied Research Laboratories: The University of Texas at Austin
+//
+//	MCSB is free software: you can redistribute it and/or modify it
+//	under the terms of the GNU Lesser General Public License as published
+//	by the Free Software Foundation, either version 2.1 of the License, or
+//	(at your option) any later version.
+//
+//	MCSB is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+//	Lesser General Public License <http://www.gnu.org/licenses/lgpl.html>
+//	for more details.
+//=============================================================================
+
+// always assert for tests, even in Release
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include "MCSB/SubscriptionIndex.h"
+#include <cstdio>
+#include <cassert>
+#include <cstdlib>
+#include <set>
+
+struct Subscriber {
+	int id;
+};
+
+//-----------------------------------------------------------------------------
+int test1(void)
+//-----------------------------------------------------------------------------
+{
+	MCSB::SubscriptionIndex<Subscriber> index;
+	const unsigned numSubs = 10;
+	Subscriber subs[numSubs];
+
+	assert(!index.Subscribers(0));
+	assert(0==index.NumMsgIDs());
+
+	// subscriber i subscribes to msgIDs 0..i
+	for (unsigned i=0; i<numSubs; i++) {
+		subs[i].id = i;
+		for (unsigned mid=0; mid<=i; mid++) {
+			assert(index.Subscribe(mid,&subs[i]));
+			assert(!index.Subscribe(mid,&subs[i])); // duplicate
+		}
+	}
+	assert(numSubs==index.NumMsgIDs());
+	for (unsigned mid=0; mid<numSubs; mid++) {
+		assert(numSubs-mid==index.NumSubscribers(mid));
+	}
+	assert(!index.Subscribers(numSubs));
+
+	// unsubscribe the even subscribers
+	for (unsigned i=0; i<numSubs; i+=2) {
+		for (unsigned mid=0; mid<=i; mid++) {
+			assert(index.Unsubscribe(mid,&subs[i]));
+			assert(!index.Unsubscribe(mid,&subs[i])); // duplicate
+		}
+	}
+	for (unsigned mid=0; mid<numSubs; mid++) {
+		const MCSB::SubscriptionIndex<Subscriber>::SubscriberList* list =
+			index.Subscribers(mid);
+		assert(list);
+		for (unsigned i=0; i<list->size(); i++) {
+			assert((*list)[i]->id & 1);
+			assert((*list)[i]->id >= (int)mid);
+		}
+	}
+
+	// unsubscribe the rest, msgIDs should be erased
+	for (unsigned i=1; i<numSubs; i+=2) {
+		for (unsigned mid=0; mid<=i; mid++) {
+			assert(index.Unsubscribe(mid,&subs[i]));
+		}
+	}
+	assert(0==index.NumMsgIDs());
+	assert(!index.Unsubscribe(0,&subs[0]));
+
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+int test2(void)
+//-----------------------------------------------------------------------------
+{
+	// random range subscriptions checked against a brute force model
+	typedef MCSB::SubscriptionIndex<Subscriber> Index;
+	Index index;
+	const unsigned numSubs = 8, numMsgIDs = 64;
+	Subscriber subs[numSubs];
+	std::set<Subscriber*> model[numMsgIDs];
+	srandom(1);
+
+	for (unsigned i=0; i<numSubs; i++) subs[i].id = i;
+	assert(!index.RangeSubscribers(0));
+	assert(!index.SubscribeRange(2,1,&subs[0]));
+
+	for (unsigned iter=0; iter<2000; iter++) {
+		Subscriber* sub = &subs[random()%numSubs];
+		uint32_t first = random()%numMsgIDs;
+		uint32_t last = first + random()%(numMsgIDs-first);
+		bool reg = random()%2;
+		bool changed = false;
+		for (uint32_t mid=first; mid<=last; mid++) {
+			if (reg) changed |= model[mid].insert(sub).second;
+			else changed |= model[mid].erase(sub);
+		}
+		if (reg) assert(changed==index.SubscribeRange(first,last,sub));
+		else assert(changed==index.UnsubscribeRange(first,last,sub));
+
+		unsigned numIntervals = 0;
+		for (uint32_t mid=0; mid<=numMsgIDs; mid++) {
+			const Index::SubscriberList* list = index.RangeSubscribers(mid);
+			if (mid==numMsgIDs || model[mid].empty()) {
+				assert(!list);
+				continue;
+			}
+			assert(list);
+			assert(std::set<Subscriber*>(list->begin(),list->end())==model[mid]);
+			if (!mid || model[mid]!=model[mid-1]) numIntervals++;
+		}
+		// equal neighbors are coalesced, allow one terminator per interval
+		assert(index.NumRangeIntervals()<=2*numIntervals);
+	}
+
+	// the full msgID space
+	Index all;
+	assert(all.SubscribeRange(0,0xFFFFFFFF,&subs[0]));
+	assert(all.RangeSubscribers(0xFFFFFFFF));
+	assert(all.UnsubscribeRange(0x100,0xFFFFFFFF,&subs[0]));
+	assert(all.RangeSubscribers(0xFF));
+	assert(!all.RangeSubscribers(0x100));
+	assert(all.UnsubscribeRange(0,0xFF,&subs[0]));
+	assert(0==all.NumRangeIntervals());
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* const argv[])
+//-----------------------------------------------------------------------------
+{
+	int result = test1();
+	if (result) return result;
+	result = test2();
+	if (result) return result;
+	fprintf(stderr,"=== PASS ===\n");
+	return result;
+}
@@ -0,0 +1,100 @@
+//=============================================================================
+//	This file is part of MCSB, the Multi-Client Shared Buffer
+//	Copyright (C) 2014  Gregory E. Allen and
+//		Applied Research Laboratories: The University of Texas at Austin
+//
+//	MCSB is free software: you can redistribute it and/or modify it
+//	under the terms of the GNU Lesser General Public License as published
+//	by the Free Software Foundation, either version 2.1 of the License, or
+//	(at your option) any later version.
+//
+//	MCSB is distributed in the hope that it will be useful,
+//	but WITHOUT ANY WARRANTY; without even the implied warranty of
+//	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+//	Lesser General Public License <http://www.gnu.org/licenses/lgpl.html>
+//	for more details.
+//=============================================================================
+// always assert for tests, even in Release
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include "MCSB/WantedQueueBound.h"
+#include <cstdio>
+#include <cassert>
+
+typedef MCSB::WantedQueueBound WQB;
+
+//-----------------------------------------------------------------------------
+int test1(void)
+//-----------------------------------------------------------------------------
+{
+	WQB bound;
+	// without a budget, a fixed count and no byte bound
+	assert(WQB::kDefaultSegs==bound.MaxSegs());
+	bound.Update(1000000,true,1.);
+	bound.Update(2000000,true,2.);
+	assert(WQB::kDefaultSegs==bound.MaxSegs());
+	assert(!bound.Exceeded(WQB::kDefaultSegs,~0ULL));
+	assert(bound.Exceeded(WQB::kDefaultSegs+1,0));
+
+	// a byte budget alone
+	bound.SetBudget(0,1000);
+	assert(!bound.Exceeded(1,1000));
+	assert(bound.Exceeded(1,1001));
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+int test2(void)
+//-----------------------------------------------------------------------------
+{
+	WQB bound;
+	bound.SetBudget(.5,0);
+	assert(WQB::kDefaultSegs==bound.MaxSegs());
+
+	// a backlogged client draining 100k segs/sec converges to 50k
+	double t = 0;
+	uint64_t sent = 0;
+	for (unsigned i=0; i<100; i++, t+=.1, sent+=10000)
+		bound.Update(sent,true,t);
+	assert(bound.DrainRate()>99000 && bound.DrainRate()<101000);
+	assert(bound.MaxSegs()>49000 && bound.MaxSegs()<51000);
+
+	// then slows to 10 segs/sec, and is held to the minimum
+	for (unsigned i=0; i<100; i++, t+=.1, sent+=1)
+		bound.Update(sent,true,t);
+	assert(WQB::kMinSegs==bound.MaxSegs());
+
+	// a client that keeps up only raises the estimate
+	for (unsigned i=0; i<10; i++, t+=.1, sent+=0)
+		bound.Update(sent,false,t);
+	assert(WQB::kMinSegs==bound.MaxSegs());
+	for (unsigned i=0; i<10; i++, t+=.1, sent+=200)
+		bound.Update(sent,false,t);
+	assert(bound.MaxSegs()>=990);
+
+	// too-frequent updates are ignored
+	unsigned maxSegs = bound.MaxSegs();
+	bound.Update(sent+1000000,true,t-.099); // .001 after the last
+	assert(maxSegs==bound.MaxSegs());
+
+	// never beyond the maximum
+	bound.SetBudget(1000,0);
+	for (unsigned i=0; i<10; i++, t+=1, sent+=10000000)
+		bound.Update(sent,true,t);
+	assert(WQB::kMaxSegs==bound.MaxSegs());
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char* const argv[])
+//-----------------------------------------------------------------------------
+{
+	int errs = 0;
+	errs += test1();
+	errs += test2();
+	if (!errs)
+		fprintf(stderr,"=== PASS ===\n");
+	return errs;
+}